@@ -0,0 +1,83 @@
+package com.autonion.automationcompanion.features.flow_automation.engine.executors
+
+import android.graphics.Bitmap
+import android.graphics.Canvas
+import android.graphics.Color
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import androidx.test.platform.app.InstrumentationRegistry
+import com.autonion.automationcompanion.core.vision.MatchResultBuffer
+import com.autonion.automationcompanion.core.vision.VisionMatcher
+import org.junit.After
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertNotNull
+import org.junit.Assert.assertNotSame
+import org.junit.Assert.assertSame
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Test
+import org.junit.runner.RunWith
+import java.io.File
+import java.util.Random
+
+/**
+ * The executor's matcher cache: nodes sharing one template image under
+ * different IDs must each get a matcher that reports their own ID.
+ */
+@RunWith(AndroidJUnit4::class)
+class VisualTriggerNodeExecutorTest {
+
+    private lateinit var template: Bitmap
+    private lateinit var path: String
+    private val executor = VisualTriggerNodeExecutor()
+
+    @Before
+    fun writeTemplate() {
+        // Noise, so nothing else on the screen resembles it.
+        val random = Random(5)
+        template = Bitmap.createBitmap(64, 48, Bitmap.Config.ARGB_8888)
+        for (y in 0 until template.height) {
+            for (x in 0 until template.width) {
+                template.setPixel(x, y, Color.rgb(random.nextInt(256), random.nextInt(256), random.nextInt(256)))
+            }
+        }
+        val context = InstrumentationRegistry.getInstrumentation().targetContext
+        val file = File(context.cacheDir, "visual_trigger_test.png")
+        file.outputStream().use { template.compress(Bitmap.CompressFormat.PNG, 100, it) }
+        path = file.absolutePath
+    }
+
+    @After
+    fun cleanUp() {
+        executor.close()
+        File(path).delete()
+    }
+
+    @Test
+    fun samePathAndIdSharesOneMatcher() {
+        val first = executor.matcherFor(path, 1)
+        assertNotNull(first)
+        assertSame(first, executor.matcherFor(path, 1))
+    }
+
+    @Test
+    fun samePathWithAnotherIdGetsItsOwnMatcher() {
+        val one = executor.matcherFor(path, 1)!!
+        val two = executor.matcherFor(path, 2)!!
+        assertNotSame(one, two)
+
+        val screen = Bitmap.createBitmap(320, 240, Bitmap.Config.ARGB_8888)
+        screen.eraseColor(Color.WHITE)
+        Canvas(screen).drawBitmap(template, 100f, 80f, null)
+        assertFoundAs(one, screen, 1)
+        assertFoundAs(two, screen, 2)
+    }
+
+    private fun assertFoundAs(matcher: VisionMatcher, screen: Bitmap, id: Int) {
+        val results = matcher.match(screen, MatchResultBuffer())
+        val i = results.indexOfId(id)
+        assertTrue("no result for ID $id", i >= 0)
+        assertTrue("ID $id not matched", results.matched(i))
+        assertEquals(100, results.x(i))
+        assertEquals(80, results.y(i))
+    }
+}
@@ -0,0 +1,229 @@
+#ifndef VISION_BENCH_COMMON_H
+#define VISION_BENCH_COMMON_H
+
+// Shared helpers for the desktop benchmarks (and the tools that borrow
+// their timing and argument parsing): timing, percentile reporting, tiny
+// argument parsing and synthetic phone screens and templates.
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+inline double elapsed_ms(Clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - since)
+      .count();
+}
+
+// Resident set size of the process in bytes, after handing freed heap pages
+// back to the system where the C library allows it; 0 without /proc.
+inline size_t resident_bytes() {
+#if defined(__GLIBC__)
+  malloc_trim(0);
+#endif
+#if defined(__linux__)
+  FILE *f = std::fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  unsigned long total = 0, resident = 0;
+  const int read = std::fscanf(f, "%lu %lu", &total, &resident);
+  std::fclose(f);
+  return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+  return 0;
+#endif
+}
+
+// Nearest-rank percentile; p in [0, 100].
+inline double percentile(std::vector<double> samples, double p) {
+  if (samples.empty())
+    return 0.0;
+  std::sort(samples.begin(), samples.end());
+  size_t rank = (size_t)std::ceil(p / 100.0 * (double)samples.size());
+  rank = std::min(std::max<size_t>(rank, 1), samples.size());
+  return samples[rank - 1];
+}
+
+inline double mean(const std::vector<double> &samples) {
+  if (samples.empty())
+    return 0.0;
+  double sum = 0.0;
+  for (double s : samples)
+    sum += s;
+  return sum / (double)samples.size();
+}
+
+inline void print_header(const char *first_column) {
+  std::printf("  %-22s %10s %10s %10s\n", first_column, "p50(ms)", "p99(ms)",
+              "mean(ms)");
+}
+
+inline void print_row(const char *name, const std::vector<double> &samples) {
+  std::printf("  %-22s %10.3f %10.3f %10.3f\n", name, percentile(samples, 50),
+              percentile(samples, 99), mean(samples));
+}
+
+// ── Arguments ─────────────────────────────────────────────────────────
+
+// Returns the value following `flag`, or nullptr when absent.
+inline const char *arg_value(int argc, char **argv, const char *flag) {
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (std::strcmp(argv[i], flag) == 0)
+      return argv[i + 1];
+  }
+  return nullptr;
+}
+
+inline bool has_flag(int argc, char **argv, const char *flag) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], flag) == 0)
+      return true;
+  }
+  return false;
+}
+
+inline int arg_int(int argc, char **argv, const char *flag, int fallback) {
+  const char *v = arg_value(argc, argv, flag);
+  return v ? std::atoi(v) : fallback;
+}
+
+// Parses "10,50,200" into {10, 50, 200}.
+inline std::vector<int> arg_int_list(int argc, char **argv, const char *flag,
+                                     std::vector<int> fallback) {
+  const char *v = arg_value(argc, argv, flag);
+  if (!v)
+    return fallback;
+  std::vector<int> out;
+  std::string s(v);
+  size_t start = 0;
+  while (start < s.size()) {
+    size_t comma = s.find(',', start);
+    if (comma == std::string::npos)
+      comma = s.size();
+    int n = std::atoi(s.substr(start, comma - start).c_str());
+    if (n > 0)
+      out.push_back(n);
+    start = comma + 1;
+  }
+  return out.empty() ? fallback : out;
+}
+
+// ── Synthetic screens ─────────────────────────────────────────────────
+
+// Height of one list row of make_canvas. Every row's icon has a white disc
+// of radius 24 centred at (78, top + 70).
+constexpr int kCanvasRowHeight = 140;
+
+// A tall RGBA canvas that looks roughly like a scrolling list UI: rows with
+// an icon, a few text-like runs and a button, plus mild sensor-ish noise so
+// correlation maps are not degenerate. Frames are windows into it.
+inline cv::Mat make_canvas(int width, int height, uint64_t seed) {
+  cv::RNG rng(seed);
+  cv::Mat canvas(height, width, CV_8UC4);
+  for (int y = 0; y < height; ++y) {
+    int shade = 235 + (y * 12) / std::max(height, 1);
+    canvas.row(y).setTo(cv::Scalar(shade, shade, shade - 4, 255));
+  }
+
+  const int row_h = kCanvasRowHeight;
+  for (int top = 0; top + row_h <= height; top += row_h) {
+    cv::Scalar icon(rng.uniform(0, 255), rng.uniform(0, 255),
+                    rng.uniform(0, 255), 255);
+    cv::rectangle(canvas, cv::Rect(32, top + 24, 92, 92), icon, cv::FILLED);
+    cv::circle(canvas, cv::Point(78, top + 70), 24,
+               cv::Scalar(255, 255, 255, 255), cv::FILLED);
+
+    int x = 150;
+    int runs = rng.uniform(3, 7);
+    for (int r = 0; r < runs && x < width - 300; ++r) {
+      int w = rng.uniform(40, 160);
+      int line = rng.uniform(0, 2);
+      cv::rectangle(canvas, cv::Rect(x, top + 36 + line * 40, w, 18),
+                    cv::Scalar(40, 40, 48, 255), cv::FILLED);
+      x += w + rng.uniform(10, 24);
+    }
+
+    cv::Rect button(width - 250, top + 40, 200, 64);
+    cv::rectangle(canvas, button,
+                  cv::Scalar(rng.uniform(0, 80), rng.uniform(90, 200), 240,
+                             255),
+                  cv::FILLED);
+    cv::rectangle(canvas, button, cv::Scalar(20, 20, 20, 255), 2);
+    cv::line(canvas, cv::Point(0, top + row_h - 1),
+             cv::Point(width, top + row_h - 1), cv::Scalar(200, 200, 200, 255));
+  }
+
+  cv::Mat noise(canvas.size(), CV_8UC4);
+  rng.fill(noise, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(6));
+  canvas += noise;
+  return canvas;
+}
+
+// Frame `index` of a slow scroll through `canvas`, `height` rows tall.
+inline cv::Mat scroll_frame(const cv::Mat &canvas, int height, int index,
+                            int step_px) {
+  int travel = std::max(canvas.rows - height, 0);
+  int offset = travel > 0 ? (index * step_px) % (travel + 1) : 0;
+  return canvas.rowRange(offset, offset + height).clone();
+}
+
+// ── Templates ─────────────────────────────────────────────────────────
+
+struct Template {
+  int id;
+  cv::Mat rgba;
+  cv::Mat gray;
+  cv::Rect prior; // where it sits on frame 0; random for miss templates
+};
+
+// `count` templates with IDs 1..count. Roughly `miss_percent` of them are
+// noise patches that never appear on screen; the rest are cut from the band
+// of `canvas` that stays visible in every scroll position.
+inline std::vector<Template> make_templates(const cv::Mat &canvas,
+                                            int screen_h, int count,
+                                            int miss_percent, uint64_t seed) {
+  cv::RNG rng(seed);
+  std::vector<Template> out;
+  int band_top = std::max(canvas.rows - screen_h, 0);
+  int band_h = std::max(screen_h - band_top, 1);
+  for (int i = 0; i < count; ++i) {
+    int w = rng.uniform(48, 220);
+    int h = rng.uniform(32, 140);
+    Template t;
+    t.id = i + 1;
+    int x = rng.uniform(0, canvas.cols - w);
+    int y = band_top + rng.uniform(0, std::max(band_h - h, 1));
+    t.prior = cv::Rect(x, y, w, h);
+    if (rng.uniform(0, 100) < miss_percent) {
+      t.rgba.create(h, w, CV_8UC4);
+      rng.fill(t.rgba, cv::RNG::UNIFORM, cv::Scalar::all(0),
+               cv::Scalar::all(256));
+    } else {
+      t.rgba = canvas(t.prior).clone();
+    }
+    cv::cvtColor(t.rgba, t.gray, cv::COLOR_RGBA2GRAY);
+    out.push_back(std::move(t));
+  }
+  return out;
+}
+
+} // namespace bench
+
+#endif // VISION_BENCH_COMMON_H
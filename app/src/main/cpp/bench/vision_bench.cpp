@@ -0,0 +1,440 @@
+// Desktop latency benchmark for the template matcher.
+//
+// Generates synthetic 1080x2400 phone screens (a slowly scrolling list UI),
+// registers N templates and reports per-frame p50/p99 for every stage of the
+// legacy matching pipeline plus the end-to-end vision_match_all call, whose
+// scores are checked against plain cv::matchTemplate.
+//
+//   vision_bench [--frames 20] [--templates 10,50,200] [--width 1080]
+//                [--height 2400] [--miss-percent 25] [--seed 1]
+//                [--pyramid-factor 4] [--prior-margin 160]
+//                [--pack vision_bench.vpk]
+//
+// "Miss" templates are noise patches that never appear on screen, so they
+// walk every scale; the rest are cut from the screen and usually exit early.
+// Each frame is also matched in pyramid mode and compared with the exhaustive
+// result; a differing decision, a hit placed elsewhere or a score deviating
+// beyond kPyramidScoreTolerance fails the run (exit status 1). A third pass
+// registers every template with the rectangle it was cut from (as seen on the
+// first frame) as its prior, so scrolling eventually forces the fallback.
+// Every frame is then matched a second time unchanged ("idle"), which the
+// dirty-tile pass should answer entirely from the previous results, and
+// through two targeted vision_match calls: the last template alone (checked
+// against its exhaustive result) and every ID in order stopping at the
+// first match. Before the frames, registration is timed both from RGBA
+// templates and from a compiled pack written to --pack (deleted
+// afterwards), and the two sets are checked to match identically. Last, a
+// template cut from an element every list row repeats is matched plainly
+// and with instances, reporting how many copies one scan finds.
+// Scratch arena growths after the first frame are counted too and fail the
+// run: arenas keep what recent frames needed, so a steady state has none.
+// Finally a matcher of its own matches full-resolution exhaustive frames on
+// a 4-thread pool and is destroyed, checking that its scratch bytes (which
+// fail the run if kept) and resident memory are given back while the
+// calling thread lives on.
+
+#include "bench_common.h"
+#include "vision_engine.h"
+#include "vision_scratch.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct StageTimes {
+  std::vector<double> convert;
+  std::vector<double> resize;
+  std::vector<double> match;
+  std::vector<double> peak;
+  std::vector<double> staged_total;
+  std::vector<double> end_to_end;
+  std::vector<double> idle;
+  std::vector<double> pyramid;
+  std::vector<double> prior;
+  std::vector<double> targeted; // one template by ID
+  std::vector<double> first;    // all IDs, stop at the first match
+};
+
+struct PyramidAgreement {
+  int compared = 0;
+  int decision_mismatches = 0; // matched flag differs
+  int location_mismatches = 0; // matched in both, placed elsewhere
+  int beyond_tolerance = 0;    // matched in both, |delta score| too large
+  float max_delta = 0.0f;
+
+  int failures() const {
+    return decision_mismatches + location_mismatches + beyond_tolerance;
+  }
+};
+
+void compare_results(const std::vector<MatchResult> &exhaustive,
+                     const std::vector<MatchResult> &pyramid,
+                     PyramidAgreement &out) {
+  for (size_t i = 0; i < exhaustive.size() && i < pyramid.size(); ++i) {
+    const MatchResult &e = exhaustive[i];
+    const MatchResult &p = pyramid[i];
+    out.compared++;
+    if (e.matched != p.matched) {
+      out.decision_mismatches++;
+      continue;
+    }
+    if (!e.matched)
+      continue;
+    if (e.rect.size() != p.rect.size() ||
+        std::abs(e.rect.x - p.rect.x) > kPyramidLocationTolerance ||
+        std::abs(e.rect.y - p.rect.y) > kPyramidLocationTolerance)
+      out.location_mismatches++;
+    float delta = std::abs(e.score - p.score);
+    out.max_delta = std::max(out.max_delta, delta);
+    if (delta > kPyramidScoreTolerance)
+      out.beyond_tolerance++;
+  }
+}
+
+// The per-frame pipeline before templates were prepared at registration:
+// resize every scale, then cv::matchTemplate (which recomputes template
+// statistics and frame integrals on every call). Kept as the baseline the
+// engine is timed against, and as the reference for its scores. Times are
+// summed over all templates of a frame; `best` gets one score per template.
+void time_stages(const cv::Mat &screen,
+                 const std::vector<bench::Template> &templates, StageTimes &out,
+                 std::vector<float> &best_scores) {
+  double convert = 0, resize = 0, match = 0, peak = 0;
+
+  auto t0 = bench::Clock::now();
+  cv::Mat gray;
+  cv::cvtColor(screen, gray, cv::COLOR_RGBA2GRAY);
+  convert += bench::elapsed_ms(t0);
+
+  best_scores.clear();
+  for (const bench::Template &t : templates) {
+    float best = -1.0f;
+    for (int s = 0; s < kNumMatchScales; ++s) {
+      float scale = kMatchScales[s];
+      cv::Mat scaled;
+      if (scale == 1.0f) {
+        scaled = t.gray;
+      } else {
+        int w = (int)(t.gray.cols * scale);
+        int h = (int)(t.gray.rows * scale);
+        if (w <= 0 || h <= 0 || w > gray.cols || h > gray.rows)
+          continue;
+        auto r0 = bench::Clock::now();
+        cv::resize(t.gray, scaled, cv::Size(w, h));
+        resize += bench::elapsed_ms(r0);
+      }
+
+      auto m0 = bench::Clock::now();
+      cv::Mat result;
+      cv::matchTemplate(gray, scaled, result, cv::TM_CCOEFF_NORMED);
+      match += bench::elapsed_ms(m0);
+
+      auto p0 = bench::Clock::now();
+      double max_val;
+      cv::minMaxLoc(result, nullptr, &max_val);
+      peak += bench::elapsed_ms(p0);
+
+      best = std::max(best, (float)max_val);
+      if (s == 0 && best > kEarlyExitScore)
+        break;
+    }
+    best_scores.push_back(best);
+  }
+
+  out.convert.push_back(convert);
+  out.resize.push_back(resize);
+  out.match.push_back(match);
+  out.peak.push_back(peak);
+  out.staged_total.push_back(convert + resize + match + peak);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int frames = bench::arg_int(argc, argv, "--frames", 20);
+  const int width = bench::arg_int(argc, argv, "--width", 1080);
+  const int height = bench::arg_int(argc, argv, "--height", 2400);
+  const int miss_percent = bench::arg_int(argc, argv, "--miss-percent", 25);
+  const int seed = bench::arg_int(argc, argv, "--seed", 1);
+  const int pyramid_factor = bench::arg_int(argc, argv, "--pyramid-factor", 4);
+  const int prior_margin = bench::arg_int(argc, argv, "--prior-margin", 160);
+  const std::vector<int> counts =
+      bench::arg_int_list(argc, argv, "--templates", {10, 50, 200});
+  const char *pack_arg = bench::arg_value(argc, argv, "--pack");
+  const std::string pack_path = pack_arg ? pack_arg : "vision_bench.vpk";
+
+  cv::setNumThreads(1); // measure the matcher, not OpenCV's internal pool
+  vision_init();
+
+  const int scroll_step = 24;
+  cv::Mat canvas = bench::make_canvas(width, height + 480, (uint64_t)seed);
+
+  std::printf("vision_bench: screen=%dx%d frames=%d miss=%d%% opencv=%s\n",
+              width, height, frames, miss_percent, CV_VERSION);
+
+  int failures = 0; // checks that fail the run, not just the timings
+
+  for (int count : counts) {
+    std::vector<bench::Template> templates = bench::make_templates(
+        canvas, height, count, miss_percent, (uint64_t)seed * 7919 + count);
+
+    // Registration from a pack must give the same results as from pixels.
+    cv::Mat first = bench::scroll_frame(canvas, height, 0, scroll_step);
+    std::vector<PackSource> sources;
+    for (const bench::Template &t : templates) {
+      PackSource src;
+      src.id = t.id;
+      src.templ = t.rgba;
+      sources.push_back(src);
+    }
+    auto c0 = bench::Clock::now();
+    bool compiled = vision_compile_pack(pack_path, sources, (uint64_t)count);
+    double compile_ms = bench::elapsed_ms(c0);
+    vision_clear_templates();
+    auto k0 = bench::Clock::now();
+    int packed = vision_add_pack(pack_path, (uint64_t)count);
+    double pack_ms = bench::elapsed_ms(k0);
+    std::vector<MatchResult> from_pack = vision_match_all(first);
+    std::remove(pack_path.c_str());
+
+    vision_clear_templates();
+    auto r0 = bench::Clock::now();
+    for (const bench::Template &t : templates)
+      vision_add_template(t.id, t.rgba);
+    double register_ms = bench::elapsed_ms(r0);
+    std::vector<MatchResult> from_pixels = vision_match_all(first);
+    int pack_mismatches = from_pack.size() == from_pixels.size() ? 0 : 1;
+    for (size_t i = 0; i < from_pack.size() && i < from_pixels.size(); ++i) {
+      if (from_pack[i].id != from_pixels[i].id ||
+          from_pack[i].matched != from_pixels[i].matched ||
+          from_pack[i].rect != from_pixels[i].rect ||
+          from_pack[i].score != from_pixels[i].score)
+        pack_mismatches++;
+    }
+
+    MatchConfig exhaustive;
+    MatchConfig pyramid;
+    pyramid.mode = SearchMode::Pyramid;
+    pyramid.pyramid_factor = pyramid_factor;
+
+    StageTimes times;
+    PyramidAgreement agreement;
+    int matched_last = 0;
+    float reference_delta = 0.0f;
+    int prior_hits = 0;
+    int prior_results = 0;
+    int idle_skipped = 0;
+    int idle_templates = 0;
+    int idle_mismatches = 0;
+    int targeted_mismatches = 0;
+    size_t first_evaluated = 0;
+    VisionMatcher &matcher = vision_default_matcher();
+    uint64_t growths_before = matcher.scratch_growths();
+    for (int f = 0; f < frames; ++f) {
+      if (f == 1)
+        growths_before = matcher.scratch_growths();
+      cv::Mat screen = bench::scroll_frame(canvas, height, f, scroll_step);
+
+      std::vector<float> reference;
+      time_stages(screen, templates, times, reference);
+
+      vision_set_config(exhaustive);
+      auto e0 = bench::Clock::now();
+      std::vector<MatchResult> results = vision_match_all(screen);
+      times.end_to_end.push_back(bench::elapsed_ms(e0));
+
+      auto i0 = bench::Clock::now();
+      std::vector<MatchResult> again = vision_match_all(screen);
+      times.idle.push_back(bench::elapsed_ms(i0));
+      FrameDiffStats diff = vision_last_frame_diff();
+      idle_skipped += diff.templates_skipped;
+      idle_templates += diff.templates;
+      for (size_t i = 0; i < again.size() && i < results.size(); ++i) {
+        if (again[i].matched != results[i].matched ||
+            again[i].rect != results[i].rect ||
+            again[i].score != results[i].score)
+          idle_mismatches++;
+      }
+
+      vision_set_config(pyramid);
+      auto p0 = bench::Clock::now();
+      std::vector<MatchResult> coarse = vision_match_all(screen);
+      times.pyramid.push_back(bench::elapsed_ms(p0));
+      compare_results(results, coarse, agreement);
+      for (size_t i = 0; i < results.size() && i < reference.size(); ++i)
+        reference_delta = std::max(reference_delta,
+                                   std::abs(results[i].score - reference[i]));
+
+      // Targeted matches: the last template alone, then every ID in order
+      // up to the first match. Setting the config again before each keeps
+      // earlier results from being reused.
+      vision_set_config(exhaustive);
+      MatchRequest one;
+      one.ids.push_back(templates.back().id);
+      auto t0 = bench::Clock::now();
+      std::vector<MatchResult> single = vision_match(screen, one);
+      times.targeted.push_back(bench::elapsed_ms(t0));
+      if (single.size() != 1 || single[0].matched != results.back().matched ||
+          single[0].rect != results.back().rect ||
+          single[0].score != results.back().score)
+        targeted_mismatches++;
+
+      vision_set_config(exhaustive);
+      MatchRequest until_hit;
+      until_hit.stop = MatchStop::First;
+      for (const bench::Template &t : templates)
+        until_hit.ids.push_back(t.id);
+      auto h0 = bench::Clock::now();
+      first_evaluated += vision_match(screen, until_hit).size();
+      times.first.push_back(bench::elapsed_ms(h0));
+
+      vision_clear_templates();
+      for (const bench::Template &t : templates)
+        vision_add_template(t.id, t.rgba, t.prior, prior_margin);
+      auto w0 = bench::Clock::now();
+      std::vector<MatchResult> windowed = vision_match_all(screen);
+      times.prior.push_back(bench::elapsed_ms(w0));
+      for (const MatchResult &r : windowed) {
+        prior_results++;
+        prior_hits += r.from_prior ? 1 : 0;
+      }
+      vision_clear_templates();
+      for (const bench::Template &t : templates)
+        vision_add_template(t.id, t.rgba);
+
+      matched_last = 0;
+      for (const MatchResult &r : results)
+        matched_last += r.matched ? 1 : 0;
+    }
+
+    std::printf("\ntemplates=%d (matched %d on last frame)\n", count,
+                matched_last);
+    bench::print_header("legacy stage (frame)");
+    bench::print_row("convert", times.convert);
+    bench::print_row("resize", times.resize);
+    bench::print_row("matchTemplate", times.match);
+    bench::print_row("minMaxLoc", times.peak);
+    bench::print_row("legacy total", times.staged_total);
+    bench::print_row("vision_match_all", times.end_to_end);
+    bench::print_row("vision_match_all idle", times.idle);
+    bench::print_row("vision_match_all pyr", times.pyramid);
+    bench::print_row("vision_match_all prior", times.prior);
+    bench::print_row("vision_match 1 id", times.targeted);
+    bench::print_row("vision_match first", times.first);
+    std::printf("  pyramid 1/%d vs exhaustive: %d results, %d decision "
+                "mismatches, %d placed elsewhere, %d beyond +/-%.2f, "
+                "max |delta|=%.4f%s\n",
+                pyramid_factor, agreement.compared,
+                agreement.decision_mismatches, agreement.location_mismatches,
+                agreement.beyond_tolerance, kPyramidScoreTolerance,
+                agreement.max_delta,
+                agreement.failures() == 0 ? "" : " (FAILED)");
+    failures += agreement.failures() == 0 ? 0 : 1;
+    std::printf("  exhaustive vs cv::matchTemplate: max |delta|=%.6f\n",
+                reference_delta);
+    std::printf("  prior margin %dpx: %d of %d results answered from the "
+                "prior window\n",
+                prior_margin, prior_hits, prior_results);
+    std::printf("  idle frame: %d of %d templates reused, %d results differ\n",
+                idle_skipped, idle_templates, idle_mismatches);
+    std::printf("  targeted: 1-id result differs on %d frames; first-match "
+                "stopped after %.1f of %d templates\n",
+                targeted_mismatches,
+                (double)first_evaluated / std::max(frames, 1), count);
+    std::printf("  registration: add_template %.2f ms, compile pack %.2f ms%s, "
+                "add_pack %.3f ms (%d templates), %d results differ\n",
+                register_ms, compile_ms, compiled ? "" : " (FAILED)", pack_ms,
+                packed, pack_mismatches);
+    const uint64_t growths = matcher.scratch_growths() - growths_before;
+    std::printf("  scratch: %llu buffer growths after the first frame%s, "
+                "%.1f MB held\n",
+                (unsigned long long)growths, growths == 0 ? "" : " (FAILED)",
+                (double)matcher.scratch_bytes() / (1024.0 * 1024.0));
+    failures += growths == 0 ? 0 : 1;
+  }
+
+  // A repeated element: the disc on every row's icon, found by one
+  // multi-instance scan instead of the plain match a batch action would
+  // otherwise repeat after each tap.
+  {
+    const cv::Mat screen = bench::scroll_frame(canvas, height, 0, scroll_step);
+    const cv::Rect disc(46, 38, 64, 64);
+    int rows = 0;
+    for (int top = 0; top + disc.br().y <= height;
+         top += bench::kCanvasRowHeight)
+      rows++;
+
+    MatchConfig fresh;
+    fresh.diff_tile = 0; // every call does the full work
+    vision_set_config(fresh);
+    vision_clear_templates();
+    vision_add_template(1, canvas(disc).clone());
+    MatchRequest every;
+    every.instances = rows + 8;
+
+    std::vector<double> plain, multi;
+    size_t found = 0;
+    for (int f = 0; f < frames; ++f) {
+      auto t0 = bench::Clock::now();
+      vision_match_all(screen);
+      plain.push_back(bench::elapsed_ms(t0));
+      t0 = bench::Clock::now();
+      found = vision_match(screen, every).size();
+      multi.push_back(bench::elapsed_ms(t0));
+    }
+    std::printf("\nrepeated element (%d rows on screen)\n", rows);
+    bench::print_header("call");
+    bench::print_row("vision_match_all", plain);
+    bench::print_row("vision_match instances", multi);
+    std::printf("  one scan found %zu of %d instances\n", found, rows);
+  }
+
+  // Scratch lifetime: arenas belong to the matcher and its pool workers, so
+  // destroying the matcher returns them even though this thread, which
+  // borrowed one for every call, keeps running.
+  {
+    const cv::Mat screen = bench::scroll_frame(canvas, height, 0, scroll_step);
+    const std::vector<bench::Template> templates =
+        bench::make_templates(canvas, height, 10, miss_percent, seed);
+    const uint64_t scratch_before = vision_scratch_bytes();
+    const size_t rss_before = bench::resident_bytes();
+    uint64_t scratch_held = 0;
+    size_t rss_held = 0;
+    {
+      VisionMatcher matcher;
+      matcher.set_threads(4, {});
+      MatchConfig exhaustive;
+      exhaustive.diff_tile = 0;
+      matcher.set_config(exhaustive);
+      for (const bench::Template &t : templates)
+        matcher.add_template(t.id, t.rgba);
+      for (int f = 0; f < 3; ++f)
+        matcher.match(screen);
+      scratch_held = vision_scratch_bytes() - scratch_before;
+      rss_held = bench::resident_bytes();
+    }
+    const uint64_t scratch_after = vision_scratch_bytes() - scratch_before;
+    const size_t rss_after = bench::resident_bytes();
+    const double mb = 1024.0 * 1024.0;
+    std::printf("\nscratch lifetime (exhaustive, 4 threads)\n");
+    std::printf("  scratch held %.1f MB while matching, %.1f MB after the "
+                "matcher is destroyed%s\n",
+                scratch_held / mb, scratch_after / mb,
+                scratch_after == 0 ? "" : " (LEAKED)");
+    failures += scratch_after == 0 ? 0 : 1;
+    std::printf("  resident %.1f MB before, %.1f MB while matching, %.1f MB "
+                "after%s\n",
+                rss_before / mb, rss_held / mb, rss_after / mb,
+                rss_after <= rss_before + scratch_held / 4 ? ""
+                                                           : " (NOT RETURNED)");
+  }
+
+  vision_clear_templates();
+  if (failures != 0)
+    std::printf("\n%d check(s) FAILED\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+// Benchmark for the native UI-element detector.
+//
+// Runs an exported detector on frames of the synthetic list UI on the CPU,
+// as a device without a GPU delegate would, and reports per-frame time for
+// preparing the input (letterbox into the blob), the forward pass with
+// decode, and the whole detection. With --int8 a quantised export of the
+// same model is run alongside, with how far its detections drift from the
+// float model's. Finally the detector is attached to a matcher to show the
+// cost submit_frame adds for preparing its input.
+//
+//   vision_dnn_bench --model best.onnx [--int8 best_int8.onnx]
+//                    [--frames 30] [--size 640] [--width 1080]
+//                    [--height 2400] [--threads 4]
+//
+// Models come from the training pipeline (e.g. an Ultralytics export with
+// format=onnx, then onnxruntime's quantize_static for the int8 one).
+// --threads sets OpenCV's thread count; 0 keeps its default.
+
+#include "bench_common.h"
+#include "vision_dnn.h"
+#include "vision_engine.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct DetectorRun {
+  std::vector<double> prepare_ms, run_ms, total_ms;
+  std::vector<std::vector<Detection>> detections; // per frame
+};
+
+DetectorRun run_detector(VisionDetector &detector,
+                         const std::vector<cv::Mat> &frames) {
+  DetectorRun out;
+  DetectorInput input;
+  for (const cv::Mat &frame : frames) {
+    std::vector<Detection> found;
+    auto t0 = bench::Clock::now();
+    detector.prepare(frame.data, frame.step, frame.cols, frame.rows, input);
+    const double prepare = bench::elapsed_ms(t0);
+    auto t1 = bench::Clock::now();
+    detector.run(input, found);
+    const double run = bench::elapsed_ms(t1);
+    out.prepare_ms.push_back(prepare);
+    out.run_ms.push_back(run);
+    out.total_ms.push_back(prepare + run);
+    out.detections.push_back(found);
+  }
+  return out;
+}
+
+float iou(const Detection &a, const Detection &b) {
+  float x0 = std::max(a.left, b.left), y0 = std::max(a.top, b.top);
+  float x1 = std::min(a.right, b.right), y1 = std::min(a.bottom, b.bottom);
+  float inter = std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+  float uni = (a.right - a.left) * (a.bottom - a.top) +
+              (b.right - b.left) * (b.bottom - b.top) - inter;
+  return uni > 0 ? inter / uni : 0.0f;
+}
+
+// Share of the reference detections that `other` found again: same class,
+// IoU above 0.5.
+double recall(const DetectorRun &reference, const DetectorRun &other) {
+  size_t total = 0, kept = 0;
+  for (size_t f = 0; f < reference.detections.size(); f++) {
+    for (const Detection &r : reference.detections[f]) {
+      total++;
+      for (const Detection &o : other.detections[f]) {
+        if (o.cls == r.cls && iou(o, r) > 0.5f) {
+          kept++;
+          break;
+        }
+      }
+    }
+  }
+  return total > 0 ? 100.0 * (double)kept / (double)total : 100.0;
+}
+
+double mean_count(const DetectorRun &run) {
+  size_t n = 0;
+  for (const std::vector<Detection> &d : run.detections)
+    n += d.size();
+  return run.detections.empty() ? 0.0
+                                : (double)n / (double)run.detections.size();
+}
+
+void print_run(const char *name, const DetectorRun &run) {
+  std::printf("\n%s (%.1f detections per frame)\n", name, mean_count(run));
+  bench::print_header("stage");
+  bench::print_row("prepare", run.prepare_ms);
+  bench::print_row("forward + decode", run.run_ms);
+  bench::print_row("detect", run.total_ms);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *model = bench::arg_value(argc, argv, "--model");
+  const char *int8 = bench::arg_value(argc, argv, "--int8");
+  if (!model) {
+    std::fprintf(stderr, "usage: vision_dnn_bench --model best.onnx "
+                         "[--int8 best_int8.onnx] [--frames 30] ...\n");
+    return 2;
+  }
+  const int frames = bench::arg_int(argc, argv, "--frames", 30);
+  const int width = bench::arg_int(argc, argv, "--width", 1080);
+  const int height = bench::arg_int(argc, argv, "--height", 2400);
+  const int threads = bench::arg_int(argc, argv, "--threads", 0);
+  if (threads > 0)
+    cv::setNumThreads(threads);
+
+  DetectorConfig config;
+  config.input_size = bench::arg_int(argc, argv, "--size", 640);
+
+  const cv::Mat canvas = bench::make_canvas(width, height * 3, 7);
+  std::vector<cv::Mat> shots;
+  for (int f = 0; f < frames; f++)
+    shots.push_back(bench::scroll_frame(canvas, height, f, 24));
+
+  std::printf("vision_dnn_bench: %dx%d frames=%d input=%d threads=%d\n",
+              width, height, frames, config.input_size,
+              cv::getNumThreads());
+
+  auto detector = std::make_shared<VisionDetector>(model, config);
+  if (!detector->loaded())
+    return 1;
+  const DetectorRun reference = run_detector(*detector, shots);
+  print_run(detector->quantized() ? "model (int8)" : "model (float)",
+            reference);
+
+  if (int8) {
+    VisionDetector quantized(int8, config);
+    if (!quantized.loaded())
+      return 1;
+    const DetectorRun run = run_detector(quantized, shots);
+    print_run("int8 model", run);
+    if (!quantized.quantized())
+      std::printf("  (no int8 layers found; is it really quantised?)\n");
+    std::printf("  %-22s %9.1f%%\n", "float boxes kept",
+                recall(reference, run));
+  }
+
+  // The submit path: one RGBA frame converted for matching and prepared for
+  // detection in the same call.
+  VisionMatcher matcher;
+  std::vector<double> plain_ms, attached_ms, latest_ms;
+  std::vector<Detection> found;
+  for (const cv::Mat &shot : shots) {
+    auto t0 = bench::Clock::now();
+    matcher.submit_frame(shot.data, shot.total() * shot.elemSize(),
+                         shot.cols, shot.rows, (int)shot.step, 4);
+    plain_ms.push_back(bench::elapsed_ms(t0));
+  }
+  matcher.set_detector(detector);
+  for (const cv::Mat &shot : shots) {
+    auto t0 = bench::Clock::now();
+    matcher.submit_frame(shot.data, shot.total() * shot.elemSize(),
+                         shot.cols, shot.rows, (int)shot.step, 4);
+    attached_ms.push_back(bench::elapsed_ms(t0));
+    t0 = bench::Clock::now();
+    matcher.detect_latest(found);
+    latest_ms.push_back(bench::elapsed_ms(t0));
+  }
+  std::printf("\nsubmit_frame\n");
+  bench::print_header("path");
+  bench::print_row("submit (matching only)", plain_ms);
+  bench::print_row("submit (+ detector)", attached_ms);
+  bench::print_row("detect_latest", latest_ms);
+  return 0;
+}
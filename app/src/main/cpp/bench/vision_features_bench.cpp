@@ -0,0 +1,144 @@
+// Benchmark for feature-mode templates.
+//
+// Cuts templates from the synthetic list UI, then shows them a frame of the
+// same UI rendered at another density (--scale). Each template count is
+// matched once with every template in pixel mode (exhaustive, all
+// kMatchScales) and once with every template in feature mode, reporting
+// per-frame time, registration time and how many templates each mode finds
+// where they really are.
+//
+//   vision_features_bench [--templates 10,50,200] [--frames 5]
+//                         [--scale 130] [--width 1080] [--height 2400]
+//                         [--threads 4] [--seed 1]
+//
+// --scale is in percent; 100 is the density the templates were cut at,
+// where pixel matching should find everything too. Templates cut from
+// flat areas have too few keypoints and stay in pixel mode; they are
+// counted separately.
+
+#include "bench_common.h"
+#include "vision_engine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+struct ModeRun {
+  std::vector<double> frame_ms;
+  double register_ms = 0.0;
+  int found = 0;     // matched at the true place
+  int misplaced = 0; // matched elsewhere
+};
+
+// A hit is in the right place when its centre is within a quarter of the
+// expected size of the true centre.
+bool placed(const cv::Rect &hit, const cv::Rect &truth) {
+  const cv::Point2f a(hit.x + hit.width * 0.5f, hit.y + hit.height * 0.5f);
+  const cv::Point2f b(truth.x + truth.width * 0.5f,
+                      truth.y + truth.height * 0.5f);
+  const float tol = 0.25f * std::max(truth.width, truth.height);
+  return std::abs(a.x - b.x) <= tol && std::abs(a.y - b.y) <= tol;
+}
+
+void run_mode(const std::vector<bench::Template> &templates,
+              const cv::Mat &frame, const std::vector<cv::Rect> &truth,
+              bool features, int frames, int threads, ModeRun &out,
+              int *pixel_fallbacks) {
+  VisionMatcher matcher;
+  matcher.set_threads(threads, std::vector<int>());
+  MatchConfig config;
+  config.diff_tile = 0; // every frame does the full work
+  matcher.set_config(config);
+
+  auto t0 = bench::Clock::now();
+  for (const bench::Template &t : templates) {
+    if (!features) {
+      matcher.add_template(t.id, t.rgba);
+    } else if (!matcher.add_feature_template(t.id, t.rgba) &&
+               pixel_fallbacks) {
+      (*pixel_fallbacks)++;
+    }
+  }
+  out.register_ms = bench::elapsed_ms(t0);
+
+  std::vector<MatchResult> results;
+  for (int f = 0; f < frames; f++) {
+    t0 = bench::Clock::now();
+    results = matcher.match(frame);
+    out.frame_ms.push_back(bench::elapsed_ms(t0));
+  }
+  for (size_t i = 0; i < results.size() && i < truth.size(); i++) {
+    if (!results[i].matched)
+      continue;
+    if (placed(results[i].rect, truth[i]))
+      out.found++;
+    else
+      out.misplaced++;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::vector<int> counts =
+      bench::arg_int_list(argc, argv, "--templates", {10, 50, 200});
+  const int frames = bench::arg_int(argc, argv, "--frames", 5);
+  const int scale_pct = bench::arg_int(argc, argv, "--scale", 130);
+  const int width = bench::arg_int(argc, argv, "--width", 1080);
+  const int height = bench::arg_int(argc, argv, "--height", 2400);
+  const int threads = bench::arg_int(argc, argv, "--threads", 4);
+  const int seed = bench::arg_int(argc, argv, "--seed", 1);
+  const double scale = scale_pct / 100.0;
+
+  // The UI at the density the templates were recorded at, and the frame at
+  // the new density: the same content, `scale` times larger, cropped to
+  // the screen.
+  const cv::Mat canvas = bench::make_canvas(width, height, (uint64_t)seed);
+  cv::Mat scaled;
+  cv::resize(canvas, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+  const cv::Rect screen(0, 0, std::min(width, scaled.cols),
+                        std::min(height, scaled.rows));
+  const cv::Mat frame = scaled(screen).clone();
+
+  std::printf("vision_features_bench: %dx%d frame at %d%% of the recorded "
+              "density, threads=%d, frames=%d\n",
+              frame.cols, frame.rows, scale_pct, threads, frames);
+
+  for (int count : counts) {
+    // Templates from the part of the canvas still on screen after scaling.
+    const cv::Mat visible = canvas(cv::Rect(
+        0, 0, width, std::min(height, (int)(screen.height / scale))));
+    std::vector<bench::Template> templates = bench::make_templates(
+        visible, visible.rows, count, 0, (uint64_t)seed + (uint64_t)count);
+    std::vector<cv::Rect> truth;
+    for (const bench::Template &t : templates) {
+      truth.emplace_back((int)std::lround(t.prior.x * scale),
+                         (int)std::lround(t.prior.y * scale),
+                         (int)std::lround(t.prior.width * scale),
+                         (int)std::lround(t.prior.height * scale));
+    }
+
+    ModeRun pixels, features;
+    int fallbacks = 0;
+    run_mode(templates, frame, truth, false, frames, threads, pixels, nullptr);
+    run_mode(templates, frame, truth, true, frames, threads, features,
+             &fallbacks);
+
+    std::printf("\n%d templates (%d too plain for features)\n", count,
+                fallbacks);
+    bench::print_header("mode");
+    bench::print_row("pixel (exhaustive)", pixels.frame_ms);
+    bench::print_row("feature", features.frame_ms);
+    std::printf("  %-22s %10s %10s\n", "", "pixel", "feature");
+    std::printf("  %-22s %10.1f %10.1f\n", "register (ms)", pixels.register_ms,
+                features.register_ms);
+    std::printf("  %-22s %10d %10d\n", "found in place", pixels.found,
+                features.found);
+    std::printf("  %-22s %10d %10d\n", "matched elsewhere", pixels.misplaced,
+                features.misplaced);
+  }
+  return 0;
+}
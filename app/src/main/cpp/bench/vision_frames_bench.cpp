@@ -0,0 +1,359 @@
+// Benchmark for the capture frame pool.
+//
+// Feeds frames of the synthetic list UI, laid out as an ImageReader plane
+// with padded rows, through the two capture paths the app has had:
+//
+//   bitmaps  what the capture classes did per frame: a padded bitmap
+//            copied from the plane, a cropped copy of it, the snapshot
+//            copy ScreenUnderstandingService kept, and a match that
+//            converts the cropped copy to gray.
+//   pool     FramePool::fill (one unpadded copy plus gray, into a reused
+//            buffer), then submit_frame and match_latest on the pooled
+//            frame.
+//
+// Reports per-frame time and the bytes each path allocates per frame
+// against the pool's fixed footprint. With --hold a consumer keeps every
+// pooled frame referenced for that many further frames (a slow detector),
+// which shows frames being dropped once it pins the whole pool.
+//
+// Then waits for a template to appear: a producer thread fills the pool
+// every --interval ms with a screen missing the target, then with it, and
+// wait_for (two stable frames) reports the time from the target's first
+// frame to found, against the fixed 200 ms delay plus one match that flow
+// nodes used before. Repeated --waits times.
+//
+// --check runs only the checks, on small frames, and exits non-zero when
+// one fails (registered with CTest). wait_for:
+//   stale   the latest frame at the call shows the target, the next one,
+//           after a quiet spell, does not: not found
+//   fresh   the target appears after the call, then the screen is quiet:
+//           found
+//   cancel  the cancel flag is set while the wait blocks: returns at once
+//   close   the pool is closed while the wait blocks: returns at once
+// and match_latest with a sequence, as a service polling on a timer calls
+// it: each submitted frame is matched once, a poll with no new frame is
+// not (so its action is not repeated), and nothing submitted before
+// clear_latest (a pause) is matched after it.
+//
+//   vision_frames_bench [--frames 100] [--width 1080] [--height 2400]
+//                       [--padding 64] [--templates 20] [--capacity 4]
+//                       [--hold 0] [--interval 16] [--waits 5] [--check]
+
+#include "bench_common.h"
+#include "vision_engine.h"
+#include "vision_frames.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <deque>
+#include <thread>
+#include <vector>
+
+namespace {
+
+double mb(double bytes) { return bytes / (1024.0 * 1024.0); }
+
+void fill(FramePool &pool, const cv::Mat &image) {
+  pool.fill(image.data, image.total() * image.elemSize(), image.cols,
+            image.rows, (int)image.step, 4);
+}
+
+void sleep_ms(int ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// One wait_for check: `first` is in the pool before the call, `during`
+// runs beside the wait. Prints the outcome; true when it is as expected.
+bool check_wait(const char *name, VisionMatcher &matcher,
+                WaitRequest request, const cv::Mat &first,
+                const std::function<void(FramePool &)> &during,
+                bool want_found, double max_ms) {
+  FramePool pool(FramePool::kDefaultCapacity);
+  fill(pool, first);
+  std::thread side([&] { during(pool); });
+  auto t0 = bench::Clock::now();
+  const WaitResult result = matcher.wait_for(pool, request);
+  const double ms = bench::elapsed_ms(t0);
+  side.join();
+  const bool ok = result.found == want_found && ms <= max_ms;
+  std::printf("  %-8s %s: found=%d after %.0f ms, %d frames (want found=%d "
+              "within %.0f ms)\n",
+              name, ok ? "ok" : "FAILED", result.found ? 1 : 0, ms,
+              result.frames, want_found ? 1 : 0, max_ms);
+  return ok;
+}
+
+int run_wait_checks() {
+  const int width = 320, height = 480;
+  // The target is a noise patch, so nothing else on screen resembles it.
+  const cv::Mat without = bench::make_canvas(width, height, 3);
+  const cv::Rect target(100, 200, 96, 64);
+  cv::Mat patch(target.size(), CV_8UC4);
+  cv::RNG rng(5);
+  rng.fill(patch, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+  cv::Mat with = without.clone();
+  cv::Mat spot = with(target);
+  patch.copyTo(spot);
+
+  VisionMatcher matcher;
+  MatchConfig config;
+  config.diff_tile = 0;
+  matcher.set_config(config);
+  matcher.add_template(1, patch);
+  WaitRequest request;
+  request.match.ids = {1};
+  request.stable_frames = 2;
+  request.timeout_ms = 1000;
+
+  std::printf("wait_for checks\n");
+  int failed = 0;
+  // The gap before the next frame outlasts a quiet spell, which must not
+  // confirm a target seen only on the frame from before the call.
+  if (!check_wait("stale", matcher, request, with,
+                  [&](FramePool &pool) {
+                    sleep_ms(400);
+                    fill(pool, without);
+                  },
+                  false, 2000))
+    failed++;
+  if (!check_wait("fresh", matcher, request, without,
+                  [&](FramePool &pool) {
+                    sleep_ms(50);
+                    fill(pool, with);
+                  },
+                  true, 900))
+    failed++;
+
+  std::atomic<bool> cancel{false};
+  WaitRequest cancellable = request;
+  cancellable.timeout_ms = 5000;
+  cancellable.cancel = &cancel;
+  if (!check_wait("cancel", matcher, cancellable, without,
+                  [&](FramePool &pool) {
+                    sleep_ms(100);
+                    cancel.store(true);
+                    pool.wake();
+                  },
+                  false, 1000))
+    failed++;
+  WaitRequest closing = request;
+  closing.timeout_ms = 5000;
+  if (!check_wait("close", matcher, closing, without,
+                  [&](FramePool &pool) {
+                    sleep_ms(100);
+                    pool.close();
+                  },
+                  false, 1000))
+    failed++;
+  return failed;
+}
+
+// One match_latest poll: prints the outcome; true when it matched a frame
+// exactly when `want_frame` and, if so, found the target when
+// `want_found`.
+bool check_poll(const char *name, VisionMatcher &matcher, uint64_t &sequence,
+                bool want_frame, bool want_found = false) {
+  std::vector<MatchResult> results;
+  const bool frame = matcher.match_latest(sequence, results);
+  const bool found = !results.empty() && results[0].matched;
+  const bool ok = frame == want_frame && (!frame || found == want_found);
+  std::printf("  %-8s %s: new frame=%d found=%d (want new frame=%d%s)\n",
+              name, ok ? "ok" : "FAILED", frame ? 1 : 0, found ? 1 : 0,
+              want_frame ? 1 : 0,
+              want_frame ? want_found ? " found=1" : " found=0" : "");
+  return ok;
+}
+
+int run_latest_checks() {
+  const int width = 320, height = 480;
+  const cv::Mat without = bench::make_canvas(width, height, 3);
+  const cv::Rect target(100, 200, 96, 64);
+  cv::Mat patch(target.size(), CV_8UC4);
+  cv::RNG rng(7);
+  rng.fill(patch, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+  cv::Mat with = without.clone();
+  cv::Mat spot = with(target);
+  patch.copyTo(spot);
+
+  VisionMatcher matcher;
+  matcher.add_template(1, patch);
+  auto submit = [&](const cv::Mat &image) {
+    matcher.submit_frame(image.data, image.total() * image.elemSize(),
+                         image.cols, image.rows, (int)image.step, 4);
+  };
+
+  std::printf("match_latest checks\n");
+  int failed = 0;
+  uint64_t sequence = 0;
+  if (!check_poll("empty", matcher, sequence, false))
+    failed++;
+  submit(with);
+  if (!check_poll("first", matcher, sequence, true, true))
+    failed++;
+  // No frame since: the target is still the last thing seen, but acting
+  // on it again would repeat the action.
+  if (!check_poll("repeat", matcher, sequence, false))
+    failed++;
+  submit(without);
+  if (!check_poll("next", matcher, sequence, true, false))
+    failed++;
+  // Paused: the frame from before the pause must not be matched on
+  // resume; one captured while paused is.
+  submit(with);
+  matcher.clear_latest();
+  if (!check_poll("paused", matcher, sequence, false))
+    failed++;
+  submit(with);
+  if (!check_poll("resumed", matcher, sequence, true, true))
+    failed++;
+  return failed;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (bench::has_flag(argc, argv, "--check"))
+    return run_wait_checks() + run_latest_checks() == 0 ? 0 : 1;
+
+  const int frames = bench::arg_int(argc, argv, "--frames", 100);
+  const int width = bench::arg_int(argc, argv, "--width", 1080);
+  const int height = bench::arg_int(argc, argv, "--height", 2400);
+  const int padding = bench::arg_int(argc, argv, "--padding", 64);
+  const int templates = bench::arg_int(argc, argv, "--templates", 20);
+  const int capacity = bench::arg_int(argc, argv, "--capacity",
+                                      FramePool::kDefaultCapacity);
+  const int hold = bench::arg_int(argc, argv, "--hold", 0);
+  const int interval = bench::arg_int(argc, argv, "--interval", 16);
+  const int waits = bench::arg_int(argc, argv, "--waits", 5);
+
+  std::printf("vision_frames_bench: %dx%d (+%d px row padding) frames=%d "
+              "templates=%d capacity=%d hold=%d\n",
+              width, height, padding, frames, templates, capacity, hold);
+
+  const cv::Mat canvas = bench::make_canvas(width, height * 3, 11);
+  std::vector<cv::Mat> planes;
+  for (int f = 0; f < frames; f++) {
+    cv::Mat plane(height, width + padding, CV_8UC4, cv::Scalar::all(0));
+    cv::Mat image = plane.colRange(0, width);
+    bench::scroll_frame(canvas, height, f, 24).copyTo(image);
+    planes.push_back(plane);
+  }
+  const std::vector<bench::Template> set =
+      bench::make_templates(canvas, height, templates, 20, 5);
+
+  // ── Bitmap per frame ──
+  VisionMatcher copying;
+  for (const bench::Template &t : set)
+    copying.add_template(t.id, t.rgba);
+  std::vector<double> copy_ms, copy_total_ms;
+  double copy_bytes = 0;
+  for (const cv::Mat &plane : planes) {
+    auto t0 = bench::Clock::now();
+    cv::Mat padded = plane.clone();
+    cv::Mat cropped = padded.colRange(0, width).clone();
+    cv::Mat snapshot = cropped.clone();
+    copy_ms.push_back(bench::elapsed_ms(t0));
+    copying.match(cropped);
+    copy_total_ms.push_back(bench::elapsed_ms(t0));
+    // The gray the match converts into is allocated per frame as well.
+    copy_bytes += (double)(padded.total() * padded.elemSize() +
+                           2 * cropped.total() * cropped.elemSize() +
+                           cropped.total());
+  }
+
+  // ── Frame pool ──
+  VisionMatcher pooled;
+  for (const bench::Template &t : set)
+    pooled.add_template(t.id, t.rgba);
+  FramePool pool(capacity);
+  std::deque<FrameRef> held;
+  std::vector<double> pool_ms, pool_total_ms;
+  for (const cv::Mat &plane : planes) {
+    auto t0 = bench::Clock::now();
+    FrameRef frame = pool.fill(plane.data, plane.total() * plane.elemSize(),
+                               width, height, (int)plane.step, 4);
+    pool_ms.push_back(bench::elapsed_ms(t0));
+    if (frame)
+      pooled.submit_frame(frame);
+    pooled.match_latest();
+    pool_total_ms.push_back(bench::elapsed_ms(t0));
+    if (hold > 0 && frame) {
+      held.push_back(frame);
+      if ((int)held.size() > hold)
+        held.pop_front();
+    }
+  }
+  const FramePoolStats stats = pool.stats();
+
+  // ── Waiting for a template ──
+  const cv::Mat screen = bench::scroll_frame(canvas, height, 0, 24);
+  const cv::Rect target(width / 3, height / 2, std::min(220, width / 2),
+                        std::min(120, height / 4));
+  cv::Mat before = screen.clone();
+  cv::Mat hole = before(target);
+  hole.setTo(cv::Scalar::all(0));
+  VisionMatcher waiting;
+  waiting.add_template(1, screen(target).clone());
+  WaitRequest request;
+  request.match.ids = {1};
+  request.timeout_ms = 5000;
+  request.stable_frames = 2;
+  std::vector<double> wait_ms, poll_ms;
+  int missed = 0;
+  for (int w = 0; w < waits; w++) {
+    FramePool wait_pool(capacity);
+    bench::Clock::time_point appeared;
+    std::thread producer([&] {
+      for (int f = 0; f < 40; f++) {
+        const cv::Mat &image = f < 10 ? before : screen;
+        if (f == 10)
+          appeared = bench::Clock::now();
+        wait_pool.fill(image.data, image.total() * image.elemSize(), width,
+                       height, (int)image.step, 4);
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+      }
+    });
+    const WaitResult result = waiting.wait_for(wait_pool, request);
+    const bench::Clock::time_point found = bench::Clock::now();
+    producer.join();
+    if (!result.found) {
+      missed++;
+      continue;
+    }
+    wait_ms.push_back(
+        std::chrono::duration<double, std::milli>(found - appeared).count());
+
+    auto t0 = bench::Clock::now();
+    waiting.match(screen, request.match);
+    poll_ms.push_back(200.0 + bench::elapsed_ms(t0));
+  }
+
+  const double frame_bytes = (double)width * height * (4 + 1) +
+                             (double)(width / 4) * (height / 4);
+
+  std::printf("\nper frame\n");
+  bench::print_header("path");
+  bench::print_row("bitmaps: capture", copy_ms);
+  bench::print_row("bitmaps: + match", copy_total_ms);
+  bench::print_row("pool: fill", pool_ms);
+  bench::print_row("pool: + submit, match", pool_total_ms);
+
+  std::printf("\nappearance to found (%d ms between frames, %d missed)\n",
+              interval, missed);
+  bench::print_header("path");
+  bench::print_row("delay 200 ms + match", poll_ms);
+  bench::print_row("wait_for, 2 stable", wait_ms);
+
+  std::printf("\nmemory\n");
+  std::printf("  %-22s %9.1f MB per frame, %.0f MB over the run\n",
+              "bitmaps allocate", mb(copy_bytes / frames), mb(copy_bytes));
+  std::printf("  %-22s %9.1f MB, fixed\n", "pool buffers",
+              mb(frame_bytes * stats.capacity));
+  std::printf("  %-22s %9llu filled, %llu dropped, %d of %d in use\n",
+              "pool frames", (unsigned long long)stats.filled,
+              (unsigned long long)stats.dropped, stats.in_use,
+              stats.capacity);
+  return 0;
+}
@@ -0,0 +1,193 @@
+// Benchmark for the box index.
+//
+// Builds synthetic screens (UI elements in a jittered grid, OCR blocks
+// inside most of them plus loose text between) and runs the two lookups the
+// app makes per frame both ways: the element x OCR join of
+// PerceptionLayer.detectWithOcr and the nearest same-label anchor of
+// ScreenMLNodeExecutor, once as the Kotlin loops did (transliterated) and
+// once through a BoxIndex rebuilt for the frame. Reports per-frame time
+// and checks that both give the same answers.
+//
+//   vision_geometry_bench [--elements 100,300,600] [--frames 200]
+//                         [--anchors 20] [--seed 1]
+
+#include "bench_common.h"
+#include "vision_geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr int kScreenWidth = 1080;
+constexpr int kScreenHeight = 2400;
+constexpr int kColumns = 6;
+constexpr int kClasses = 5;
+
+struct Screen {
+  std::vector<Detection> elements;
+  std::vector<Detection> blocks;
+  std::vector<Detection> anchors; // centre and class of saved steps
+};
+
+Detection box(int cls, float x, float y, float w, float h) {
+  return {cls, 1.0f, x, y, x + w, y + h};
+}
+
+Screen make_screen(int elements, int anchors, std::mt19937 &rng) {
+  std::normal_distribution<float> jitter(0.0f, 3.0f);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  const int rows = std::max(elements / kColumns, 1);
+  const float pitch_x = (float)kScreenWidth / kColumns;
+  const float pitch_y = (float)kScreenHeight / (float)rows;
+
+  Screen s;
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < kColumns; c++) {
+      const float x = c * pitch_x + 4 + jitter(rng);
+      const float y = r * pitch_y + 2 + jitter(rng);
+      const float w = pitch_x - 8, h = pitch_y * 0.8f;
+      s.elements.push_back(box((r + c) % kClasses, x, y, w, h));
+      if (unit(rng) < 0.7f) // a label inside the element
+        s.blocks.push_back(box(0, x + w * 0.1f, y + h * 0.3f, w * 0.8f,
+                               h * 0.4f));
+      if (unit(rng) < 0.3f) // loose text straddling the gap
+        s.blocks.push_back(box(0, x + w * 0.5f, y + h * 0.9f, w, h * 0.3f));
+    }
+  }
+  for (int a = 0; a < anchors; a++) {
+    const Detection &e =
+        s.elements[(size_t)(unit(rng) * (float)(s.elements.size() - 1))];
+    s.anchors.push_back(
+        box(e.cls, e.left + jitter(rng) * 10, e.top + jitter(rng) * 10, 0, 0));
+  }
+  return s;
+}
+
+// Kotlin IoU helper of PerceptionLayer.
+float kotlin_iou(const Detection &a, const Detection &b) {
+  float x0 = std::max(a.left, b.left), y0 = std::max(a.top, b.top);
+  float x1 = std::min(a.right, b.right), y1 = std::min(a.bottom, b.bottom);
+  float inter = std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+  float uni = (a.right - a.left) * (a.bottom - a.top) +
+              (b.right - b.left) * (b.bottom - b.top) - inter;
+  return uni > 0 ? inter / uni : 0.0f;
+}
+
+// detectWithOcr before the index: every element filters every block by
+// IoU above 0.05 and sorts the survivors by IoU, descending and stable.
+void brute_join(const Screen &s, std::vector<BoxHit> &out) {
+  out.clear();
+  for (size_t e = 0; e < s.elements.size(); e++) {
+    const size_t first = out.size();
+    for (size_t b = 0; b < s.blocks.size(); b++) {
+      float v = kotlin_iou(s.elements[e], s.blocks[b]);
+      if (v > 0.05f)
+        out.push_back({(int)e, (int)b, v});
+    }
+    std::stable_sort(out.begin() + (std::ptrdiff_t)first, out.end(),
+                     [](const BoxHit &a, const BoxHit &b) {
+                       return a.iou > b.iou;
+                     });
+  }
+}
+
+// ScreenMLNodeExecutor before the index: the same-class element whose
+// centre is closest to the anchor's, first on ties.
+int brute_nearest(const Screen &s, const Detection &anchor) {
+  int best = -1;
+  double best_d = 0.0;
+  for (size_t e = 0; e < s.elements.size(); e++) {
+    const Detection &d = s.elements[e];
+    if (d.cls != anchor.cls)
+      continue;
+    double dx = ((double)d.left + d.right) * 0.5 - anchor.left;
+    double dy = ((double)d.top + d.bottom) * 0.5 - anchor.top;
+    double dist = std::hypot(dx, dy);
+    if (best < 0 || dist < best_d) {
+      best = (int)e;
+      best_d = dist;
+    }
+  }
+  return best;
+}
+
+bool same_hits(const std::vector<BoxHit> &a, const std::vector<BoxHit> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (a[i].query != b[i].query || a[i].box != b[i].box)
+      return false;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::vector<int> sizes =
+      bench::arg_int_list(argc, argv, "--elements", {100, 300, 600});
+  const int frames = bench::arg_int(argc, argv, "--frames", 200);
+  const int anchors = bench::arg_int(argc, argv, "--anchors", 20);
+  const int seed = bench::arg_int(argc, argv, "--seed", 1);
+
+  std::printf("vision_geometry_bench: frames=%d anchors=%d\n", frames,
+              anchors);
+
+  for (int size : sizes) {
+    std::mt19937 rng((uint32_t)seed);
+    std::vector<Screen> screens;
+    size_t blocks = 0;
+    for (int f = 0; f < frames; f++) {
+      screens.push_back(make_screen(size, anchors, rng));
+      blocks += screens.back().blocks.size();
+    }
+    std::printf("\n%d elements per screen (%.0f OCR blocks)\n", size,
+                (double)blocks / (double)frames);
+
+    std::vector<double> brute_join_ms, index_join_ms;
+    std::vector<double> brute_near_ms, index_near_ms;
+    std::vector<BoxHit> expected, hits;
+    std::vector<int> expected_near, near;
+    BoxIndex index;
+    int mismatches = 0;
+    for (const Screen &s : screens) {
+      auto t0 = bench::Clock::now();
+      brute_join(s, expected);
+      brute_join_ms.push_back(bench::elapsed_ms(t0));
+
+      t0 = bench::Clock::now();
+      hits.clear();
+      index.build(s.blocks.data(), s.blocks.size());
+      index.join(s.elements.data(), s.elements.size(), kAnyClass, 0.05f,
+                 hits);
+      index_join_ms.push_back(bench::elapsed_ms(t0));
+      mismatches += same_hits(expected, hits) ? 0 : 1;
+
+      t0 = bench::Clock::now();
+      expected_near.clear();
+      for (const Detection &a : s.anchors)
+        expected_near.push_back(brute_nearest(s, a));
+      brute_near_ms.push_back(bench::elapsed_ms(t0));
+
+      t0 = bench::Clock::now();
+      near.clear();
+      index.build(s.elements.data(), s.elements.size());
+      for (const Detection &a : s.anchors)
+        near.push_back(index.nearest(a.left, a.top, a.cls, INFINITY));
+      index_near_ms.push_back(bench::elapsed_ms(t0));
+      mismatches += expected_near == near ? 0 : 1;
+    }
+
+    bench::print_header("lookup");
+    bench::print_row("ocr join (kotlin)", brute_join_ms);
+    bench::print_row("ocr join (BoxIndex)", index_join_ms);
+    bench::print_row("anchors (kotlin)", brute_near_ms);
+    bench::print_row("anchors (BoxIndex)", index_near_ms);
+    std::printf("  frames with differing answers: %d\n", mismatches);
+  }
+  return 0;
+}
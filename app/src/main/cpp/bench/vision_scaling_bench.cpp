@@ -0,0 +1,140 @@
+// Thread-scaling benchmark for vision_match_all.
+//
+// Runs the same synthetic frames with the worker pool at 1..N threads and
+// reports p50/p99 per frame, speedup over the first --threads entry (1 by
+// default), and whether the results (ID order, decisions, rects, scores)
+// match that first run.
+//
+//   vision_scaling_bench [--threads 1,2,4,8] [--templates 1,20,100]
+//                        [--frames 10] [--mode exhaustive|pyramid]
+//                        [--width 1080] [--height 2400] [--seed 1]
+//                        [--pin]
+//
+// --pin pins workers to vision_performance_cores(). One template is the
+// striping case: a single search split across every thread.
+
+#include "bench_common.h"
+#include "vision_engine.h"
+#include "vision_pool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Agreement {
+  int order_mismatches = 0;    // ID sequence differs from serial
+  int decision_mismatches = 0; // matched flag or rect differs
+  float max_delta = 0.0f;
+};
+
+void compare(const std::vector<MatchResult> &serial,
+             const std::vector<MatchResult> &parallel, Agreement &out) {
+  if (serial.size() != parallel.size()) {
+    out.order_mismatches++;
+    return;
+  }
+  for (size_t i = 0; i < serial.size(); ++i) {
+    const MatchResult &a = serial[i];
+    const MatchResult &b = parallel[i];
+    if (a.id != b.id) {
+      out.order_mismatches++;
+      continue;
+    }
+    if (a.matched != b.matched || a.rect != b.rect)
+      out.decision_mismatches++;
+    out.max_delta = std::max(out.max_delta, std::abs(a.score - b.score));
+  }
+}
+
+std::vector<int> default_threads() {
+  std::vector<int> out;
+  int hw = (int)std::max(std::thread::hardware_concurrency(), 1u);
+  for (int t = 1; t < hw; t *= 2)
+    out.push_back(t);
+  out.push_back(hw);
+  return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int frames = bench::arg_int(argc, argv, "--frames", 10);
+  const int width = bench::arg_int(argc, argv, "--width", 1080);
+  const int height = bench::arg_int(argc, argv, "--height", 2400);
+  const int seed = bench::arg_int(argc, argv, "--seed", 1);
+  const bool pin = bench::has_flag(argc, argv, "--pin");
+  const char *mode_arg = bench::arg_value(argc, argv, "--mode");
+  const bool pyramid = mode_arg && std::strcmp(mode_arg, "pyramid") == 0;
+  const std::vector<int> thread_counts =
+      bench::arg_int_list(argc, argv, "--threads", default_threads());
+  const std::vector<int> counts =
+      bench::arg_int_list(argc, argv, "--templates", {1, 20, 100});
+
+  cv::setNumThreads(1); // scale our pool, not OpenCV's
+  vision_init();
+
+  MatchConfig config;
+  config.mode = pyramid ? SearchMode::Pyramid : SearchMode::Exhaustive;
+  vision_set_config(config);
+
+  std::vector<int> cpus;
+  if (pin)
+    cpus = vision_performance_cores();
+
+  const int scroll_step = 24;
+  cv::Mat canvas = bench::make_canvas(width, height + 480, (uint64_t)seed);
+  std::vector<cv::Mat> screens;
+  for (int f = 0; f < frames; ++f)
+    screens.push_back(bench::scroll_frame(canvas, height, f, scroll_step));
+
+  std::printf("vision_scaling_bench: screen=%dx%d frames=%d mode=%s "
+              "pinned=%zu cpus hw=%u\n",
+              width, height, frames, pyramid ? "pyramid" : "exhaustive",
+              cpus.size(), std::thread::hardware_concurrency());
+
+  for (int count : counts) {
+    std::vector<bench::Template> templates = bench::make_templates(
+        canvas, height, count, 25, (uint64_t)seed * 7919 + count);
+    vision_clear_templates();
+    for (const bench::Template &t : templates)
+      vision_add_template(t.id, t.rgba);
+
+    std::printf("\ntemplates=%d\n", count);
+    std::printf("  %-8s %10s %10s %9s %9s %9s %10s\n", "threads", "p50(ms)",
+                "p99(ms)", "speedup", "order", "decision", "max|delta|");
+
+    std::vector<std::vector<MatchResult>> serial;
+    double serial_p50 = 0.0;
+    for (int threads : thread_counts) {
+      vision_set_threads(threads, cpus);
+
+      std::vector<double> samples;
+      Agreement agreement;
+      for (int f = 0; f < frames; ++f) {
+        auto t0 = bench::Clock::now();
+        std::vector<MatchResult> results = vision_match_all(screens[f]);
+        samples.push_back(bench::elapsed_ms(t0));
+        if (serial.size() < (size_t)frames)
+          serial.push_back(results);
+        else
+          compare(serial[f], results, agreement);
+      }
+
+      double p50 = bench::percentile(samples, 50);
+      if (serial_p50 == 0.0)
+        serial_p50 = p50;
+      std::printf("  %-8d %10.3f %10.3f %8.2fx %9d %9d %10.6f\n", threads, p50,
+                  bench::percentile(samples, 99), serial_p50 / p50,
+                  agreement.order_mismatches, agreement.decision_mismatches,
+                  agreement.max_delta);
+    }
+  }
+
+  vision_set_threads(1, {});
+  vision_clear_templates();
+  return 0;
+}
@@ -0,0 +1,207 @@
+// Micro-benchmark for the fused RGBA -> gray (+ downscale) kernel.
+//
+// Times the OpenCV path the engine used before (cvtColor, then cv::resize
+// with INTER_AREA for the pyramid levels) against vision_rgba_to_gray on
+// every SIMD path this CPU supports, and checks each path is bit-exact with
+// the scalar reference and how far it lands from OpenCV.
+//
+// Then times the detector input preparation: resize, letterbox padding and
+// normalisation with OpenCV against the one-pass vision_letterbox, into
+// float32 and float16.
+//
+//   vision_simd_bench [--iterations 200] [--width 1080] [--height 2400]
+//                     [--seed 1]
+//
+// The source frame has a padded row stride, like an ImageReader plane.
+
+#include "bench_common.h"
+#include "vision_detect.h"
+#include "vision_simd.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace {
+
+struct Output {
+  cv::Mat gray;
+  cv::Mat reduced;
+};
+
+// A fused run: which outputs to write and the reduction factor.
+struct Variant {
+  const char *name;
+  bool gray;
+  int factor;
+};
+
+const Variant kVariants[] = {
+    {"gray", true, 1},
+    {"gray+2x", true, 2},
+    {"gray+4x", true, 4},
+    {"4x only", false, 4},
+};
+
+std::vector<double> time_runs(int iterations, const std::function<void()> &fn) {
+  fn(); // warm caches and lazy allocations
+  std::vector<double> samples;
+  samples.reserve(iterations);
+  for (int i = 0; i < iterations; ++i) {
+    auto t0 = bench::Clock::now();
+    fn();
+    samples.push_back(bench::elapsed_ms(t0));
+  }
+  return samples;
+}
+
+Output run_fused(SimdPath path, const cv::Mat &rgba, const Variant &v) {
+  Output out;
+  if (v.gray)
+    out.gray.create(rgba.rows, rgba.cols, CV_8UC1);
+  if (v.factor > 1)
+    out.reduced.create(rgba.rows / v.factor, rgba.cols / v.factor, CV_8UC1);
+  vision_rgba_to_gray(path, rgba.data, rgba.step, rgba.cols, rgba.rows,
+                      v.gray ? out.gray.data : nullptr,
+                      v.gray ? out.gray.step : 0,
+                      v.factor > 1 ? out.reduced.data : nullptr,
+                      v.factor > 1 ? out.reduced.step : 0, v.factor);
+  return out;
+}
+
+int max_abs_diff(const cv::Mat &a, const cv::Mat &b) {
+  if (a.empty() && b.empty())
+    return 0;
+  if (a.size() != b.size())
+    return 255;
+  cv::Mat diff;
+  cv::absdiff(a, b, diff);
+  double max_val = 0.0;
+  cv::minMaxLoc(diff, nullptr, &max_val);
+  return (int)max_val;
+}
+
+// The OpenCV equivalent of vision_letterbox with keep_aspect, float32.
+void opencv_letterbox(const cv::Mat &rgba, int side, cv::Mat &dst) {
+  float s = std::min((float)side / rgba.cols, (float)side / rgba.rows);
+  int w = std::min(std::max((int)std::lround(rgba.cols * s), 1), side);
+  int h = std::min(std::max((int)std::lround(rgba.rows * s), 1), side);
+  cv::Mat rgb, resized, padded;
+  cv::cvtColor(rgba, rgb, cv::COLOR_RGBA2RGB);
+  cv::resize(rgb, resized, cv::Size(w, h), 0, 0, cv::INTER_LINEAR);
+  int x = (side - w) / 2, y = (side - h) / 2;
+  cv::copyMakeBorder(resized, padded, y, side - h - y, x, side - w - x,
+                     cv::BORDER_CONSTANT, cv::Scalar::all(kLetterboxGray));
+  padded.convertTo(dst, CV_32FC3, 1.0 / 255.0);
+}
+
+void run_letterbox(int iterations, const cv::Mat &rgba) {
+  const int side = 640;
+  cv::Mat cv_input;
+  opencv_letterbox(rgba, side, cv_input);
+  cv::Mat input32(side, side, CV_32FC3);
+  std::vector<uint16_t> input16((size_t)side * side * 3);
+
+  std::printf("\n");
+  bench::print_header("letterbox 640");
+  bench::print_row("opencv float32", time_runs(iterations, [&] {
+                     opencv_letterbox(rgba, side, cv_input);
+                   }));
+  bench::print_row("native float32", time_runs(iterations, [&] {
+                     vision_letterbox(rgba.data, rgba.step, rgba.cols,
+                                      rgba.rows, side, true, false,
+                                      input32.data);
+                   }));
+  bench::print_row("native float16", time_runs(iterations, [&] {
+                     vision_letterbox(rgba.data, rgba.step, rgba.cols,
+                                      rgba.rows, side, true, true,
+                                      input16.data());
+                   }));
+
+  // 7-bit weights against OpenCV's 11-bit ones: about one level apart.
+  cv::Mat diff;
+  cv::absdiff(input32, cv_input, diff);
+  double max_val = 0.0;
+  cv::minMaxLoc(diff.reshape(1), nullptr, &max_val);
+  std::printf("  %-22s %10.2f levels\n", "max vs opencv", max_val * 255.0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int iterations = bench::arg_int(argc, argv, "--iterations", 200);
+  const int width = bench::arg_int(argc, argv, "--width", 1080);
+  const int height = bench::arg_int(argc, argv, "--height", 2400);
+  const int seed = bench::arg_int(argc, argv, "--seed", 1);
+
+  cv::setNumThreads(1); // compare single-threaded kernels
+
+  // Padded stride: 64 spare pixels per row, viewed through an ROI.
+  cv::Mat canvas = bench::make_canvas(width + 64, height, (uint64_t)seed);
+  cv::Mat rgba = canvas(cv::Rect(0, 0, width, height));
+
+  std::printf("vision_simd_bench: frame=%dx%d stride=%zu iterations=%d "
+              "best=%s\n\n",
+              width, height, (size_t)rgba.step, iterations,
+              vision_simd_path_name(vision_simd_best_path()));
+
+  // OpenCV reference outputs, and the baseline timings.
+  cv::Mat cv_gray, cv_half, cv_quarter;
+  cv::cvtColor(rgba, cv_gray, cv::COLOR_RGBA2GRAY);
+  cv::resize(cv_gray, cv_half, cv::Size(width / 2, height / 2), 0, 0,
+             cv::INTER_AREA);
+  cv::resize(cv_gray, cv_quarter, cv::Size(width / 4, height / 4), 0, 0,
+             cv::INTER_AREA);
+
+  bench::print_header("opencv");
+  bench::print_row("cvtColor", time_runs(iterations, [&] {
+                     cv::Mat g;
+                     cv::cvtColor(rgba, g, cv::COLOR_RGBA2GRAY);
+                   }));
+  bench::print_row("cvtColor+resize/2", time_runs(iterations, [&] {
+                     cv::Mat g, h;
+                     cv::cvtColor(rgba, g, cv::COLOR_RGBA2GRAY);
+                     cv::resize(g, h, cv::Size(width / 2, height / 2), 0, 0,
+                                cv::INTER_AREA);
+                   }));
+  bench::print_row("cvtColor+resize/4", time_runs(iterations, [&] {
+                     cv::Mat g, q;
+                     cv::cvtColor(rgba, g, cv::COLOR_RGBA2GRAY);
+                     cv::resize(g, q, cv::Size(width / 4, height / 4), 0, 0,
+                                cv::INTER_AREA);
+                   }));
+
+  const SimdPath paths[] = {SimdPath::Scalar, SimdPath::Sse2, SimdPath::Avx2,
+                            SimdPath::Neon};
+  for (SimdPath path : paths) {
+    if (!vision_simd_supported(path))
+      continue;
+    std::printf("\n");
+    bench::print_header(vision_simd_path_name(path));
+    for (const Variant &v : kVariants) {
+      bench::print_row(v.name, time_runs(iterations, [&] {
+                         run_fused(path, rgba, v);
+                       }));
+    }
+
+    // Agreement: every path must equal scalar exactly; against OpenCV gray
+    // is exact and the 4x box filter differs from INTER_AREA by rounding.
+    std::printf("  %-22s %10s %10s\n", "check", "vs scalar", "vs opencv");
+    for (const Variant &v : kVariants) {
+      Output mine = run_fused(path, rgba, v);
+      Output ref = run_fused(SimdPath::Scalar, rgba, v);
+      int scalar_delta = std::max(max_abs_diff(mine.gray, ref.gray),
+                                  max_abs_diff(mine.reduced, ref.reduced));
+      int cv_delta = v.gray ? max_abs_diff(mine.gray, cv_gray) : 0;
+      if (v.factor == 2)
+        cv_delta = std::max(cv_delta, max_abs_diff(mine.reduced, cv_half));
+      if (v.factor == 4)
+        cv_delta = std::max(cv_delta, max_abs_diff(mine.reduced, cv_quarter));
+      std::printf("  %-22s %10d %10d\n", v.name, scalar_delta, cv_delta);
+    }
+  }
+
+  run_letterbox(iterations, rgba);
+  return 0;
+}
@@ -0,0 +1,253 @@
+// Benchmark for the detection tracker.
+//
+// Feeds a synthetic scrolling list (a few hundred elements on screen, five
+// classes, jittered boxes, occasional missed detections) through the greedy
+// same-label IoU tracker the app used before (TemporalTracker.kt,
+// transliterated) and through VisionTracker. Reports per-frame time and how
+// often an element's track ID changed while it stayed on screen.
+//
+//   vision_track_bench [--elements 100,300,600] [--frames 300]
+//                      [--speed 40] [--seed 1]
+//
+// The list accelerates from rest to --speed pixels per frame and back, at
+// 30 frames per second.
+
+#include "bench_common.h"
+#include "vision_track.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr int kScreenWidth = 1080;
+constexpr int kScreenHeight = 2400;
+constexpr int kColumns = 6;
+constexpr int kClasses = 5;
+constexpr int64_t kFrameMs = 33;
+
+struct Element {
+  int cls;
+  float x, y, w, h; // in list coordinates
+};
+
+// Detections of one frame, and the element each one belongs to.
+struct Frame {
+  std::vector<Detection> detections;
+  std::vector<int> element;
+};
+
+std::vector<Element> make_list(int visible) {
+  const int rows_on_screen = std::max(visible / kColumns, 1);
+  const float pitch = (float)kScreenHeight / (float)rows_on_screen;
+  const float cell = (float)kScreenWidth / kColumns;
+  std::vector<Element> list;
+  for (int row = 0; row < rows_on_screen * 8; row++) {
+    for (int col = 0; col < kColumns; col++) {
+      list.push_back({(row + col) % kClasses, col * cell + 4, row * pitch + 2,
+                      cell - 8, pitch * 0.8f});
+    }
+  }
+  return list;
+}
+
+std::vector<Frame> make_frames(const std::vector<Element> &list, int frames,
+                               float speed, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> jitter(0.0f, 1.5f);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<Frame> out(frames);
+  float offset = 0.0f;
+  for (int f = 0; f < frames; f++) {
+    // Smooth fling: 0 -> speed -> 0 over the run.
+    offset += speed * std::sin(3.14159265f * (float)f / (float)frames);
+    Frame &frame = out[f];
+    for (size_t e = 0; e < list.size(); e++) {
+      const Element &el = list[e];
+      const float top = el.y - offset;
+      if (top + el.h < 0 || top > kScreenHeight)
+        continue;
+      if (unit(rng) < 0.03f)
+        continue; // missed by the detector this frame
+      Detection d;
+      d.cls = el.cls;
+      d.score = 0.5f + 0.5f * unit(rng);
+      d.left = el.x + jitter(rng);
+      d.top = top + jitter(rng);
+      d.right = el.x + el.w + jitter(rng);
+      d.bottom = top + el.h + jitter(rng);
+      frame.detections.push_back(d);
+      frame.element.push_back((int)e);
+    }
+  }
+  return out;
+}
+
+// TemporalTracker.kt before the native tracker: for each track in order,
+// the unmatched detection of the same label with the highest IoU above
+// 0.5 wins; unmatched tracks are kept for 500 ms; leftovers become tracks.
+class GreedyTracker {
+public:
+  // Returns the track ID given to each detection.
+  const std::vector<int> &update(const std::vector<Detection> &detections,
+                                 int64_t now_ms) {
+    ids_.assign(detections.size(), -1);
+    std::vector<Entry> updated;
+    for (const Entry &track : tracks_) {
+      int best = -1;
+      float best_iou = 0.0f;
+      for (size_t i = 0; i < detections.size(); i++) {
+        if (ids_[i] >= 0 || detections[i].cls != track.box.cls)
+          continue;
+        float v = iou(track.box, detections[i]);
+        if (v > 0.5f && v > best_iou) {
+          best_iou = v;
+          best = (int)i;
+        }
+      }
+      if (best >= 0) {
+        ids_[best] = track.id;
+        updated.push_back({track.id, detections[best], now_ms});
+      } else if (now_ms - track.seen_ms < 500) {
+        updated.push_back(track);
+      }
+    }
+    for (size_t i = 0; i < detections.size(); i++) {
+      if (ids_[i] >= 0)
+        continue;
+      ids_[i] = next_id_++;
+      updated.push_back({ids_[i], detections[i], now_ms});
+    }
+    tracks_ = updated; // the Kotlin version copied the list every frame too
+    return ids_;
+  }
+
+private:
+  struct Entry {
+    int id;
+    Detection box;
+    int64_t seen_ms;
+  };
+
+  static float iou(const Detection &a, const Detection &b) {
+    float x0 = std::max(a.left, b.left), y0 = std::max(a.top, b.top);
+    float x1 = std::min(a.right, b.right), y1 = std::min(a.bottom, b.bottom);
+    if (x1 < x0 || y1 < y0)
+      return 0.0f;
+    float inter = (x1 - x0) * (y1 - y0);
+    float uni = (a.right - a.left) * (a.bottom - a.top) +
+                (b.right - b.left) * (b.bottom - b.top) - inter;
+    return uni > 0 ? inter / uni : 0.0f;
+  }
+
+  std::vector<Entry> tracks_;
+  std::vector<int> ids_;
+  int next_id_ = 1;
+};
+
+// Counts ID changes of elements seen in consecutive frames.
+struct SwitchCounter {
+  std::map<int, int> last; // element -> track ID
+  int switches = 0;
+  int observations = 0;
+
+  void observe(const Frame &frame, const std::vector<int> &ids) {
+    std::map<int, int> now;
+    for (size_t i = 0; i < ids.size(); i++) {
+      const int element = frame.element[i];
+      auto it = last.find(element);
+      if (it != last.end()) {
+        observations++;
+        if (it->second != ids[i])
+          switches++;
+      }
+      now[element] = ids[i];
+    }
+    last.swap(now);
+  }
+};
+
+// VisionTracker reports matched tracks with the detection's exact box;
+// map them back to detections through the box corners.
+void native_ids(const Frame &frame, const std::vector<Track> &tracks,
+                std::vector<int> &ids) {
+  std::map<std::pair<float, float>, int> by_corner;
+  for (const Track &t : tracks) {
+    if (t.missed_ms == 0)
+      by_corner[{t.left, t.top}] = t.id;
+  }
+  ids.assign(frame.detections.size(), -1);
+  for (size_t i = 0; i < frame.detections.size(); i++) {
+    auto it = by_corner.find(
+        {frame.detections[i].left, frame.detections[i].top});
+    if (it != by_corner.end())
+      ids[i] = it->second;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::vector<int> sizes =
+      bench::arg_int_list(argc, argv, "--elements", {100, 300, 600});
+  const int frames = bench::arg_int(argc, argv, "--frames", 300);
+  const int speed = bench::arg_int(argc, argv, "--speed", 40);
+  const int seed = bench::arg_int(argc, argv, "--seed", 1);
+
+  std::printf("vision_track_bench: frames=%d peak speed=%d px/frame\n",
+              frames, speed);
+
+  for (int size : sizes) {
+    const std::vector<Element> list = make_list(size);
+    const std::vector<Frame> run =
+        make_frames(list, frames, (float)speed, (uint32_t)seed);
+    size_t total = 0;
+    for (const Frame &f : run)
+      total += f.detections.size();
+
+    std::printf("\n%d elements per screen (%.0f detections per frame)\n",
+                size, (double)total / (double)run.size());
+    bench::print_header("tracker");
+
+    GreedyTracker greedy;
+    SwitchCounter greedy_switches;
+    std::vector<double> greedy_ms;
+    for (int f = 0; f < frames; f++) {
+      auto t0 = bench::Clock::now();
+      const std::vector<int> &ids = greedy.update(run[f].detections,
+                                                  f * kFrameMs);
+      greedy_ms.push_back(bench::elapsed_ms(t0));
+      greedy_switches.observe(run[f], ids);
+    }
+    bench::print_row("greedy (kotlin)", greedy_ms);
+
+    VisionTracker tracker;
+    SwitchCounter native_switches;
+    std::vector<double> native_ms;
+    std::vector<int> ids;
+    for (int f = 0; f < frames; f++) {
+      auto t0 = bench::Clock::now();
+      const std::vector<Track> &tracks =
+          tracker.update(run[f].detections.data(), run[f].detections.size(),
+                         f * kFrameMs);
+      native_ms.push_back(bench::elapsed_ms(t0));
+      native_ids(run[f], tracks, ids);
+      native_switches.observe(run[f], ids);
+    }
+    bench::print_row("VisionTracker", native_ms);
+
+    std::printf("  %-22s %10s %10s\n", "ID switches", "greedy", "native");
+    std::printf("  %-22s %10d %10d\n", "count",
+                greedy_switches.switches, native_switches.switches);
+    std::printf("  %-22s %9.2f%% %9.2f%%\n", "of observations",
+                100.0 * greedy_switches.switches /
+                    std::max(greedy_switches.observations, 1),
+                100.0 * native_switches.switches /
+                    std::max(native_switches.observations, 1));
+  }
+  return 0;
+}
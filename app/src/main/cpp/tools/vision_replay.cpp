@@ -0,0 +1,120 @@
+// Replays a frame recording (see vision_record.h) through vision_match_all
+// and prints every frame's results and match latency, so a session captured
+// on a device can be re-run against engine changes on a desktop.
+//
+//   vision_replay <recording> [--cadence] [--threads 1] [--diff-tile 32]
+//                 [--pyramid-factor 0] [--quiet] [--stats]
+//
+// Frames are matched back to back by default. --cadence waits for each
+// frame's capture time first and counts frames that arrived before the
+// previous match finished; a live session would have skipped those, the
+// replay matches every frame so its results stay deterministic.
+// --pyramid-factor 4 or 8 selects the pyramid search. Results go to stdout
+// as CSV, one row per result:
+//   frame,timestamp_ms,latency_ms,id,matched,score,x,y,width,height
+// (--quiet leaves them out) and a latency summary goes to stderr, followed
+// with --stats by the engine's stage counters as JSON (see vision_stats.h).
+//
+// The recording holds the grayscale frames the engine was given, so replay
+// skips only the RGBA conversion; pyramid searches build their coarse level
+// with cv::resize instead of the fused kernel.
+
+#include "bench_common.h"
+#include "vision_engine.h"
+#include "vision_record.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argv[1][0] == '-') {
+    std::fprintf(stderr,
+                 "usage: vision_replay <recording> [--cadence] [--threads N] "
+                 "[--diff-tile PX] [--pyramid-factor 4|8] [--quiet] "
+                 "[--stats]\n");
+    return 2;
+  }
+  const std::string path = argv[1];
+  const bool cadence = bench::has_flag(argc, argv, "--cadence");
+  const bool quiet = bench::has_flag(argc, argv, "--quiet");
+  const bool stats = bench::has_flag(argc, argv, "--stats");
+  const int threads = bench::arg_int(argc, argv, "--threads", 1);
+  const int diff_tile = bench::arg_int(argc, argv, "--diff-tile", 32);
+  const int pyramid_factor = bench::arg_int(argc, argv, "--pyramid-factor", 0);
+
+  ReplayFrameSource source;
+  if (!source.open(path))
+    return 1;
+
+  vision_init();
+  vision_set_threads(threads, std::vector<int>());
+  MatchConfig config;
+  config.diff_tile = diff_tile;
+  if (pyramid_factor > 0) {
+    config.mode = SearchMode::Pyramid;
+    config.pyramid_factor = pyramid_factor;
+  }
+  vision_set_config(config);
+  vision_register_recorded(vision_default_matcher(), source.templates());
+
+  if (!quiet)
+    std::printf(
+        "frame,timestamp_ms,latency_ms,id,matched,score,x,y,width,height\n");
+
+  std::vector<double> latency;
+  int frames = 0;
+  int late = 0;
+  long matches = 0;
+  cv::Mat gray;
+  int64_t timestamp_ms = 0;
+  int64_t first_ms = 0;
+  const auto start = bench::Clock::now();
+  while (source.next(gray, timestamp_ms)) {
+    if (frames == 0)
+      first_ms = timestamp_ms;
+    if (cadence) {
+      const auto due =
+          start + std::chrono::milliseconds(timestamp_ms - first_ms);
+      if (bench::Clock::now() > due && frames > 0)
+        late++;
+      std::this_thread::sleep_until(due);
+    }
+
+    const auto t0 = bench::Clock::now();
+    const std::vector<MatchResult> results = vision_match_all(gray);
+    const double ms = bench::elapsed_ms(t0);
+    latency.push_back(ms);
+
+    for (const MatchResult &r : results) {
+      matches += r.matched ? 1 : 0;
+      if (!quiet)
+        std::printf("%d,%lld,%.3f,%d,%d,%.4f,%d,%d,%d,%d\n", frames,
+                    (long long)timestamp_ms, ms, r.id, r.matched ? 1 : 0,
+                    r.score, r.rect.x, r.rect.y, r.rect.width,
+                    r.rect.height);
+    }
+    frames++;
+  }
+
+  std::fprintf(stderr,
+               "vision_replay: %d frames over %.1f s, %zu templates, %ld "
+               "matches, threads=%d\n",
+               frames, (double)(timestamp_ms - first_ms) / 1000.0,
+               source.templates().size(), matches, threads);
+  std::fprintf(stderr,
+               "  latency p50 %.3f ms, p99 %.3f ms, max %.3f ms, mean %.3f "
+               "ms\n",
+               bench::percentile(latency, 50), bench::percentile(latency, 99),
+               bench::percentile(latency, 100), bench::mean(latency));
+  if (cadence)
+    std::fprintf(stderr,
+                 "  %d frames arrived before the previous match finished\n",
+                 late);
+  if (stats)
+    std::fprintf(stderr, "  %s\n",
+                 vision_default_matcher().stats_json().c_str());
+  vision_clear_templates();
+  return 0;
+}
@@ -0,0 +1,343 @@
+#include "vision_detect.h"
+#include "vision_simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// Candidates sampled to tell normalised from pixel-space coordinates.
+constexpr int kFormatSamples = 20;
+// Normalised heads stay near 0-1; pixel-space ones reach tens or hundreds.
+constexpr float kNormalizedLimit = 3.0f;
+// Upper bound on NMS grid cells per side.
+constexpr int kMaxGridSide = 64;
+
+bool finite(const Detection &d) {
+  return std::isfinite(d.left) && std::isfinite(d.top) &&
+         std::isfinite(d.right) && std::isfinite(d.bottom);
+}
+
+// Same arithmetic as the Kotlin IoU it replaces, so decisions match.
+float iou(const Detection &a, const Detection &b) {
+  float x0 = std::max(a.left, b.left);
+  float y0 = std::max(a.top, b.top);
+  float x1 = std::min(a.right, b.right);
+  float y1 = std::min(a.bottom, b.bottom);
+  float inter = std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+  float area_a = (a.right - a.left) * (a.bottom - a.top);
+  float area_b = (b.right - b.left) * (b.bottom - b.top);
+  float uni = area_a + area_b - inter;
+  return uni > 0 ? inter / uni : 0.0f;
+}
+
+// Uniform grid over the candidates' extent. A box is filed in every cell
+// it covers, so two boxes that intersect always share a cell; boxes with
+// no area (or inverted edges) cover none and can neither suppress nor be
+// suppressed, exactly as their IoU of 0 implies.
+class NmsGrid {
+public:
+  NmsGrid(const std::vector<Detection> &boxes) {
+    float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    for (const Detection &d : boxes) {
+      if (!finite(d))
+        continue;
+      x0 = std::min(x0, d.left);
+      y0 = std::min(y0, d.top);
+      x1 = std::max(x1, d.right);
+      y1 = std::max(y1, d.bottom);
+    }
+    side_ = std::max(
+        1, std::min(kMaxGridSide, (int)std::sqrt((double)boxes.size())));
+    if (x1 > x0 && y1 > y0) {
+      x_ = x0;
+      y_ = y0;
+      sx_ = side_ / (x1 - x0);
+      sy_ = side_ / (y1 - y0);
+    }
+    cells_.resize((size_t)side_ * side_);
+  }
+
+  template <typename Fn> bool any_near(const Detection &d, Fn &&fn) const {
+    int cx0, cy0, cx1, cy1;
+    if (!range(d, cx0, cy0, cx1, cy1))
+      return false;
+    for (int cy = cy0; cy <= cy1; cy++) {
+      for (int cx = cx0; cx <= cx1; cx++) {
+        for (int k : cells_[(size_t)cy * side_ + cx]) {
+          if (fn(k))
+            return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void insert(const Detection &d, int index) {
+    int cx0, cy0, cx1, cy1;
+    if (!range(d, cx0, cy0, cx1, cy1))
+      return;
+    for (int cy = cy0; cy <= cy1; cy++)
+      for (int cx = cx0; cx <= cx1; cx++)
+        cells_[(size_t)cy * side_ + cx].push_back(index);
+  }
+
+private:
+  int cell(float v, float origin, float scale) const {
+    float c = (v - origin) * scale;
+    return c <= 0 ? 0 : c >= side_ - 1 ? side_ - 1 : (int)c;
+  }
+
+  bool range(const Detection &d, int &cx0, int &cy0, int &cx1,
+             int &cy1) const {
+    if (!finite(d) || !(d.right > d.left) || !(d.bottom > d.top))
+      return false;
+    cx0 = cell(d.left, x_, sx_);
+    cx1 = cell(d.right, x_, sx_);
+    cy0 = cell(d.top, y_, sy_);
+    cy1 = cell(d.bottom, y_, sy_);
+    return true;
+  }
+
+  int side_ = 1;
+  float x_ = 0, y_ = 0, sx_ = 0, sy_ = 0;
+  std::vector<std::vector<int>> cells_;
+};
+
+// Resize tables for one (frame size, side, mode), plus the two source rows
+// currently interpolated horizontally. Per thread, rebuilt only when the
+// geometry changes.
+struct LetterboxPlan {
+  int width = 0, height = 0, side = 0;
+  bool keep_aspect = false;
+  Letterbox transform;
+  int out_w = 0, out_h = 0;
+  std::vector<int> x0, x1, wx; // per output column
+  std::vector<int> y0, y1, wy; // per output row
+  std::vector<uint16_t> rows[2];
+  int row_of[2] = {-1, -1}; // source row held by rows[k]
+};
+
+// Source index pair and fixed-point weight for output coordinate `o` of a
+// bilinear resize from `src` to `out` samples (half-pixel centres).
+void bilinear_tap(int o, int src, int out, int &i0, int &i1, int &w) {
+  float s = ((float)o + 0.5f) * ((float)src / (float)out) - 0.5f;
+  if (s < 0.0f)
+    s = 0.0f;
+  i0 = std::min((int)s, src - 1);
+  w = (int)std::lround((s - (float)i0) * (1 << kBlendBits));
+  if (w >= (1 << kBlendBits)) {
+    i0 = std::min(i0 + 1, src - 1);
+    w = 0;
+  }
+  i1 = std::min(i0 + 1, src - 1);
+}
+
+void build_plan(LetterboxPlan &p, int width, int height, int side,
+                bool keep_aspect) {
+  p.width = width;
+  p.height = height;
+  p.side = side;
+  p.keep_aspect = keep_aspect;
+  if (keep_aspect) {
+    float s = std::min((float)side / (float)width, (float)side / (float)height);
+    p.out_w = std::min(std::max((int)std::lround(width * s), 1), side);
+    p.out_h = std::min(std::max((int)std::lround(height * s), 1), side);
+  } else {
+    p.out_w = side;
+    p.out_h = side;
+  }
+  p.transform.scale_x = (float)p.out_w / (float)width;
+  p.transform.scale_y = (float)p.out_h / (float)height;
+  p.transform.pad_x = (side - p.out_w) / 2;
+  p.transform.pad_y = (side - p.out_h) / 2;
+
+  p.x0.resize(p.out_w);
+  p.x1.resize(p.out_w);
+  p.wx.resize(p.out_w);
+  for (int x = 0; x < p.out_w; x++)
+    bilinear_tap(x, width, p.out_w, p.x0[x], p.x1[x], p.wx[x]);
+  p.y0.resize(p.out_h);
+  p.y1.resize(p.out_h);
+  p.wy.resize(p.out_h);
+  for (int y = 0; y < p.out_h; y++)
+    bilinear_tap(y, height, p.out_h, p.y0[y], p.y1[y], p.wy[y]);
+  for (int k = 0; k < 2; k++) {
+    p.rows[k].resize((size_t)p.out_w * 3);
+    p.row_of[k] = -1;
+  }
+}
+
+// RGB samples of source row `y` at every output column, in blend units.
+const uint16_t *horizontal_row(LetterboxPlan &p, const uint8_t *rgba,
+                               size_t step, int y) {
+  for (int k = 0; k < 2; k++) {
+    if (p.row_of[k] == y)
+      return p.rows[k].data();
+  }
+  // Replace the row not needed by the current output row pair; consecutive
+  // output rows walk the source downwards, so the older one is stale.
+  const int k = p.row_of[0] < p.row_of[1] ? 0 : 1;
+  const uint8_t *src = rgba + (size_t)y * step;
+  uint16_t *out = p.rows[k].data();
+  const int one = 1 << kBlendBits;
+  for (int x = 0; x < p.out_w; x++) {
+    const uint8_t *a = src + 4 * p.x0[x];
+    const uint8_t *b = src + 4 * p.x1[x];
+    const int w = p.wx[x];
+    for (int c = 0; c < 3; c++)
+      out[3 * x + c] = (uint16_t)(a[c] * (one - w) + b[c] * w);
+  }
+  p.row_of[k] = y;
+  return out;
+}
+
+} // namespace
+
+Letterbox vision_letterbox(const uint8_t *rgba, size_t step, int width,
+                           int height, int side, bool keep_aspect, bool half,
+                           void *dst) {
+  if (!rgba || !dst || width <= 0 || height <= 0 || side <= 0 ||
+      step < (size_t)width * 4)
+    return Letterbox();
+
+  thread_local LetterboxPlan plan;
+  if (plan.width != width || plan.height != height || plan.side != side ||
+      plan.keep_aspect != keep_aspect)
+    build_plan(plan, width, height, side, keep_aspect);
+  plan.row_of[0] = plan.row_of[1] = -1; // new frame, new pixels
+
+  const int one = 1 << kBlendBits;
+  const float scale = 1.0f / (255.0f * one * one);
+  const int row_len = side * 3;
+  float *dst32 = half ? nullptr : static_cast<float *>(dst);
+  uint16_t *dst16 = half ? static_cast<uint16_t *>(dst) : nullptr;
+
+  // Padding goes through the same arithmetic as the pixels.
+  const float pad = (float)(kLetterboxGray * one * one) * scale;
+  const uint16_t pad16 = vision_half_from_float(pad);
+  auto fill = [&](int row, int from, int count) {
+    const size_t at = (size_t)row * row_len + (size_t)from * 3;
+    if (dst32)
+      std::fill(dst32 + at, dst32 + at + (size_t)count * 3, pad);
+    else
+      std::fill(dst16 + at, dst16 + at + (size_t)count * 3, pad16);
+  };
+
+  const Letterbox &t = plan.transform;
+  for (int y = 0; y < side; y++) {
+    const int sy = y - t.pad_y;
+    if (sy < 0 || sy >= plan.out_h) {
+      fill(y, 0, side);
+      continue;
+    }
+    fill(y, 0, t.pad_x);
+    fill(y, t.pad_x + plan.out_w, side - t.pad_x - plan.out_w);
+    const uint16_t *a = horizontal_row(plan, rgba, step, plan.y0[sy]);
+    const uint16_t *b = horizontal_row(plan, rgba, step, plan.y1[sy]);
+    const size_t at = (size_t)y * row_len + (size_t)t.pad_x * 3;
+    vision_blend_rows(a, b, plan.wy[sy], scale, plan.out_w * 3,
+                      dst32 ? dst32 + at : nullptr,
+                      dst16 ? dst16 + at : nullptr);
+  }
+  return t;
+}
+
+void vision_nms(std::vector<Detection> &boxes, float iou_threshold) {
+  if (boxes.size() < 2)
+    return;
+  std::stable_sort(boxes.begin(), boxes.end(),
+                   [](const Detection &a, const Detection &b) {
+                     return a.score > b.score;
+                   });
+  NmsGrid grid(boxes);
+  size_t kept = 0;
+  for (size_t i = 0; i < boxes.size(); i++) {
+    const Detection candidate = boxes[i];
+    bool suppressed = grid.any_near(candidate, [&](int k) {
+      return iou(candidate, boxes[(size_t)k]) > iou_threshold;
+    });
+    if (suppressed)
+      continue;
+    boxes[kept] = candidate;
+    grid.insert(candidate, (int)kept);
+    kept++;
+  }
+  boxes.resize(kept);
+}
+
+std::vector<Detection> vision_decode_yolo(const float *output, int channels,
+                                          int anchors, int image_width,
+                                          int image_height,
+                                          const DetectConfig &config) {
+  std::vector<Detection> out;
+  if (!output || channels <= 4 || anchors <= 0)
+    return out;
+
+  std::vector<float> best((size_t)anchors);
+  std::vector<int32_t> cls((size_t)anchors);
+  vision_argmax_rows(output + 4 * (size_t)anchors, (size_t)anchors,
+                     channels - 4, anchors, best.data(), cls.data());
+
+  const float *cx = output;
+  const float *cy = output + anchors;
+  const float *w = output + 2 * (size_t)anchors;
+  const float *h = output + 3 * (size_t)anchors;
+
+  std::vector<int> picks;
+  bool normalized = true;
+  for (int i = 0; i < anchors; i++) {
+    if (!(best[i] > config.score_threshold))
+      continue;
+    if ((int)picks.size() < kFormatSamples &&
+        !(cx[i] < kNormalizedLimit && cy[i] < kNormalizedLimit))
+      normalized = false;
+    picks.push_back(i);
+  }
+
+  // Head units to image pixels: x * scale - offset.
+  float scale_x, scale_y, offset_x = 0.0f, offset_y = 0.0f;
+  const Letterbox &lb = config.letterbox;
+  if (lb.scale_x > 0.0f && lb.scale_y > 0.0f) {
+    const float unit = normalized ? (float)config.input_size : 1.0f;
+    scale_x = unit / lb.scale_x;
+    scale_y = unit / lb.scale_y;
+    offset_x = (float)lb.pad_x / lb.scale_x;
+    offset_y = (float)lb.pad_y / lb.scale_y;
+  } else {
+    scale_x = normalized ? (float)image_width
+                         : (float)image_width / (float)config.input_size;
+    scale_y = normalized ? (float)image_height
+                         : (float)image_height / (float)config.input_size;
+  }
+
+  // Buckets per class in order of first appearance.
+  std::vector<int> bucket_of;
+  std::vector<std::vector<Detection>> buckets;
+  for (int i : picks) {
+    const int c = cls[i];
+    if (config.classes > 0 && c >= config.classes)
+      continue;
+    if ((int)bucket_of.size() <= c)
+      bucket_of.resize((size_t)c + 1, -1);
+    if (bucket_of[c] < 0) {
+      bucket_of[c] = (int)buckets.size();
+      buckets.emplace_back();
+    }
+    Detection d;
+    d.cls = c;
+    d.score = best[i];
+    d.left = (cx[i] - w[i] / 2) * scale_x - offset_x;
+    d.top = (cy[i] - h[i] / 2) * scale_y - offset_y;
+    d.right = (cx[i] + w[i] / 2) * scale_x - offset_x;
+    d.bottom = (cy[i] + h[i] / 2) * scale_y - offset_y;
+    buckets[bucket_of[c]].push_back(d);
+  }
+
+  for (std::vector<Detection> &bucket : buckets) {
+    vision_nms(bucket, config.iou_threshold);
+    out.insert(out.end(), bucket.begin(), bucket.end());
+  }
+  return out;
+}
@@ -0,0 +1,70 @@
+#ifndef VISION_DETECT_H
+#define VISION_DETECT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Post-processing for YOLO-style detector heads, shared by the app (through
+// JNI) and host tools. Pure C++: the tensor comes in as a float pointer so
+// the caller can hand over a direct buffer without copying.
+//
+// The head is channel-major, [4 + classes][anchors]: channels 0-3 hold the
+// box centre and size (cx, cy, w, h), the rest one score per class.
+
+// Where a frame landed in the model input: input = image * scale + pad.
+// A zero scale means the frame was stretched to the input without a
+// recorded transform.
+struct Letterbox {
+  float scale_x = 0.0f;
+  float scale_y = 0.0f;
+  int pad_x = 0;
+  int pad_y = 0;
+};
+
+struct DetectConfig {
+  float score_threshold = 0.25f; // best class score must exceed this
+  float iou_threshold = 0.45f;   // same-class boxes above this are dropped
+  int input_size = 640;          // model input side, for pixel-space heads
+  int classes = 0; // argmax winners at or above this are dropped; 0 keeps all
+  Letterbox letterbox; // maps boxes back when set by vision_letterbox
+};
+
+struct Detection {
+  int cls;
+  float score;
+  float left, top, right, bottom; // in image pixels
+};
+
+// Fills a `side` x `side` RGB model input (HWC, values / 255) from an
+// RGBA_8888 frame with `step` bytes per row, in one pass over the source
+// rows it samples. With `keep_aspect` the frame is scaled to fit and
+// centred on kLetterboxGray, as YOLO models are trained; otherwise it is
+// stretched. The resize is bilinear with half-pixel centres and 7-bit
+// weights. `dst` receives side * side * 3 floats, or IEEE halves when
+// `half`. Resize tables and row buffers are cached per thread, so repeated
+// frames of one size allocate nothing. Returns the transform for
+// DetectConfig::letterbox, with zero scale on bad arguments.
+constexpr int kLetterboxGray = 114;
+Letterbox vision_letterbox(const uint8_t *rgba, size_t step, int width,
+                           int height, int side, bool keep_aspect, bool half,
+                           void *dst);
+
+// Decodes `output` for an image of `image_width` x `image_height` and runs
+// non-maximum suppression per class. Coordinates are taken as normalised
+// (0-1) when the first 20 candidates all have cx and cy below 3, and as
+// input-size pixels otherwise; with a letterbox they are mapped back
+// through it. Survivors are grouped by class in order of
+// each class's first candidate, highest score first within a class.
+std::vector<Detection> vision_decode_yolo(const float *output, int channels,
+                                          int anchors, int image_width,
+                                          int image_height,
+                                          const DetectConfig &config);
+
+// Greedy NMS over boxes of one class, in place: sorts by descending score
+// (stable) and keeps a box unless it overlaps an already kept one by more
+// than `iou_threshold`. Kept boxes are bucketed in a uniform grid, so each
+// candidate is only compared with kept boxes sharing a cell.
+void vision_nms(std::vector<Detection> &boxes, float iou_threshold);
+
+#endif // VISION_DETECT_H
@@ -0,0 +1,105 @@
+#include "vision_detect.h"
+#include "vision_log.h"
+#include <algorithm>
+#include <android/bitmap.h>
+#include <jni.h>
+
+// JNI glue for DetectionNativeBridge; decoding lives in vision_detect.cpp.
+// Shares libvision_engine (and its JNI_OnLoad) with vision_jni.cpp.
+
+// Packed layout shared with DetectionBuffer.kt: per detection kPackedFloats
+// floats (class, score, left, top, right, bottom). Letterbox transforms
+// travel as four floats (scale_x, scale_y, pad_x, pad_y).
+constexpr int kPackedFloats = 6;
+
+extern "C" {
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_DetectionNativeBridge_nativeLetterbox(
+    JNIEnv *env, jobject, jobject bitmap, jint side, jboolean keep_aspect,
+    jboolean half, jobject dst, jfloatArray transform) {
+  void *out = env->GetDirectBufferAddress(dst);
+  const jlong need = (jlong)side * side * 3 * (half ? 2 : 4);
+  if (!out || side <= 0 || env->GetDirectBufferCapacity(dst) < need ||
+      !transform || env->GetArrayLength(transform) < 4) {
+    LOGE("letterbox: need a direct buffer of %lld bytes", (long long)need);
+    return JNI_FALSE;
+  }
+
+  AndroidBitmapInfo info;
+  void *pixels = nullptr;
+  if (AndroidBitmap_getInfo(env, bitmap, &info) < 0 ||
+      info.format != ANDROID_BITMAP_FORMAT_RGBA_8888)
+    return JNI_FALSE;
+  if (AndroidBitmap_lockPixels(env, bitmap, &pixels) < 0 || !pixels)
+    return JNI_FALSE;
+  // Read straight from the locked pixels; nothing is copied.
+  Letterbox t = vision_letterbox(static_cast<const uint8_t *>(pixels),
+                                 info.stride, (int)info.width,
+                                 (int)info.height, (int)side, keep_aspect,
+                                 half, out);
+  AndroidBitmap_unlockPixels(env, bitmap);
+  if (t.scale_x <= 0.0f)
+    return JNI_FALSE;
+
+  const jfloat packed[4] = {t.scale_x, t.scale_y, (jfloat)t.pad_x,
+                            (jfloat)t.pad_y};
+  env->SetFloatArrayRegion(transform, 0, 4, packed);
+  return JNI_TRUE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_DetectionNativeBridge_nativeDecodeYolo(
+    JNIEnv *env, jobject, jobject output, jint channels, jint anchors,
+    jint image_width, jint image_height, jint input_size,
+    jfloat score_threshold, jfloat iou_threshold, jint classes,
+    jfloatArray transform, jfloatArray out) {
+  const float *data =
+      static_cast<const float *>(env->GetDirectBufferAddress(output));
+  jlong capacity = env->GetDirectBufferCapacity(output); // in floats
+  if (!data || !out || channels <= 4 || anchors <= 0 ||
+      capacity < (jlong)channels * anchors) {
+    LOGE("decodeYolo: need a direct FloatBuffer of %d x %d floats", channels,
+         anchors);
+    return -1;
+  }
+
+  DetectConfig config;
+  config.score_threshold = score_threshold;
+  config.iou_threshold = iou_threshold;
+  config.input_size = std::max((int)input_size, 1);
+  config.classes = (int)classes;
+  if (transform && env->GetArrayLength(transform) >= 4) {
+    jfloat t[4];
+    env->GetFloatArrayRegion(transform, 0, 4, t);
+    config.letterbox.scale_x = t[0];
+    config.letterbox.scale_y = t[1];
+    config.letterbox.pad_x = (int)t[2];
+    config.letterbox.pad_y = (int)t[3];
+  }
+  std::vector<Detection> detections =
+      vision_decode_yolo(data, (int)channels, (int)anchors, (int)image_width,
+                         (int)image_height, config);
+
+  // As many as fit; the total tells the caller whether to grow and retry.
+  size_t n = std::min(detections.size(), (size_t)env->GetArrayLength(out) /
+                                             kPackedFloats);
+  if (n > 0) {
+    auto *fp = static_cast<jfloat *>(env->GetPrimitiveArrayCritical(out, 0));
+    if (!fp)
+      return -1;
+    for (size_t i = 0; i < n; ++i) {
+      const Detection &d = detections[i];
+      jfloat *rec = fp + i * kPackedFloats;
+      rec[0] = (jfloat)d.cls;
+      rec[1] = d.score;
+      rec[2] = d.left;
+      rec[3] = d.top;
+      rec[4] = d.right;
+      rec[5] = d.bottom;
+    }
+    env->ReleasePrimitiveArrayCritical(out, fp, 0);
+  }
+  return (jint)detections.size();
+}
+}
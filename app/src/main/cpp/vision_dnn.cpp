@@ -0,0 +1,124 @@
+#include "vision_dnn.h"
+#include "vision_log.h"
+
+#include <algorithm>
+
+VisionDetector::VisionDetector(const std::string &path,
+                               const DetectorConfig &config)
+    : config_(config) {
+  try {
+    net_ = cv::dnn::readNetFromONNX(path);
+  } catch (const cv::Exception &e) {
+    LOGE("VisionDetector: cannot load %s: %s", path.c_str(), e.what());
+  }
+  configure();
+}
+
+VisionDetector::VisionDetector(const uint8_t *model, size_t size,
+                               const DetectorConfig &config)
+    : config_(config) {
+  try {
+    if (model && size > 0)
+      net_ = cv::dnn::readNetFromONNX(reinterpret_cast<const char *>(model),
+                                      size);
+  } catch (const cv::Exception &e) {
+    LOGE("VisionDetector: cannot load a %zu-byte model: %s", size, e.what());
+  }
+  configure();
+}
+
+void VisionDetector::configure() {
+  if (net_.empty() || config_.input_size <= 0)
+    return;
+  // Plain CPU kernels: the same code path on a phone and on a CI host.
+  net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+  net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+  std::vector<cv::String> types;
+  net_.getLayerTypes(types);
+  quantized_ = std::any_of(types.begin(), types.end(),
+                           [](const cv::String &type) {
+                             return type.find("Int8") != cv::String::npos ||
+                                    type == "Quantize";
+                           });
+  loaded_ = true;
+  LOGD("VisionDetector: %zu layer types, input %d, %s", types.size(),
+       config_.input_size, quantized_ ? "int8" : "float");
+}
+
+bool VisionDetector::prepare(const uint8_t *rgba, size_t step, int width,
+                             int height, DetectorInput &input) const {
+  const int side = config_.input_size;
+  if (!rgba || width <= 0 || height <= 0 || side <= 0)
+    return false;
+  input.hwc.create(side, side, CV_32FC3);
+  const int shape[] = {1, 3, side, side};
+  input.blob.create(4, shape, CV_32F);
+
+  const Letterbox t = vision_letterbox(rgba, step, width, height, side,
+                                       config_.keep_aspect, false,
+                                       input.hwc.data);
+  if (t.scale_x <= 0.0f)
+    return false;
+
+  // Interleaved to planar in one pass, straight into the blob.
+  cv::Mat planes[3];
+  for (int c = 0; c < 3; c++)
+    planes[c] = cv::Mat(side, side, CV_32F, input.blob.ptr<float>(0, c));
+  cv::split(input.hwc, planes);
+
+  input.letterbox = t;
+  input.image_width = width;
+  input.image_height = height;
+  return true;
+}
+
+bool VisionDetector::run(const DetectorInput &input,
+                         std::vector<Detection> &out) {
+  out.clear();
+  if (!loaded_ || input.image_width <= 0)
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  cv::Mat output;
+  try {
+    net_.setInput(input.blob);
+    output = net_.forward();
+  } catch (const cv::Exception &e) {
+    LOGE("VisionDetector: forward failed: %s", e.what());
+    return false;
+  }
+  if (output.dims != 3 || output.size[0] != 1 || output.type() != CV_32F) {
+    LOGE("VisionDetector: unexpected output (dims=%d)", output.dims);
+    return false;
+  }
+
+  // The decoder reads [4 + classes][anchors]; some exports emit the
+  // transpose, which always has more rows than columns.
+  int channels = output.size[1];
+  int anchors = output.size[2];
+  const float *head = output.ptr<float>();
+  if (channels > anchors) {
+    cv::transpose(cv::Mat(channels, anchors, CV_32F, output.ptr<float>()),
+                  head_);
+    std::swap(channels, anchors);
+    head = head_.ptr<float>();
+  }
+
+  DetectConfig decode = config_.decode;
+  decode.input_size = config_.input_size;
+  decode.letterbox = input.letterbox;
+  out = vision_decode_yolo(head, channels, anchors, input.image_width,
+                           input.image_height, decode);
+  return true;
+}
+
+bool VisionDetector::detect(const uint8_t *rgba, size_t step, int width,
+                            int height, std::vector<Detection> &out) {
+  thread_local DetectorInput input;
+  if (!prepare(rgba, step, width, height, input)) {
+    out.clear();
+    return false;
+  }
+  return run(input, out);
+}
@@ -0,0 +1,81 @@
+#ifndef VISION_DNN_H
+#define VISION_DNN_H
+
+#include "vision_detect.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// UI-element detector running the YOLO-style model in ONNX form through
+// OpenCV's DNN module on the CPU, shared by the app (through JNI) and host
+// benchmarks. Models quantised to int8 (QuantizeLinear / DequantizeLinear
+// or QLinear operators) load the same way and run on OpenCV's int8
+// kernels, the faster choice on devices without a GPU delegate.
+//
+// A frame takes two steps: prepare() letterboxes RGBA pixels into an input
+// blob, and run() does the forward pass and decodes the head with
+// vision_decode_yolo. Keeping them apart lets VisionMatcher::submit_frame
+// prepare the input while it still holds the caller's pixels, so one
+// submitted frame feeds both matching and detection.
+
+struct DetectorConfig {
+  int input_size = 640;    // model input side
+  bool keep_aspect = true; // letterbox on kLetterboxGray instead of stretch
+  DetectConfig decode;     // thresholds and classes; letterbox set per frame
+};
+
+// One frame's model input. Reused across frames: preparing a frame into an
+// input that already has the right size allocates nothing.
+struct DetectorInput {
+  cv::Mat hwc;  // side x side CV_32FC3, as vision_letterbox writes it
+  cv::Mat blob; // 1 x 3 x side x side CV_32F, as the network reads it
+  Letterbox letterbox;
+  int image_width = 0; // 0 until prepared
+  int image_height = 0;
+};
+
+class VisionDetector {
+public:
+  // Loads an ONNX model from `path`, or from `size` bytes at `model`. On
+  // failure the error is logged and loaded() is false.
+  VisionDetector(const std::string &path, const DetectorConfig &config);
+  VisionDetector(const uint8_t *model, size_t size,
+                 const DetectorConfig &config);
+
+  VisionDetector(const VisionDetector &) = delete;
+  VisionDetector &operator=(const VisionDetector &) = delete;
+
+  bool loaded() const { return loaded_; }
+  // True when the model carries int8 layers.
+  bool quantized() const { return quantized_; }
+  const DetectorConfig &config() const { return config_; }
+
+  // Letterboxes an RGBA_8888 frame with `step` bytes per row into `input`.
+  // Touches no model state, so any thread may prepare at any time.
+  bool prepare(const uint8_t *rgba, size_t step, int width, int height,
+               DetectorInput &input) const;
+
+  // Forward pass and decode of a prepared input into `out`, boxes in frame
+  // pixels. Runs are serialised on the model.
+  bool run(const DetectorInput &input, std::vector<Detection> &out);
+
+  // prepare() into a per-thread input, then run().
+  bool detect(const uint8_t *rgba, size_t step, int width, int height,
+              std::vector<Detection> &out);
+
+private:
+  void configure();
+
+  DetectorConfig config_;
+  std::mutex mutex_; // Protects net_ and head_
+  cv::dnn::Net net_;
+  cv::Mat head_; // [channels][anchors] when the model emits it transposed
+  bool loaded_ = false;
+  bool quantized_ = false;
+};
+
+#endif // VISION_DNN_H
@@ -0,0 +1,200 @@
+#include "vision_dnn.h"
+#include "vision_engine.h"
+#include "vision_log.h"
+#include <algorithm>
+#include <android/bitmap.h>
+#include <jni.h>
+
+// JNI glue for NativeDetector, and the detector hooks of VisionMatcher and
+// VisionNativeBridge; the detector lives in vision_dnn.cpp. Shares
+// libvision_engine (and its JNI_OnLoad) with vision_jni.cpp.
+
+// Detections leave in the DetectionBuffer.kt layout: kPackedFloats floats
+// each (class, score, left, top, right, bottom).
+constexpr int kPackedFloats = 6;
+
+namespace {
+
+// NativeDetector handles own a reference, so a matcher the detector is
+// attached to keeps it alive after the Kotlin object is closed.
+struct DetectorHandle {
+  std::shared_ptr<VisionDetector> detector;
+};
+
+DetectorHandle *from_handle(jlong handle) {
+  return reinterpret_cast<DetectorHandle *>(handle);
+}
+
+VisionMatcher *matcher_from_handle(jlong handle) {
+  return reinterpret_cast<VisionMatcher *>(handle);
+}
+
+// NativeFrame handles are a heap-allocated FrameRef each; see
+// vision_frames_jni.cpp.
+const FrameRef &frame_from_handle(jlong frame) {
+  return *reinterpret_cast<FrameRef *>(frame);
+}
+
+// The calling thread's last detections. A buffer too small for them is
+// grown and refilled from here through nativeLastDetections, so the model
+// does not run twice.
+std::vector<Detection> &last_detections() {
+  thread_local std::vector<Detection> detections;
+  return detections;
+}
+
+jint pack_detections(JNIEnv *env, const std::vector<Detection> &detections,
+                     jfloatArray out) {
+  if (!out)
+    return -1;
+  size_t n = std::min(detections.size(), (size_t)env->GetArrayLength(out) /
+                                             kPackedFloats);
+  if (n > 0) {
+    auto *fp = static_cast<jfloat *>(env->GetPrimitiveArrayCritical(out, 0));
+    if (!fp)
+      return -1;
+    for (size_t i = 0; i < n; ++i) {
+      const Detection &d = detections[i];
+      jfloat *rec = fp + i * kPackedFloats;
+      rec[0] = (jfloat)d.cls;
+      rec[1] = d.score;
+      rec[2] = d.left;
+      rec[3] = d.top;
+      rec[4] = d.right;
+      rec[5] = d.bottom;
+    }
+    env->ReleasePrimitiveArrayCritical(out, fp, 0);
+  }
+  return (jint)detections.size();
+}
+
+// Prepares the input straight from the locked pixels, which are released
+// before the forward pass.
+bool detect_bitmap(JNIEnv *env, VisionDetector &detector, jobject bitmap,
+                   std::vector<Detection> &out) {
+  thread_local DetectorInput input;
+  AndroidBitmapInfo info;
+  void *pixels = nullptr;
+  if (AndroidBitmap_getInfo(env, bitmap, &info) < 0 ||
+      info.format != ANDROID_BITMAP_FORMAT_RGBA_8888)
+    return false;
+  if (AndroidBitmap_lockPixels(env, bitmap, &pixels) < 0 || !pixels)
+    return false;
+  const bool prepared =
+      detector.prepare(static_cast<const uint8_t *>(pixels), info.stride,
+                       (int)info.width, (int)info.height, input);
+  AndroidBitmap_unlockPixels(env, bitmap);
+  return prepared && detector.run(input, out);
+}
+
+jint detect_latest(JNIEnv *env, VisionMatcher &matcher, jfloatArray out) {
+  std::vector<Detection> &detections = last_detections();
+  if (!matcher.detect_latest(detections))
+    return -1;
+  const uint64_t t0 = vision_now_ns();
+  const jint count = pack_detections(env, detections, out);
+  matcher.record_stage(VisionStage::Marshal, vision_now_ns() - t0);
+  return count;
+}
+
+} // namespace
+
+extern "C" {
+
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeDetector_nativeCreate(
+    JNIEnv *env, jobject, jbyteArray model, jint input_size,
+    jboolean keep_aspect, jfloat score_threshold, jfloat iou_threshold,
+    jint classes) {
+  if (!model || input_size <= 0)
+    return 0;
+  DetectorConfig config;
+  config.input_size = (int)input_size;
+  config.keep_aspect = keep_aspect;
+  config.decode.score_threshold = score_threshold;
+  config.decode.iou_threshold = iou_threshold;
+  config.decode.classes = (int)classes;
+
+  // The parser copies what it needs, so the Java bytes are only borrowed.
+  const jsize size = env->GetArrayLength(model);
+  jbyte *bytes = env->GetByteArrayElements(model, nullptr);
+  if (!bytes)
+    return 0;
+  auto detector = std::make_shared<VisionDetector>(
+      reinterpret_cast<const uint8_t *>(bytes), (size_t)size, config);
+  env->ReleaseByteArrayElements(model, bytes, JNI_ABORT);
+  if (!detector->loaded())
+    return 0;
+  return reinterpret_cast<jlong>(new DetectorHandle{std::move(detector)});
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeDetector_nativeDestroy(
+    JNIEnv *, jobject, jlong handle) {
+  delete from_handle(handle);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeDetector_nativeQuantized(
+    JNIEnv *, jobject, jlong handle) {
+  return from_handle(handle)->detector->quantized();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeDetector_nativeDetect(
+    JNIEnv *env, jobject, jlong handle, jobject bitmap, jfloatArray out) {
+  std::vector<Detection> &detections = last_detections();
+  if (!detect_bitmap(env, *from_handle(handle)->detector, bitmap,
+                     detections)) {
+    LOGE("NativeDetector: detection failed (bitmap must be ARGB_8888)");
+    return -1;
+  }
+  return pack_detections(env, detections, out);
+}
+
+// Detects on a pooled frame in place.
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeDetector_nativeDetectFrame(
+    JNIEnv *env, jobject, jlong handle, jlong frame, jfloatArray out) {
+  const cv::Mat &rgba = frame_from_handle(frame)->rgba;
+  std::vector<Detection> &detections = last_detections();
+  if (!from_handle(handle)->detector->detect(rgba.data, rgba.step, rgba.cols,
+                                             rgba.rows, detections))
+    return -1;
+  return pack_detections(env, detections, out);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_DetectionNativeBridge_nativeLastDetections(
+    JNIEnv *env, jobject, jfloatArray out) {
+  return pack_detections(env, last_detections(), out);
+}
+
+// ── Detector hooks of the matchers ────────────────────────────────────
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeSetDetector(
+    JNIEnv *, jobject, jlong detector) {
+  vision_default_matcher().set_detector(
+      detector ? from_handle(detector)->detector : nullptr);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeDetectLatest(
+    JNIEnv *env, jobject, jfloatArray out) {
+  return detect_latest(env, vision_default_matcher(), out);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeSetDetector(
+    JNIEnv *, jobject, jlong handle, jlong detector) {
+  matcher_from_handle(handle)->set_detector(
+      detector ? from_handle(detector)->detector : nullptr);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeDetectLatest(
+    JNIEnv *env, jobject, jlong handle, jfloatArray out) {
+  return detect_latest(env, *matcher_from_handle(handle), out);
+}
+}
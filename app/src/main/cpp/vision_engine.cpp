@@ -1,25 +1,72 @@
 #include "vision_engine.h"
-#include <android/bitmap.h>
-#include <android/log.h>
+#include "vision_features.h"
+#include "vision_log.h"
+#include "vision_pack.h"
+#include "vision_pool.h"
+#include "vision_record.h"
+#include "vision_scratch.h"
+#include "vision_simd.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <mutex>
 
-#define LOG_TAG "VisionEngineNative"
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+// One scale of a registered template, prepared once at registration so the
+// per-frame path only correlates. mean/norm are the template half of
+// TM_CCOEFF_NORMED: mean(T) and ||T - mean(T)||.
+struct TemplateVariant {
+  cv::Mat gray; // empty when the scale degenerates to zero size
+  double mean = 0.0;
+  double norm = 0.0;
+};
 
-// Global state — store grayscale templates
-std::map<int, cv::Mat> g_templates;
-std::mutex g_mutex; // Protects g_templates from concurrent access
+// A registered template: grayscale pixels, every kMatchScales variant, their
+// downscaled copies for the pyramid search (keyed by factor, only for factors
+// the template survives), and an optional search prior — the rectangle it
+// was cut from when the preset was recorded. Templates registered from a
+// pack point into its mapping, which `pack` keeps alive. Templates with
+// `features` are found by keypoint matching instead (see vision_features.h).
+struct TemplateEntry {
+  cv::Mat gray;
+  std::vector<TemplateVariant> variants; // indexed like kMatchScales
+  std::map<int, std::vector<TemplateVariant>> coarse;
+  bool has_prior = false;
+  cv::Rect prior;
+  int prior_margin = 0;
+  std::shared_ptr<const TemplatePack> pack;
+  std::shared_ptr<const FeatureSet> features;
+};
 
-void vision_init() {
-  std::lock_guard<std::mutex> lock(g_mutex);
-  g_templates.clear();
-  LOGD("Vision Engine Initialized (Template Matching)");
-}
+// A grayscale frame plus, when the pyramid search will want it, its 4x box
+// reduction produced in the same pass over the RGBA source. Frames taken
+// from a FramePool keep their buffer referenced, so it is not refilled
+// under a match.
+struct GrayFrame {
+  cv::Mat gray;
+  cv::Mat quarter;
+  FrameRef source; // null unless the Mats point into a pooled frame
+};
 
-void vision_add_template(int id, const cv::Mat &templ) {
-  if (templ.empty())
-    return;
+// ── Template preparation ──────────────────────────────────────────────
+
+namespace {
+
+// Coarse templates smaller than this (in either dimension) carry too little
+// structure to rank candidates, so such templates use a smaller factor.
+constexpr int kMinCoarseSide = 6;
+
+// Pyramid factors prepared at registration; vision_set_config picks 4 or 8
+// and small templates step down to 2.
+constexpr int kCoarseFactors[] = {2, 4, 8};
+
+cv::Mat to_gray(const cv::Mat &templ) {
   cv::Mat gray;
   if (templ.channels() == 4) {
     cv::cvtColor(templ, gray, cv::COLOR_RGBA2GRAY);
@@ -28,215 +75,2025 @@ void vision_add_template(int id, const cv::Mat &templ) {
   } else {
     gray = templ.clone();
   }
-  std::lock_guard<std::mutex> lock(g_mutex);
-  g_templates[id] = gray;
-  LOGD("Added template ID=%d: %dx%d", id, gray.cols, gray.rows);
+  return gray;
 }
 
-void vision_clear_templates() {
-  std::lock_guard<std::mutex> lock(g_mutex);
-  g_templates.clear();
-  LOGD("Cleared all templates");
+TemplateVariant make_variant(const cv::Mat &gray) {
+  TemplateVariant v;
+  if (gray.empty())
+    return v;
+  v.gray = gray;
+  cv::Scalar mean, stddev;
+  cv::meanStdDev(gray, mean, stddev);
+  v.mean = mean[0];
+  v.norm = stddev[0] * std::sqrt((double)gray.total());
+  return v;
 }
 
-// Template matching: pixel correlation, perfect for UI elements
-static bool match_one(const cv::Mat &screen_gray, const cv::Mat &templ_gray,
-                      cv::Rect &out_rect, float &out_score, int id) {
+TemplateEntry make_entry(const cv::Mat &templ) {
+  TemplateEntry entry;
+  entry.gray = to_gray(templ);
+  entry.variants.resize(kNumMatchScales);
+  for (int s = 0; s < kNumMatchScales; s++) {
+    float scale = kMatchScales[s];
+    int w = (int)(entry.gray.cols * scale);
+    int h = (int)(entry.gray.rows * scale);
+    if (w <= 0 || h <= 0)
+      continue;
+    cv::Mat scaled;
+    if (scale == 1.0f)
+      scaled = entry.gray;
+    else
+      cv::resize(entry.gray, scaled, cv::Size(w, h));
+    entry.variants[s] = make_variant(scaled);
+  }
 
-  if (screen_gray.empty() || templ_gray.empty())
-    return false;
+  const float smallest_scale =
+      *std::min_element(std::begin(kMatchScales), std::end(kMatchScales));
+  int min_side = std::min(entry.gray.cols, entry.gray.rows);
+  for (int factor : kCoarseFactors) {
+    if (min_side * smallest_scale / factor < kMinCoarseSide)
+      continue;
+    std::vector<TemplateVariant> &level = entry.coarse[factor];
+    level.resize(kNumMatchScales);
+    for (int s = 0; s < kNumMatchScales; s++) {
+      const cv::Mat &full = entry.variants[s].gray;
+      if (full.empty())
+        continue;
+      cv::Mat small;
+      cv::resize(full, small,
+                 cv::Size(std::max(full.cols / factor, 1),
+                          std::max(full.rows / factor, 1)),
+                 0, 0, cv::INTER_AREA);
+      level[s] = make_variant(small);
+    }
+  }
+  return entry;
+}
 
-  // Template must be smaller than screen
-  if (templ_gray.cols > screen_gray.cols ||
-      templ_gray.rows > screen_gray.rows) {
-    LOGD("ID=%d: template (%dx%d) larger than screen (%dx%d), skip", id,
-         templ_gray.cols, templ_gray.rows, screen_gray.cols, screen_gray.rows);
+} // namespace
+
+// ── Template packs ────────────────────────────────────────────────────
+
+namespace {
+
+// Index of the 1.0 scale, whose variant is the template itself.
+constexpr int kUnitScale = 0;
+static_assert(kMatchScales[kUnitScale] == 1.0f, "kMatchScales[0] is 1.0");
+
+// Fingerprint of everything make_entry's output depends on besides the
+// source pixels. A pack built under different tables is rejected and
+// recompiled; bump the seed when the preprocessing itself changes.
+uint64_t engine_tag() {
+  uint64_t h = 1469598103934665603ull; // FNV-1a
+  auto mix = [&h](const void *data, size_t n) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < n; i++)
+      h = (h ^ p[i]) * 1099511628211ull;
+  };
+  const int seed = 1;
+  mix(&seed, sizeof(seed));
+  mix(kMatchScales, sizeof(kMatchScales));
+  mix(kCoarseFactors, sizeof(kCoarseFactors));
+  mix(&kMinCoarseSide, sizeof(kMinCoarseSide));
+  return h;
+}
+
+// Maps `path` if it is a pack built from `checksum` by this engine.
+std::shared_ptr<const TemplatePack> open_current_pack(const std::string &path,
+                                                      uint64_t checksum) {
+  std::shared_ptr<const TemplatePack> pack = TemplatePack::open(path);
+  if (!pack)
+    return nullptr;
+  if (pack->header().checksum != checksum) {
+    LOGD("TemplatePack: %s is stale (sources changed)", path.c_str());
+    return nullptr;
+  }
+  if (pack->header().engine_tag != engine_tag()) {
+    LOGD("TemplatePack: %s was built for other match tables", path.c_str());
+    return nullptr;
+  }
+  return pack;
+}
+
+// Wraps one packed template's mapped images; false when an image does not
+// fit this engine's tables.
+bool entry_from_pack(const std::shared_ptr<const TemplatePack> &pack,
+                     const PackTemplate &pt, TemplateEntry &entry) {
+  entry.variants.assign(kNumMatchScales, TemplateVariant());
+  for (uint32_t i = 0; i < pt.image_count; i++) {
+    const PackImage &img = pack->images()[pt.first_image + i];
+    if (img.scale_index < 0 || img.scale_index >= kNumMatchScales)
+      return false;
+    TemplateVariant v;
+    v.gray = pack->view(img);
+    v.mean = img.mean;
+    v.norm = img.norm;
+    if (img.factor == 1) {
+      entry.variants[img.scale_index] = v;
+    } else {
+      std::vector<TemplateVariant> &level = entry.coarse[img.factor];
+      level.resize(kNumMatchScales);
+      level[img.scale_index] = v;
+    }
+  }
+  entry.gray = entry.variants[kUnitScale].gray;
+  if (entry.gray.empty())
     return false;
+  entry.has_prior = pt.prior_width > 0 && pt.prior_height > 0;
+  entry.prior =
+      cv::Rect(pt.prior_x, pt.prior_y, pt.prior_width, pt.prior_height);
+  entry.prior_margin = pt.prior_margin;
+  entry.pack = pack;
+  return true;
+}
+
+} // namespace
+
+bool vision_compile_pack(const std::string &path,
+                         const std::vector<PackSource> &sources,
+                         uint64_t checksum) {
+  TemplatePackWriter writer;
+  for (const PackSource &src : sources) {
+    if (src.templ.empty()) {
+      LOGE("vision_compile_pack: template ID=%d is empty", src.id);
+      return false;
+    }
+    TemplateEntry entry = make_entry(src.templ);
+    writer.add_template(src.id, src.prior, src.margin);
+    for (int s = 0; s < kNumMatchScales; s++) {
+      const TemplateVariant &v = entry.variants[s];
+      writer.add_image(1, s, v.gray, v.mean, v.norm);
+    }
+    for (const auto &level : entry.coarse) {
+      for (int s = 0; s < kNumMatchScales; s++) {
+        const TemplateVariant &v = level.second[s];
+        writer.add_image(level.first, s, v.gray, v.mean, v.norm);
+      }
+    }
   }
+  return writer.write(path, checksum, engine_tag());
+}
 
-  float best_score = -1.0f;
-  cv::Point best_loc;
-  float best_scale = 1.0f;
+bool vision_pack_current(const std::string &path, uint64_t checksum) {
+  return open_current_pack(path, checksum) != nullptr;
+}
 
-  // Multi-scale: handles slight DPI differences
-  float scales[] = {1.0f, 0.95f, 1.05f, 0.9f, 1.1f, 0.85f, 1.15f};
-  int num_scales = 7;
+// ── Matching ──────────────────────────────────────────────────────────
 
-  for (int s = 0; s < num_scales; s++) {
-    float scale = scales[s];
+namespace {
 
-    cv::Mat scaled_templ;
-    if (scale == 1.0f) {
-      scaled_templ = templ_gray;
-    } else {
-      int new_w = (int)(templ_gray.cols * scale);
-      int new_h = (int)(templ_gray.rows * scale);
-      if (new_w <= 0 || new_h <= 0 || new_w > screen_gray.cols ||
-          new_h > screen_gray.rows)
-        continue;
-      cv::resize(templ_gray, scaled_templ, cv::Size(new_w, new_h));
+struct ScaleHit {
+  float score = -1.0f;
+  cv::Point loc;
+  float scale = 1.0f;
+};
+
+// A correlation peak kept for multi-instance matching, as the rectangle the
+// template variant covers there.
+struct Peak {
+  float score;
+  cv::Rect rect;
+};
+
+// Most peaks one correlation map contributes to a multi-instance search.
+constexpr size_t kMaxMapPeaks = 256;
+// Further instances may cover at most this fraction of the smaller of their
+// box and an accepted one's.
+constexpr float kInstanceOverlap = 0.1f;
+
+// Strongest first; ties in reading order, so the pick is deterministic.
+bool peak_before(const Peak &a, const Peak &b) {
+  if (a.score != b.score)
+    return a.score > b.score;
+  if (a.rect.y != b.rect.y)
+    return a.rect.y < b.rect.y;
+  if (a.rect.x != b.rect.x)
+    return a.rect.x < b.rect.x;
+  return a.rect.width < b.rect.width;
+}
+
+// Scratch slots (see vision_scratch.h). The per-template ones live in the
+// arena of whichever thread runs the template; the pyramid ones, indexed by
+// log2 of the factor, in the arena of the thread that called match.
+constexpr int kScratchResult = 0;      // correlation map
+constexpr int kScratchWindowSum = 1;   // integrals of a small window
+constexpr int kScratchWindowSqsum = 2;
+constexpr int kScratchLevel = 3;       // downscaled levels 2, 4, 8
+constexpr int kScratchSum = 7;         // level integrals 1, 2, 4, 8
+constexpr int kScratchSqsum = 11;
+static_assert(kScratchSqsum + 4 <= ScratchArena::kSlots,
+              "every pyramid factor needs its own scratch slots");
+
+int factor_slot(int base, int factor) {
+  CV_Assert(factor >= 1 && factor <= 8 && (factor & (factor - 1)) == 0);
+  return base + __builtin_ctz((unsigned)factor);
+}
+
+// Integral images of (part of) one pyramid level. `origin` is where the
+// integrated region starts in level coordinates.
+struct FrameStats {
+  cv::Mat sum;   // CV_32S, exact for frames up to ~8.4 MP
+  cv::Mat sqsum; // CV_64F
+  cv::Point origin;
+};
+
+// Grayscale frame plus lazily built downscaled copies and integral images,
+// shared by every template matched against the same frame. Level 1 is the
+// full-resolution frame. Safe to use from several pool threads: creation is
+// serialised and built levels never move, as each factor has its own fixed
+// entry. Built levels and integrals are views into `scratch`, the calling
+// thread's arena, so the pyramid must not outlive the match.
+class FramePyramid {
+public:
+  FramePyramid(const GrayFrame &frame, ScratchArena &scratch)
+      : scratch_(scratch) {
+    levels_[index(1)] = frame.gray;
+    if (!frame.quarter.empty())
+      levels_[index(4)] = frame.quarter;
+  }
+
+  const cv::Mat &full() const { return levels_[index(1)]; }
+
+  const cv::Mat &level(int factor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return level_locked(factor);
+  }
+
+  bool has_stats(int factor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !stats_[index(factor)].sum.empty();
+  }
+
+  const FrameStats &stats(int factor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FrameStats &st = stats_[index(factor)];
+    if (!st.sum.empty())
+      return st;
+    const cv::Mat &lvl = level_locked(factor);
+    st.sum = scratch_.view(factor_slot(kScratchSum, factor), lvl.rows + 1,
+                           lvl.cols + 1, CV_32S);
+    st.sqsum = scratch_.view(factor_slot(kScratchSqsum, factor),
+                             lvl.rows + 1, lvl.cols + 1, CV_64F);
+    cv::integral(lvl, st.sum, st.sqsum, CV_32S, CV_64F);
+    return st;
+  }
+
+  // Time spent building levels with cv::resize so far.
+  uint64_t resize_ns() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resize_ns_;
+  }
+
+private:
+  // Factors 1, 2, 4 and 8 as 0..3.
+  static size_t index(int factor) { return (size_t)factor_slot(0, factor); }
+
+  const cv::Mat &level_locked(int factor) {
+    cv::Mat &lvl = levels_[index(factor)];
+    if (lvl.empty()) {
+      const uint64_t t0 = vision_now_ns();
+      const cv::Mat &gray = levels_[index(1)];
+      lvl = scratch_.view(factor_slot(kScratchLevel, factor),
+                          gray.rows / factor, gray.cols / factor, CV_8U);
+      cv::resize(gray, lvl, lvl.size(), 0, 0, cv::INTER_AREA);
+      resize_ns_ += vision_now_ns() - t0;
     }
+    return lvl;
+  }
 
-    cv::Mat result;
-    cv::matchTemplate(screen_gray, scaled_templ, result, cv::TM_CCOEFF_NORMED);
+  ScratchArena &scratch_;
+  std::mutex mutex_;
+  std::array<cv::Mat, 4> levels_;
+  std::array<FrameStats, 4> stats_;
+  uint64_t resize_ns_ = 0;
+};
 
-    double minVal, maxVal;
-    cv::Point minLoc, maxLoc;
-    cv::minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc);
+// Turns a raw TM_CCORR map (sum of I*T) into TM_CCOEFF_NORMED using the
+// template's precomputed mean/norm and the frame's integral images.
+// `offset` is the integral-image position of corr(0, 0). Edge handling
+// follows OpenCV's matchTemplate so scores are interchangeable.
+void normalize_ccoeff(cv::Mat &corr, const TemplateVariant &templ,
+                      const FrameStats &stats, const cv::Point &offset) {
+  const int tw = templ.gray.cols;
+  const int th = templ.gray.rows;
+  const double inv_area = 1.0 / ((double)tw * th);
 
-    if ((float)maxVal > best_score) {
-      best_score = (float)maxVal;
-      best_loc = maxLoc;
-      best_scale = scale;
+  for (int y = 0; y < corr.rows; y++) {
+    float *row = corr.ptr<float>(y);
+    const int *s0 = stats.sum.ptr<int>(offset.y + y) + offset.x;
+    const int *s1 = stats.sum.ptr<int>(offset.y + y + th) + offset.x;
+    const double *q0 = stats.sqsum.ptr<double>(offset.y + y) + offset.x;
+    const double *q1 = stats.sqsum.ptr<double>(offset.y + y + th) + offset.x;
+    for (int x = 0; x < corr.cols; x++) {
+      double wsum = (double)(s1[x + tw] - s1[x] - s0[x + tw] + s0[x]);
+      double wsq = q1[x + tw] - q1[x] - q0[x + tw] + q0[x];
+      double num = row[x] - wsum * templ.mean;
+      double t = std::sqrt(std::max(wsq - wsum * wsum * inv_area, 0.0)) *
+                 templ.norm;
+      if (std::abs(num) < t)
+        num /= t;
+      else if (std::abs(num) < t * 1.125)
+        num = num > 0 ? 1 : -1;
+      else
+        num = 0;
+      row[x] = (float)num;
     }
+  }
+}
+
+// TM_CCOEFF_NORMED of `templ` over `roi` of pyramid level `factor`. The
+// correlation itself is a plain TM_CCORR; everything OpenCV would otherwise
+// recompute per call (template statistics, frame integrals) is reused.
+// Small ROIs integrate locally unless the level's integral already exists.
+// `result` is a view into this thread's arena, valid until its next call.
+// The time taken, less any pyramid level built for it, goes to `tally`.
+void correlate(FramePyramid &frame, int factor, const cv::Rect &roi,
+               const TemplateVariant &templ, cv::Mat &result,
+               StageTally &tally) {
+  const cv::Mat &img = frame.level(factor);
+  const uint64_t t0 = vision_now_ns();
+  ScratchArena &scratch = vision_scratch();
+  cv::Mat view = img(roi);
+  result = scratch.view(kScratchResult, roi.height - templ.gray.rows + 1,
+                        roi.width - templ.gray.cols + 1, CV_32F);
+  cv::matchTemplate(view, templ.gray, result, cv::TM_CCORR);
+
+  // Same as OpenCV: a flat template correlates perfectly everywhere.
+  if (templ.norm < DBL_EPSILON) {
+    result.setTo(1.0);
+    tally.add(VisionStage::Correlate, vision_now_ns() - t0);
+    return;
+  }
+
+  bool whole = roi.width == img.cols && roi.height == img.rows;
+  if (whole || frame.has_stats(factor)) {
+    const FrameStats &st = frame.stats(factor);
+    normalize_ccoeff(result, templ, st, roi.tl() - st.origin);
+  } else {
+    FrameStats local;
+    local.sum = scratch.view(kScratchWindowSum, view.rows + 1, view.cols + 1,
+                             CV_32S);
+    local.sqsum = scratch.view(kScratchWindowSqsum, view.rows + 1,
+                               view.cols + 1, CV_64F);
+    cv::integral(view, local.sum, local.sqsum, CV_32S, CV_64F);
+    normalize_ccoeff(result, templ, local, cv::Point(0, 0));
+  }
+  tally.add(VisionStage::Correlate, vision_now_ns() - t0);
+}
+
+// Appends the local maxima of a TM_CCOEFF_NORMED map that clear
+// kMatchThreshold, keeping at most kMaxMapPeaks of the strongest. A maximum
+// is at least each of its 8 neighbours, so a map searched in stripes yields
+// the same peaks apart from duplicates and extras along the cut rows, which
+// suppression in append_instances removes. `origin` places map (0, 0) in the
+// frame; `size` is the variant's.
+void collect_peaks(const cv::Mat &result, const cv::Point &origin,
+                   const cv::Size &size, std::vector<Peak> &peaks) {
+  const size_t first = peaks.size();
+  for (int y = 0; y < result.rows; y++) {
+    const float *row = result.ptr<float>(y);
+    const float *up = y > 0 ? result.ptr<float>(y - 1) : nullptr;
+    const float *down =
+        y + 1 < result.rows ? result.ptr<float>(y + 1) : nullptr;
+    for (int x = 0; x < result.cols; x++) {
+      const float v = row[x];
+      if (v < kMatchThreshold)
+        continue;
+      bool peak = true;
+      for (int nx = std::max(x - 1, 0);
+           peak && nx <= std::min(x + 1, result.cols - 1); nx++) {
+        if ((nx != x && row[nx] > v) || (up && up[nx] > v) ||
+            (down && down[nx] > v))
+          peak = false;
+      }
+      if (peak)
+        peaks.push_back({v, cv::Rect(origin.x + x, origin.y + y, size.width,
+                                     size.height)});
+    }
+  }
+  if (peaks.size() - first > kMaxMapPeaks) {
+    std::partial_sort(peaks.begin() + (std::ptrdiff_t)first,
+                      peaks.begin() + (std::ptrdiff_t)(first + kMaxMapPeaks),
+                      peaks.end(), peak_before);
+    peaks.resize(first + kMaxMapPeaks);
+  }
+}
+
+bool fits(const cv::Mat &templ, const cv::Size &area) {
+  return !templ.empty() && templ.cols <= area.width &&
+         templ.rows <= area.height;
+}
+
+// Best hit of every scale over `roi` (the whole frame, a stripe of it, or a
+// prior window), indexed like kMatchScales. Stops after the native scale when
+// it already clears kEarlyExitScore; skipped scales keep score -1. With
+// `peaks`, every scanned map's peaks above the threshold go there too.
+void scan_scales(FramePyramid &frame, const cv::Rect &roi,
+                 const TemplateEntry &entry, std::vector<ScaleHit> &hits,
+                 StageTally &tally, std::vector<Peak> *peaks = nullptr) {
+  hits.assign(kNumMatchScales, ScaleHit());
+  for (int s = 0; s < kNumMatchScales; s++) {
+    const TemplateVariant &variant = entry.variants[s];
+    hits[s].scale = kMatchScales[s];
+    if (!fits(variant.gray, roi.size()))
+      continue;
+
+    cv::Mat result;
+    correlate(frame, 1, roi, variant, result, tally);
+
+    const uint64_t t0 = vision_now_ns();
+    double maxVal;
+    cv::Point maxLoc;
+    cv::minMaxLoc(result, nullptr, &maxVal, nullptr, &maxLoc);
+    hits[s].score = (float)maxVal;
+    hits[s].loc = maxLoc + roi.tl();
+    // A flat template correlates 1 everywhere: no instances to tell apart.
+    if (peaks && variant.norm >= DBL_EPSILON)
+      collect_peaks(result, roi.tl(), variant.gray.size(), *peaks);
+    tally.add(VisionStage::Peak, vision_now_ns() - t0);
 
     // Early exit on strong match at native scale
-    if (s == 0 && best_score > 0.90f)
+    if (s == 0 && hits[s].score > kEarlyExitScore)
+      break;
+  }
+}
+
+// The serial selection rule over per-scale hits: the first strictly better
+// scale wins, and a native-scale hit above kEarlyExitScore ends the search.
+// Merged stripe hits go through the same rule, so striping never changes
+// which scale is reported.
+ScaleHit pick_best(const std::vector<ScaleHit> &hits) {
+  ScaleHit best;
+  for (int s = 0; s < (int)hits.size(); s++) {
+    if (hits[s].score > best.score)
+      best = hits[s];
+    if (s == 0 && best.score > kEarlyExitScore)
       break;
   }
+  return best;
+}
+
+// Original strategy: every scale at full resolution over `roi`.
+ScaleHit search_exhaustive(FramePyramid &frame, const cv::Rect &roi,
+                           const TemplateEntry &entry, StageTally &tally,
+                           std::vector<Peak> *peaks = nullptr) {
+  std::vector<ScaleHit> hits;
+  scan_scales(frame, roi, entry, hits, tally, peaks);
+  return pick_best(hits);
+}
+
+// Largest prepared pyramid factor not above `max_factor`, or 1 when even a
+// 2x reduction would leave too little of the template.
+int coarse_factor_for(const TemplateEntry &entry, int max_factor) {
+  int factor = 1;
+  for (const auto &level : entry.coarse) {
+    if (level.first <= max_factor)
+      factor = std::max(factor, level.first);
+  }
+  return factor;
+}
+
+// Coarse-to-fine: all scales at 1/factor resolution, then the best few
+// (location, scale) candidates re-scored at full resolution inside small
+// windows. Scores are exact full-resolution TM_CCOEFF_NORMED values at the
+// refined location, so they only differ from search_exhaustive when the
+// coarse pass ranks the true peak outside the refined candidates. With
+// `peaks`, at least `instances` candidates are refined and each window's
+// peaks are collected.
+ScaleHit search_pyramid(FramePyramid &frame, const TemplateEntry &entry,
+                        const MatchConfig &config, StageTally &tally,
+                        int instances = 1,
+                        std::vector<Peak> *peaks = nullptr) {
+  const cv::Mat &screen_gray = frame.full();
+  const cv::Rect bounds(0, 0, screen_gray.cols, screen_gray.rows);
+  int factor = coarse_factor_for(entry, config.pyramid_factor);
+  if (factor == 1)
+    return search_exhaustive(frame, bounds, entry, tally, peaks);
+  const int keep = std::max(config.refine_candidates, instances);
+
+  const cv::Mat &coarse_screen = frame.level(factor);
+  const cv::Rect coarse_bounds(0, 0, coarse_screen.cols, coarse_screen.rows);
+  const std::vector<TemplateVariant> &coarse = entry.coarse.at(factor);
+
+  struct Candidate {
+    float score;
+    cv::Point loc; // coarse coordinates
+    int scale_index;
+  };
+  std::vector<Candidate> candidates;
+
+  for (int s = 0; s < kNumMatchScales; s++) {
+    if (!fits(entry.variants[s].gray, bounds.size()) ||
+        !fits(coarse[s].gray, coarse_bounds.size()))
+      continue;
+    const cv::Mat &coarse_templ = coarse[s].gray;
+
+    cv::Mat result;
+    correlate(frame, factor, coarse_bounds, coarse[s], result, tally);
+
+    // Take the top peaks of this scale, blanking a template-sized
+    // neighbourhood after each so the candidates are distinct.
+    const uint64_t t0 = vision_now_ns();
+    for (int k = 0; k < keep; k++) {
+      double maxVal;
+      cv::Point maxLoc;
+      cv::minMaxLoc(result, nullptr, &maxVal, nullptr, &maxLoc);
+      if (maxVal <= -1.0)
+        break;
+      candidates.push_back({(float)maxVal, maxLoc, s});
+      cv::Rect blank(maxLoc.x - coarse_templ.cols / 2,
+                     maxLoc.y - coarse_templ.rows / 2, coarse_templ.cols,
+                     coarse_templ.rows);
+      blank &= cv::Rect(0, 0, result.cols, result.rows);
+      result(blank).setTo(-2.0);
+    }
+    tally.add(VisionStage::Peak, vision_now_ns() - t0);
+  }
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return a.score > b.score;
+            });
+  if ((int)candidates.size() > keep)
+    candidates.resize(keep);
+
+  // Refinement window: the up-scaled candidate +/- 2 coarse pixels, which
+  // covers rounding in both downscales.
+  const int margin = 2 * factor;
 
-  out_score = best_score;
+  ScaleHit best;
+  for (const Candidate &c : candidates) {
+    const TemplateVariant &variant = entry.variants[c.scale_index];
+    cv::Rect window(c.loc.x * factor - margin, c.loc.y * factor - margin,
+                    variant.gray.cols + 2 * margin,
+                    variant.gray.rows + 2 * margin);
+    window &= bounds;
+    if (!fits(variant.gray, window.size()))
+      continue;
 
-  int w = (int)(templ_gray.cols * best_scale);
-  int h = (int)(templ_gray.rows * best_scale);
-  out_rect = cv::Rect(best_loc.x, best_loc.y, w, h);
+    cv::Mat result;
+    correlate(frame, 1, window, variant, result, tally);
+    const uint64_t t0 = vision_now_ns();
+    double maxVal;
+    cv::Point maxLoc;
+    cv::minMaxLoc(result, nullptr, &maxVal, nullptr, &maxLoc);
+    if (peaks && variant.norm >= DBL_EPSILON)
+      collect_peaks(result, window.tl(), variant.gray.size(), *peaks);
+    tally.add(VisionStage::Peak, vision_now_ns() - t0);
+
+    if ((float)maxVal > best.score) {
+      best.score = (float)maxVal;
+      best.loc = maxLoc + window.tl();
+      best.scale = kMatchScales[c.scale_index];
+    }
+  }
+  return best;
+}
+
+// Search window for a template with a prior: the recorded rectangle grown by
+// the margin on every side, plus room for the largest scale, clipped to the
+// frame. Empty when the clipped window cannot hold the template.
+cv::Rect prior_window(const TemplateEntry &entry, const cv::Size &screen) {
+  const float largest_scale =
+      *std::max_element(std::begin(kMatchScales), std::end(kMatchScales));
+  int slack_x = (int)std::ceil(entry.gray.cols * (largest_scale - 1.0f));
+  int slack_y = (int)std::ceil(entry.gray.rows * (largest_scale - 1.0f));
+  int m = entry.prior_margin;
+  int w = std::max(entry.prior.width, entry.gray.cols) + 2 * m + slack_x;
+  int h = std::max(entry.prior.height, entry.gray.rows) + 2 * m + slack_y;
+  cv::Rect window(entry.prior.x - m, entry.prior.y - m, w, h);
+  window &= cv::Rect(0, 0, screen.width, screen.height);
+  if (window.width < entry.gray.cols || window.height < entry.gray.rows)
+    return cv::Rect();
+  return window;
+}
 
-  const float MATCH_THRESHOLD = 0.75f;
-  bool matched = best_score >= MATCH_THRESHOLD;
+// Templates covering at least this fraction of the frame are always split
+// across every thread when searched exhaustively.
+constexpr int kLargeTemplateDivisor = 32;
 
-  LOGD("ID=%d: score=%.3f (threshold=%.2f) scale=%.2f at=(%d,%d) %dx%d %s", id,
-       best_score, MATCH_THRESHOLD, best_scale, best_loc.x, best_loc.y, w, h,
-       matched ? "MATCHED" : "no match");
+// Horizontal stripes a full-frame exhaustive search is split into: enough
+// tasks to keep every thread busy when there are few templates, every thread
+// for large templates, and never so thin that the overlap dominates.
+int stripe_count(const TemplateEntry &entry, const cv::Size &screen,
+                 int threads, int templates) {
+  if (threads <= 1)
+    return 1;
+  int stripes = std::min((2 * threads + templates - 1) / templates, threads);
+  if ((double)entry.gray.total() * kLargeTemplateDivisor >=
+      (double)screen.area())
+    stripes = threads;
 
-  return matched;
+  int tallest = 0;
+  for (const TemplateVariant &v : entry.variants)
+    tallest = std::max(tallest, v.gray.rows);
+  if (tallest > 0)
+    stripes = std::min(stripes, screen.height / (2 * tallest));
+  return std::max(stripes, 1);
 }
 
-std::vector<MatchResult> vision_match_all(const cv::Mat &screen) {
-  std::vector<MatchResult> results;
-  if (screen.empty())
-    return results;
+// Stripe `index` of `count`: its rows of top-left positions plus the tallest
+// variant's height of overlap, so every placement is inside some stripe.
+cv::Rect stripe_rect(const TemplateEntry &entry, const cv::Size &screen,
+                     int index, int count) {
+  int tallest = 0;
+  for (const TemplateVariant &v : entry.variants)
+    tallest = std::max(tallest, v.gray.rows);
+  int top = index * screen.height / count;
+  int next = (index + 1) * screen.height / count;
+  int bottom = std::min(next + tallest - 1, screen.height);
+  return cv::Rect(0, top, screen.width, bottom - top);
+}
 
-  // Take a snapshot of templates under lock — then match without holding lock
-  std::map<int, cv::Mat> templates_snapshot;
-  {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    if (g_templates.empty())
-      return results;
-    templates_snapshot = g_templates; // deep copy of map (Mat uses refcount)
+// One template's progress through vision_match_all. Phase 1 runs the prior
+// window and, where it misses, the configured full-frame search; only
+// exhaustive searches worth striping are left for phase 2.
+// Templates answered from the previous frame skip both phases.
+struct TemplateJob {
+  int id = 0;
+  const TemplateEntry *entry = nullptr;
+  ScaleHit best;
+  cv::Rect window; // prior window searched, empty when there was none
+  bool from_prior = false;
+  bool skipped = false;
+  bool reused = false;
+  MatchResult previous; // the result handed back when `reused`
+  int stripes = 1;
+  std::vector<std::vector<ScaleHit>> stripe_hits; // [stripe][scale]
+  // Multi-instance matching: results wanted, and the peaks found so far.
+  int instances = 1;
+  std::vector<Peak> peaks;
+  std::vector<std::vector<Peak>> stripe_peaks; // [stripe]
+  // Feature mode: the votes this frame cast for the template, and where
+  // verification placed it.
+  const std::vector<FeatureVote> *votes = nullptr;
+  cv::Rect feature_rect;
+  int inliers = 0;
+  // Time spent on this template, phase 1 and each stripe kept apart so
+  // no two tasks write the same tally.
+  StageTally tally;
+  std::vector<StageTally> stripe_tallies; // [stripe]
+};
+
+// The previous frame and what matching it produced. Shared immutably once
+// published: each frame fills the spare one, swaps it in and keeps the one
+// it replaced as the next spare, so steady frames allocate none.
+struct FrameMemory {
+  struct Entry {
+    int id;
+    MatchResult result;
+    cv::Rect searched; // pixels the result depended on
+  };
+
+  cv::Mat gray;
+  uint64_t generation = 0;
+  int tile = 0;
+  std::vector<Entry> entries; // sorted by ID
+
+  const Entry *find(int id) const {
+    auto it = std::lower_bound(
+        entries.begin(), entries.end(), id,
+        [](const Entry &e, int key) { return e.id < key; });
+    return it != entries.end() && it->id == id ? &*it : nullptr;
   }
+};
 
-  LOGD("vision_match_all: screen=%dx%d ch=%d, templates=%zu", screen.cols,
-       screen.rows, screen.channels(), templates_snapshot.size());
+// True when `m` is the only Mat referencing its pixels, so they may be
+// overwritten without another holder noticing.
+static bool sole_owner(const cv::Mat &m) {
+  return m.u != nullptr && m.u->refcount == 1;
+}
 
-  cv::Mat screen_gray;
-  if (screen.channels() == 4) {
-    cv::cvtColor(screen, screen_gray, cv::COLOR_RGBA2GRAY);
-  } else if (screen.channels() == 3) {
-    cv::cvtColor(screen, screen_gray, cv::COLOR_RGB2GRAY);
+// Which tiles of a frame differ from the previous frame. Until diff() runs
+// every tile counts as changed; a tile of 0 gives an empty grid.
+class TileMask {
+public:
+  TileMask(int tile, const cv::Size &size)
+      : tile_(std::max(tile, 1)),
+        cols_(tile > 0 ? (size.width + tile - 1) / tile : 0),
+        rows_(tile > 0 ? (size.height + tile - 1) / tile : 0),
+        changed_((size_t)cols_ * rows_, 1), count_(cols_ * rows_) {}
+
+  void diff(const cv::Mat &prev, const cv::Mat &cur) {
+    if (prev.data == cur.data) { // the same submitted frame, matched again
+      std::fill(changed_.begin(), changed_.end(), (uint8_t)0);
+      count_ = 0;
+      return;
+    }
+    count_ = vision_tile_diff(prev.data, prev.step, cur.data, cur.step,
+                              cur.cols, cur.rows, tile_, changed_.data());
+  }
+
+  int tiles() const { return cols_ * rows_; }
+  int changed() const { return count_; }
+
+  // Whether any tile overlapping `area` changed.
+  bool any(const cv::Rect &area) const {
+    if (area.empty())
+      return false;
+    int x0 = std::max(area.x / tile_, 0);
+    int y0 = std::max(area.y / tile_, 0);
+    int x1 = std::min((area.x + area.width - 1) / tile_, cols_ - 1);
+    int y1 = std::min((area.y + area.height - 1) / tile_, rows_ - 1);
+    for (int y = y0; y <= y1; y++) {
+      const uint8_t *row = changed_.data() + (size_t)y * cols_;
+      for (int x = x0; x <= x1; x++) {
+        if (row[x])
+          return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  int tile_;
+  int cols_;
+  int rows_;
+  std::vector<uint8_t> changed_;
+  int count_;
+};
+
+// One immutable version of everything a frame is matched with. Writers copy
+// the current version, change the copy and publish it with an atomic
+// pointer swap; a frame keeps the version it started with alive through its
+// shared_ptr, so nothing it uses is freed until the last such frame ends.
+// Entries are shared between versions, so a copy costs one node per
+// template.
+struct Registry {
+  std::map<int, std::shared_ptr<const TemplateEntry>> templates;
+  MatchConfig config;
+  std::shared_ptr<WorkerPool> pool; // null = match on the calling thread
+  // Bumped whenever templates or config change, so results remembered from
+  // an earlier frame are never reused against a different setup.
+  uint64_t generation = 0;
+  // Index over the descriptors of every feature-mode template, slot i
+  // describing template feature_ids[i]. Rebuilt by the first frame after the
+  // templates change, so registering many costs one build.
+  std::shared_ptr<const FeatureIndex> feature_index;
+  std::vector<int> feature_ids; // ascending
+  bool features_dirty = false;
+};
+
+} // namespace
+
+// Frame keypoints described per frame for feature-mode templates: on a
+// busy screen, enough to leave a small icon a few dozen of its own.
+constexpr int kFrameFeatures = 30000;
+
+// Everything one matcher owns. Frames read the current registry version
+// without locking; frame memory and the latest frame have their own locks,
+// so instances never contend with each other.
+struct VisionMatcher::State {
+  // Counts every arena below and in the pool, so it is declared first and
+  // destroyed last.
+  ScratchCounters scratch;
+
+  // Only ever accessed through std::atomic_load / std::atomic_store.
+  std::shared_ptr<const Registry> registry = std::make_shared<Registry>();
+  std::mutex mutex; // Serialises registry writers; readers never take it
+
+  std::mutex memory_mutex; // Protects memory, spare_memory and last_diff
+  std::shared_ptr<const FrameMemory> memory;
+  std::shared_ptr<const FrameMemory> spare_memory; // the one memory replaced
+  FrameDiffStats last_diff;
+
+  // Grayscale copy of the most recently submitted frame, or the pooled
+  // frame it borrows. Replaced wholesale on every submit; a match already
+  // holding the previous frame keeps it alive through the refcount.
+  std::mutex frame_mutex;
+  GrayFrame latest;
+  GrayFrame spare; // the converted frame latest replaced, refilled next
+  uint64_t latest_sequence = 0; // frames submitted so far
+  int64_t latest_ms = 0;        // steady clock at the latest submit
+  std::condition_variable frame_cv;
+
+  // The attached detector and its input for the latest frame, prepared on
+  // submit. The previous input is kept as the spare the next submit fills,
+  // unless a detection still holds it.
+  std::mutex detect_mutex;
+  std::shared_ptr<VisionDetector> detector;
+  std::shared_ptr<DetectorInput> detect_input;
+  std::shared_ptr<DetectorInput> detect_spare;
+
+  // Submitted frames are appended here while a recording runs. Frames are
+  // written on the submitting thread under their own lock.
+  std::mutex record_mutex;
+  RecordingWriter recorder;
+  int64_t record_start_ms = 0;
+
+  // Scratch arenas for threads calling match, each borrowed for one call
+  // (see BorrowedScratch). Pool workers have their own.
+  std::mutex scratch_mutex; // Protects spare_scratch
+  std::vector<std::unique_ptr<ScratchArena>> spare_scratch;
+
+  VisionStats stats; // thread-safe on its own
+};
+
+// Binds one of the matcher's spare arenas (a new one when every spare is in
+// use by a concurrent match) to the calling thread for the lifetime of the
+// object, then ends the frame on it and hands it back.
+class BorrowedScratch {
+public:
+  explicit BorrowedScratch(VisionMatcher::State &st) : st_(st) {
+    {
+      std::lock_guard<std::mutex> lock(st_.scratch_mutex);
+      if (!st_.spare_scratch.empty()) {
+        arena_ = std::move(st_.spare_scratch.back());
+        st_.spare_scratch.pop_back();
+      }
+    }
+    if (!arena_)
+      arena_.reset(new ScratchArena(st_.scratch));
+    binding_.reset(new ScratchBinding(arena_.get()));
+  }
+
+  ~BorrowedScratch() {
+    binding_.reset();
+    arena_->end_frame();
+    std::lock_guard<std::mutex> lock(st_.scratch_mutex);
+    st_.spare_scratch.push_back(std::move(arena_));
+  }
+
+  BorrowedScratch(const BorrowedScratch &) = delete;
+  BorrowedScratch &operator=(const BorrowedScratch &) = delete;
+
+private:
+  VisionMatcher::State &st_;
+  std::unique_ptr<ScratchArena> arena_;
+  std::unique_ptr<ScratchBinding> binding_;
+};
+
+static int64_t steady_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static std::shared_ptr<const Registry>
+current_registry(const VisionMatcher::State &st) {
+  return std::atomic_load(&st.registry);
+}
+
+// Publishes a copy of the current registry changed by `change`. Frames
+// already running keep the version they loaded.
+static void update_registry(VisionMatcher::State &st,
+                            const std::function<void(Registry &)> &change) {
+  std::lock_guard<std::mutex> lock(st.mutex);
+  auto next = std::make_shared<Registry>(*current_registry(st));
+  change(*next);
+  std::atomic_store(&st.registry,
+                    std::shared_ptr<const Registry>(std::move(next)));
+}
+
+// Publishes the current templates with a rebuilt feature index, unless a
+// frame racing this one already did, and returns the version to match.
+static std::shared_ptr<const Registry>
+reindex_features(VisionMatcher::State &st) {
+  std::shared_ptr<const Registry> reg;
+  update_registry(st, [&](Registry &next) {
+    if (!next.features_dirty)
+      return;
+    std::vector<const FeatureSet *> sets;
+    next.feature_ids.clear();
+    for (const auto &pair : next.templates) {
+      if (!pair.second->features)
+        continue;
+      next.feature_ids.push_back(pair.first);
+      sets.push_back(pair.second->features.get());
+    }
+    next.feature_index =
+        sets.empty() ? nullptr : std::make_shared<const FeatureIndex>(sets);
+    next.features_dirty = false;
+    if (next.feature_index)
+      LOGD("Feature index: %zu templates, %zu descriptors", sets.size(),
+           next.feature_index->descriptors());
+  });
+  return current_registry(st);
+}
+
+// Feature mode: fits one transform to the votes the frame's keypoints cast
+// for the template and scores the template warped through it. Priors and
+// the search mode do not apply.
+static void match_features(const cv::Mat &screen_gray, TemplateJob &job) {
+  const uint64_t t0 = vision_now_ns();
+  cv::Mat transform;
+  if (!job.votes ||
+      !vision_verify_votes(*job.votes, job.entry->gray.size(), transform,
+                           job.inliers)) {
+    LOGT("ID=%d: %zu feature votes, %d agree, no match", job.id,
+         job.votes ? job.votes->size() : (size_t)0, job.inliers);
+    job.tally.add(VisionStage::Features, vision_now_ns() - t0);
+    return;
+  }
+  job.best.score = vision_warped_score(screen_gray, job.entry->gray,
+                                       transform, job.feature_rect);
+  const double a = transform.at<double>(0, 0);
+  const double b = transform.at<double>(1, 0);
+  job.best.scale = (float)std::sqrt(a * a + b * b);
+  job.tally.add(VisionStage::Features, vision_now_ns() - t0);
+}
+
+// Template matching: pixel correlation, perfect for UI elements.
+// Templates with a prior are searched inside their recorded window first;
+// the full-frame search (in the configured mode) only runs when that misses.
+// Multi-instance jobs go straight to the full frame, collecting peaks.
+// Exhaustive full-frame searches that need striping are left pending.
+static void match_one(FramePyramid &frame, const MatchConfig &config,
+                      TemplateJob &job) {
+  const cv::Mat &screen_gray = frame.full();
+  const TemplateEntry &entry = *job.entry;
+  const cv::Mat &templ_gray = entry.gray;
+
+  if (screen_gray.empty() || templ_gray.empty()) {
+    job.skipped = true;
+    return;
+  }
+
+  if (entry.features) {
+    match_features(screen_gray, job);
+    return;
+  }
+
+  // Template must be smaller than screen
+  if (templ_gray.cols > screen_gray.cols ||
+      templ_gray.rows > screen_gray.rows) {
+    LOGT("ID=%d: template (%dx%d) larger than screen (%dx%d), skip", job.id,
+         templ_gray.cols, templ_gray.rows, screen_gray.cols, screen_gray.rows);
+    job.skipped = true;
+    return;
+  }
+
+  std::vector<Peak> *peaks = job.instances > 1 ? &job.peaks : nullptr;
+  cv::Rect window = entry.has_prior && !peaks
+                        ? prior_window(entry, screen_gray.size())
+                        : cv::Rect();
+  job.window = window;
+  if (!window.empty()) {
+    job.best = search_exhaustive(frame, window, entry, job.tally);
+    job.from_prior = job.best.score >= kMatchThreshold;
+    LOGT("ID=%d: prior window %dx%d (1/%.0f of frame) score=%.3f%s", job.id,
+         window.width, window.height,
+         (double)screen_gray.total() / (double)window.area(), job.best.score,
+         job.from_prior ? "" : ", falling back to full frame");
+    if (job.from_prior)
+      return;
+  }
+
+  if (config.mode == SearchMode::Pyramid) {
+    ScaleHit full = search_pyramid(frame, entry, config, job.tally,
+                                   job.instances, peaks);
+    if (full.score > job.best.score)
+      job.best = full;
+  } else if (job.stripes == 1) {
+    ScaleHit full = search_exhaustive(
+        frame, cv::Rect(0, 0, screen_gray.cols, screen_gray.rows), entry,
+        job.tally, peaks);
+    if (full.score > job.best.score)
+      job.best = full;
   } else {
-    screen_gray = screen;
+    job.stripe_hits.resize(job.stripes);
+    job.stripe_tallies.resize(job.stripes);
+    if (peaks)
+      job.stripe_peaks.resize(job.stripes);
   }
+}
 
-  for (const auto &pair : templates_snapshot) {
-    int id = pair.first;
-    const cv::Mat &tmpl = pair.second;
+// Folds a striped search back together: per scale the first stripe with the
+// strictly best score wins (top to bottom), then the serial scale rule.
+static void merge_stripes(TemplateJob &job) {
+  if (job.stripe_hits.empty())
+    return;
+  std::vector<ScaleHit> merged(kNumMatchScales);
+  for (const std::vector<ScaleHit> &hits : job.stripe_hits) {
+    for (int s = 0; s < kNumMatchScales && s < (int)hits.size(); s++) {
+      if (hits[s].score > merged[s].score)
+        merged[s] = hits[s];
+    }
+  }
+  ScaleHit full = pick_best(merged);
+  if (full.score > job.best.score)
+    job.best = full;
+  for (const std::vector<Peak> &peaks : job.stripe_peaks)
+    job.peaks.insert(job.peaks.end(), peaks.begin(), peaks.end());
+  for (const StageTally &tally : job.stripe_tallies)
+    job.tally.merge(tally);
+}
+
+static MatchResult finish(const TemplateJob &job) {
+  MatchResult res;
+  res.id = job.id;
+  res.matched = false;
+  res.score = 0.0f;
+  res.from_prior = false;
+  if (job.skipped)
+    return res;
+
+  const ScaleHit &best = job.best;
+  if (job.entry->features) {
+    res.score = std::max(best.score, 0.0f);
+    res.rect = job.feature_rect;
+    res.matched = res.score >= kMatchThreshold;
+    LOGT("ID=%d: score=%.3f (threshold=%.2f) inliers=%d/%zu scale=%.2f "
+         "at=(%d,%d) %dx%d %s",
+         job.id, res.score, kMatchThreshold, job.inliers,
+         job.votes ? job.votes->size() : (size_t)0, best.scale, res.rect.x,
+         res.rect.y, res.rect.width, res.rect.height,
+         res.matched ? "MATCHED" : "no match");
+    return res;
+  }
+
+  int w = (int)(job.entry->gray.cols * best.scale);
+  int h = (int)(job.entry->gray.rows * best.scale);
+
+  res.score = best.score;
+  res.rect = cv::Rect(best.loc.x, best.loc.y, w, h);
+  res.matched = best.score >= kMatchThreshold;
+  res.from_prior = job.from_prior;
 
-    cv::Rect r;
-    float score = 0;
-    bool found = match_one(screen_gray, tmpl, r, score, id);
+  LOGT("ID=%d: score=%.3f (threshold=%.2f) scale=%.2f at=(%d,%d) %dx%d %s%s",
+       job.id, best.score, kMatchThreshold, best.scale, best.loc.x,
+       best.loc.y, w, h, res.matched ? "MATCHED" : "no match",
+       job.from_prior ? " (prior)" : "");
+  return res;
+}
 
+// Multi-instance matching: follows the template's best result, already in
+// `results` and matched, with its strongest other peaks, skipping any that
+// overlap an accepted box by more than kInstanceOverlap of the smaller one,
+// until job.instances results are in.
+static void append_instances(TemplateJob &job,
+                             std::vector<MatchResult> &results) {
+  std::vector<cv::Rect> kept(1, results.back().rect);
+  std::sort(job.peaks.begin(), job.peaks.end(), peak_before);
+  for (const Peak &peak : job.peaks) {
+    if ((int)kept.size() >= job.instances)
+      break;
+    bool overlaps = false;
+    for (const cv::Rect &box : kept) {
+      const float limit =
+          kInstanceOverlap * (float)std::min(peak.rect.area(), box.area());
+      if ((float)(peak.rect & box).area() > limit) {
+        overlaps = true;
+        break;
+      }
+    }
+    if (overlaps)
+      continue;
+    kept.push_back(peak.rect);
     MatchResult res;
-    res.id = id;
-    res.matched = found;
-    res.score = score;
-    res.rect = r;
+    res.id = job.id;
+    res.matched = true;
+    res.score = peak.score;
+    res.rect = peak.rect;
+    res.from_prior = false;
     results.push_back(res);
   }
+  LOGT("ID=%d: %zu instances from %zu peaks", job.id, kept.size(),
+       job.peaks.size());
+}
+
+// Matches registered templates against an already grayscale frame: all of
+// them in ID order, or those `request` names in its order, stopping once it
+// is satisfied and returning up to request->instances results per template.
+static std::vector<MatchResult> match_gray(VisionMatcher::State &st,
+                                           const GrayFrame &gray_frame,
+                                           const MatchRequest *request) {
+  std::vector<MatchResult> results;
+  const cv::Mat &screen_gray = gray_frame.gray;
+  if (screen_gray.empty())
+    return results;
+  const uint64_t frame_start = vision_now_ns();
+
+  // The registry version current now stays alive, unchanged, until this
+  // frame is done with it; templates registered meanwhile wait for the next
+  // frame. A request takes only the templates it names, in its order.
+  std::shared_ptr<const Registry> reg = current_registry(st);
+  if (reg->templates.empty())
+    return results;
+  if (reg->features_dirty)
+    reg = reindex_features(st);
+  // Everything drawn from scratch below is dropped before this returns it.
+  BorrowedScratch scratch(st);
+  std::vector<std::pair<int, const TemplateEntry *>> order;
+  if (request && !request->ids.empty()) {
+    for (int id : request->ids) {
+      auto it = reg->templates.find(id);
+      auto seen = [id](const std::pair<int, const TemplateEntry *> &o) {
+        return o.first == id;
+      };
+      if (it != reg->templates.end() &&
+          std::none_of(order.begin(), order.end(), seen))
+        order.emplace_back(id, it->second.get());
+    }
+  } else {
+    order.reserve(reg->templates.size());
+    for (const auto &pair : reg->templates)
+      order.emplace_back(pair.first, pair.second.get());
+  }
+  const MatchConfig &config = reg->config;
+  const std::shared_ptr<WorkerPool> &pool = reg->pool;
+  const uint64_t generation = reg->generation;
+  const std::shared_ptr<const FeatureIndex> &feature_index =
+      reg->feature_index;
+  const std::vector<int> &feature_ids = reg->feature_ids;
+  const int threads = pool ? pool->size() : 1;
+
+  // Matches needed before the rest of the order is skipped; 0 runs it all.
+  // Multi-instance searches are never reused or remembered: frame memory
+  // holds one result per template.
+  const int instances = request ? std::max(request->instances, 1) : 1;
+  int wanted = 0;
+  if (request && request->stop == MatchStop::First)
+    wanted = 1;
+  else if (request && request->stop == MatchStop::AnyN)
+    wanted = std::max(request->n, 1);
+
+  std::shared_ptr<const FrameMemory> memory;
+  std::shared_ptr<const FrameMemory> spare;
+  {
+    std::lock_guard<std::mutex> lock(st.memory_mutex);
+    memory = st.memory;
+    spare = std::move(st.spare_memory);
+  }
+
+  // Dirty tiles against the previous frame. Without a comparable frame every
+  // tile counts as changed, so nothing is reused.
+  const int tile = config.diff_tile;
+  const bool comparable = tile > 0 && memory &&
+                          memory->generation == generation &&
+                          memory->tile == tile &&
+                          memory->gray.size() == screen_gray.size();
+  TileMask mask(tile, screen_gray.size());
+  if (comparable) {
+    const uint64_t t0 = vision_now_ns();
+    mask.diff(memory->gray, screen_gray);
+    st.stats.record(VisionStage::Diff, vision_now_ns() - t0);
+  }
+
+  FramePyramid frame(gray_frame, vision_scratch());
+
+  // Jobs stay in evaluation order, so results are deterministic whatever
+  // order the pool finishes them in.
+  std::vector<TemplateJob> jobs;
+  jobs.reserve(order.size());
+  bool need_features = false;
+  for (const auto &pair : order) {
+    TemplateJob job;
+    job.id = pair.first;
+    job.entry = pair.second;
+    job.instances = job.entry->features ? 1 : instances;
+    if (comparable && instances == 1) {
+      const FrameMemory::Entry *entry = memory->find(job.id);
+      if (entry && !mask.any(entry->searched)) {
+        job.reused = true;
+        job.previous = entry->result;
+      }
+    }
+    if (!job.reused && job.entry->features)
+      need_features = true;
+    jobs.push_back(job);
+  }
+
+  auto run = [&](int count, const std::function<void(int)> &task) {
+    if (pool)
+      pool->run(count, task);
+    else
+      for (int i = 0; i < count; i++)
+        task(i);
+  };
+
+  // Feature-mode templates: the frame is described once and each of its
+  // keypoints votes for all of them in one index lookup. Chunks of keypoints
+  // vote in parallel into their own lists, concatenated in chunk order.
+  std::vector<std::vector<FeatureVote>> votes;
+  uint64_t features_ns = 0; // frame keypoints and votes, not per template
+  if (need_features && feature_index) {
+    const uint64_t t0 = vision_now_ns();
+    const FeatureSet keypoints =
+        vision_frame_features(screen_gray, kFrameFeatures);
+    const size_t slots = feature_index->templates();
+    const int chunks = std::max(threads, 1);
+    std::vector<std::vector<std::vector<FeatureVote>>> chunk_votes(
+        (size_t)chunks, std::vector<std::vector<FeatureVote>>(slots));
+    run(chunks, [&](int c) {
+      size_t begin = keypoints.size() * (size_t)c / (size_t)chunks;
+      size_t end = keypoints.size() * (size_t)(c + 1) / (size_t)chunks;
+      feature_index->vote(keypoints, begin, end, chunk_votes[(size_t)c]);
+    });
+    votes.resize(slots);
+    for (size_t slot = 0; slot < slots; slot++) {
+      for (const auto &chunk : chunk_votes)
+        votes[slot].insert(votes[slot].end(), chunk[slot].begin(),
+                           chunk[slot].end());
+    }
+    for (TemplateJob &job : jobs) {
+      auto it =
+          std::lower_bound(feature_ids.begin(), feature_ids.end(), job.id);
+      if (job.entry->features && it != feature_ids.end() && *it == job.id)
+        job.votes = &votes[(size_t)(it - feature_ids.begin())];
+    }
+    features_ns = vision_now_ns() - t0;
+    LOGD("match: %zu frame keypoints vote for %zu feature templates",
+         keypoints.size(), slots);
+  }
+
+  // Remember this frame, and the area each result depended on: the prior
+  // window when it answered, the whole frame when the full search ran.
+  // Templates left unevaluated are forgotten; their old results were
+  // relative to an older frame.
+  // A pooled frame's gray is copied: as the diff reference it would pin a
+  // pool buffer for as long as the matcher lives. The spare is refilled
+  // when no frame still reads it, and its gray when nothing shares it.
+  std::shared_ptr<FrameMemory> next =
+      spare && spare.use_count() == 1
+          ? std::const_pointer_cast<FrameMemory>(std::move(spare))
+          : std::make_shared<FrameMemory>();
+  next->entries.clear();
+  if (!gray_frame.source)
+    next->gray = screen_gray;
+  else if (sole_owner(next->gray))
+    screen_gray.copyTo(next->gray);
+  else
+    next->gray = screen_gray.clone();
+  next->generation = generation;
+  next->tile = tile;
+  const cv::Rect whole(0, 0, screen_gray.cols, screen_gray.rows);
+
+  // Without a stop condition every job is one wave, as before. Otherwise
+  // jobs go in waves of one per thread, in order, until enough matched;
+  // results after the satisfying match are dropped even if its wave
+  // evaluated them, so the answer does not depend on the thread count.
+  const size_t wave = wanted > 0 ? (size_t)threads : jobs.size();
+  int matched = 0;
+  int done = 0;
+  int evaluated = 0;
+  for (size_t begin = 0;
+       begin < jobs.size() && (wanted == 0 || matched < wanted);
+       begin += wave) {
+    const size_t end = std::min(begin + wave, jobs.size());
+    int active = 0;
+    for (size_t j = begin; j < end; j++)
+      active += jobs[j].reused ? 0 : 1;
+    for (size_t j = begin; j < end; j++) {
+      TemplateJob &job = jobs[j];
+      if (!job.reused && !job.entry->features)
+        job.stripes =
+            stripe_count(*job.entry, screen_gray.size(), threads, active);
+    }
+
+    run((int)(end - begin), [&](int i) {
+      TemplateJob &job = jobs[begin + (size_t)i];
+      if (!job.reused)
+        match_one(frame, config, job);
+    });
+
+    // Phase 2: the stripes of every pending exhaustive search, as one batch.
+    std::vector<std::pair<int, int>> stripes; // (job, stripe)
+    for (size_t j = begin; j < end; j++) {
+      for (int k = 0; k < (int)jobs[j].stripe_hits.size(); k++)
+        stripes.emplace_back((int)j, k);
+    }
+    run((int)stripes.size(), [&](int i) {
+      TemplateJob &job = jobs[(size_t)stripes[(size_t)i].first];
+      int k = stripes[(size_t)i].second;
+      cv::Rect roi =
+          stripe_rect(*job.entry, screen_gray.size(), k, job.stripes);
+      scan_scales(frame, roi, *job.entry, job.stripe_hits[(size_t)k],
+                  job.stripe_tallies[(size_t)k],
+                  job.stripe_peaks.empty() ? nullptr
+                                           : &job.stripe_peaks[(size_t)k]);
+    });
+
+    for (size_t j = begin; j < end; j++) {
+      TemplateJob &job = jobs[j];
+      done++;
+      evaluated += job.reused ? 0 : 1;
+      cv::Rect searched;
+      if (job.reused) {
+        results.push_back(job.previous);
+        searched = memory->find(job.id)->searched;
+      } else {
+        merge_stripes(job);
+        results.push_back(finish(job));
+        searched =
+            job.skipped ? cv::Rect() : job.from_prior ? job.window : whole;
+      }
+      const bool hit = results.back().matched;
+      if (instances == 1)
+        next->entries.push_back({job.id, results.back(), searched});
+      else if (hit && job.instances > 1)
+        append_instances(job, results);
+      if (hit && ++matched == wanted)
+        break;
+    }
+  }
+
+  LOGD("match: screen=%dx%d, templates=%d of %zu requested (%d reused), "
+       "results=%zu, threads=%d, tiles changed=%d/%d",
+       screen_gray.cols, screen_gray.rows, done, jobs.size(),
+       done - evaluated, results.size(), threads, mask.changed(),
+       mask.tiles());
+
+  // One histogram sample per stage for the frame: the sum over the
+  // templates that ran, which is CPU time when the pool split them.
+  std::vector<TemplateSample> samples;
+  samples.reserve((size_t)done);
+  StageTally frame_tally;
+  frame_tally.add(VisionStage::Features, features_ns);
+  frame_tally.add(VisionStage::Resize, frame.resize_ns());
+  size_t r = 0;
+  for (int j = 0; j < done; j++) {
+    const TemplateJob &job = jobs[(size_t)j];
+    frame_tally.merge(job.tally);
+    samples.push_back({job.id, job.reused, results[r].matched,
+                       results[r].score, job.tally});
+    // Skip the extra instances that follow a template's first result.
+    r++;
+    while (r < results.size() && results[r].id == job.id)
+      r++;
+  }
+  st.stats.add_templates(samples);
+  for (VisionStage stage : {VisionStage::Resize, VisionStage::Features,
+                            VisionStage::Correlate, VisionStage::Peak}) {
+    if (frame_tally.ns[(int)stage] > 0)
+      st.stats.record(stage, frame_tally.ns[(int)stage]);
+  }
+  st.stats.record(VisionStage::Frame, vision_now_ns() - frame_start);
+
+  FrameDiffStats stats;
+  stats.tiles = mask.tiles();
+  stats.tiles_changed = mask.changed();
+  stats.templates = done;
+  stats.templates_skipped = done - evaluated;
+  std::sort(next->entries.begin(), next->entries.end(),
+            [](const FrameMemory::Entry &a, const FrameMemory::Entry &b) {
+              return a.id < b.id;
+            });
+  {
+    std::lock_guard<std::mutex> lock(st.memory_mutex);
+    // A spare still sharing its frame's gray would keep that frame's buffer
+    // from being converted into again.
+    if (st.memory && st.memory.use_count() == 1 && !sole_owner(st.memory->gray))
+      std::const_pointer_cast<FrameMemory>(st.memory)->gray.release();
+    st.spare_memory = std::move(st.memory);
+    st.memory = std::move(next);
+    st.last_diff = stats;
+  }
   return results;
 }
 
-// ── JNI Helpers ───────────────────────────────────────────────────────
+// Converts RGBA pixels to gray with the fused SIMD kernel; the pyramid's 4x
+// level comes out of the same pass when `mode` will search it. The buffers
+// of `reuse` are written in place when nothing else references them.
+static GrayFrame gray_from_rgba(const uint8_t *pixels, size_t step, int width,
+                                int height, SearchMode mode,
+                                GrayFrame reuse = GrayFrame()) {
+  GrayFrame out;
+  if (!reuse.source && sole_owner(reuse.gray))
+    out.gray = std::move(reuse.gray);
+  out.gray.create(height, width, CV_8UC1);
+  uint8_t *quarter = nullptr;
+  if (mode == SearchMode::Pyramid && width >= 4 && height >= 4) {
+    if (!reuse.source && sole_owner(reuse.quarter))
+      out.quarter = std::move(reuse.quarter);
+    out.quarter.create(height / 4, width / 4, CV_8UC1);
+    quarter = out.quarter.data;
+  }
+  vision_rgba_to_gray(pixels, step, width, height, out.gray.data,
+                      out.gray.step, quarter,
+                      quarter ? out.quarter.step : 0, 4);
+  return out;
+}
 
-bool bitmap_to_mat(JNIEnv *env, jobject bitmap, cv::Mat &dst) {
-  AndroidBitmapInfo info;
-  void *pixels = 0;
+// Letterboxes a submitted frame for the attached detector, if any, into
+// the spare input, then publishes it as the latest. A spare a detection is
+// still reading is left to it and a fresh input is used instead.
+static void prepare_detection(VisionMatcher::State &st, const uint8_t *pixels,
+                              size_t step, int width, int height) {
+  std::shared_ptr<VisionDetector> detector;
+  std::shared_ptr<DetectorInput> input;
+  {
+    std::lock_guard<std::mutex> lock(st.detect_mutex);
+    if (!st.detector)
+      return;
+    detector = st.detector;
+    input = std::move(st.detect_spare);
+  }
+  if (!input || input.use_count() > 1)
+    input = std::make_shared<DetectorInput>();
 
-  if (AndroidBitmap_getInfo(env, bitmap, &info) < 0)
-    return false;
-  if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888)
+  const uint64_t t0 = vision_now_ns();
+  const bool ok = detector->prepare(pixels, step, width, height, *input);
+  st.stats.record(VisionStage::Detect, vision_now_ns() - t0);
+  if (!ok)
+    return;
+
+  std::lock_guard<std::mutex> lock(st.detect_mutex);
+  if (st.detector != detector)
+    return; // replaced meanwhile; its inputs were reset
+  st.detect_spare = std::move(st.detect_input);
+  st.detect_input = std::move(input);
+}
+
+// Makes `frame` the latest and records it. The detector input is prepared
+// from `rgba`, the frame's pixels, before the frame is announced, so a
+// waiter woken by it detects on it.
+static void publish_frame(VisionMatcher::State &st, const GrayFrame &frame,
+                          const uint8_t *rgba, size_t step) {
+  prepare_detection(st, rgba, step, frame.gray.cols, frame.gray.rows);
+  const int64_t now = steady_ms();
+  {
+    std::lock_guard<std::mutex> lock(st.frame_mutex);
+    if (!st.latest.source) // a pooled one would pin its pool buffer
+      st.spare = std::move(st.latest);
+    st.latest = frame;
+    st.latest_sequence++;
+    st.latest_ms = now;
+  }
+  st.frame_cv.notify_all();
+
+  std::lock_guard<std::mutex> lock(st.record_mutex);
+  if (st.recorder.is_open() &&
+      !st.recorder.append(frame.gray, now - st.record_start_ms)) {
+    LOGE("submit_frame: recording stopped after %zu frames",
+         st.recorder.close());
+  }
+}
+
+// The gray levels of a pooled frame, borrowed rather than converted.
+static GrayFrame gray_from_pooled(const FrameRef &frame) {
+  GrayFrame out;
+  out.gray = frame->gray;
+  out.quarter = frame->quarter;
+  out.source = frame;
+  return out;
+}
+
+// ── Matcher instances ─────────────────────────────────────────────────
+
+// Publishes `entry` under `id`, replacing any template of that ID.
+static void put_template(VisionMatcher::State &st, int id,
+                         const TemplateEntry &entry) {
+  auto shared = std::make_shared<const TemplateEntry>(entry);
+  update_registry(st, [&](Registry &next) {
+    next.templates[id] = shared;
+    next.generation++;
+    next.features_dirty = true;
+  });
+}
+
+VisionMatcher::VisionMatcher() : state_(new State()) {}
+
+VisionMatcher::~VisionMatcher() = default;
+
+void VisionMatcher::add_template(int id, const cv::Mat &templ) {
+  if (templ.empty())
+    return;
+  TemplateEntry entry = make_entry(templ);
+  put_template(*state_, id, entry);
+  LOGD("Added template ID=%d: %dx%d, %zu coarse levels", id, entry.gray.cols,
+       entry.gray.rows, entry.coarse.size());
+}
+
+void VisionMatcher::add_template(int id, const cv::Mat &templ,
+                                 const cv::Rect &prior, int margin) {
+  if (templ.empty())
+    return;
+  TemplateEntry entry = make_entry(templ);
+  entry.has_prior = prior.width > 0 && prior.height > 0;
+  entry.prior = prior;
+  entry.prior_margin = std::max(margin, 0);
+  put_template(*state_, id, entry);
+  LOGD("Added template ID=%d: %dx%d, %zu coarse levels, prior=(%d,%d %dx%d) "
+       "margin=%d",
+       id, entry.gray.cols, entry.gray.rows, entry.coarse.size(), prior.x,
+       prior.y, prior.width, prior.height, entry.prior_margin);
+}
+
+bool VisionMatcher::add_feature_template(int id, const cv::Mat &templ) {
+  if (templ.empty())
     return false;
-  if (AndroidBitmap_lockPixels(env, bitmap, &pixels) < 0)
+  TemplateEntry entry = make_entry(templ);
+  FeatureSet features = vision_template_features(entry.gray);
+  const size_t keypoints = features.size();
+  const bool usable = (int)keypoints >= kMinTemplateFeatures;
+  if (usable)
+    entry.features = std::make_shared<const FeatureSet>(std::move(features));
+  put_template(*state_, id, entry);
+  LOGD("Added template ID=%d: %dx%d, %zu keypoints%s", id, entry.gray.cols,
+       entry.gray.rows, keypoints,
+       usable ? "" : ", too few for features, using pixels");
+  return usable;
+}
+
+int VisionMatcher::add_pack(const std::string &path, uint64_t checksum,
+                            const std::vector<int> &ids) {
+  std::shared_ptr<const TemplatePack> pack = open_current_pack(path, checksum);
+  if (!pack)
+    return -1;
+  std::vector<std::pair<int, std::shared_ptr<const TemplateEntry>>> entries;
+  for (uint32_t t = 0; t < pack->header().template_count; t++) {
+    const PackTemplate &pt = pack->templates()[t];
+    if (!ids.empty() && std::find(ids.begin(), ids.end(), pt.id) == ids.end())
+      continue;
+    TemplateEntry entry;
+    if (!entry_from_pack(pack, pt, entry)) {
+      LOGE("TemplatePack: %s template ID=%d does not fit this engine",
+           path.c_str(), pt.id);
+      return -1;
+    }
+    entries.emplace_back(pt.id,
+                         std::make_shared<const TemplateEntry>(entry));
+  }
+
+  update_registry(*state_, [&](Registry &next) {
+    for (const auto &pair : entries)
+      next.templates[pair.first] = pair.second;
+    next.generation++;
+    next.features_dirty = true;
+  });
+  LOGD("Added %zu templates from pack %s", entries.size(), path.c_str());
+  return (int)entries.size();
+}
+
+bool VisionMatcher::remove_template(int id) {
+  bool removed = false;
+  update_registry(*state_, [&](Registry &next) {
+    removed = next.templates.erase(id) != 0;
+    if (!removed)
+      return;
+    next.generation++;
+    next.features_dirty = true;
+  });
+  return removed;
+}
+
+void VisionMatcher::clear_templates() {
+  update_registry(*state_, [](Registry &next) {
+    next.templates.clear();
+    next.generation++;
+    next.features_dirty = true;
+  });
+  LOGD("Cleared all templates");
+}
+
+size_t VisionMatcher::template_count() const {
+  return current_registry(*state_)->templates.size();
+}
+
+void VisionMatcher::set_config(const MatchConfig &config) {
+  MatchConfig c = config;
+  if (c.pyramid_factor != 8)
+    c.pyramid_factor = 4;
+  if (c.refine_candidates < 1)
+    c.refine_candidates = 1;
+  if (c.diff_tile < 0)
+    c.diff_tile = 0;
+  update_registry(*state_, [&](Registry &next) {
+    next.config = c;
+    next.generation++;
+  });
+  LOGD("Search mode=%s factor=%d candidates=%d diff_tile=%d",
+       c.mode == SearchMode::Pyramid ? "pyramid" : "exhaustive",
+       c.pyramid_factor, c.refine_candidates, c.diff_tile);
+}
+
+MatchConfig VisionMatcher::config() const {
+  return current_registry(*state_)->config;
+}
+
+void VisionMatcher::set_threads(int threads, const std::vector<int> &cpus) {
+  threads = std::max(threads, 1);
+  std::shared_ptr<WorkerPool> pool;
+  if (threads > 1)
+    pool = std::make_shared<WorkerPool>(threads, cpus, state_->scratch);
+  // The previous pool is joined once the last frame holding it ends.
+  update_registry(*state_, [&](Registry &next) { next.pool = pool; });
+  LOGD("Matching threads=%d, pinned CPUs=%zu", threads, cpus.size());
+}
+
+int VisionMatcher::threads() const {
+  const std::shared_ptr<const Registry> reg = current_registry(*state_);
+  return reg->pool ? reg->pool->size() : 1;
+}
+
+// Grayscale frame for match(): RGBA through the fused kernel, anything
+// else through OpenCV. Conversions are timed into `stats`.
+static GrayFrame gray_from_mat(const cv::Mat &screen, SearchMode mode,
+                               VisionStats &stats) {
+  GrayFrame frame;
+  const uint64_t t0 = vision_now_ns();
+  if (screen.type() == CV_8UC4) {
+    frame = gray_from_rgba(screen.data, screen.step, screen.cols, screen.rows,
+                           mode);
+    stats.record(VisionStage::Convert, vision_now_ns() - t0);
+  } else if (screen.channels() == 3) {
+    cv::cvtColor(screen, frame.gray, cv::COLOR_RGB2GRAY);
+    stats.record(VisionStage::Convert, vision_now_ns() - t0);
+  } else {
+    // Kept as the next frame's diff reference, so it must not alias the
+    // caller's buffer.
+    frame.gray = screen.clone();
+  }
+  return frame;
+}
+
+std::vector<MatchResult> VisionMatcher::match(const cv::Mat &screen) {
+  if (screen.empty())
+    return std::vector<MatchResult>();
+  return match_gray(*state_,
+                    gray_from_mat(screen, config().mode, state_->stats),
+                    nullptr);
+}
+
+std::vector<MatchResult> VisionMatcher::match(const cv::Mat &screen,
+                                              const MatchRequest &request) {
+  if (screen.empty())
+    return std::vector<MatchResult>();
+  return match_gray(*state_,
+                    gray_from_mat(screen, config().mode, state_->stats),
+                    &request);
+}
+
+std::vector<MatchResult> VisionMatcher::match(const FrameRef &frame) {
+  if (!frame || frame->gray.empty())
+    return std::vector<MatchResult>();
+  return match_gray(*state_, gray_from_pooled(frame), nullptr);
+}
+
+std::vector<MatchResult> VisionMatcher::match(const FrameRef &frame,
+                                              const MatchRequest &request) {
+  if (!frame || frame->gray.empty())
+    return std::vector<MatchResult>();
+  return match_gray(*state_, gray_from_pooled(frame), &request);
+}
+
+bool VisionMatcher::submit_frame(const uint8_t *pixels, size_t capacity,
+                                 int width, int height, int row_stride,
+                                 int pixel_stride) {
+  if (!vision_plane_fits("submit_frame", pixels, capacity, width, height,
+                         row_stride, pixel_stride))
     return false;
-  if (!pixels)
+
+  // Convert straight from the caller's memory, skipping the row padding:
+  // the only writes are the grayscale frame (and its 4x level), plus the
+  // detector input while a detector is attached.
+  GrayFrame spare;
+  {
+    std::lock_guard<std::mutex> lock(state_->frame_mutex);
+    spare = std::move(state_->spare);
+  }
+  const uint64_t t0 = vision_now_ns();
+  GrayFrame frame = gray_from_rgba(pixels, (size_t)row_stride, width, height,
+                                   config().mode, std::move(spare));
+  state_->stats.record(VisionStage::Convert, vision_now_ns() - t0);
+  publish_frame(*state_, frame, pixels, (size_t)row_stride);
+  return true;
+}
+
+bool VisionMatcher::submit_frame(const FrameRef &frame) {
+  if (!frame || frame->gray.empty())
     return false;
+  publish_frame(*state_, gray_from_pooled(frame), frame->rgba.data,
+                frame->rgba.step);
+  return true;
+}
 
-  // Deep copy so we can safely unlock
-  cv::Mat view(info.height, info.width, CV_8UC4, pixels);
-  view.copyTo(dst);
+void VisionMatcher::set_detector(std::shared_ptr<VisionDetector> detector) {
+  std::lock_guard<std::mutex> lock(state_->detect_mutex);
+  state_->detector = std::move(detector);
+  state_->detect_input.reset();
+  state_->detect_spare.reset();
+}
+
+bool VisionMatcher::detect_latest(std::vector<Detection> &out) {
+  std::shared_ptr<VisionDetector> detector;
+  std::shared_ptr<DetectorInput> input;
+  {
+    std::lock_guard<std::mutex> lock(state_->detect_mutex);
+    detector = state_->detector;
+    input = state_->detect_input;
+  }
+  if (!detector || !input) {
+    out.clear();
+    return false;
+  }
+  const uint64_t t0 = vision_now_ns();
+  const bool ok = detector->run(*input, out);
+  state_->stats.record(VisionStage::Detect, vision_now_ns() - t0);
+  return ok;
+}
 
-  AndroidBitmap_unlockPixels(env, bitmap);
+bool VisionMatcher::wait_frame(uint64_t &sequence, cv::Mat &gray,
+                               int64_t &timestamp_ms, int timeout_ms) {
+  std::unique_lock<std::mutex> lock(state_->frame_mutex);
+  if (!state_->frame_cv.wait_for(
+          lock, std::chrono::milliseconds(std::max(timeout_ms, 0)),
+          [&] { return state_->latest_sequence > sequence; }))
+    return false;
+  sequence = state_->latest_sequence;
+  timestamp_ms = state_->latest_ms;
+  GrayFrame frame = state_->latest;
+  lock.unlock();
+  // Pooled pixels are refilled once released, so the caller gets a copy.
+  gray = frame.source ? frame.gray.clone() : frame.gray;
   return true;
 }
 
-// ── JNI Exports ───────────────────────────────────────────────────────
+// ── Waiting for templates ─────────────────────────────────────────────
 
-extern "C" {
+// With the target on screen, how long without a new frame counts as the
+// screen holding still for one more stable frame.
+static constexpr int kWaitQuietMs = 250;
+// How far a hit's centre may move between frames and still count as stable.
+static constexpr int kWaitStableShift = 8;
 
-JNIEXPORT jstring JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeInit(
-    JNIEnv *env, jobject) {
-  vision_init();
-  return env->NewStringUTF("Vision Engine Initialized (Template Matching)");
+// The results of `results` that count as hits for `request`.
+static std::vector<MatchResult>
+wait_hits(const std::vector<MatchResult> &results,
+          const WaitRequest &request) {
+  std::vector<MatchResult> hits;
+  for (const MatchResult &r : results)
+    if (r.matched && r.score >= request.min_score)
+      hits.push_back(r);
+  return hits;
 }
 
-JNIEXPORT void JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeAddTemplate(
-    JNIEnv *env, jobject, jint id, jobject bitmap) {
-  cv::Mat mat;
-  if (!bitmap_to_mat(env, bitmap, mat))
-    return;
-  vision_add_template((int)id, mat);
+static bool wait_satisfied(const std::vector<MatchResult> &results,
+                           const std::vector<MatchResult> &hits,
+                           const MatchRequest &request) {
+  std::vector<int> asked, hit;
+  for (const MatchResult &r : results)
+    asked.push_back(r.id);
+  for (const MatchResult &r : hits)
+    hit.push_back(r.id);
+  for (std::vector<int> *ids : {&asked, &hit}) {
+    std::sort(ids->begin(), ids->end());
+    ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+  }
+  switch (request.stop) {
+  case MatchStop::First:
+    return !hit.empty();
+  case MatchStop::AnyN:
+    return (int)hit.size() >= std::max(request.n, 1);
+  case MatchStop::All:
+  default:
+    return !asked.empty() && hit.size() == asked.size();
+  }
 }
 
-JNIEXPORT void JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeClearTemplates(
-    JNIEnv *env, jobject) {
-  vision_clear_templates();
+// True when every hit in `now` has a hit of the same template in `before`
+// within kWaitStableShift of it.
+static bool wait_same_place(const std::vector<MatchResult> &before,
+                            const std::vector<MatchResult> &now) {
+  for (const MatchResult &r : now) {
+    const int cx = r.rect.x + r.rect.width / 2;
+    const int cy = r.rect.y + r.rect.height / 2;
+    bool held = false;
+    for (const MatchResult &p : before) {
+      const int dx = p.rect.x + p.rect.width / 2 - cx;
+      const int dy = p.rect.y + p.rect.height / 2 - cy;
+      if (p.id == r.id && std::abs(dx) <= kWaitStableShift &&
+          std::abs(dy) <= kWaitStableShift) {
+        held = true;
+        break;
+      }
+    }
+    if (!held)
+      return false;
+  }
+  return true;
 }
 
-JNIEXPORT jobjectArray JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatch(
-    JNIEnv *env, jobject, jobject bitmap) {
+WaitResult VisionMatcher::wait_for(const FramePool &pool,
+                                   const WaitRequest &request) {
+  WaitResult out;
+  const int64_t deadline = steady_ms() + std::max(request.timeout_ms, 0);
+  const int stable = std::max(request.stable_frames, 1);
+  std::vector<MatchResult> hits; // of the previous satisfying frame
+  uint64_t seen = 0;
+  int streak = 0;
+  auto cancelled = [&] {
+    return pool.closed() ||
+           (request.cancel && request.cancel->load(std::memory_order_acquire));
+  };
 
-  cv::Mat screen;
-  if (!bitmap_to_mat(env, bitmap, screen))
-    return nullptr;
+  FrameRef frame = pool.latest();
+  // Frames up to this one may show the screen before the caller's action.
+  const uint64_t stale = frame ? frame->sequence : 0;
+  for (;;) {
+    if (frame) {
+      seen = frame->sequence;
+      out.frames++;
+      out.results = match(frame, request.match);
+      // Drop the frame before waiting so its buffer can be refilled.
+      frame.reset();
+      std::vector<MatchResult> now = wait_hits(out.results, request);
+      if (!wait_satisfied(out.results, now, request.match))
+        streak = 0;
+      else if (streak > 0 && wait_same_place(hits, now))
+        streak++;
+      else
+        streak = 1;
+      hits.swap(now);
+    } else if (streak > 0 && seen > stale) {
+      streak++; // quiet: the screen still shows the last frame
+    }
+    if (streak >= stable) {
+      out.found = true;
+      return out;
+    }
 
-  std::vector<MatchResult> results = vision_match_all(screen);
+    const int64_t left = deadline - steady_ms();
+    if (left <= 0 || cancelled())
+      return out;
+    const int64_t wait = streak > 0 && seen > stale
+                             ? std::min<int64_t>(left, kWaitQuietMs)
+                             : left;
+    frame = pool.wait_newer(seen, (int)wait, request.cancel);
+    if (!frame && cancelled())
+      return out;
+  }
+}
 
-  // Create Java Array of MatchResultNative
-  jclass cls = env->FindClass(
-      "com/autonion/automationcompanion/core/vision/MatchResultNative");
-  if (!cls)
-    return nullptr;
+bool VisionMatcher::start_recording(const std::string &path) {
+  std::vector<RecordedTemplate> templates;
+  for (const auto &pair : current_registry(*state_)->templates) {
+    const TemplateEntry &entry = *pair.second;
+    RecordedTemplate t;
+    t.id = pair.first;
+    t.gray = entry.gray;
+    if (entry.has_prior)
+      t.prior = entry.prior;
+    t.margin = entry.prior_margin;
+    t.features = entry.features != nullptr;
+    templates.push_back(t);
+  }
+  std::lock_guard<std::mutex> lock(state_->record_mutex);
+  state_->recorder.close();
+  state_->record_start_ms = steady_ms();
+  return state_->recorder.open(path, templates);
+}
 
-  jmethodID ctor = env->GetMethodID(cls, "<init>", "(IZFIIII)V");
-  if (!ctor)
-    return nullptr;
+size_t VisionMatcher::stop_recording() {
+  std::lock_guard<std::mutex> lock(state_->record_mutex);
+  if (!state_->recorder.is_open())
+    return 0;
+  return state_->recorder.close();
+}
 
-  jobjectArray jobjArray =
-      env->NewObjectArray((jsize)results.size(), cls, nullptr);
+std::vector<MatchResult> VisionMatcher::match_latest() {
+  GrayFrame frame;
+  {
+    std::lock_guard<std::mutex> lock(state_->frame_mutex);
+    frame = state_->latest;
+  }
+  return match_gray(*state_, frame, nullptr);
+}
 
-  for (size_t i = 0; i < results.size(); ++i) {
-    jobject obj = env->NewObject(
-        cls, ctor, (jint)results[i].id,
-        results[i].matched ? JNI_TRUE : JNI_FALSE, (jfloat)results[i].score,
-        (jint)results[i].rect.x, (jint)results[i].rect.y,
-        (jint)results[i].rect.width, (jint)results[i].rect.height);
-    env->SetObjectArrayElement(jobjArray, (jsize)i, obj);
-    env->DeleteLocalRef(obj);
+std::vector<MatchResult>
+VisionMatcher::match_latest(const MatchRequest &request) {
+  GrayFrame frame;
+  {
+    std::lock_guard<std::mutex> lock(state_->frame_mutex);
+    frame = state_->latest;
   }
+  return match_gray(*state_, frame, &request);
+}
+
+// The latest frame when it is newer than `sequence`, which is advanced to
+// it; false when there is none, or the slot was cleared since.
+static bool latest_since(VisionMatcher::State &st, uint64_t &sequence,
+                         GrayFrame &frame) {
+  std::lock_guard<std::mutex> lock(st.frame_mutex);
+  if (st.latest_sequence <= sequence || st.latest.gray.empty())
+    return false;
+  sequence = st.latest_sequence;
+  frame = st.latest;
+  return true;
+}
 
-  return jobjArray;
+bool VisionMatcher::match_latest(uint64_t &sequence,
+                                 std::vector<MatchResult> &results) {
+  GrayFrame frame;
+  if (!latest_since(*state_, sequence, frame))
+    return false;
+  results = match_gray(*state_, frame, nullptr);
+  return true;
+}
+
+bool VisionMatcher::match_latest(uint64_t &sequence,
+                                 const MatchRequest &request,
+                                 std::vector<MatchResult> &results) {
+  GrayFrame frame;
+  if (!latest_since(*state_, sequence, frame))
+    return false;
+  results = match_gray(*state_, frame, &request);
+  return true;
 }
+
+void VisionMatcher::clear_latest() {
+  {
+    std::lock_guard<std::mutex> lock(state_->frame_mutex);
+    state_->latest = GrayFrame();
+  }
+  std::lock_guard<std::mutex> lock(state_->detect_mutex);
+  state_->detect_input.reset();
+}
+
+FrameDiffStats VisionMatcher::last_frame_diff() const {
+  std::lock_guard<std::mutex> lock(state_->memory_mutex);
+  return state_->last_diff;
+}
+
+std::string VisionMatcher::stats_json() const {
+  return state_->stats.json(state_->scratch);
+}
+
+void VisionMatcher::reset_stats() {
+  state_->stats.reset();
+  state_->scratch.growths.store(0);
+}
+
+uint64_t VisionMatcher::scratch_growths() const {
+  return state_->scratch.growths.load(std::memory_order_relaxed);
+}
+
+uint64_t VisionMatcher::scratch_bytes() const {
+  return state_->scratch.bytes.load(std::memory_order_relaxed);
+}
+
+void VisionMatcher::record_stage(VisionStage stage, uint64_t ns) {
+  state_->stats.record(stage, ns);
+}
+
+// ── Process-wide matcher ──────────────────────────────────────────────
+
+VisionMatcher &vision_default_matcher() {
+  static VisionMatcher matcher;
+  return matcher;
+}
+
+void vision_init() {
+  vision_default_matcher().clear_templates();
+  LOGD("Vision Engine Initialized (Template Matching)");
+}
+
+void vision_add_template(int id, const cv::Mat &templ) {
+  vision_default_matcher().add_template(id, templ);
+}
+
+void vision_add_template(int id, const cv::Mat &templ, const cv::Rect &prior,
+                         int margin) {
+  vision_default_matcher().add_template(id, templ, prior, margin);
+}
+
+bool vision_add_feature_template(int id, const cv::Mat &templ) {
+  return vision_default_matcher().add_feature_template(id, templ);
+}
+
+int vision_add_pack(const std::string &path, uint64_t checksum) {
+  return vision_default_matcher().add_pack(path, checksum);
+}
+
+void vision_clear_templates() { vision_default_matcher().clear_templates(); }
+
+void vision_set_config(const MatchConfig &config) {
+  vision_default_matcher().set_config(config);
+}
+
+MatchConfig vision_get_config() { return vision_default_matcher().config(); }
+
+void vision_set_threads(int threads, const std::vector<int> &cpus) {
+  vision_default_matcher().set_threads(threads, cpus);
+}
+
+int vision_get_threads() { return vision_default_matcher().threads(); }
+
+std::vector<MatchResult> vision_match_all(const cv::Mat &screen) {
+  return vision_default_matcher().match(screen);
+}
+
+std::vector<MatchResult> vision_match(const cv::Mat &screen,
+                                      const MatchRequest &request) {
+  return vision_default_matcher().match(screen, request);
+}
+
+FrameDiffStats vision_last_frame_diff() {
+  return vision_default_matcher().last_frame_diff();
+}
+
+bool vision_submit_frame(const uint8_t *pixels, size_t capacity, int width,
+                         int height, int row_stride, int pixel_stride) {
+  return vision_default_matcher().submit_frame(pixels, capacity, width, height,
+                                               row_stride, pixel_stride);
+}
+
+std::vector<MatchResult> vision_match_latest() {
+  return vision_default_matcher().match_latest();
+}
+
+std::vector<MatchResult> vision_match_latest(const MatchRequest &request) {
+  return vision_default_matcher().match_latest(request);
 }
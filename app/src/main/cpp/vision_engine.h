@@ -1,46 +1,305 @@
 #ifndef VISION_ENGINE_H
 #define VISION_ENGINE_H
 
-#include <jni.h>
+#include <atomic>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
 
-// Helper to convert Bitmap to Mat
-bool bitmap_to_mat(JNIEnv *env, jobject bitmap, cv::Mat &dst);
+#include "vision_dnn.h"
+#include "vision_frames.h"
+#include "vision_stats.h"
 
-void vision_init();
-void vision_add_template(int id, const cv::Mat &templ);
-void vision_clear_templates();
+// Pure OpenCV matcher core. Nothing declared here may depend on JNI or the
+// Android NDK so the same code builds on a desktop host for benchmarking;
+// the JNI glue lives in vision_jni.cpp.
+
+// Scales tried per template, in evaluation order. 1.0 comes first so a strong
+// native-scale hit (> kEarlyExitScore) can skip the remaining passes.
+constexpr float kMatchScales[] = {1.0f, 0.95f, 1.05f, 0.9f, 1.1f, 0.85f, 1.15f};
+constexpr int kNumMatchScales = sizeof(kMatchScales) / sizeof(kMatchScales[0]);
+constexpr float kEarlyExitScore = 0.90f;
+constexpr float kMatchThreshold = 0.75f;
+
+// How each template is searched for.
+//  Exhaustive: every scale at full resolution over the whole frame.
+//  Pyramid:    every scale at 1/pyramid_factor resolution, then only the best
+//              refine_candidates (location, scale) pairs are re-scored at full
+//              resolution in small windows. Reported scores are exact
+//              full-resolution values at the refined location, so they equal
+//              the exhaustive score whenever the same peak is found; the bench
+//              fails unless both modes agree on every decision, every hit's
+//              scale and, within kPyramidLocationTolerance pixels, position,
+//              and |delta| <= kPyramidScoreTolerance.
+// Exhaustive is the default; Pyramid is an explicit opt-in per matcher.
+enum class SearchMode { Exhaustive = 0, Pyramid = 1 };
+
+constexpr float kPyramidScoreTolerance = 0.05f;
+constexpr int kPyramidLocationTolerance = 2;
+
+struct MatchConfig {
+  SearchMode mode = SearchMode::Exhaustive;
+  int pyramid_factor = 4;    // 4 or 8; small templates fall back to less
+  int refine_candidates = 3; // coarse peaks refined at full resolution
+  int diff_tile = 32;        // dirty-tile side in pixels; 0 disables reuse
+};
 
 struct MatchResult {
   int id;
   bool matched;
   float score;
   cv::Rect rect;
+  bool from_prior; // hit came from the prior window, not the full-frame search
 };
 
-std::vector<MatchResult> vision_match_all(const cv::Mat &screen);
+// When a targeted match stops.
+//  All:   every requested template is evaluated.
+//  First: evaluation stops at the first match.
+//  AnyN:  evaluation stops once `n` templates matched.
+enum class MatchStop { All = 0, First = 1, AnyN = 2 };
+
+// A targeted match: only `ids` are evaluated, in that order (unknown and
+// repeated IDs are skipped), and results come back in the same order; no
+// IDs means every template in ID order. With a stop condition, results end
+// at the satisfying match; templates after it are never matched, apart
+// from those already running beside it on the worker pool, whose results
+// are dropped.
+//
+// `instances` above 1 asks for every copy of a template on screen (each
+// "Install" button of a list) from the same scan: a matched template's best
+// result is followed by its other correlation peaks above kMatchThreshold,
+// strongest first, each overlapping no earlier one by more than a tenth of
+// the smaller box, up to `instances` results for that ID. Such searches
+// cover the whole frame (priors are ignored) and are never answered from
+// the previous frame. Feature-mode templates give one result.
+struct MatchRequest {
+  std::vector<int> ids;
+  MatchStop stop = MatchStop::All;
+  int n = 1;         // for AnyN; counts templates, not instances
+  int instances = 1; // results per matched template, at most
+};
+
+// A wait for templates to appear (see VisionMatcher::wait_for). A frame
+// satisfies it when `match` would: every requested template hit for All,
+// any for First, `n` templates for AnyN, counting only hits scoring at
+// least `min_score`. The target is found after `stable_frames` satisfying
+// frames in a row that each place every hit where the previous one did,
+// so a button still sliding in is not tapped mid-animation.
+//
+// `cancel`, when given, ends the wait once set; call FramePool::wake()
+// after setting it so a wait blocked on the pool notices at once.
+struct WaitRequest {
+  MatchRequest match;
+  float min_score = kMatchThreshold;
+  int timeout_ms = 5000;
+  int stable_frames = 1;
+  const std::atomic<bool> *cancel = nullptr;
+};
+
+struct WaitResult {
+  bool found = false;
+  std::vector<MatchResult> results; // from the last frame matched
+  int frames = 0;                   // frames matched while waiting
+};
+
+// What the dirty-tile pass saved on the most recent frame.
+struct FrameDiffStats {
+  int tiles = 0;         // tiles in the grid; 0 when reuse is disabled
+  int tiles_changed = 0; // every tile when there was no comparable frame
+  int templates = 0;
+  int templates_skipped = 0; // answered from the previous frame
+};
+
+// An independent matcher: its own templates, config, worker pool, frame
+// memory and latest-frame slot. Instances share nothing, so several callers
+// can register their templates once and match in parallel without
+// contending on a lock or clobbering each other's sets. Every method is
+// thread-safe; matches on one instance may overlap. Matches take no lock:
+// each runs against the templates and config current when it started, and
+// registering, removing or clearing templates never waits for it.
+class VisionMatcher {
+public:
+  VisionMatcher();
+  ~VisionMatcher();
+
+  VisionMatcher(const VisionMatcher &) = delete;
+  VisionMatcher &operator=(const VisionMatcher &) = delete;
 
-extern "C" {
+  void add_template(int id, const cv::Mat &templ);
+  // Registers a template together with the rectangle it was recorded at.
+  // Each frame searches that rectangle grown by `margin` pixels first and
+  // only falls back to a full-frame search when the windowed score misses
+  // the threshold.
+  void add_template(int id, const cv::Mat &templ, const cv::Rect &prior,
+                    int margin);
+  // Registers a template for keypoint matching (see vision_features.h),
+  // which finds it rotated or at scales well outside kMatchScales, e.g. on a
+  // screen of another density. Its score is the pixel correlation of the
+  // template warped to where the keypoints place it, so thresholds carry
+  // over. Templates too plain for keypoints (flat buttons, short text) are
+  // registered for pixel matching instead and false is returned.
+  bool add_feature_template(int id, const cv::Mat &templ);
+  // Registers the templates of a pack written by vision_compile_pack — all
+  // of them, or only `ids` when non-empty — wrapping its mapped pixels
+  // without copying. Returns how many were added, or -1 when the pack is
+  // missing, corrupt, built from other sources (`checksum` differs) or for
+  // other match tables; the caller then recompiles it.
+  int add_pack(const std::string &path, uint64_t checksum,
+               const std::vector<int> &ids = std::vector<int>());
+  bool remove_template(int id);
+  void clear_templates();
+  size_t template_count() const;
 
-JNIEXPORT jstring JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeInit(
-    JNIEnv *env, jobject thiz);
+  void set_config(const MatchConfig &config);
+  MatchConfig config() const;
 
-JNIEXPORT void JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeAddTemplate(
-    JNIEnv *env, jobject thiz, jint id, jobject bitmap);
+  // Matches templates — and stripes of large or few full-frame exhaustive
+  // searches — on `threads` threads including the caller, with results
+  // still in ID order. Workers pin themselves to `cpus` when it is non-empty
+  // (see vision_performance_cores). 1 restores serial matching.
+  void set_threads(int threads, const std::vector<int> &cpus);
+  int threads() const;
 
-JNIEXPORT void JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeClearTemplates(
-    JNIEnv *env, jobject thiz);
+  // Each frame is compared with the previous one in diff_tile x diff_tile
+  // tiles. A template whose search area (the prior window it hit in, or the
+  // whole frame) has no changed tile keeps its previous result without
+  // being matched again; any template, config or frame size change matches
+  // all.
+  std::vector<MatchResult> match(const cv::Mat &screen);
+  // Matches only the templates `request` names; see MatchRequest.
+  std::vector<MatchResult> match(const cv::Mat &screen,
+                                 const MatchRequest &request);
+  // Matches a pooled frame (see vision_frames.h) in place, without
+  // converting it again. The frame is only referenced during the call.
+  std::vector<MatchResult> match(const FrameRef &frame);
+  std::vector<MatchResult> match(const FrameRef &frame,
+                                 const MatchRequest &request);
 
-JNIEXPORT jobjectArray JNICALL
-Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatch(
-    JNIEnv *env, jobject thiz, jobject bitmap);
-}
+  // Zero-copy ingestion: converts an RGBA_8888 frame straight from the
+  // caller's memory (e.g. an ImageReader plane) into the latest-frame slot.
+  // `row_stride` may include padding; `capacity` is the buffer size in
+  // bytes. Only pixel_stride 4 is supported. The caller may reuse the memory
+  // as soon as this returns.
+  bool submit_frame(const uint8_t *pixels, size_t capacity, int width,
+                    int height, int row_stride, int pixel_stride);
+  // Makes a pooled frame the latest without copying or converting it; it
+  // stays referenced, holding its pool buffer, until the next submit.
+  bool submit_frame(const FrameRef &frame);
+  // Matches against the latest submitted frame; empty before the first
+  // submit.
+  std::vector<MatchResult> match_latest();
+  std::vector<MatchResult> match_latest(const MatchRequest &request);
+  // For a caller polling on a timer: matches the latest frame only when it
+  // was submitted after the one numbered `sequence` (0 before any), which is
+  // then set to its number. False, with `results` untouched, when there is
+  // no newer frame, so a screen that did not change is not acted on twice.
+  bool match_latest(uint64_t &sequence, std::vector<MatchResult> &results);
+  bool match_latest(uint64_t &sequence, const MatchRequest &request,
+                    std::vector<MatchResult> &results);
+  // Empties the latest-frame slot, releasing a pooled frame and the
+  // detector input, so nothing submitted before is matched or detected on
+  // again; sequence numbers keep counting.
+  void clear_latest();
+
+  // Matches every frame `pool` takes in, starting with the latest already
+  // there, until `request` is satisfied or its timeout passes; returns as
+  // soon as the target is found, with that frame's results. A capture only
+  // produces frames while the screen changes, so once the target is on
+  // screen, a quiet spell with no new frame counts as one more stable
+  // frame -- but only after a frame captured since the call has matched:
+  // the latest frame at the call may predate the action that led to the
+  // wait, and its target may already be gone. Ends early when the pool is
+  // closed or the request is cancelled. Blocks the calling thread.
+  WaitResult wait_for(const FramePool &pool, const WaitRequest &request);
+
+  // Waits up to `timeout_ms` for a frame submitted after the one numbered
+  // `sequence` (0 before any), then hands out the latest grayscale frame,
+  // its number and its submit time (steady clock, milliseconds). False on
+  // timeout. See LiveFrameSource in vision_record.h.
+  bool wait_frame(uint64_t &sequence, cv::Mat &gray, int64_t &timestamp_ms,
+                  int timeout_ms);
+
+  // Attaches a detector (nullptr detaches it). While one is attached,
+  // submit_frame also prepares the frame as its input, so detect_latest
+  // runs on the submitted frame without another copy or conversion.
+  void set_detector(std::shared_ptr<VisionDetector> detector);
+  // Detects on the latest submitted frame; false without a detector or a
+  // frame submitted since it was attached.
+  bool detect_latest(std::vector<Detection> &out);
+
+  // Records every frame submitted from now on, with the templates
+  // registered now, to `path` (see vision_record.h); register the preset
+  // first. Replaces a recording already running. Frames are written on the
+  // submitting thread.
+  bool start_recording(const std::string &path);
+  // Ends the recording and returns how many frames it holds.
+  size_t stop_recording();
+
+  FrameDiffStats last_frame_diff() const;
+
+  // Counters kept since creation or the last reset_stats(), as JSON (see
+  // VisionStats::json). record_stage adds a sample for work done outside
+  // the engine on its behalf, such as the JNI bitmap copy.
+  std::string stats_json() const;
+  void reset_stats();
+  void record_stage(VisionStage stage, uint64_t ns);
+
+  // This matcher's scratch arenas (see vision_scratch.h): buffer growths
+  // since creation or reset_stats(), none once frames are steady, and the
+  // bytes held now.
+  uint64_t scratch_growths() const;
+  uint64_t scratch_bytes() const;
+
+  struct State; // defined in vision_engine.cpp
+
+private:
+  std::unique_ptr<State> state_;
+};
+
+// One template for vision_compile_pack: any image add_template accepts,
+// plus the optional prior it is registered with.
+struct PackSource {
+  int id = 0;
+  cv::Mat templ;
+  cv::Rect prior; // empty for none
+  int margin = 0;
+};
+
+// Preprocesses `sources` exactly as add_template would and writes the
+// result as a memory-mappable pack (see vision_pack.h) tagged with the
+// caller's `checksum` of the sources. Replaces `path` atomically.
+bool vision_compile_pack(const std::string &path,
+                         const std::vector<PackSource> &sources,
+                         uint64_t checksum);
+// True when `path` is a readable pack built from `checksum` by this engine.
+bool vision_pack_current(const std::string &path, uint64_t checksum);
+
+// The process-wide matcher behind the vision_* functions below, which keep
+// the original single-set API for existing callers.
+VisionMatcher &vision_default_matcher();
+
+void vision_init();
+void vision_add_template(int id, const cv::Mat &templ);
+void vision_add_template(int id, const cv::Mat &templ, const cv::Rect &prior,
+                         int margin);
+bool vision_add_feature_template(int id, const cv::Mat &templ);
+int vision_add_pack(const std::string &path, uint64_t checksum);
+void vision_clear_templates();
+void vision_set_config(const MatchConfig &config);
+MatchConfig vision_get_config();
+void vision_set_threads(int threads, const std::vector<int> &cpus);
+int vision_get_threads();
+std::vector<MatchResult> vision_match_all(const cv::Mat &screen);
+std::vector<MatchResult> vision_match(const cv::Mat &screen,
+                                      const MatchRequest &request);
+FrameDiffStats vision_last_frame_diff();
+bool vision_submit_frame(const uint8_t *pixels, size_t capacity, int width,
+                         int height, int row_stride, int pixel_stride);
+std::vector<MatchResult> vision_match_latest();
+std::vector<MatchResult> vision_match_latest(const MatchRequest &request);
 
 #endif // VISION_ENGINE_H
@@ -0,0 +1,359 @@
+#include "vision_features.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+
+namespace {
+
+// ORB patch size; also how far the template is mirrored outwards.
+constexpr int kPatch = 31;
+// Template keypoints kept per template.
+constexpr int kTemplateFeatures = 500;
+// Templates whose short side is below this are described at 2x, where ORB
+// finds enough corners; coordinates are scaled back.
+constexpr int kMinTemplateSide = 64;
+// Votes need a Hamming distance of at most this (of 256 bits) and clearly
+// better than the template's runner-up.
+constexpr int kMaxDistance = 64;
+constexpr float kRatio = 0.8f;
+// RANSAC reprojection limit in frame pixels.
+constexpr double kReprojection = 4.0;
+// Clusters of centre predictions verified per template, densest first.
+constexpr int kClusters = 8;
+// Transforms scaling a template beyond this range are rejected.
+constexpr double kMinScale = 0.2;
+constexpr double kMaxScale = 5.0;
+
+int hamming(const uint8_t *a, const uint8_t *b) {
+  int d = 0;
+  for (int i = 0; i < kFeatureBytes; i += 8) {
+    uint64_t x, y;
+    std::memcpy(&x, a + i, 8);
+    std::memcpy(&y, b + i, 8);
+    d += __builtin_popcountll(x ^ y);
+  }
+  return d;
+}
+
+FeatureSet describe(const cv::Ptr<cv::ORB> &orb, const cv::Mat &gray,
+                    const cv::Mat &mask, float offset, float scale) {
+  std::vector<cv::KeyPoint> keypoints;
+  FeatureSet out;
+  orb->detectAndCompute(gray, mask, keypoints, out.descriptors);
+  if (out.descriptors.empty() || out.descriptors.cols != kFeatureBytes)
+    return FeatureSet();
+  for (cv::KeyPoint &kp : keypoints) {
+    kp.pt.x = (kp.pt.x - offset) / scale;
+    kp.pt.y = (kp.pt.y - offset) / scale;
+    kp.size /= scale;
+  }
+  out.keypoints = std::move(keypoints);
+  return out;
+}
+
+uint64_t cell_key(int cx, int cy) {
+  return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+}
+
+} // namespace
+
+// ── Description ───────────────────────────────────────────────────────
+
+FeatureSet vision_template_features(const cv::Mat &gray) {
+  if (gray.empty() || gray.type() != CV_8UC1)
+    return FeatureSet();
+  cv::Mat source = gray;
+  float scale = 1.0f;
+  if (std::min(gray.cols, gray.rows) < kMinTemplateSide) {
+    scale = 2.0f;
+    cv::resize(gray, source, cv::Size(), scale, scale, cv::INTER_LINEAR);
+  }
+  cv::Mat padded;
+  cv::copyMakeBorder(source, padded, kPatch, kPatch, kPatch, kPatch,
+                     cv::BORDER_REFLECT_101);
+  cv::Mat mask = cv::Mat::zeros(padded.size(), CV_8UC1);
+  mask(cv::Rect(kPatch, kPatch, source.cols, source.rows)).setTo(255);
+
+  cv::Ptr<cv::ORB> orb = cv::ORB::create(kTemplateFeatures, 1.2f, 8, kPatch,
+                                         0, 2, cv::ORB::HARRIS_SCORE, kPatch);
+  return describe(orb, padded, mask, (float)kPatch, scale);
+}
+
+FeatureSet vision_frame_features(const cv::Mat &gray, int max_features) {
+  if (gray.empty() || gray.type() != CV_8UC1 || max_features <= 0)
+    return FeatureSet();
+  cv::Ptr<cv::ORB> orb = cv::ORB::create(max_features);
+  return describe(orb, gray, cv::Mat(), 0.0f, 1.0f);
+}
+
+// ── Index ─────────────────────────────────────────────────────────────
+
+FeatureIndex::FeatureIndex(const std::vector<const FeatureSet *> &templates) {
+  // Fixed seed: the same templates always hash the same way.
+  std::mt19937 rng(0x5eed);
+  for (int t = 0; t < kTables; t++) {
+    std::vector<uint16_t> all(kFeatureBytes * 8);
+    for (size_t i = 0; i < all.size(); i++)
+      all[i] = (uint16_t)i;
+    std::shuffle(all.begin(), all.end(), rng);
+    std::copy(all.begin(), all.begin() + kKeyBits, bits_[t]);
+  }
+
+  slot_keypoints_.resize(templates.size());
+  for (size_t slot = 0; slot < templates.size(); slot++) {
+    const FeatureSet *set = templates[slot];
+    if (!set || set->descriptors.rows != (int)set->size())
+      continue;
+    slot_keypoints_[slot] = set->keypoints;
+    for (int i = 0; i < set->descriptors.rows; i++) {
+      const uint8_t *d = set->descriptors.ptr<uint8_t>(i);
+      descriptors_.insert(descriptors_.end(), d, d + kFeatureBytes);
+      owner_.push_back((uint32_t)slot);
+      point_.push_back((uint32_t)i);
+    }
+  }
+
+  // Counting sort of the entries by key, per table.
+  const size_t buckets = (size_t)1 << kKeyBits;
+  std::vector<uint32_t> keys(owner_.size());
+  for (int t = 0; t < kTables; t++) {
+    offsets_[t].assign(buckets + 1, 0);
+    for (size_t e = 0; e < owner_.size(); e++) {
+      keys[e] = key(t, &descriptors_[e * kFeatureBytes]);
+      offsets_[t][keys[e] + 1]++;
+    }
+    for (size_t b = 0; b < buckets; b++)
+      offsets_[t][b + 1] += offsets_[t][b];
+    entries_[t].resize(owner_.size());
+    std::vector<uint32_t> fill(offsets_[t].begin(), offsets_[t].end() - 1);
+    for (size_t e = 0; e < owner_.size(); e++)
+      entries_[t][fill[keys[e]]++] = (uint32_t)e;
+  }
+}
+
+uint32_t FeatureIndex::key(int table, const uint8_t *descriptor) const {
+  uint32_t k = 0;
+  for (int i = 0; i < kKeyBits; i++) {
+    const int bit = bits_[table][i];
+    k |= (uint32_t)((descriptor[bit >> 3] >> (bit & 7)) & 1) << i;
+  }
+  return k;
+}
+
+void FeatureIndex::vote(const FeatureSet &frame, size_t begin, size_t end,
+                        std::vector<std::vector<FeatureVote>> &votes) const {
+  if (owner_.empty())
+    return;
+  end = std::min(end, frame.size());
+
+  struct Nearest {
+    int first = INT_MAX;
+    int second = INT_MAX;
+    uint32_t entry = 0;
+  };
+  std::vector<Nearest> nearest(templates());
+  std::vector<uint32_t> touched;
+  std::vector<uint32_t> seen(owner_.size(), UINT32_MAX); // last query per entry
+
+  for (size_t q = begin; q < end; q++) {
+    const uint8_t *qd = frame.descriptors.ptr<uint8_t>((int)q);
+    touched.clear();
+    for (int t = 0; t < kTables; t++) {
+      const uint32_t k = key(t, qd);
+      // The exact bucket, then each bucket one key bit away.
+      for (int probe = -1; probe < kKeyBits; probe++) {
+        const uint32_t b = probe < 0 ? k : k ^ (1u << probe);
+        for (uint32_t i = offsets_[t][b]; i < offsets_[t][b + 1]; i++) {
+          const uint32_t e = entries_[t][i];
+          if (seen[e] == (uint32_t)q)
+            continue;
+          seen[e] = (uint32_t)q;
+          const int d = hamming(qd, &descriptors_[(size_t)e * kFeatureBytes]);
+          Nearest &n = nearest[owner_[e]];
+          if (n.first == INT_MAX)
+            touched.push_back(owner_[e]);
+          if (d < n.first) {
+            n.second = n.first;
+            n.first = d;
+            n.entry = e;
+          } else if (d < n.second) {
+            n.second = d;
+          }
+        }
+      }
+    }
+    for (uint32_t slot : touched) {
+      Nearest &n = nearest[slot];
+      if (n.first <= kMaxDistance &&
+          (n.second == INT_MAX || (float)n.first < kRatio * (float)n.second)) {
+        const cv::KeyPoint &t = slot_keypoints_[slot][point_[n.entry]];
+        const cv::KeyPoint &f = frame.keypoints[q];
+        votes[slot].push_back({t.pt, f.pt, f.size / t.size, f.angle - t.angle});
+      }
+      n = Nearest();
+    }
+  }
+}
+
+// ── Verification ──────────────────────────────────────────────────────
+
+bool vision_verify_votes(const std::vector<FeatureVote> &votes,
+                         const cv::Size &templ_size, cv::Mat &transform,
+                         int &inliers) {
+  inliers = 0;
+  if ((int)votes.size() < kMinFeatureInliers)
+    return false;
+
+  // Each vote's keypoint pair implies a full similarity transform; bin the
+  // template centre it predicts. Cells are half the template's short side,
+  // and a cluster is a cell with its eight neighbours.
+  const float cx = templ_size.width * 0.5f, cy = templ_size.height * 0.5f;
+  const float cell = std::max(
+      16.0f, std::min(templ_size.width, templ_size.height) * 0.5f);
+  std::vector<std::pair<uint64_t, int>> cells;
+  cells.reserve(votes.size());
+  for (size_t i = 0; i < votes.size(); i++) {
+    const FeatureVote &v = votes[i];
+    if (!(v.scale >= kMinScale && v.scale <= kMaxScale))
+      continue;
+    const float rad = v.angle * (float)(CV_PI / 180.0);
+    const float c = std::cos(rad) * v.scale, s = std::sin(rad) * v.scale;
+    const float dx = cx - v.templ.x, dy = cy - v.templ.y;
+    const float px = v.frame.x + c * dx - s * dy;
+    const float py = v.frame.y + s * dx + c * dy;
+    cells.emplace_back(cell_key((int)std::floor(px / cell),
+                                (int)std::floor(py / cell)),
+                       (int)i);
+  }
+  std::sort(cells.begin(), cells.end());
+
+  auto range = [&cells](uint64_t key) {
+    auto lo = std::lower_bound(cells.begin(), cells.end(),
+                               std::make_pair(key, INT_MIN));
+    auto hi = std::lower_bound(lo, cells.end(),
+                               std::make_pair(key + 1, INT_MIN));
+    return std::make_pair(lo, hi);
+  };
+  auto neighbourhood = [&](uint64_t key, std::vector<int> *members) {
+    const int kx = (int)(uint32_t)key, ky = (int)(uint32_t)(key >> 32);
+    int n = 0;
+    for (int y = ky - 1; y <= ky + 1; y++) {
+      for (int x = kx - 1; x <= kx + 1; x++) {
+        auto r = range(cell_key(x, y));
+        n += (int)(r.second - r.first);
+        if (members)
+          for (auto it = r.first; it != r.second; ++it)
+            members->push_back(it->second);
+      }
+    }
+    return n;
+  };
+
+  std::vector<std::pair<int, uint64_t>> clusters; // (votes, cell)
+  for (size_t i = 0; i < cells.size();) {
+    const uint64_t key = cells[i].first;
+    const int n = neighbourhood(key, nullptr);
+    if (n >= kMinFeatureInliers)
+      clusters.emplace_back(n, key);
+    while (i < cells.size() && cells[i].first == key)
+      i++;
+  }
+  std::sort(clusters.begin(), clusters.end(),
+            std::greater<std::pair<int, uint64_t>>());
+  if ((int)clusters.size() > kClusters)
+    clusters.resize(kClusters);
+
+  std::vector<int> members;
+  std::vector<cv::Point2f> from, to;
+  std::vector<uint8_t> mask;
+  for (const auto &cluster : clusters) {
+    if (cluster.first <= inliers)
+      break; // cannot beat the best fit so far
+    members.clear();
+    neighbourhood(cluster.second, &members);
+    from.clear();
+    to.clear();
+    for (int i : members) {
+      from.push_back(votes[(size_t)i].templ);
+      to.push_back(votes[(size_t)i].frame);
+    }
+    cv::Mat m = cv::estimateAffinePartial2D(from, to, mask, cv::RANSAC,
+                                            kReprojection);
+    if (m.empty())
+      continue;
+    const double a = m.at<double>(0, 0), b = m.at<double>(1, 0);
+    const double scale = std::sqrt(a * a + b * b);
+    if (scale < kMinScale || scale > kMaxScale)
+      continue;
+    const int n = (int)std::count(mask.begin(), mask.end(), (uint8_t)1);
+    if (n > inliers) {
+      inliers = n;
+      transform = m;
+    }
+  }
+  return inliers >= kMinFeatureInliers;
+}
+
+float vision_warped_score(const cv::Mat &frame, const cv::Mat &templ,
+                          const cv::Mat &transform, cv::Rect &rect) {
+  const float w = (float)templ.cols, h = (float)templ.rows;
+  std::vector<cv::Point2f> corners = {{0, 0}, {w, 0}, {w, h}, {0, h}};
+  std::vector<cv::Point2f> moved;
+  cv::transform(corners, moved, transform);
+  float x0 = moved[0].x, y0 = moved[0].y, x1 = x0, y1 = y0;
+  for (const cv::Point2f &p : moved) {
+    x0 = std::min(x0, p.x);
+    y0 = std::min(y0, p.y);
+    x1 = std::max(x1, p.x);
+    y1 = std::max(y1, p.y);
+  }
+  rect = cv::Rect((int)std::floor(x0), (int)std::floor(y0),
+                  (int)std::ceil(x1 - x0), (int)std::ceil(y1 - y0));
+  rect &= cv::Rect(0, 0, frame.cols, frame.rows);
+  if (rect.empty())
+    return 0.0f;
+
+  // Warp straight into the clipped rectangle, with a mask of the pixels the
+  // template actually covers (rotation leaves empty corners).
+  cv::Mat shifted = transform.clone();
+  shifted.at<double>(0, 2) -= rect.x;
+  shifted.at<double>(1, 2) -= rect.y;
+  cv::Mat warped, footprint;
+  cv::warpAffine(templ, warped, shifted, rect.size(), cv::INTER_LINEAR,
+                 cv::BORDER_CONSTANT);
+  cv::warpAffine(cv::Mat(templ.size(), CV_8UC1, cv::Scalar(255)), footprint,
+                 shifted, rect.size(), cv::INTER_NEAREST,
+                 cv::BORDER_CONSTANT);
+
+  double n = 0, st = 0, sf = 0, stt = 0, sff = 0, stf = 0;
+  for (int y = 0; y < rect.height; y++) {
+    const uint8_t *t = warped.ptr<uint8_t>(y);
+    const uint8_t *m = footprint.ptr<uint8_t>(y);
+    const uint8_t *f = frame.ptr<uint8_t>(rect.y + y) + rect.x;
+    for (int x = 0; x < rect.width; x++) {
+      if (!m[x])
+        continue;
+      const double tv = t[x], fv = f[x];
+      n++;
+      st += tv;
+      sf += fv;
+      stt += tv * tv;
+      sff += fv * fv;
+      stf += tv * fv;
+    }
+  }
+  if (n == 0)
+    return 0.0f;
+  const double vt = stt - st * st / n;
+  const double vf = sff - sf * sf / n;
+  // As with TM_CCOEFF_NORMED (and normalize_ccoeff), zero variance on
+  // either side leaves nothing to correlate, which scores 0: a flat patch
+  // must not clear the threshold.
+  if (vt <= 0 || vf <= 0)
+    return 0.0f;
+  return (float)((stf - st * sf / n) / std::sqrt(vt * vf));
+}
@@ -0,0 +1,110 @@
+#ifndef VISION_FEATURES_H
+#define VISION_FEATURES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Keypoint matching for templates that change scale or rotation beyond what
+// the kMatchScales passes cover (other DPIs, rotated icons). Templates are
+// described once at registration with ORB; all their descriptors live in
+// one FeatureIndex. Each frame is described once, every frame descriptor
+// is looked up in the index, and the hits vote for their templates
+// together, so the per-frame cost grows with the number of features rather
+// than with templates x scales. Each vote also predicts where the
+// template's centre lands (from the keypoints' scale and orientation); the
+// densest clusters of predictions are verified by fitting one similarity
+// transform (rotation, uniform scale, translation) and the template is
+// scored warped through the best one.
+
+// ORB descriptors are 256 bits.
+constexpr int kFeatureBytes = 32;
+// Templates yielding fewer keypoints than this stay on pixel matching.
+constexpr int kMinTemplateFeatures = 12;
+// Votes agreeing on one transform needed to report a template as found.
+constexpr int kMinFeatureInliers = 8;
+
+// Keypoints and their descriptors (CV_8UC1, kFeatureBytes per row, row i
+// describing keypoints[i]).
+struct FeatureSet {
+  std::vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+
+  size_t size() const { return keypoints.size(); }
+};
+
+// Describes a grayscale template. The image is mirrored outwards by one ORB
+// patch first so corners and edges near the border still get keypoints;
+// only keypoints inside the template are kept.
+FeatureSet vision_template_features(const cv::Mat &gray);
+
+// Describes a grayscale frame, keeping the `max_features` strongest
+// keypoints. Small elements on a busy screen only get a few keypoints each,
+// so this wants to be in the tens of thousands.
+FeatureSet vision_frame_features(const cv::Mat &gray, int max_features);
+
+// A frame keypoint voting for a template keypoint, with the scale and
+// rotation (degrees) between the two.
+struct FeatureVote {
+  cv::Point2f templ;
+  cv::Point2f frame;
+  float scale;
+  float angle;
+};
+
+// Multi-probe LSH over the descriptors of many templates. Each of kTables
+// tables hashes a descriptor by a fixed random subset of its bits; a lookup
+// probes the exact bucket and every bucket one bit away in each table, then
+// ranks the candidates by Hamming distance. Immutable once built, so any
+// number of threads may vote at once.
+class FeatureIndex {
+public:
+  // `templates[slot]` is described by slot number in the votes; null or
+  // empty sets take no part.
+  explicit FeatureIndex(const std::vector<const FeatureSet *> &templates);
+
+  size_t templates() const { return slot_keypoints_.size(); }
+  size_t descriptors() const { return owner_.size(); }
+
+  // Looks up frame descriptors [begin, end) and appends a vote to
+  // votes[slot] for each one whose nearest template descriptor passes the
+  // distance limit and the ratio test against the runner-up within that
+  // template. `votes` must have templates() entries.
+  void vote(const FeatureSet &frame, size_t begin, size_t end,
+            std::vector<std::vector<FeatureVote>> &votes) const;
+
+private:
+  static constexpr int kTables = 6;
+  static constexpr int kKeyBits = 13;
+
+  uint32_t key(int table, const uint8_t *descriptor) const;
+
+  std::vector<uint8_t> descriptors_; // kFeatureBytes per entry
+  std::vector<uint32_t> owner_;      // template slot per entry
+  std::vector<uint32_t> point_;      // keypoint index per entry
+  std::vector<std::vector<cv::KeyPoint>> slot_keypoints_;
+  uint16_t bits_[kTables][kKeyBits];
+  // Per table, entries grouped by key: bucket b is
+  // entries_[offsets_[b] .. offsets_[b + 1]).
+  std::vector<uint32_t> offsets_[kTables];
+  std::vector<uint32_t> entries_[kTables];
+};
+
+// Clusters `votes` by the template centre they predict and fits a
+// similarity transform (template to frame coordinates, 2x3 CV_64F) to each
+// of the densest clusters with RANSAC, keeping the one with most inliers.
+// True when enough votes agree on a transform at a plausible scale.
+bool vision_verify_votes(const std::vector<FeatureVote> &votes,
+                         const cv::Size &templ_size, cv::Mat &transform,
+                         int &inliers);
+
+// Places `templ` in `frame` through `transform`. `rect` receives the bounding
+// box of its transformed corners, clipped to the frame; the result is
+// TM_CCOEFF_NORMED between the warped template and the frame over the
+// template's footprint inside it, so scores compare with pixel matching; 0
+// when either side is flat there.
+float vision_warped_score(const cv::Mat &frame, const cv::Mat &templ,
+                          const cv::Mat &transform, cv::Rect &rect);
+
+#endif // VISION_FEATURES_H
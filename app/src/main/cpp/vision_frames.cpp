@@ -0,0 +1,168 @@
+#include "vision_frames.h"
+#include "vision_log.h"
+#include "vision_simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Buffers live as long as the Core, which every handed-out reference keeps
+// alive through its deleter, so a frame may outlive its pool.
+struct FramePool::Core {
+  std::mutex mutex; // Protects free_slots and the counters
+  std::vector<std::unique_ptr<PooledFrame>> frames;
+  std::vector<int> free_slots;
+  uint64_t filled = 0;
+  uint64_t dropped = 0;
+};
+
+namespace {
+
+// Deleter of handed-out frames: the last reference returns the buffer.
+struct ReturnToPool {
+  std::shared_ptr<FramePool::Core> core;
+  int slot;
+
+  void operator()(const PooledFrame *) const {
+    std::lock_guard<std::mutex> lock(core->mutex);
+    core->free_slots.push_back(slot);
+  }
+};
+
+int64_t steady_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+bool vision_plane_fits(const char *who, const uint8_t *pixels,
+                       size_t capacity, int width, int height, int row_stride,
+                       int pixel_stride) {
+  if (!pixels || width <= 0 || height <= 0)
+    return false;
+  if (pixel_stride != 4 || row_stride < width * pixel_stride) {
+    LOGE("%s: unsupported layout %dx%d rowStride=%d pixelStride=%d", who,
+         width, height, row_stride, pixel_stride);
+    return false;
+  }
+  // The last row is not necessarily padded out to row_stride.
+  size_t needed = (size_t)row_stride * (size_t)(height - 1) +
+                  (size_t)width * (size_t)pixel_stride;
+  if (capacity < needed) {
+    LOGE("%s: buffer of %zu bytes, need %zu", who, capacity, needed);
+    return false;
+  }
+  return true;
+}
+
+FramePool::FramePool(int capacity) : core_(std::make_shared<Core>()) {
+  capacity = std::max(capacity, 2);
+  for (int i = 0; i < capacity; i++) {
+    core_->frames.emplace_back(new PooledFrame());
+    core_->free_slots.push_back(i);
+  }
+}
+
+FramePool::~FramePool() = default;
+
+FrameRef FramePool::fill(const uint8_t *pixels, size_t capacity, int width,
+                         int height, int row_stride, int pixel_stride) {
+  if (!vision_plane_fits("FramePool", pixels, capacity, width, height,
+                         row_stride, pixel_stride))
+    return nullptr;
+
+  int slot;
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    if (core_->free_slots.empty()) {
+      core_->dropped++;
+      return nullptr;
+    }
+    slot = core_->free_slots.back();
+    core_->free_slots.pop_back();
+    sequence = ++core_->filled;
+  }
+
+  // Nothing references a free buffer, so it is written without a lock.
+  // Same-sized Mats are refilled in place.
+  PooledFrame &frame = *core_->frames[(size_t)slot];
+  cv::Mat plane(height, width, CV_8UC4, const_cast<uint8_t *>(pixels),
+                (size_t)row_stride);
+  plane.copyTo(frame.rgba);
+  frame.gray.create(height, width, CV_8UC1);
+  uint8_t *quarter = nullptr;
+  if (width >= 4 && height >= 4) {
+    frame.quarter.create(height / 4, width / 4, CV_8UC1);
+    quarter = frame.quarter.data;
+  } else {
+    frame.quarter.release();
+  }
+  vision_rgba_to_gray(frame.rgba.data, frame.rgba.step, width, height,
+                      frame.gray.data, frame.gray.step, quarter,
+                      quarter ? frame.quarter.step : 0, 4);
+  frame.sequence = sequence;
+  frame.timestamp_ms = steady_ms();
+
+  FrameRef ref(&frame, ReturnToPool{core_, slot});
+  {
+    std::lock_guard<std::mutex> lock(latest_mutex_);
+    // Concurrent fills may finish out of order; the newest stays latest.
+    if (!latest_ || latest_->sequence < sequence)
+      latest_ = ref;
+  }
+  latest_cv_.notify_all();
+  return ref;
+}
+
+FrameRef FramePool::latest() const {
+  std::lock_guard<std::mutex> lock(latest_mutex_);
+  return latest_;
+}
+
+FrameRef FramePool::wait_newer(uint64_t after, int timeout_ms,
+                               const std::atomic<bool> *cancel) const {
+  std::unique_lock<std::mutex> lock(latest_mutex_);
+  auto stop = [&] {
+    return closed_ || (cancel && cancel->load(std::memory_order_acquire));
+  };
+  auto ready = [&] {
+    return stop() || (latest_ && latest_->sequence > after);
+  };
+  latest_cv_.wait_for(lock, std::chrono::milliseconds(std::max(timeout_ms, 0)),
+                      ready);
+  if (stop() || !ready())
+    return nullptr;
+  return latest_;
+}
+
+void FramePool::wake() const {
+  // Taking the lock orders the caller's flag before any waiter's check.
+  { std::lock_guard<std::mutex> lock(latest_mutex_); }
+  latest_cv_.notify_all();
+}
+
+void FramePool::close() {
+  {
+    std::lock_guard<std::mutex> lock(latest_mutex_);
+    closed_ = true;
+  }
+  latest_cv_.notify_all();
+}
+
+bool FramePool::closed() const {
+  std::lock_guard<std::mutex> lock(latest_mutex_);
+  return closed_;
+}
+
+FramePoolStats FramePool::stats() const {
+  std::lock_guard<std::mutex> lock(core_->mutex);
+  FramePoolStats stats;
+  stats.capacity = (int)core_->frames.size();
+  stats.in_use = stats.capacity - (int)core_->free_slots.size();
+  stats.filled = core_->filled;
+  stats.dropped = core_->dropped;
+  return stats;
+}
@@ -0,0 +1,96 @@
+#ifndef VISION_FRAMES_H
+#define VISION_FRAMES_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+
+// Fixed set of capture buffers shared by every consumer of one screen
+// capture. Each captured image is copied out of the ImageReader plane once,
+// without its row padding, and converted to gray in the same call; the
+// matcher, the detector and snapshots then read that one copy through
+// references. A buffer goes back to the pool when its last reference is
+// dropped, so memory stays at `capacity` frames however long capture runs:
+// while every buffer is referenced, new images are dropped rather than
+// allocated for.
+
+// One captured image. Never written while a reference to it is held.
+struct PooledFrame {
+  cv::Mat rgba;    // height x width CV_8UC4, rows unpadded
+  cv::Mat gray;    // height x width CV_8UC1
+  cv::Mat quarter; // gray at 1/4 per side, as the pyramid search reads it
+  uint64_t sequence = 0;    // images filled so far, this one included
+  int64_t timestamp_ms = 0; // steady clock at the fill
+};
+
+using FrameRef = std::shared_ptr<const PooledFrame>;
+
+struct FramePoolStats {
+  int capacity = 0;
+  int in_use = 0;       // buffers referenced, the latest frame included
+  uint64_t filled = 0;  // images taken in
+  uint64_t dropped = 0; // images dropped because every buffer was in use
+};
+
+// True when an RGBA_8888 plane of `capacity` bytes holds a `width` x
+// `height` image with `row_stride` bytes per row (padding allowed) and
+// pixel_stride 4. Logs why not under `who`.
+bool vision_plane_fits(const char *who, const uint8_t *pixels,
+                       size_t capacity, int width, int height, int row_stride,
+                       int pixel_stride);
+
+class FramePool {
+public:
+  static constexpr int kDefaultCapacity = 4;
+
+  // `capacity` buffers, at least 2: the latest frame and one to fill.
+  // Buffers are sized by the first image and resized only when the capture
+  // size changes.
+  explicit FramePool(int capacity = kDefaultCapacity);
+  ~FramePool();
+
+  FramePool(const FramePool &) = delete;
+  FramePool &operator=(const FramePool &) = delete;
+
+  // Copies an RGBA_8888 plane (see vision_plane_fits) into a free buffer,
+  // converts it, and publishes it as latest(). Returns the frame, or nullptr
+  // when the plane does not fit or every buffer is in use. The caller may
+  // reuse the plane as soon as this returns.
+  FrameRef fill(const uint8_t *pixels, size_t capacity, int width,
+                int height, int row_stride, int pixel_stride);
+
+  // The most recently filled frame; nullptr before the first.
+  FrameRef latest() const;
+
+  // Waits up to `timeout_ms` for a frame newer than the one numbered `after`
+  // (0 for any) and returns the latest. nullptr on timeout, once the pool
+  // is closed, or once `cancel` is set and wake() called.
+  FrameRef wait_newer(uint64_t after, int timeout_ms,
+                      const std::atomic<bool> *cancel = nullptr) const;
+
+  // Makes every wait_newer() check its cancel flag again.
+  void wake() const;
+
+  // Wakes every wait_newer() and fails those to come, so a consumer blocked
+  // on the capture returns when capture stops. Frames stay valid.
+  void close();
+  bool closed() const;
+
+  FramePoolStats stats() const;
+
+  struct Core; // defined in vision_frames.cpp; outlives the pool while
+               // frames are still referenced
+
+private:
+  std::shared_ptr<Core> core_;
+  mutable std::mutex latest_mutex_; // Protects latest_ and closed_
+  mutable std::condition_variable latest_cv_;
+  FrameRef latest_;
+  bool closed_ = false;
+};
+
+#endif // VISION_FRAMES_H
@@ -0,0 +1,154 @@
+#include "vision_frames_jni.h"
+#include "vision_log.h"
+#include <android/bitmap.h>
+#include <jni.h>
+
+// JNI glue for FramePool and NativeFrame; the pool lives in
+// vision_frames.cpp. Shares libvision_engine (and its JNI_OnLoad) with
+// vision_jni.cpp.
+//
+// A FramePool handle is a heap-allocated FramePoolHandle (see
+// vision_frames_jni.h). A NativeFrame handle is a heap-allocated FrameRef:
+// one reference to the pooled frame, dropped when the Kotlin object is
+// closed. vision_jni.cpp and vision_dnn_jni.cpp read pools and frames
+// through the same handles.
+
+namespace {
+
+FramePool *from_handle(jlong handle) { return pool_handle(handle).pool.get(); }
+
+jlong new_pool_handle(std::shared_ptr<FramePool> pool) {
+  FramePoolHandle *handle = new FramePoolHandle();
+  handle->pool = std::move(pool);
+  return reinterpret_cast<jlong>(handle);
+}
+
+const FrameRef &frame_from_handle(jlong handle) {
+  return *reinterpret_cast<FrameRef *>(handle);
+}
+
+jlong new_frame_handle(FrameRef frame) {
+  if (!frame)
+    return 0;
+  return reinterpret_cast<jlong>(new FrameRef(std::move(frame)));
+}
+
+jlongArray to_java_longs(JNIEnv *env, const jlong *values, jsize count) {
+  jlongArray out = env->NewLongArray(count);
+  if (out)
+    env->SetLongArrayRegion(out, 0, count, values);
+  return out;
+}
+
+} // namespace
+
+extern "C" {
+
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeCreate(
+    JNIEnv *, jclass, jint capacity) {
+  return new_pool_handle(std::make_shared<FramePool>((int)capacity));
+}
+
+// Another handle on the same pool, with a cancel flag of its own.
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeRetain(
+    JNIEnv *, jobject, jlong handle) {
+  return new_pool_handle(pool_handle(handle).pool);
+}
+
+// Ends the waits made through this handle, now and later.
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeCancelWaits(
+    JNIEnv *, jobject, jlong handle) {
+  FramePoolHandle &h = pool_handle(handle);
+  h.cancelled->store(true, std::memory_order_release);
+  h.pool->wake();
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeClose(
+    JNIEnv *, jclass, jlong handle) {
+  from_handle(handle)->close();
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeDestroy(
+    JNIEnv *, jclass, jlong handle) {
+  delete reinterpret_cast<FramePoolHandle *>(handle);
+}
+
+// Returns the frame's sequence number, or 0 when it was not taken in.
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeFill(
+    JNIEnv *env, jobject, jlong handle, jobject buffer, jint width,
+    jint height, jint row_stride, jint pixel_stride) {
+  void *pixels = env->GetDirectBufferAddress(buffer);
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (!pixels || capacity <= 0)
+    return 0;
+  FrameRef frame = from_handle(handle)->fill(
+      static_cast<const uint8_t *>(pixels), (size_t)capacity, (int)width,
+      (int)height, (int)row_stride, (int)pixel_stride);
+  return frame ? (jlong)frame->sequence : 0;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeLatest(
+    JNIEnv *, jobject, jlong handle) {
+  return new_frame_handle(from_handle(handle)->latest());
+}
+
+// {capacity, inUse, filled, dropped}
+JNIEXPORT jlongArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_FramePool_nativeStats(
+    JNIEnv *env, jobject, jlong handle) {
+  const FramePoolStats stats = from_handle(handle)->stats();
+  const jlong values[] = {stats.capacity, stats.in_use, (jlong)stats.filled,
+                          (jlong)stats.dropped};
+  return to_java_longs(env, values, 4);
+}
+
+// ── NativeFrame ───────────────────────────────────────────────────────
+
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeFrame_nativeRetain(
+    JNIEnv *, jobject, jlong frame) {
+  return new_frame_handle(frame_from_handle(frame));
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeFrame_nativeRelease(
+    JNIEnv *, jclass, jlong frame) {
+  delete reinterpret_cast<FrameRef *>(frame);
+}
+
+// {width, height, sequence, timestampMs}
+JNIEXPORT jlongArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeFrame_nativeInfo(
+    JNIEnv *env, jobject, jlong frame) {
+  const PooledFrame &f = *frame_from_handle(frame);
+  const jlong values[] = {f.rgba.cols, f.rgba.rows, (jlong)f.sequence,
+                          (jlong)f.timestamp_ms};
+  return to_java_longs(env, values, 4);
+}
+
+// Copies the frame into an ARGB_8888 bitmap of the same size.
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_NativeFrame_nativeCopyToBitmap(
+    JNIEnv *env, jobject, jlong frame, jobject bitmap) {
+  const cv::Mat &rgba = frame_from_handle(frame)->rgba;
+  AndroidBitmapInfo info;
+  void *pixels = nullptr;
+  if (AndroidBitmap_getInfo(env, bitmap, &info) < 0 ||
+      info.format != ANDROID_BITMAP_FORMAT_RGBA_8888 ||
+      (int)info.width != rgba.cols || (int)info.height != rgba.rows)
+    return JNI_FALSE;
+  if (AndroidBitmap_lockPixels(env, bitmap, &pixels) < 0 || !pixels)
+    return JNI_FALSE;
+  cv::Mat view(rgba.rows, rgba.cols, CV_8UC4, pixels, info.stride);
+  rgba.copyTo(view);
+  AndroidBitmap_unlockPixels(env, bitmap);
+  return JNI_TRUE;
+}
+}
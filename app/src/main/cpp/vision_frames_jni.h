@@ -0,0 +1,26 @@
+#ifndef VISION_FRAMES_JNI_H
+#define VISION_FRAMES_JNI_H
+
+#include "vision_frames.h"
+
+#include <atomic>
+#include <jni.h>
+#include <memory>
+
+// What a Kotlin FramePool handle points to: a reference that keeps the pool
+// alive, so a matcher blocked in wait_for on a retained handle survives the
+// capture closing its own, and a cancel flag for the waits made through
+// this handle alone. A wait holds its own reference to the flag, as the
+// handle may be destroyed while it blocks. Shared by vision_frames_jni.cpp
+// and vision_jni.cpp.
+struct FramePoolHandle {
+  std::shared_ptr<FramePool> pool;
+  std::shared_ptr<std::atomic<bool>> cancelled =
+      std::make_shared<std::atomic<bool>>(false);
+};
+
+inline FramePoolHandle &pool_handle(jlong handle) {
+  return *reinterpret_cast<FramePoolHandle *>(handle);
+}
+
+#endif // VISION_FRAMES_JNI_H
@@ -0,0 +1,255 @@
+#include "vision_geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Lower bound on the cell side, in pixels.
+constexpr float kMinCell = 8.0f;
+// Upper bound on the cell count, as a multiple of the boxes indexed (with a
+// floor for small frames). Sparse frames with a few far-apart boxes get
+// coarser cells instead of a mostly empty grid.
+constexpr size_t kCellsPerBox = 4;
+constexpr size_t kMinCells = 64;
+
+bool usable(const Detection &d) {
+  return std::isfinite(d.left) && std::isfinite(d.top) &&
+         std::isfinite(d.right) && std::isfinite(d.bottom) &&
+         d.right > d.left && d.bottom > d.top;
+}
+
+// Same arithmetic as the Kotlin IoU it replaces, so decisions match.
+float iou(const Detection &a, const Detection &b) {
+  float x0 = std::max(a.left, b.left);
+  float y0 = std::max(a.top, b.top);
+  float x1 = std::min(a.right, b.right);
+  float y1 = std::min(a.bottom, b.bottom);
+  float inter = std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+  float area_a = (a.right - a.left) * (a.bottom - a.top);
+  float area_b = (b.right - b.left) * (b.bottom - b.top);
+  float uni = area_a + area_b - inter;
+  return uni > 0 ? inter / uni : 0.0f;
+}
+
+bool matches(const Detection &d, int cls) {
+  return cls < 0 || d.cls == cls;
+}
+
+// Cell holding grid coordinate `v` (in cells), clamped to [0, n).
+int clamp_cell(float v, int n) {
+  if (!(v > 0.0f))
+    return 0;
+  if (v >= (float)(n - 1))
+    return n - 1;
+  return (int)v;
+}
+
+} // namespace
+
+// ── BoxIndex ──────────────────────────────────────────────────────────
+
+int BoxIndex::column(float x) const {
+  return clamp_cell((x - x0_) / cell_, cols_);
+}
+
+int BoxIndex::row(float y) const {
+  return clamp_cell((y - y0_) / cell_, rows_);
+}
+
+uint32_t BoxIndex::next_epoch() {
+  if (++epoch_ == 0) {
+    std::fill(stamp_.begin(), stamp_.end(), 0);
+    epoch_ = 1;
+  }
+  return epoch_;
+}
+
+void BoxIndex::build(const Detection *boxes, size_t count) {
+  boxes_.assign(boxes, boxes + count);
+  stamp_.assign(count, 0);
+  epoch_ = 0;
+  cols_ = rows_ = 0;
+  start_.clear();
+  items_.clear();
+
+  double sum = 0.0;
+  size_t n = 0;
+  float min_x = std::numeric_limits<float>::max(), min_y = min_x;
+  float max_x = std::numeric_limits<float>::lowest(), max_y = max_x;
+  for (const Detection &d : boxes_) {
+    if (!usable(d))
+      continue;
+    sum += std::max(d.right - d.left, d.bottom - d.top);
+    n++;
+    min_x = std::min(min_x, d.left);
+    min_y = std::min(min_y, d.top);
+    max_x = std::max(max_x, d.right);
+    max_y = std::max(max_y, d.bottom);
+  }
+  if (n == 0)
+    return;
+
+  // Cells about the size of a typical box keep each box in a few cells.
+  double cell = std::max((double)kMinCell, sum / (double)n);
+  const double budget = (double)std::max(kMinCells, kCellsPerBox * n);
+  double cols, rows;
+  for (;;) {
+    cols = std::floor(((double)max_x - min_x) / cell) + 1.0;
+    rows = std::floor(((double)max_y - min_y) / cell) + 1.0;
+    if (cols * rows <= budget)
+      break;
+    cell *= 2.0;
+  }
+  x0_ = min_x;
+  y0_ = min_y;
+  cell_ = (float)cell;
+  cols_ = (int)cols;
+  rows_ = (int)rows;
+
+  // Count per cell, turn the counts into offsets, then file the boxes; each
+  // cell lists its boxes in index order.
+  start_.assign((size_t)cols_ * rows_ + 1, 0);
+  for (const Detection &d : boxes_) {
+    if (!usable(d))
+      continue;
+    for (int cy = row(d.top), y1 = row(d.bottom); cy <= y1; cy++)
+      for (int cx = column(d.left), x1 = column(d.right); cx <= x1; cx++)
+        start_[(size_t)cy * cols_ + cx + 1]++;
+  }
+  for (size_t c = 1; c < start_.size(); c++)
+    start_[c] += start_[c - 1];
+  items_.resize((size_t)start_.back());
+  cursor_.assign(start_.begin(), start_.end() - 1);
+  for (size_t i = 0; i < boxes_.size(); i++) {
+    const Detection &d = boxes_[i];
+    if (!usable(d))
+      continue;
+    for (int cy = row(d.top), y1 = row(d.bottom); cy <= y1; cy++)
+      for (int cx = column(d.left), x1 = column(d.right); cx <= x1; cx++)
+        items_[(size_t)cursor_[(size_t)cy * cols_ + cx]++] = (int)i;
+  }
+}
+
+// Calls `fn(index)` once for every box sharing a cell with `query`. Two
+// boxes that overlap always share a cell, so no pair with IoU above zero
+// is missed.
+template <typename Visit>
+void BoxIndex::visit(const Detection &query, Visit &&fn) {
+  if (cols_ == 0 || !usable(query))
+    return;
+  const uint32_t epoch = next_epoch();
+  const int x0 = column(query.left), x1 = column(query.right);
+  const int y0 = row(query.top), y1 = row(query.bottom);
+  for (int cy = y0; cy <= y1; cy++) {
+    for (int cx = x0; cx <= x1; cx++) {
+      const size_t c = (size_t)cy * cols_ + cx;
+      for (int k = start_[c]; k < start_[c + 1]; k++) {
+        const int i = items_[(size_t)k];
+        if (stamp_[(size_t)i] == epoch)
+          continue; // already seen through another cell
+        stamp_[(size_t)i] = epoch;
+        fn(i);
+      }
+    }
+  }
+}
+
+void BoxIndex::join(const Detection *queries, size_t count, int cls,
+                    float min_iou, std::vector<BoxHit> &out) {
+  min_iou = std::max(min_iou, 0.0f);
+  for (size_t q = 0; q < count; q++) {
+    const Detection &query = queries[q];
+    const size_t first = out.size();
+    visit(query, [&](int i) {
+      const Detection &d = boxes_[(size_t)i];
+      if (!matches(d, cls))
+        return;
+      const float overlap = iou(query, d);
+      if (overlap > min_iou)
+        out.push_back({(int)q, i, overlap});
+    });
+    std::sort(out.begin() + (std::ptrdiff_t)first, out.end(),
+              [](const BoxHit &a, const BoxHit &b) {
+                return a.iou != b.iou ? a.iou > b.iou : a.box < b.box;
+              });
+  }
+}
+
+int BoxIndex::best_overlap(const Detection &query, int cls, float min_iou,
+                           float *iou_out) {
+  int best = -1;
+  float best_iou = std::max(min_iou, 0.0f);
+  visit(query, [&](int i) {
+    const Detection &d = boxes_[(size_t)i];
+    if (!matches(d, cls))
+      return;
+    const float overlap = iou(query, d);
+    if (overlap > best_iou || (best >= 0 && overlap == best_iou && i < best)) {
+      best = i;
+      best_iou = overlap;
+    }
+  });
+  if (iou_out)
+    *iou_out = best >= 0 ? best_iou : 0.0f;
+  return best;
+}
+
+int BoxIndex::nearest(float x, float y, int cls, float max_distance) {
+  if (cols_ == 0 || !std::isfinite(x) || !std::isfinite(y) ||
+      !(max_distance >= 0.0f))
+    return -1;
+  const uint32_t epoch = next_epoch();
+  const int px = column(x), py = row(y);
+  const int rings = std::max({px, cols_ - 1 - px, py, rows_ - 1 - py});
+
+  int best = -1;
+  double best_d2 = (double)max_distance * (double)max_distance;
+  auto scan = [&](int cx, int cy) {
+    const size_t c = (size_t)cy * cols_ + cx;
+    for (int k = start_[c]; k < start_[c + 1]; k++) {
+      const int i = items_[(size_t)k];
+      if (stamp_[(size_t)i] == epoch)
+        continue;
+      stamp_[(size_t)i] = epoch;
+      const Detection &d = boxes_[(size_t)i];
+      if (!matches(d, cls))
+        continue;
+      const double dx = ((double)d.left + d.right) * 0.5 - x;
+      const double dy = ((double)d.top + d.bottom) * 0.5 - y;
+      const double d2 = dx * dx + dy * dy;
+      if (d2 < best_d2 || (d2 == best_d2 && (best < 0 || i < best))) {
+        best = i;
+        best_d2 = d2;
+      }
+    }
+  };
+
+  for (int r = 0; r <= rings; r++) {
+    // The cells at Chebyshev distance r from the point's cell.
+    for (int cy = py - r; cy <= py + r; cy++) {
+      if (cy < 0 || cy >= rows_)
+        continue;
+      const bool whole = cy == py - r || cy == py + r;
+      for (int cx = px - r; cx <= px + r; cx += whole ? 1 : std::max(2 * r, 1))
+        if (cx >= 0 && cx < cols_)
+          scan(cx, cy);
+    }
+
+    // Every box's centre lies in one of the cells it is filed in, so the
+    // centres not yet seen are outside the searched block. Sides of the
+    // block on the grid's edge hide nothing.
+    const double inf = std::numeric_limits<double>::infinity();
+    const double left = px - r <= 0 ? inf : x - (x0_ + (px - r) * cell_);
+    const double right =
+        px + r >= cols_ - 1 ? inf : (x0_ + (px + r + 1) * cell_) - x;
+    const double top = py - r <= 0 ? inf : y - (y0_ + (py - r) * cell_);
+    const double bottom =
+        py + r >= rows_ - 1 ? inf : (y0_ + (py + r + 1) * cell_) - y;
+    const double reach = std::max(0.0, std::min({left, right, top, bottom}));
+    if (reach * reach > best_d2)
+      break;
+  }
+  return best;
+}
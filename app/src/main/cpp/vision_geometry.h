@@ -0,0 +1,77 @@
+#ifndef VISION_GEOMETRY_H
+#define VISION_GEOMETRY_H
+
+#include "vision_detect.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Spatial index over one frame's boxes (UI elements, OCR blocks, step
+// anchors), rebuilt per frame, for the joins the app used to run as nested
+// Kotlin loops. Boxes are filed in a uniform grid with cells about the size
+// of a typical box, stored as one flat array per build (cell offsets plus
+// box indices), so a rebuild reuses its memory and a query only looks at
+// the boxes near it. Answers are indices into the built array, with the
+// same IoU arithmetic and tie-breaking as the Kotlin code it replaces.
+//
+// A box's `cls` is whatever label ID the caller chose; queries take a class
+// to filter on, or kAnyClass. Boxes with no area or non-finite coordinates
+// are never returned. Queries reuse scratch, so one index serves one
+// thread at a time.
+
+constexpr int kAnyClass = -1;
+
+// One overlapping pair from BoxIndex::join.
+struct BoxHit {
+  int query; // index into the query array
+  int box;   // index into the built array
+  float iou;
+};
+
+class BoxIndex {
+public:
+  // Replaces the indexed boxes with `boxes[0, count)`.
+  void build(const Detection *boxes, size_t count);
+  void clear() { build(nullptr, 0); }
+
+  size_t size() const { return boxes_.size(); }
+  const Detection &box(int i) const { return boxes_[(size_t)i]; }
+
+  // Appends every (query, box) pair whose IoU is above `min_iou` (taken as
+  // at least 0, so disjoint boxes never pair) and whose box is of class
+  // `cls`: grouped by query in query order, each group strongest first,
+  // equal IoUs by box index.
+  void join(const Detection *queries, size_t count, int cls, float min_iou,
+            std::vector<BoxHit> &out);
+
+  // The box of class `cls` overlapping `query` most, if that IoU is above
+  // `min_iou`; -1 otherwise. Ties go to the lower index. `iou`, when given,
+  // receives the IoU of the answer.
+  int best_overlap(const Detection &query, int cls, float min_iou,
+                   float *iou = nullptr);
+
+  // The box of class `cls` whose centre is closest to (x, y), if within
+  // `max_distance` pixels; -1 otherwise. Ties go to the lower index. Rings
+  // of cells are searched outwards from the point and the search stops as
+  // soon as no unvisited cell can hold a closer centre.
+  int nearest(float x, float y, int cls, float max_distance);
+
+private:
+  template <typename Visit> void visit(const Detection &query, Visit &&fn);
+  uint32_t next_epoch();
+  int column(float x) const;
+  int row(float y) const;
+
+  std::vector<Detection> boxes_;
+  float x0_ = 0.0f, y0_ = 0.0f; // grid origin
+  float cell_ = 0.0f;           // cell side, pixels
+  int cols_ = 0, rows_ = 0;     // 0 when nothing is indexed
+  std::vector<int> start_;      // first item of each cell, plus the end
+  std::vector<int> items_;      // box indices, cell by cell
+  std::vector<int> cursor_;     // build scratch
+  std::vector<uint32_t> stamp_; // per box: last query that saw it
+  uint32_t epoch_ = 0;
+};
+
+#endif // VISION_GEOMETRY_H
@@ -0,0 +1,148 @@
+#include "vision_geometry.h"
+#include "vision_log.h"
+#include <algorithm>
+#include <jni.h>
+
+// JNI glue for BoxIndex.kt; the index lives in vision_geometry.cpp. Shares
+// libvision_engine (and its JNI_OnLoad) with vision_jni.cpp.
+
+// Boxes and queries arrive in the DetectionBuffer.kt layout: kBoxFloats
+// floats each (class, score, left, top, right, bottom). Join pairs leave in
+// the OverlapBuffer.kt layout: kHitInts ints (query, box) and kHitFloats
+// floats (IoU) each.
+constexpr int kBoxFloats = 6;
+constexpr int kHitInts = 2;
+constexpr int kHitFloats = 1;
+
+namespace {
+
+// An index plus the unpacked input and join output it reuses across frames.
+struct IndexHandle {
+  BoxIndex index;
+  std::vector<Detection> input;
+  std::vector<BoxHit> hits;
+};
+
+IndexHandle *from_handle(jlong handle) {
+  return reinterpret_cast<IndexHandle *>(handle);
+}
+
+bool unpack(JNIEnv *env, jfloatArray boxes, jint count,
+            std::vector<Detection> &out) {
+  if (!boxes || count < 0 ||
+      (jlong)count * kBoxFloats > env->GetArrayLength(boxes))
+    return false;
+  out.resize((size_t)count);
+  if (count == 0)
+    return true;
+  auto *fp = static_cast<jfloat *>(env->GetPrimitiveArrayCritical(boxes, 0));
+  if (!fp)
+    return false;
+  for (jint i = 0; i < count; ++i) {
+    const jfloat *rec = fp + (size_t)i * kBoxFloats;
+    Detection &d = out[(size_t)i];
+    d.cls = (int)rec[0];
+    d.score = rec[1];
+    d.left = rec[2];
+    d.top = rec[3];
+    d.right = rec[4];
+    d.bottom = rec[5];
+  }
+  env->ReleasePrimitiveArrayCritical(boxes, fp, JNI_ABORT);
+  return true;
+}
+
+// Writes as many pairs as fit; the total tells the caller whether to grow
+// and fetch again through nativeHits, which does not run the join again.
+jint pack_hits(JNIEnv *env, const std::vector<BoxHit> &hits, jintArray ints,
+               jfloatArray floats) {
+  size_t n = std::min({hits.size(),
+                       (size_t)env->GetArrayLength(ints) / kHitInts,
+                       (size_t)env->GetArrayLength(floats) / kHitFloats});
+  if (n > 0) {
+    auto *ip = static_cast<jint *>(env->GetPrimitiveArrayCritical(ints, 0));
+    if (!ip)
+      return -1;
+    auto *fp = static_cast<jfloat *>(env->GetPrimitiveArrayCritical(floats, 0));
+    if (!fp) {
+      env->ReleasePrimitiveArrayCritical(ints, ip, JNI_ABORT);
+      return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      ip[i * kHitInts] = hits[i].query;
+      ip[i * kHitInts + 1] = hits[i].box;
+      fp[i * kHitFloats] = hits[i].iou;
+    }
+    env->ReleasePrimitiveArrayCritical(floats, fp, 0);
+    env->ReleasePrimitiveArrayCritical(ints, ip, 0);
+  }
+  return (jint)hits.size();
+}
+
+} // namespace
+
+extern "C" {
+
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_BoxIndex_nativeCreate(
+    JNIEnv *, jobject) {
+  return reinterpret_cast<jlong>(new IndexHandle());
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_BoxIndex_nativeDestroy(
+    JNIEnv *, jobject, jlong handle) {
+  delete from_handle(handle);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_BoxIndex_nativeBuild(
+    JNIEnv *env, jobject, jlong handle, jfloatArray boxes, jint count) {
+  IndexHandle *h = from_handle(handle);
+  if (!unpack(env, boxes, count, h->input)) {
+    LOGE("BoxIndex: bad boxes (count=%d)", (int)count);
+    h->index.clear();
+    return JNI_FALSE;
+  }
+  h->index.build(h->input.data(), h->input.size());
+  return JNI_TRUE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_BoxIndex_nativeJoin(
+    JNIEnv *env, jobject, jlong handle, jfloatArray queries, jint count,
+    jint cls, jfloat min_iou, jintArray ints, jfloatArray floats) {
+  IndexHandle *h = from_handle(handle);
+  h->hits.clear();
+  if (!ints || !floats || !unpack(env, queries, count, h->input)) {
+    LOGE("BoxIndex: bad queries (count=%d)", (int)count);
+    return -1;
+  }
+  h->index.join(h->input.data(), h->input.size(), (int)cls, min_iou,
+                h->hits);
+  return pack_hits(env, h->hits, ints, floats);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_BoxIndex_nativeHits(
+    JNIEnv *env, jobject, jlong handle, jintArray ints, jfloatArray floats) {
+  if (!ints || !floats)
+    return -1;
+  return pack_hits(env, from_handle(handle)->hits, ints, floats);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_BoxIndex_nativeBestOverlap(
+    JNIEnv *, jobject, jlong handle, jfloat left, jfloat top, jfloat right,
+    jfloat bottom, jint cls, jfloat min_iou) {
+  Detection query{(int)cls, 0.0f, left, top, right, bottom};
+  return from_handle(handle)->index.best_overlap(query, (int)cls, min_iou);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_BoxIndex_nativeNearest(
+    JNIEnv *, jobject, jlong handle, jfloat x, jfloat y, jint cls,
+    jfloat max_distance) {
+  return from_handle(handle)->index.nearest(x, y, (int)cls, max_distance);
+}
+}
@@ -0,0 +1,763 @@
+#include "vision_engine.h"
+#include "vision_frames_jni.h"
+#include "vision_log.h"
+#include "vision_pool.h"
+#include <algorithm>
+#include <android/bitmap.h>
+#include <jni.h>
+
+// JNI glue for VisionNativeBridge. Only marshalling lives here; all matching
+// logic is in the host-buildable core (vision_engine.cpp).
+
+// ── JNI Helpers ───────────────────────────────────────────────────────
+
+static bool bitmap_to_mat(JNIEnv *env, jobject bitmap, cv::Mat &dst) {
+  AndroidBitmapInfo info;
+  void *pixels = 0;
+
+  if (AndroidBitmap_getInfo(env, bitmap, &info) < 0)
+    return false;
+  if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888)
+    return false;
+  if (AndroidBitmap_lockPixels(env, bitmap, &pixels) < 0)
+    return false;
+  if (!pixels)
+    return false;
+
+  // Deep copy so we can safely unlock
+  cv::Mat view(info.height, info.width, CV_8UC4, pixels);
+  view.copyTo(dst);
+
+  AndroidBitmap_unlockPixels(env, bitmap);
+  return true;
+}
+
+// Class and constructor references resolved once in JNI_OnLoad; FindClass
+// and GetMethodID are far too slow for the per-frame path.
+struct JniCache {
+  jclass match_result = nullptr; // global ref
+  jmethodID match_result_ctor = nullptr;
+};
+
+static JniCache g_jni;
+
+static jobjectArray new_result_array(JNIEnv *env,
+                                     const std::vector<MatchResult> &results) {
+  if (!g_jni.match_result)
+    return nullptr;
+  jobjectArray jobjArray = env->NewObjectArray((jsize)results.size(),
+                                               g_jni.match_result, nullptr);
+  if (!jobjArray)
+    return nullptr;
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    jobject obj = env->NewObject(
+        g_jni.match_result, g_jni.match_result_ctor, (jint)results[i].id,
+        results[i].matched ? JNI_TRUE : JNI_FALSE, (jfloat)results[i].score,
+        (jint)results[i].rect.x, (jint)results[i].rect.y,
+        (jint)results[i].rect.width, (jint)results[i].rect.height,
+        results[i].from_prior ? JNI_TRUE : JNI_FALSE);
+    env->SetObjectArrayElement(jobjArray, (jsize)i, obj);
+    env->DeleteLocalRef(obj);
+  }
+
+  return jobjArray;
+}
+
+// Packed layout shared with MatchResultBuffer.kt: per result kPackedInts ints
+// (id, flags, x, y, width, height) plus one float score.
+constexpr int kPackedInts = 6;
+constexpr jint kFlagMatched = 1;
+constexpr jint kFlagFromPrior = 2;
+
+// Writes as many results as fit into the caller's arrays, straight into the
+// Java heap, and returns the total count so the caller can tell whether its
+// buffer was large enough.
+static jint write_packed(JNIEnv *env, const std::vector<MatchResult> &results,
+                         jintArray ints, jfloatArray scores) {
+  if (!ints || !scores)
+    return -1;
+  size_t capacity = std::min((size_t)env->GetArrayLength(ints) / kPackedInts,
+                             (size_t)env->GetArrayLength(scores));
+  size_t n = std::min(capacity, results.size());
+  if (n > 0) {
+    auto *ip = static_cast<jint *>(env->GetPrimitiveArrayCritical(ints, 0));
+    auto *fp =
+        ip ? static_cast<jfloat *>(env->GetPrimitiveArrayCritical(scores, 0))
+           : nullptr;
+    if (!fp) {
+      if (ip)
+        env->ReleasePrimitiveArrayCritical(ints, ip, JNI_ABORT);
+      return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      const MatchResult &r = results[i];
+      jint *rec = ip + i * kPackedInts;
+      rec[0] = (jint)r.id;
+      rec[1] = (r.matched ? kFlagMatched : 0) |
+               (r.from_prior ? kFlagFromPrior : 0);
+      rec[2] = (jint)r.rect.x;
+      rec[3] = (jint)r.rect.y;
+      rec[4] = (jint)r.rect.width;
+      rec[5] = (jint)r.rect.height;
+      fp[i] = (jfloat)r.score;
+    }
+    env->ReleasePrimitiveArrayCritical(scores, fp, 0);
+    env->ReleasePrimitiveArrayCritical(ints, ip, 0);
+  }
+  return (jint)results.size();
+}
+
+// The per-frame entry points below go through these, which time the bitmap
+// copy and result marshalling into the matcher's counters.
+
+static bool frame_from_bitmap(JNIEnv *env, VisionMatcher &matcher,
+                              jobject bitmap, cv::Mat &dst) {
+  const uint64_t t0 = vision_now_ns();
+  const bool ok = bitmap_to_mat(env, bitmap, dst);
+  if (ok)
+    matcher.record_stage(VisionStage::Lock, vision_now_ns() - t0);
+  return ok;
+}
+
+static jobjectArray to_java_results(JNIEnv *env, VisionMatcher &matcher,
+                                    const std::vector<MatchResult> &results) {
+  const uint64_t t0 = vision_now_ns();
+  jobjectArray out = new_result_array(env, results);
+  matcher.record_stage(VisionStage::Marshal, vision_now_ns() - t0);
+  return out;
+}
+
+// The calling thread's last packed results. A buffer too small for them is
+// grown and refilled from here through nativeLastResultsPacked, so the frame
+// is not matched twice.
+static std::vector<MatchResult> &last_results() {
+  thread_local std::vector<MatchResult> results;
+  return results;
+}
+
+static jint pack_results(JNIEnv *env, VisionMatcher &matcher,
+                         std::vector<MatchResult> results, jintArray ints,
+                         jfloatArray scores) {
+  const uint64_t t0 = vision_now_ns();
+  const jint count = write_packed(env, results, ints, scores);
+  last_results().swap(results);
+  matcher.record_stage(VisionStage::Marshal, vision_now_ns() - t0);
+  return count;
+}
+
+static void set_search_mode(VisionMatcher &matcher, jint mode,
+                            jint pyramid_factor, jint refine_candidates) {
+  MatchConfig config = matcher.config();
+  config.mode = mode == 1 ? SearchMode::Pyramid : SearchMode::Exhaustive;
+  config.pyramid_factor = (int)pyramid_factor;
+  config.refine_candidates = (int)refine_candidates;
+  matcher.set_config(config);
+}
+
+static void set_diff_tile(VisionMatcher &matcher, jint tile) {
+  MatchConfig config = matcher.config();
+  config.diff_tile = (int)tile;
+  matcher.set_config(config);
+}
+
+static std::vector<int> to_int_vector(JNIEnv *env, jintArray array) {
+  std::vector<int> out;
+  if (array) {
+    jsize n = env->GetArrayLength(array);
+    out.resize((size_t)n);
+    env->GetIntArrayRegion(array, 0, n, reinterpret_cast<jint *>(out.data()));
+  }
+  return out;
+}
+
+// MatchRequest from the Java side's IDs, stop mode (MatchStop values), n and
+// instances per template.
+static MatchRequest to_request(JNIEnv *env, jintArray ids, jint stop, jint n,
+                               jint instances) {
+  MatchRequest request;
+  request.ids = to_int_vector(env, ids);
+  if (stop == (jint)MatchStop::First)
+    request.stop = MatchStop::First;
+  else if (stop == (jint)MatchStop::AnyN)
+    request.stop = MatchStop::AnyN;
+  request.n = (int)n;
+  request.instances = (int)instances;
+  return request;
+}
+
+static jboolean submit_buffer(JNIEnv *env, VisionMatcher &matcher,
+                              jobject buffer, jint width, jint height,
+                              jint row_stride, jint pixel_stride) {
+  void *pixels = env->GetDirectBufferAddress(buffer);
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (!pixels || capacity <= 0)
+    return JNI_FALSE;
+  return matcher.submit_frame(static_cast<const uint8_t *>(pixels),
+                              (size_t)capacity, (int)width, (int)height,
+                              (int)row_stride, (int)pixel_stride)
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+// FrameDiffStats as {tiles, tilesChanged, templates, templatesSkipped}.
+static jintArray to_java_diff(JNIEnv *env, const FrameDiffStats &stats) {
+  const jint values[] = {stats.tiles, stats.tiles_changed, stats.templates,
+                         stats.templates_skipped};
+  jintArray out = env->NewIntArray(4);
+  if (out)
+    env->SetIntArrayRegion(out, 0, 4, values);
+  return out;
+}
+
+static std::string to_string(JNIEnv *env, jstring str) {
+  std::string out;
+  if (!str)
+    return out;
+  const char *chars = env->GetStringUTFChars(str, nullptr);
+  if (chars) {
+    out = chars;
+    env->ReleaseStringUTFChars(str, chars);
+  }
+  return out;
+}
+
+// VisionMatcher handles are the instance pointer; 0 is never a live one.
+static VisionMatcher *from_handle(jlong handle) {
+  return reinterpret_cast<VisionMatcher *>(handle);
+}
+
+// NativeFrame handles are a heap-allocated FrameRef each; FramePool handles
+// are described in vision_frames_jni.h.
+static const FrameRef &frame_from_handle(jlong frame) {
+  return *reinterpret_cast<FrameRef *>(frame);
+}
+
+// ── JNI Exports ───────────────────────────────────────────────────────
+
+extern "C" {
+
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *) {
+  JNIEnv *env = nullptr;
+  if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK)
+    return JNI_ERR;
+  jclass cls = env->FindClass(
+      "com/autonion/automationcompanion/core/vision/MatchResultNative");
+  if (!cls)
+    return JNI_ERR;
+  g_jni.match_result = static_cast<jclass>(env->NewGlobalRef(cls));
+  env->DeleteLocalRef(cls);
+  g_jni.match_result_ctor =
+      env->GetMethodID(g_jni.match_result, "<init>", "(IZFIIIIZ)V");
+  if (!g_jni.match_result_ctor)
+    return JNI_ERR;
+  return JNI_VERSION_1_6;
+}
+
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM *vm, void *) {
+  JNIEnv *env = nullptr;
+  if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK)
+    return;
+  if (g_jni.match_result)
+    env->DeleteGlobalRef(g_jni.match_result);
+  g_jni = JniCache();
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeInit(
+    JNIEnv *env, jobject) {
+  vision_init();
+  return env->NewStringUTF("Vision Engine Initialized (Template Matching)");
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeAddTemplate(
+    JNIEnv *env, jobject, jint id, jobject bitmap) {
+  cv::Mat mat;
+  if (!bitmap_to_mat(env, bitmap, mat))
+    return;
+  vision_add_template((int)id, mat);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeAddTemplateWithPrior(
+    JNIEnv *env, jobject, jint id, jobject bitmap, jint x, jint y, jint width,
+    jint height, jint margin) {
+  cv::Mat mat;
+  if (!bitmap_to_mat(env, bitmap, mat))
+    return;
+  vision_add_template((int)id, mat,
+                      cv::Rect((int)x, (int)y, (int)width, (int)height),
+                      (int)margin);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeAddFeatureTemplate(
+    JNIEnv *env, jobject, jint id, jobject bitmap) {
+  cv::Mat mat;
+  if (!bitmap_to_mat(env, bitmap, mat))
+    return JNI_FALSE;
+  return vision_add_feature_template((int)id, mat) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeClearTemplates(
+    JNIEnv *env, jobject) {
+  vision_clear_templates();
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeSetSearchMode(
+    JNIEnv *env, jobject, jint mode, jint pyramid_factor,
+    jint refine_candidates) {
+  set_search_mode(vision_default_matcher(), mode, pyramid_factor,
+                  refine_candidates);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeSetDiffTile(
+    JNIEnv *env, jobject, jint tile) {
+  set_diff_tile(vision_default_matcher(), tile);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeSetThreads(
+    JNIEnv *env, jobject, jint threads, jintArray cpus) {
+  vision_set_threads((int)threads, to_int_vector(env, cpus));
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativePerformanceCores(
+    JNIEnv *env, jobject) {
+  std::vector<int> cores = vision_performance_cores();
+  jintArray out = env->NewIntArray((jsize)cores.size());
+  if (out)
+    env->SetIntArrayRegion(out, 0, (jsize)cores.size(),
+                           reinterpret_cast<const jint *>(cores.data()));
+  return out;
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatch(
+    JNIEnv *env, jobject, jobject bitmap) {
+  VisionMatcher &matcher = vision_default_matcher();
+  cv::Mat screen;
+  if (!frame_from_bitmap(env, matcher, bitmap, screen))
+    return nullptr;
+
+  return to_java_results(env, matcher, matcher.match(screen));
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatchPacked(
+    JNIEnv *env, jobject, jobject bitmap, jintArray ints, jfloatArray scores) {
+  VisionMatcher &matcher = vision_default_matcher();
+  cv::Mat screen;
+  if (!frame_from_bitmap(env, matcher, bitmap, screen))
+    return -1;
+  return pack_results(env, matcher, matcher.match(screen), ints, scores);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatchTargetedPacked(
+    JNIEnv *env, jobject, jobject bitmap, jintArray ids, jint stop, jint n,
+    jint instances, jintArray ints, jfloatArray scores) {
+  VisionMatcher &matcher = vision_default_matcher();
+  cv::Mat screen;
+  if (!frame_from_bitmap(env, matcher, bitmap, screen))
+    return -1;
+  return pack_results(
+      env, matcher,
+      matcher.match(screen, to_request(env, ids, stop, n, instances)), ints,
+      scores);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeSubmitFrame(
+    JNIEnv *env, jobject, jobject buffer, jint width, jint height,
+    jint row_stride, jint pixel_stride) {
+  return submit_buffer(env, vision_default_matcher(), buffer, width, height,
+                       row_stride, pixel_stride);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeSubmitPooled(
+    JNIEnv *, jobject, jlong frame) {
+  return vision_default_matcher().submit_frame(frame_from_handle(frame))
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatchLatest(
+    JNIEnv *env, jobject) {
+  VisionMatcher &matcher = vision_default_matcher();
+  return to_java_results(env, matcher, matcher.match_latest());
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatchLatestPacked(
+    JNIEnv *env, jobject, jintArray ints, jfloatArray scores) {
+  VisionMatcher &matcher = vision_default_matcher();
+  return pack_results(env, matcher, matcher.match_latest(), ints, scores);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatchLatestTargetedPacked(
+    JNIEnv *env, jobject, jintArray ids, jint stop, jint n, jint instances,
+    jintArray ints, jfloatArray scores) {
+  VisionMatcher &matcher = vision_default_matcher();
+  return pack_results(
+      env, matcher,
+      matcher.match_latest(to_request(env, ids, stop, n, instances)), ints,
+      scores);
+}
+
+// sequence[0] holds the number of the frame last matched and is advanced to
+// the one matched now; returns -1, without matching, when there is none.
+// Null `ids` matches every template.
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeMatchLatestSincePacked(
+    JNIEnv *env, jobject, jlongArray sequence, jintArray ids, jint stop,
+    jint n, jint instances, jintArray ints, jfloatArray scores) {
+  if (!sequence || env->GetArrayLength(sequence) < 1)
+    return -1;
+  jlong value = 0;
+  env->GetLongArrayRegion(sequence, 0, 1, &value);
+  VisionMatcher &matcher = vision_default_matcher();
+  uint64_t seen = (uint64_t)value;
+  std::vector<MatchResult> results;
+  const bool matched =
+      ids ? matcher.match_latest(
+                seen, to_request(env, ids, stop, n, instances), results)
+          : matcher.match_latest(seen, results);
+  if (!matched)
+    return -1;
+  value = (jlong)seen;
+  env->SetLongArrayRegion(sequence, 0, 1, &value);
+  return pack_results(env, matcher, std::move(results), ints, scores);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeClearLatest(
+    JNIEnv *, jobject) {
+  vision_default_matcher().clear_latest();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeLastResultsPacked(
+    JNIEnv *env, jobject, jintArray ints, jfloatArray scores) {
+  return write_packed(env, last_results(), ints, scores);
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeLastFrameDiff(
+    JNIEnv *env, jobject) {
+  return to_java_diff(env, vision_last_frame_diff());
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeStartRecording(
+    JNIEnv *env, jobject, jstring path) {
+  return vision_default_matcher().start_recording(to_string(env, path))
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeStopRecording(
+    JNIEnv *, jobject) {
+  return (jint)vision_default_matcher().stop_recording();
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeGetStats(
+    JNIEnv *env, jobject) {
+  return env->NewStringUTF(vision_default_matcher().stats_json().c_str());
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeResetStats(
+    JNIEnv *, jobject) {
+  vision_default_matcher().reset_stats();
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeSetTemplateLogging(
+    JNIEnv *, jobject, jboolean enabled) {
+  vision_set_template_logging(enabled == JNI_TRUE);
+}
+
+// `priors` holds (x, y, width, height) per template; 0x0 means none.
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeCompilePack(
+    JNIEnv *env, jobject, jstring path, jintArray ids, jobjectArray bitmaps,
+    jintArray priors, jint margin, jlong checksum) {
+  std::vector<int> id_list = to_int_vector(env, ids);
+  std::vector<int> rects = to_int_vector(env, priors);
+  if (!bitmaps || env->GetArrayLength(bitmaps) != (jsize)id_list.size() ||
+      rects.size() != id_list.size() * 4)
+    return JNI_FALSE;
+
+  std::vector<PackSource> sources(id_list.size());
+  for (size_t i = 0; i < id_list.size(); ++i) {
+    jobject bitmap = env->GetObjectArrayElement(bitmaps, (jsize)i);
+    bool ok = bitmap && bitmap_to_mat(env, bitmap, sources[i].templ);
+    env->DeleteLocalRef(bitmap);
+    if (!ok)
+      return JNI_FALSE;
+    sources[i].id = id_list[i];
+    sources[i].prior = cv::Rect(rects[i * 4], rects[i * 4 + 1],
+                                rects[i * 4 + 2], rects[i * 4 + 3]);
+    sources[i].margin = (int)margin;
+  }
+  return vision_compile_pack(to_string(env, path), sources,
+                             (uint64_t)checksum)
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativePackCurrent(
+    JNIEnv *env, jobject, jstring path, jlong checksum) {
+  return vision_pack_current(to_string(env, path), (uint64_t)checksum)
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionNativeBridge_nativeAddPack(
+    JNIEnv *env, jobject, jstring path, jlong checksum) {
+  return (jint)vision_add_pack(to_string(env, path), (uint64_t)checksum);
+}
+
+// ── VisionMatcher instances ──────────────────────────────────────────
+
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeCreate(
+    JNIEnv *env, jobject) {
+  return reinterpret_cast<jlong>(new VisionMatcher());
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeDestroy(
+    JNIEnv *env, jclass, jlong handle) {
+  delete from_handle(handle);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeAddTemplate(
+    JNIEnv *env, jobject, jlong handle, jint id, jobject bitmap) {
+  cv::Mat mat;
+  if (!bitmap_to_mat(env, bitmap, mat))
+    return;
+  from_handle(handle)->add_template((int)id, mat);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeAddTemplateWithPrior(
+    JNIEnv *env, jobject, jlong handle, jint id, jobject bitmap, jint x, jint y,
+    jint width, jint height, jint margin) {
+  cv::Mat mat;
+  if (!bitmap_to_mat(env, bitmap, mat))
+    return;
+  from_handle(handle)->add_template(
+      (int)id, mat, cv::Rect((int)x, (int)y, (int)width, (int)height),
+      (int)margin);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeAddFeatureTemplate(
+    JNIEnv *env, jobject, jlong handle, jint id, jobject bitmap) {
+  cv::Mat mat;
+  if (!bitmap_to_mat(env, bitmap, mat))
+    return JNI_FALSE;
+  return from_handle(handle)->add_feature_template((int)id, mat) ? JNI_TRUE
+                                                                 : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeAddPack(
+    JNIEnv *env, jobject, jlong handle, jstring path, jlong checksum,
+    jintArray ids) {
+  return (jint)from_handle(handle)->add_pack(
+      to_string(env, path), (uint64_t)checksum, to_int_vector(env, ids));
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeRemoveTemplate(
+    JNIEnv *env, jobject, jlong handle, jint id) {
+  return from_handle(handle)->remove_template((int)id) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeClearTemplates(
+    JNIEnv *env, jobject, jlong handle) {
+  from_handle(handle)->clear_templates();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeTemplateCount(
+    JNIEnv *env, jobject, jlong handle) {
+  return (jint)from_handle(handle)->template_count();
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeSetSearchMode(
+    JNIEnv *env, jobject, jlong handle, jint mode, jint pyramid_factor,
+    jint refine_candidates) {
+  set_search_mode(*from_handle(handle), mode, pyramid_factor,
+                  refine_candidates);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeSetDiffTile(
+    JNIEnv *env, jobject, jlong handle, jint tile) {
+  set_diff_tile(*from_handle(handle), tile);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeSetThreads(
+    JNIEnv *env, jobject, jlong handle, jint threads, jintArray cpus) {
+  from_handle(handle)->set_threads((int)threads, to_int_vector(env, cpus));
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeMatch(
+    JNIEnv *env, jobject, jlong handle, jobject bitmap) {
+  VisionMatcher &matcher = *from_handle(handle);
+  cv::Mat screen;
+  if (!frame_from_bitmap(env, matcher, bitmap, screen))
+    return nullptr;
+  return to_java_results(env, matcher, matcher.match(screen));
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeMatchPacked(
+    JNIEnv *env, jobject, jlong handle, jobject bitmap, jintArray ints,
+    jfloatArray scores) {
+  VisionMatcher &matcher = *from_handle(handle);
+  cv::Mat screen;
+  if (!frame_from_bitmap(env, matcher, bitmap, screen))
+    return -1;
+  return pack_results(env, matcher, matcher.match(screen), ints, scores);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeMatchTargetedPacked(
+    JNIEnv *env, jobject, jlong handle, jobject bitmap, jintArray ids,
+    jint stop, jint n, jint instances, jintArray ints, jfloatArray scores) {
+  VisionMatcher &matcher = *from_handle(handle);
+  cv::Mat screen;
+  if (!frame_from_bitmap(env, matcher, bitmap, screen))
+    return -1;
+  return pack_results(
+      env, matcher,
+      matcher.match(screen, to_request(env, ids, stop, n, instances)), ints,
+      scores);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeMatchFramePacked(
+    JNIEnv *env, jobject, jlong handle, jlong frame, jintArray ints,
+    jfloatArray scores) {
+  VisionMatcher &matcher = *from_handle(handle);
+  return pack_results(env, matcher, matcher.match(frame_from_handle(frame)),
+                      ints, scores);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeSubmitFrame(
+    JNIEnv *env, jobject, jlong handle, jobject buffer, jint width,
+    jint height, jint row_stride, jint pixel_stride) {
+  return submit_buffer(env, *from_handle(handle), buffer, width, height,
+                       row_stride, pixel_stride);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeSubmitPooled(
+    JNIEnv *, jobject, jlong handle, jlong frame) {
+  return from_handle(handle)->submit_frame(frame_from_handle(frame))
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeMatchLatestPacked(
+    JNIEnv *env, jobject, jlong handle, jintArray ints, jfloatArray scores) {
+  VisionMatcher &matcher = *from_handle(handle);
+  return pack_results(env, matcher, matcher.match_latest(), ints, scores);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeMatchLatestTargetedPacked(
+    JNIEnv *env, jobject, jlong handle, jintArray ids, jint stop, jint n,
+    jint instances, jintArray ints, jfloatArray scores) {
+  VisionMatcher &matcher = *from_handle(handle);
+  return pack_results(
+      env, matcher,
+      matcher.match_latest(to_request(env, ids, stop, n, instances)), ints,
+      scores);
+}
+
+// Blocks in wait_for on the pool's frames until found, timed out, the pool
+// closed or the handle's waits cancelled (FramePool.nativeCancelWaits).
+// Returns the last frame's result count as the packed calls do; `status`
+// receives {found, frames}.
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeWaitFor(
+    JNIEnv *env, jobject, jlong handle, jlong pool, jintArray ids, jint stop,
+    jint n, jfloat min_score, jint timeout_ms, jint stable_frames,
+    jintArray ints, jfloatArray scores, jintArray status) {
+  VisionMatcher &matcher = *from_handle(handle);
+  // Held for the whole wait: the capture may close, and so destroy, its
+  // handle meanwhile.
+  const FramePoolHandle &through = pool_handle(pool);
+  const std::shared_ptr<FramePool> frames = through.pool;
+  const std::shared_ptr<const std::atomic<bool>> cancelled = through.cancelled;
+  WaitRequest request;
+  request.cancel = cancelled.get();
+  request.match = to_request(env, ids, stop, n, 1);
+  request.min_score = (float)min_score;
+  request.timeout_ms = (int)timeout_ms;
+  request.stable_frames = (int)stable_frames;
+  WaitResult result = matcher.wait_for(*frames, request);
+  if (status && env->GetArrayLength(status) >= 2) {
+    const jint values[] = {result.found ? 1 : 0, (jint)result.frames};
+    env->SetIntArrayRegion(status, 0, 2, values);
+  }
+  return pack_results(env, matcher, std::move(result.results), ints, scores);
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeLastFrameDiff(
+    JNIEnv *env, jobject, jlong handle) {
+  return to_java_diff(env, from_handle(handle)->last_frame_diff());
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeStartRecording(
+    JNIEnv *env, jobject, jlong handle, jstring path) {
+  return from_handle(handle)->start_recording(to_string(env, path))
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeStopRecording(
+    JNIEnv *, jobject, jlong handle) {
+  return (jint)from_handle(handle)->stop_recording();
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeGetStats(
+    JNIEnv *env, jobject, jlong handle) {
+  return env->NewStringUTF(from_handle(handle)->stats_json().c_str());
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_VisionMatcher_nativeResetStats(
+    JNIEnv *, jobject, jlong handle) {
+  from_handle(handle)->reset_stats();
+}
+}
@@ -0,0 +1,46 @@
+#ifndef VISION_LOG_H
+#define VISION_LOG_H
+
+// Logging shim so the matcher core builds both inside the app (logcat) and on
+// a desktop host (stderr) for benchmarks and tools.
+
+#define LOG_TAG "VisionEngineNative"
+
+#include <atomic>
+
+// Per-template lines (scores, windows, instances) cost a formatted log call
+// per template per frame, so they are off unless switched on at runtime.
+inline std::atomic<bool> &vision_template_logging() {
+  static std::atomic<bool> enabled{false};
+  return enabled;
+}
+
+inline void vision_set_template_logging(bool enabled) {
+  vision_template_logging().store(enabled, std::memory_order_relaxed);
+}
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+// Per-template debug lines would swamp benchmark output and skew timings, so
+// host builds only print them when VISION_HOST_DEBUG_LOG is defined.
+#ifdef VISION_HOST_DEBUG_LOG
+#define LOGD(...)                                                              \
+  (std::fprintf(stderr, "D/" LOG_TAG ": " __VA_ARGS__), std::fputc('\n', stderr))
+#else
+#define LOGD(...) ((void)0)
+#endif
+#define LOGE(...)                                                              \
+  (std::fprintf(stderr, "E/" LOG_TAG ": " __VA_ARGS__), std::fputc('\n', stderr))
+#endif
+
+#define LOGT(...)                                                              \
+  do {                                                                         \
+    if (vision_template_logging().load(std::memory_order_relaxed))             \
+      LOGD(__VA_ARGS__);                                                       \
+  } while (0)
+
+#endif // VISION_LOG_H
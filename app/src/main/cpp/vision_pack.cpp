@@ -0,0 +1,183 @@
+#include "vision_pack.h"
+#include "vision_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ── Reading ───────────────────────────────────────────────────────────
+
+std::shared_ptr<const TemplatePack>
+TemplatePack::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOGD("TemplatePack: cannot open %s: %s", path.c_str(),
+         std::strerror(errno));
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PackHeader)) {
+    LOGE("TemplatePack: %s is too small", path.c_str());
+    ::close(fd);
+    return nullptr;
+  }
+  const size_t size = (size_t)st.st_size;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // the mapping keeps the file alive
+  if (addr == MAP_FAILED) {
+    LOGE("TemplatePack: mmap of %s failed: %s", path.c_str(),
+         std::strerror(errno));
+    return nullptr;
+  }
+
+  std::shared_ptr<TemplatePack> pack(new TemplatePack());
+  pack->data_ = static_cast<const uint8_t *>(addr);
+  pack->size_ = size;
+
+  const PackHeader &h = pack->header();
+  if (std::memcmp(h.magic, kPackMagic, sizeof(kPackMagic)) != 0 ||
+      h.version != kPackVersion || h.file_size != size) {
+    LOGE("TemplatePack: %s is not a version %u pack", path.c_str(),
+         kPackVersion);
+    return nullptr;
+  }
+  const uint64_t tables = sizeof(PackHeader) +
+                          (uint64_t)h.template_count * sizeof(PackTemplate) +
+                          (uint64_t)h.image_count * sizeof(PackImage);
+  if (tables > size) {
+    LOGE("TemplatePack: %s is truncated", path.c_str());
+    return nullptr;
+  }
+  for (uint32_t t = 0; t < h.template_count; t++) {
+    const PackTemplate &pt = pack->templates()[t];
+    if ((uint64_t)pt.first_image + pt.image_count > h.image_count) {
+      LOGE("TemplatePack: %s template %u has a bad image range",
+           path.c_str(), t);
+      return nullptr;
+    }
+  }
+  for (uint32_t i = 0; i < h.image_count; i++) {
+    const PackImage &img = pack->images()[i];
+    if (img.width <= 0 || img.height <= 0 || img.factor <= 0 ||
+        img.offset < tables || img.offset % kPackAlign != 0 ||
+        img.offset + (uint64_t)img.width * (uint64_t)img.height > size) {
+      LOGE("TemplatePack: %s image %u lies outside the file", path.c_str(),
+           i);
+      return nullptr;
+    }
+  }
+  return pack;
+}
+
+TemplatePack::~TemplatePack() {
+  if (data_)
+    munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+cv::Mat TemplatePack::view(const PackImage &image) const {
+  // cv::Mat has no const view; PROT_READ turns any write into a fault.
+  return cv::Mat(image.height, image.width, CV_8UC1,
+                 const_cast<uint8_t *>(data_ + image.offset));
+}
+
+// ── Writing ───────────────────────────────────────────────────────────
+
+void TemplatePackWriter::add_template(int id, const cv::Rect &prior,
+                                      int margin) {
+  PackTemplate t = {};
+  t.id = id;
+  if (prior.width > 0 && prior.height > 0) {
+    t.prior_x = prior.x;
+    t.prior_y = prior.y;
+    t.prior_width = prior.width;
+    t.prior_height = prior.height;
+  }
+  t.prior_margin = std::max(margin, 0);
+  t.first_image = (uint32_t)images_.size();
+  templates_.push_back(t);
+}
+
+void TemplatePackWriter::add_image(int factor, int scale_index,
+                                   const cv::Mat &gray, double mean,
+                                   double norm) {
+  if (templates_.empty() || gray.empty() || gray.type() != CV_8UC1)
+    return;
+  PackImage img = {};
+  img.factor = factor;
+  img.scale_index = scale_index;
+  img.width = gray.cols;
+  img.height = gray.rows;
+  img.mean = mean;
+  img.norm = norm;
+  images_.push_back(img);
+  pixels_.push_back(gray);
+  templates_.back().image_count++;
+}
+
+static size_t align_up(size_t n) {
+  return (n + kPackAlign - 1) / kPackAlign * kPackAlign;
+}
+
+bool TemplatePackWriter::write(const std::string &path, uint64_t checksum,
+                               uint64_t engine_tag) const {
+  std::vector<PackImage> images = images_;
+  size_t offset = align_up(sizeof(PackHeader) +
+                           templates_.size() * sizeof(PackTemplate) +
+                           images.size() * sizeof(PackImage));
+  for (PackImage &img : images) {
+    img.offset = offset;
+    offset = align_up(offset + (size_t)img.width * (size_t)img.height);
+  }
+
+  PackHeader h = {};
+  std::memcpy(h.magic, kPackMagic, sizeof(kPackMagic));
+  h.version = kPackVersion;
+  h.template_count = (uint32_t)templates_.size();
+  h.image_count = (uint32_t)images.size();
+  h.checksum = checksum;
+  h.engine_tag = engine_tag;
+  h.file_size = offset;
+
+  const std::string tmp = path + ".tmp";
+  FILE *f = std::fopen(tmp.c_str(), "wb");
+  if (!f) {
+    LOGE("TemplatePackWriter: cannot create %s: %s", tmp.c_str(),
+         std::strerror(errno));
+    return false;
+  }
+  bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+  if (ok && !templates_.empty())
+    ok = std::fwrite(templates_.data(), sizeof(PackTemplate),
+                     templates_.size(), f) == templates_.size();
+  if (ok && !images.empty())
+    ok = std::fwrite(images.data(), sizeof(PackImage), images.size(), f) ==
+         images.size();
+  static const uint8_t zeros[kPackAlign] = {};
+  for (size_t i = 0; ok && i < images.size(); i++) {
+    const cv::Mat &gray = pixels_[i];
+    long pad = (long)images[i].offset - std::ftell(f);
+    ok = pad >= 0 && pad < (long)kPackAlign &&
+         std::fwrite(zeros, 1, (size_t)pad, f) == (size_t)pad;
+    for (int y = 0; ok && y < gray.rows; y++)
+      ok = std::fwrite(gray.ptr(y), 1, (size_t)gray.cols, f) ==
+           (size_t)gray.cols;
+  }
+  if (ok) {
+    long pad = (long)h.file_size - std::ftell(f);
+    ok = pad >= 0 && std::fwrite(zeros, 1, (size_t)pad, f) == (size_t)pad;
+  }
+  ok = std::fclose(f) == 0 && ok;
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    LOGE("TemplatePackWriter: writing %s failed", path.c_str());
+    std::remove(tmp.c_str());
+    return false;
+  }
+  LOGD("TemplatePackWriter: %s, %zu templates, %zu images, %zu bytes",
+       path.c_str(), templates_.size(), images.size(), (size_t)h.file_size);
+  return true;
+}
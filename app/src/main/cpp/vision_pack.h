@@ -0,0 +1,120 @@
+#ifndef VISION_PACK_H
+#define VISION_PACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Compiled template packs: every template of a preset, already converted to
+// grayscale, scaled to each match scale and pyramid factor and measured, in
+// one file that is memory-mapped read-only. Registering a pack wraps the
+// mapped pixels in cv::Mat headers, so nothing is decoded or copied.
+//
+// Layout (native endianness; packs never leave the device that wrote them):
+//   PackHeader
+//   PackTemplate[template_count]
+//   PackImage[image_count]
+//   pixel rows, each image starting on a kPackAlign boundary, rows packed
+//
+// The header carries two fingerprints. `checksum` is the caller's digest of
+// the sources (PNG bytes, rectangles), so a pack whose sources changed is
+// rejected and recompiled; `engine_tag` identifies the scale and factor
+// tables the variants were built for (see vision_engine.cpp).
+
+constexpr char kPackMagic[8] = {'V', 'S', 'N', 'P', 'A', 'C', 'K', '\0'};
+constexpr uint32_t kPackVersion = 1;
+constexpr size_t kPackAlign = 64;
+
+struct PackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t template_count;
+  uint32_t image_count;
+  uint32_t reserved;
+  uint64_t checksum;
+  uint64_t engine_tag;
+  uint64_t file_size;
+};
+
+struct PackTemplate {
+  int32_t id;
+  int32_t prior_x, prior_y, prior_width, prior_height; // 0x0 when none
+  int32_t prior_margin;
+  uint32_t first_image; // index into the image table
+  uint32_t image_count;
+};
+
+// One grayscale image of a template: a kMatchScales variant at full
+// resolution (factor 1) or its copy for a pyramid factor, with the
+// TM_CCOEFF_NORMED statistics computed at compile time.
+struct PackImage {
+  int32_t factor;
+  int32_t scale_index;
+  int32_t width;
+  int32_t height;
+  double mean;
+  double norm;
+  uint64_t offset; // from the start of the file; width bytes per row
+};
+
+static_assert(sizeof(PackHeader) == 48, "PackHeader layout");
+static_assert(sizeof(PackTemplate) == 32, "PackTemplate layout");
+static_assert(sizeof(PackImage) == 40, "PackImage layout");
+
+// A mapped pack. The mapping lives as long as the object; registered
+// templates hold a shared_ptr to it.
+class TemplatePack {
+public:
+  // Maps `path` and checks the header and that every table and image lies
+  // inside the file. Returns null (and logs why) on any failure.
+  static std::shared_ptr<const TemplatePack> open(const std::string &path);
+  ~TemplatePack();
+
+  TemplatePack(const TemplatePack &) = delete;
+  TemplatePack &operator=(const TemplatePack &) = delete;
+
+  const PackHeader &header() const {
+    return *reinterpret_cast<const PackHeader *>(data_);
+  }
+  const PackTemplate *templates() const {
+    return reinterpret_cast<const PackTemplate *>(data_ + sizeof(PackHeader));
+  }
+  const PackImage *images() const {
+    return reinterpret_cast<const PackImage *>(
+        templates() + header().template_count);
+  }
+  // A read-only view of the image's pixels; it must not be written to.
+  cv::Mat view(const PackImage &image) const;
+
+private:
+  TemplatePack() = default;
+
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Collects templates and their images, then writes a pack in one go.
+class TemplatePackWriter {
+public:
+  void add_template(int id, const cv::Rect &prior, int margin);
+  // Appends an image to the template added last. `gray` is CV_8UC1.
+  void add_image(int factor, int scale_index, const cv::Mat &gray, double mean,
+                 double norm);
+  size_t template_count() const { return templates_.size(); }
+
+  // Writes to a temporary file next to `path` and renames it into place, so
+  // a reader never maps a half-written pack and existing mappings of the
+  // old file stay valid.
+  bool write(const std::string &path, uint64_t checksum,
+             uint64_t engine_tag) const;
+
+private:
+  std::vector<PackTemplate> templates_;
+  std::vector<PackImage> images_;
+  std::vector<cv::Mat> pixels_; // parallel to images_
+};
+
+#endif // VISION_PACK_H
@@ -0,0 +1,180 @@
+#include "vision_pool.h"
+#include "vision_log.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+WorkerPool::WorkerPool(int threads, const std::vector<int> &cpus,
+                       ScratchCounters &scratch) {
+  threads = std::max(threads, 1);
+  for (int i = 0; i < threads; i++) {
+    queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    arenas_.push_back(std::unique_ptr<ScratchArena>(
+        i == 0 ? nullptr : new ScratchArena(scratch)));
+  }
+  for (int i = 1; i < threads; i++)
+    threads_.emplace_back(&WorkerPool::worker_loop, this, i, cpus);
+  LOGD("WorkerPool: %d participants, %zu pinned CPUs", threads, cpus.size());
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_all();
+  for (std::thread &t : threads_)
+    t.join();
+}
+
+void WorkerPool::run(int count, const std::function<void(int)> &task) {
+  if (count <= 0)
+    return;
+  std::lock_guard<std::mutex> batch(run_mutex_);
+
+  if (size() == 1 || count == 1) {
+    for (int i = 0; i < count; i++)
+      task(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    task_ = &task;
+    error_ = nullptr;
+    pending_.store(count);
+    for (int i = 0; i < count; i++) {
+      Queue &q = *queues_[i % size()];
+      std::lock_guard<std::mutex> qlock(q.mutex);
+      q.items.push_back(i);
+    }
+    generation_++;
+  }
+  work_cv_.notify_all();
+
+  int item;
+  while (pop_or_steal(0, item))
+    execute(item);
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    done_cv_.wait(lock, [this] { return pending_.load() == 0; });
+    task_ = nullptr;
+    error = error_;
+    error_ = nullptr;
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void WorkerPool::worker_loop(int index, std::vector<int> cpus) {
+#if defined(__linux__)
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+      LOGE("WorkerPool: worker %d could not be pinned", index);
+  }
+#endif
+
+  ScratchArena &arena = *arenas_[(size_t)index];
+  ScratchBinding binding(&arena);
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(state_mutex_);
+      work_cv_.wait(lock,
+                    [&] { return stopping_ || generation_ != seen; });
+      if (stopping_)
+        return;
+      seen = generation_;
+    }
+    int item;
+    while (pop_or_steal(index, item))
+      execute(item);
+    arena.end_frame();
+  }
+}
+
+// Own deque from the back (most recently dealt, still cache-warm), then the
+// others' from the front, starting with the next participant.
+bool WorkerPool::pop_or_steal(int index, int &item) {
+  {
+    Queue &own = *queues_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.items.empty()) {
+      item = own.items.back();
+      own.items.pop_back();
+      return true;
+    }
+  }
+  const int n = size();
+  for (int k = 1; k < n; k++) {
+    Queue &victim = *queues_[(index + k) % n];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.items.empty()) {
+      item = victim.items.front();
+      victim.items.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkerPool::execute(int item) {
+  try {
+    (*task_)(item);
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    if (!error_)
+      error_ = std::current_exception();
+  }
+  if (pending_.fetch_sub(1) == 1) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    done_cv_.notify_all();
+  }
+}
+
+std::vector<int> vision_performance_cores() {
+  int n = (int)std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<int> all;
+  std::vector<long> freq(n, -1);
+  long slowest = -1;
+  bool varied = false;
+  for (int cpu = 0; cpu < n; cpu++) {
+    all.push_back(cpu);
+    char path[96];
+    std::snprintf(path, sizeof(path),
+                  "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
+                  cpu);
+    FILE *f = std::fopen(path, "r");
+    if (!f)
+      continue;
+    long khz = -1;
+    if (std::fscanf(f, "%ld", &khz) == 1 && khz > 0) {
+      freq[cpu] = khz;
+      if (slowest >= 0 && khz != slowest)
+        varied = true;
+      slowest = slowest < 0 ? khz : std::min(slowest, khz);
+    }
+    std::fclose(f);
+  }
+  if (!varied)
+    return all;
+
+  std::vector<int> fast;
+  for (int cpu = 0; cpu < n; cpu++) {
+    if (freq[cpu] > slowest)
+      fast.push_back(cpu);
+  }
+  return fast;
+}
@@ -0,0 +1,80 @@
+#ifndef VISION_POOL_H
+#define VISION_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vision_scratch.h"
+
+// Fixed-size work-stealing pool used by vision_match_all. A batch of N
+// indexed tasks is dealt round-robin into one deque per participant; each
+// participant pops from the back of its own deque and, once empty, steals
+// from the front of the others', so one slow task never leaves the rest of
+// the batch queued behind it. The calling thread is participant 0 and works
+// too, so a pool of size 1 spawns no threads at all.
+//
+// Each worker thread has its own ScratchArena, counted in the owning
+// matcher's ScratchCounters, bound while it lives, ended as a frame after
+// every batch and freed with the pool. The calling thread brings its own
+// binding.
+class WorkerPool {
+public:
+  // `threads` participants including the caller. When `cpus` is non-empty
+  // every worker thread pins itself to that CPU set (Linux/Android only;
+  // ignored elsewhere). The calling thread is never re-pinned. `scratch`
+  // must outlive the pool.
+  WorkerPool(int threads, const std::vector<int> &cpus,
+             ScratchCounters &scratch);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  int size() const { return (int)queues_.size(); }
+
+  // Runs task(i) for every i in [0, count) and returns once all have
+  // finished. Batches from different callers are serialised. The first
+  // exception thrown by a task is rethrown here after the batch drains.
+  void run(int count, const std::function<void(int)> &task);
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<int> items;
+  };
+
+  void worker_loop(int index, std::vector<int> cpus);
+  bool pop_or_steal(int index, int &item);
+  void execute(int item);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::unique_ptr<ScratchArena>> arenas_; // per participant;
+                                                      // 0 is unused
+  std::vector<std::thread> threads_;
+
+  std::mutex run_mutex_; // one batch at a time
+
+  std::mutex state_mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+
+  const std::function<void(int)> *task_ = nullptr;
+  std::atomic<int> pending_{0};
+  std::exception_ptr error_;
+};
+
+// CPUs whose maximum frequency is above the slowest cluster's, i.e. the
+// big/prime cores on a heterogeneous SoC. Every online CPU when the
+// frequencies are all equal or cannot be read.
+std::vector<int> vision_performance_cores();
+
+#endif // VISION_POOL_H
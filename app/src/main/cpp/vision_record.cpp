@@ -0,0 +1,327 @@
+#include "vision_record.h"
+#include "vision_log.h"
+#include "vision_simd.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+// PackBits: a control byte c below 128 is followed by c + 1 literal bytes;
+// c from 128 repeats the single byte after it c - 125 times (3 to 130).
+constexpr size_t kMaxLiteral = 128;
+constexpr size_t kMinRun = 3;
+constexpr size_t kMaxRun = 130;
+
+void pack_bits(const uint8_t *src, size_t n, std::vector<uint8_t> &out) {
+  size_t i = 0;
+  while (i < n) {
+    size_t run = 1;
+    while (i + run < n && run < kMaxRun && src[i + run] == src[i])
+      run++;
+    if (run >= kMinRun) {
+      out.push_back((uint8_t)(run + 125));
+      out.push_back(src[i]);
+      i += run;
+      continue;
+    }
+    // Literals up to the next run worth coding; at least one, since there
+    // is none at i.
+    const size_t start = i;
+    while (i < n && i - start < kMaxLiteral &&
+           !(i + 2 < n && src[i] == src[i + 1] && src[i] == src[i + 2]))
+      i++;
+    out.push_back((uint8_t)(i - start - 1));
+    out.insert(out.end(), src + start, src + i);
+  }
+}
+
+// Decodes exactly `n` bytes into `dst`, advancing `src`. False when the
+// input runs out or would overfill `dst`.
+bool unpack_bits(const uint8_t *&src, const uint8_t *end, uint8_t *dst,
+                 size_t n) {
+  size_t o = 0;
+  while (o < n) {
+    if (src >= end)
+      return false;
+    const uint8_t c = *src++;
+    if (c < 128) {
+      const size_t len = (size_t)c + 1;
+      if (len > n - o || len > (size_t)(end - src))
+        return false;
+      std::memcpy(dst + o, src, len);
+      src += len;
+      o += len;
+    } else {
+      const size_t len = (size_t)c - 125;
+      if (len > n - o || src >= end)
+        return false;
+      std::memset(dst + o, *src++, len);
+      o += len;
+    }
+  }
+  return true;
+}
+
+int tiles_across(int pixels) {
+  return (pixels + kRecordTile - 1) / kRecordTile;
+}
+
+cv::Rect tile_rect(int index, int cols, const cv::Size &size) {
+  const int x = (index % cols) * kRecordTile;
+  const int y = (index / cols) * kRecordTile;
+  return cv::Rect(x, y, std::min(kRecordTile, size.width - x),
+                  std::min(kRecordTile, size.height - y));
+}
+
+bool read_exact(FILE *f, void *dst, size_t n) {
+  return n == 0 || std::fread(dst, 1, n, f) == n;
+}
+
+} // namespace
+
+void vision_register_recorded(VisionMatcher &matcher,
+                              const std::vector<RecordedTemplate> &templates) {
+  for (const RecordedTemplate &t : templates) {
+    if (t.features)
+      matcher.add_feature_template(t.id, t.gray);
+    else if (!t.prior.empty())
+      matcher.add_template(t.id, t.gray, t.prior, t.margin);
+    else
+      matcher.add_template(t.id, t.gray);
+  }
+}
+
+// ── Writing ───────────────────────────────────────────────────────────
+
+bool RecordingWriter::open(const std::string &path,
+                           const std::vector<RecordedTemplate> &templates) {
+  close();
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_) {
+    LOGE("RecordingWriter: cannot create %s: %s", path.c_str(),
+         std::strerror(errno));
+    return false;
+  }
+  path_ = path;
+  frames_ = 0;
+  previous_.release();
+
+  RecordingHeader h = {};
+  std::memcpy(h.magic, kRecordMagic, sizeof(kRecordMagic));
+  h.version = kRecordVersion;
+  h.template_count = (uint32_t)templates.size();
+  h.tile = kRecordTile;
+  bool ok = std::fwrite(&h, sizeof(h), 1, file_) == 1;
+  bytes_ = sizeof(h);
+  for (const RecordedTemplate &t : templates) {
+    if (!ok)
+      break;
+    RecordingTemplate rt = {};
+    rt.id = t.id;
+    rt.width = t.gray.cols;
+    rt.height = t.gray.rows;
+    if (!t.prior.empty()) {
+      rt.prior_x = t.prior.x;
+      rt.prior_y = t.prior.y;
+      rt.prior_width = t.prior.width;
+      rt.prior_height = t.prior.height;
+    }
+    rt.prior_margin = std::max(t.margin, 0);
+    rt.flags = t.features ? kRecordFeatures : 0;
+    ok = t.gray.type() == CV_8UC1 &&
+         std::fwrite(&rt, sizeof(rt), 1, file_) == 1;
+    for (int y = 0; ok && y < t.gray.rows; y++)
+      ok = std::fwrite(t.gray.ptr(y), 1, (size_t)t.gray.cols, file_) ==
+           (size_t)t.gray.cols;
+    bytes_ += sizeof(rt) + t.gray.total();
+  }
+  if (!ok) {
+    LOGE("RecordingWriter: writing %s failed", path.c_str());
+    std::fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  LOGD("RecordingWriter: %s, %zu templates", path.c_str(), templates.size());
+  return true;
+}
+
+bool RecordingWriter::append(const cv::Mat &gray, int64_t timestamp_ms) {
+  if (!file_ || gray.empty() || gray.type() != CV_8UC1)
+    return false;
+  const int cols = tiles_across(gray.cols);
+  const int count = cols * tiles_across(gray.rows);
+  changed_.assign((size_t)count, 1);
+  int changed = count;
+  if (previous_.size() == gray.size())
+    changed = vision_tile_diff(previous_.data, previous_.step, gray.data,
+                               gray.step, gray.cols, gray.rows, kRecordTile,
+                               changed_.data());
+
+  bits_.assign(((size_t)count + 7) / 8, 0);
+  payload_.clear();
+  for (int i = 0; i < count; i++) {
+    if (!changed_[(size_t)i])
+      continue;
+    bits_[(size_t)i / 8] |= (uint8_t)(1u << (i % 8));
+    const cv::Rect r = tile_rect(i, cols, gray.size());
+    tile_.resize((size_t)r.area());
+    for (int y = 0; y < r.height; y++)
+      std::memcpy(tile_.data() + (size_t)y * r.width,
+                  gray.ptr(r.y + y) + r.x, (size_t)r.width);
+    pack_bits(tile_.data(), tile_.size(), payload_);
+  }
+
+  RecordingFrame rec = {};
+  rec.timestamp_ms = timestamp_ms;
+  rec.width = gray.cols;
+  rec.height = gray.rows;
+  rec.changed_tiles = (uint32_t)changed;
+  rec.payload_bytes = (uint32_t)payload_.size();
+  bool ok = std::fwrite(&rec, sizeof(rec), 1, file_) == 1 &&
+            std::fwrite(bits_.data(), 1, bits_.size(), file_) ==
+                bits_.size() &&
+            (payload_.empty() ||
+             std::fwrite(payload_.data(), 1, payload_.size(), file_) ==
+                 payload_.size());
+  if (!ok) {
+    LOGE("RecordingWriter: writing frame %zu to %s failed", frames_,
+         path_.c_str());
+    return false;
+  }
+  gray.copyTo(previous_);
+  frames_++;
+  bytes_ += sizeof(rec) + bits_.size() + payload_.size();
+  return true;
+}
+
+size_t RecordingWriter::close() {
+  if (!file_)
+    return frames_;
+  if (std::fclose(file_) != 0)
+    LOGE("RecordingWriter: closing %s failed", path_.c_str());
+  file_ = nullptr;
+  previous_.release();
+  LOGD("RecordingWriter: %s, %zu frames, %llu bytes", path_.c_str(), frames_,
+       (unsigned long long)bytes_);
+  return frames_;
+}
+
+// ── Replay ────────────────────────────────────────────────────────────
+
+ReplayFrameSource::~ReplayFrameSource() {
+  if (file_)
+    std::fclose(file_);
+}
+
+bool ReplayFrameSource::open(const std::string &path) {
+  if (file_)
+    std::fclose(file_);
+  templates_.clear();
+  current_.release();
+  file_ = std::fopen(path.c_str(), "rb");
+  if (!file_) {
+    LOGE("ReplayFrameSource: cannot open %s: %s", path.c_str(),
+         std::strerror(errno));
+    return false;
+  }
+
+  RecordingHeader h;
+  if (!read_exact(file_, &h, sizeof(h)) ||
+      std::memcmp(h.magic, kRecordMagic, sizeof(kRecordMagic)) != 0 ||
+      h.version != kRecordVersion || h.tile != (uint32_t)kRecordTile) {
+    LOGE("ReplayFrameSource: %s is not a version %u recording", path.c_str(),
+         kRecordVersion);
+    std::fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  for (uint32_t i = 0; i < h.template_count; i++) {
+    RecordingTemplate rt;
+    bool ok = read_exact(file_, &rt, sizeof(rt)) && rt.width > 0 &&
+              rt.height > 0 && rt.width <= 1 << 14 && rt.height <= 1 << 14;
+    RecordedTemplate t;
+    if (ok) {
+      t.id = rt.id;
+      t.gray.create(rt.height, rt.width, CV_8UC1);
+      ok = read_exact(file_, t.gray.data, t.gray.total());
+    }
+    if (!ok) {
+      LOGE("ReplayFrameSource: %s template %u is truncated", path.c_str(), i);
+      std::fclose(file_);
+      file_ = nullptr;
+      templates_.clear();
+      return false;
+    }
+    t.prior = cv::Rect(rt.prior_x, rt.prior_y, rt.prior_width,
+                       rt.prior_height);
+    t.margin = rt.prior_margin;
+    t.features = (rt.flags & kRecordFeatures) != 0;
+    templates_.push_back(t);
+  }
+  return true;
+}
+
+bool ReplayFrameSource::next(cv::Mat &gray, int64_t &timestamp_ms) {
+  if (!file_)
+    return false;
+  RecordingFrame rec;
+  if (!read_exact(file_, &rec, sizeof(rec)))
+    return false; // end of the recording
+  if (rec.width <= 0 || rec.height <= 0 || rec.width > 1 << 15 ||
+      rec.height > 1 << 15) {
+    LOGE("ReplayFrameSource: bad frame size %dx%d", rec.width, rec.height);
+    return false;
+  }
+  const cv::Size size(rec.width, rec.height);
+  const int cols = tiles_across(rec.width);
+  const int count = cols * tiles_across(rec.height);
+  bits_.resize(((size_t)count + 7) / 8);
+  payload_.resize(rec.payload_bytes);
+  if (!read_exact(file_, bits_.data(), bits_.size()) ||
+      !read_exact(file_, payload_.data(), payload_.size())) {
+    LOGE("ReplayFrameSource: last frame is truncated");
+    return false;
+  }
+
+  // Decode on top of a copy of the previous frame, so frames already handed
+  // out never change.
+  cv::Mat next;
+  if (current_.size() == size)
+    next = current_.clone();
+  else
+    next = cv::Mat::zeros(size, CV_8UC1);
+  const uint8_t *src = payload_.data();
+  const uint8_t *end = src + payload_.size();
+  int decoded = 0;
+  for (int i = 0; i < count; i++) {
+    if (!(bits_[(size_t)i / 8] & (1u << (i % 8))))
+      continue;
+    const cv::Rect r = tile_rect(i, cols, size);
+    tile_.resize((size_t)r.area());
+    if (!unpack_bits(src, end, tile_.data(), tile_.size())) {
+      LOGE("ReplayFrameSource: corrupt tile %d", i);
+      return false;
+    }
+    for (int y = 0; y < r.height; y++)
+      std::memcpy(next.ptr(r.y + y) + r.x,
+                  tile_.data() + (size_t)y * r.width, (size_t)r.width);
+    decoded++;
+  }
+  if (decoded != (int)rec.changed_tiles || src != end ||
+      (current_.size() != size && decoded != count)) {
+    LOGE("ReplayFrameSource: frame does not match its header");
+    return false;
+  }
+  current_ = next;
+  gray = next;
+  timestamp_ms = rec.timestamp_ms;
+  return true;
+}
+
+// ── Live ──────────────────────────────────────────────────────────────
+
+bool LiveFrameSource::next(cv::Mat &gray, int64_t &timestamp_ms) {
+  return matcher_.wait_frame(sequence_, gray, timestamp_ms, timeout_ms_);
+}
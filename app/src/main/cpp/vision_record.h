@@ -0,0 +1,159 @@
+#ifndef VISION_RECORD_H
+#define VISION_RECORD_H
+
+#include "vision_engine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Frame recordings: the grayscale frames a matcher was given, with their
+// capture times, plus the templates it had registered, so a field session
+// can be replayed through the engine on a desktop (tools/vision_replay).
+//
+// Layout (native endianness, like packs):
+//   RecordingHeader
+//   template_count times: RecordingTemplate, then width x height pixels
+//   frames up to the end of the file, each:
+//     RecordingFrame
+//     one bit per kRecordTile x kRecordTile tile, row-major, LSB first:
+//       set when the tile differs from the previous frame
+//     payload_bytes of PackBits-coded pixels of the set tiles in order,
+//       each tile's rows concatenated (edge tiles are partial)
+//
+// Only tiles that changed are stored, exactly, so a mostly static screen
+// costs a few bytes per frame and replay reproduces every pixel. A frame of
+// another size than the previous one (rotation) has every tile set. The
+// file is written as frames arrive and has no frame count; a reader stops
+// cleanly at a frame cut short by a crash.
+
+constexpr char kRecordMagic[8] = {'V', 'S', 'N', 'R', 'E', 'C', '\0', '\0'};
+constexpr uint32_t kRecordVersion = 1;
+constexpr int kRecordTile = 32;
+constexpr uint32_t kRecordFeatures = 1; // RecordingTemplate flag
+
+struct RecordingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t template_count;
+  uint32_t tile;
+  uint32_t reserved;
+};
+
+struct RecordingTemplate {
+  int32_t id;
+  int32_t width, height;
+  int32_t prior_x, prior_y, prior_width, prior_height; // 0x0 when none
+  int32_t prior_margin;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+struct RecordingFrame {
+  int64_t timestamp_ms; // since the recording started
+  int32_t width, height;
+  uint32_t changed_tiles;
+  uint32_t payload_bytes;
+};
+
+static_assert(sizeof(RecordingHeader) == 24, "RecordingHeader layout");
+static_assert(sizeof(RecordingTemplate) == 40, "RecordingTemplate layout");
+static_assert(sizeof(RecordingFrame) == 24, "RecordingFrame layout");
+
+// A template as recorded: what the matcher was given to register it.
+struct RecordedTemplate {
+  int id = 0;
+  cv::Mat gray;   // CV_8UC1
+  cv::Rect prior; // empty for none
+  int margin = 0;
+  bool features = false; // registered with add_feature_template
+};
+
+// Registers `templates` with `matcher` the way they were recorded.
+void vision_register_recorded(VisionMatcher &matcher,
+                              const std::vector<RecordedTemplate> &templates);
+
+// Appends frames to a recording. Not thread-safe; the matcher serialises
+// its calls.
+class RecordingWriter {
+public:
+  RecordingWriter() = default;
+  ~RecordingWriter() { close(); }
+
+  RecordingWriter(const RecordingWriter &) = delete;
+  RecordingWriter &operator=(const RecordingWriter &) = delete;
+
+  // Creates `path` and writes the header and templates.
+  bool open(const std::string &path,
+            const std::vector<RecordedTemplate> &templates);
+  // Appends a CV_8UC1 frame. The writer keeps its own copy to diff the next
+  // frame against, so `gray` may be reused afterwards.
+  bool append(const cv::Mat &gray, int64_t timestamp_ms);
+  // Flushes and closes the file; returns the frames written.
+  size_t close();
+
+  bool is_open() const { return file_ != nullptr; }
+  size_t frames() const { return frames_; }
+
+private:
+  FILE *file_ = nullptr;
+  std::string path_;
+  size_t frames_ = 0;
+  uint64_t bytes_ = 0;
+  cv::Mat previous_;
+  std::vector<uint8_t> changed_, bits_, tile_, payload_;
+};
+
+// Where a replay or live loop gets its frames.
+class FrameSource {
+public:
+  virtual ~FrameSource() = default;
+  // The next frame (CV_8UC1) and its capture time in milliseconds; false
+  // once the source has no more. `gray` stays valid after later calls.
+  virtual bool next(cv::Mat &gray, int64_t &timestamp_ms) = 0;
+};
+
+// Frames of a recording, in order, decoded one at a time.
+class ReplayFrameSource : public FrameSource {
+public:
+  ReplayFrameSource() = default;
+  ~ReplayFrameSource() override;
+
+  ReplayFrameSource(const ReplayFrameSource &) = delete;
+  ReplayFrameSource &operator=(const ReplayFrameSource &) = delete;
+
+  // Opens `path` and reads its templates. Logs why and returns false when
+  // it is not a recording this version reads.
+  bool open(const std::string &path);
+  const std::vector<RecordedTemplate> &templates() const { return templates_; }
+
+  // False at the end of the file and at a truncated or corrupt frame.
+  bool next(cv::Mat &gray, int64_t &timestamp_ms) override;
+
+private:
+  FILE *file_ = nullptr;
+  std::vector<RecordedTemplate> templates_;
+  cv::Mat current_;
+  std::vector<uint8_t> bits_, tile_, payload_;
+};
+
+// Frames as they are submitted to a matcher (VisionMatcher::submit_frame),
+// each returned once. next() waits up to `timeout_ms` for one newer than
+// the last it returned and ends the source when none comes.
+class LiveFrameSource : public FrameSource {
+public:
+  LiveFrameSource(VisionMatcher &matcher, int timeout_ms)
+      : matcher_(matcher), timeout_ms_(timeout_ms) {}
+
+  bool next(cv::Mat &gray, int64_t &timestamp_ms) override;
+
+private:
+  VisionMatcher &matcher_;
+  int timeout_ms_;
+  uint64_t sequence_ = 0;
+};
+
+#endif // VISION_RECORD_H
@@ -0,0 +1,88 @@
+#include "vision_scratch.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// Buffers grow in whole steps so a run of slightly larger requests (the
+// result maps of ever smaller templates) costs one growth, not one each.
+constexpr size_t kGrowStep = 64 * 1024;
+
+std::atomic<uint64_t> g_bytes{0};
+
+size_t round_up(size_t bytes) {
+  return (bytes + kGrowStep - 1) / kGrowStep * kGrowStep;
+}
+
+thread_local ScratchArena *t_bound = nullptr;
+
+} // namespace
+
+ScratchArena::ScratchArena(ScratchCounters &counters)
+    : counters_(counters) {}
+
+ScratchArena::~ScratchArena() {
+  for (cv::Mat &buffer : buffers_)
+    reallocate(buffer, 0);
+}
+
+cv::Mat ScratchArena::view(int slot, int rows, int cols, int type) {
+  CV_Assert(slot >= 0 && slot < kSlots && rows >= 0 && cols >= 0);
+  cv::Mat &buffer = buffers_[(size_t)slot];
+  const size_t needed =
+      round_up((size_t)rows * (size_t)cols * CV_ELEM_SIZE(type));
+  peak_[(size_t)slot] = std::max(peak_[(size_t)slot], needed);
+  if (needed > buffer.total()) {
+    counters_.growths.fetch_add(1, std::memory_order_relaxed);
+    reallocate(buffer, needed);
+  }
+  return cv::Mat(rows, cols, type, buffer.data);
+}
+
+void ScratchArena::reallocate(cv::Mat &buffer, size_t bytes) {
+  const size_t held = buffer.total();
+  buffer.release();
+  if (bytes > 0)
+    buffer.create(1, (int)bytes, CV_8U);
+  if (bytes > held) {
+    g_bytes.fetch_add(bytes - held);
+    counters_.bytes.fetch_add(bytes - held);
+  } else {
+    g_bytes.fetch_sub(held - bytes);
+    counters_.bytes.fetch_sub(held - bytes);
+  }
+}
+
+size_t ScratchArena::bytes() const {
+  size_t sum = 0;
+  for (const cv::Mat &b : buffers_)
+    sum += b.total();
+  return sum;
+}
+
+void ScratchArena::end_frame() {
+  if (++frames_ < kScratchWindowFrames)
+    return;
+  frames_ = 0;
+  for (size_t slot = 0; slot < buffers_.size(); slot++) {
+    if (buffers_[slot].total() > peak_[slot])
+      reallocate(buffers_[slot], peak_[slot]);
+    peak_[slot] = 0;
+  }
+}
+
+ScratchBinding::ScratchBinding(ScratchArena *arena) : previous_(t_bound) {
+  t_bound = arena;
+}
+
+ScratchBinding::~ScratchBinding() { t_bound = previous_; }
+
+ScratchArena &vision_scratch() {
+  CV_Assert(t_bound != nullptr);
+  return *t_bound;
+}
+
+uint64_t vision_scratch_bytes() {
+  return g_bytes.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,97 @@
+#ifndef VISION_SCRATCH_H
+#define VISION_SCRATCH_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+// Scratch memory for the per-frame path, owned by a matcher. Correlation
+// maps, window integrals and pyramid levels are Mat views into buffers that
+// grow to the largest screen and template seen, so a steady stream of
+// frames allocates nothing. Passing such a view to an OpenCV function whose
+// output has the same size and type writes into it in place.
+//
+// Every worker of a matcher's pool has its own arena, and a thread calling
+// match borrows one of the matcher's for the call (see ScratchBinding). An
+// arena keeps what the matcher's frames actually needed at their peak (see
+// end_frame) and is freed with its pool or matcher, so no thread keeps
+// scratch once the matcher is gone.
+//
+// A view stays valid until the same slot is asked for again on the same
+// arena, or end_frame cuts the slot down; it must not be kept beyond the
+// frame.
+// Different slots are independent, so another thread may use one slot
+// while the owner uses another.
+
+// One matcher's scratch accounting, shared by all of its arenas: how many
+// times a buffer grew, and the bytes held now. Once frames are steady the
+// growths stop; if they keep rising, some per-frame buffer is not drawn
+// from the arena.
+struct ScratchCounters {
+  std::atomic<uint64_t> growths{0};
+  std::atomic<uint64_t> bytes{0};
+};
+
+// Frames (or pool batches) over which an arena watches its peak before
+// giving back what that peak did not use.
+constexpr int kScratchWindowFrames = 64;
+
+class ScratchArena {
+public:
+  static constexpr int kSlots = 16;
+
+  // `counters` must outlive the arena.
+  explicit ScratchArena(ScratchCounters &counters);
+  ~ScratchArena();
+
+  ScratchArena(const ScratchArena &) = delete;
+  ScratchArena &operator=(const ScratchArena &) = delete;
+
+  // A continuous rows x cols Mat of `type` over slot `slot`, growing its
+  // buffer first when it is too small. Contents are left as they were.
+  cv::Mat view(int slot, int rows, int cols, int type);
+
+  size_t bytes() const;
+
+  // Ends a frame, or a pool batch. Every kScratchWindowFrames of them, each
+  // buffer larger than the most its slot was asked for over that window is
+  // cut down to it (freed when the slot went unused), invalidating views
+  // into it. A workload that repeats within the window therefore never
+  // regrows, and one that shrank for good gives its excess back.
+  void end_frame();
+
+private:
+  void reallocate(cv::Mat &buffer, size_t bytes);
+
+  std::array<cv::Mat, kSlots> buffers_; // 1-row CV_8U
+  std::array<size_t, kSlots> peak_{};   // most asked of each slot, rounded
+  int frames_ = 0;                      // into the current window
+  ScratchCounters &counters_;
+};
+
+// Binds `arena` to the calling thread for the binding's lifetime, then
+// restores whatever was bound before.
+class ScratchBinding {
+public:
+  explicit ScratchBinding(ScratchArena *arena);
+  ~ScratchBinding();
+
+  ScratchBinding(const ScratchBinding &) = delete;
+  ScratchBinding &operator=(const ScratchBinding &) = delete;
+
+private:
+  ScratchArena *previous_;
+};
+
+// The arena bound to the calling thread. Only valid inside a
+// ScratchBinding: pool workers bind theirs for the pool's lifetime, match
+// binds a borrowed one for the call.
+ScratchArena &vision_scratch();
+
+// Bytes held by every arena of every matcher in the process; 0 once all
+// matchers are gone. Per-matcher figures are in ScratchCounters.
+uint64_t vision_scratch_bytes();
+
+#endif // VISION_SCRATCH_H
@@ -0,0 +1,763 @@
+#include "vision_simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VISION_SIMD_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define VISION_SIMD_X86 1
+#endif
+
+namespace {
+
+constexpr int kGrayR = 9798;
+constexpr int kGrayG = 19235;
+constexpr int kGrayB = 3735;
+constexpr int kGrayShift = 15;
+constexpr int kBlendOne = 1 << kBlendBits;
+
+// Row kernels. gray: `n` RGBA pixels -> `n` gray bytes. box2/box4: one
+// reduced row of `out_w` pixels from 2 or 4 gray rows. differs: whether `n`
+// bytes of two rows are not identical. argmax: folds score row `c` into the
+// running per-column maximum. SIMD versions handle the bulk and finish the
+// tail with the scalar ones.
+struct RowKernels {
+  void (*gray)(const uint8_t *src, uint8_t *dst, int n, int from);
+  void (*box2)(const uint8_t *const *rows, uint8_t *dst, int out_w, int from);
+  void (*box4)(const uint8_t *const *rows, uint8_t *dst, int out_w, int from);
+  bool (*differs)(const uint8_t *a, const uint8_t *b, int n, int from);
+  void (*argmax)(const float *row, int32_t c, float *best, int32_t *cls, int n,
+                 int from);
+  void (*blend)(const uint16_t *a, const uint16_t *b, int wy, float scale,
+                float *dst32, uint16_t *dst16, int n, int from);
+};
+
+// ── Scalar reference ──────────────────────────────────────────────────
+
+void gray_row_scalar(const uint8_t *src, uint8_t *dst, int n, int from) {
+  for (int i = from; i < n; i++) {
+    const uint8_t *p = src + 4 * i;
+    dst[i] = (uint8_t)((p[0] * kGrayR + p[1] * kGrayG + p[2] * kGrayB +
+                        (1 << (kGrayShift - 1))) >>
+                       kGrayShift);
+  }
+}
+
+void box2_row_scalar(const uint8_t *const *rows, uint8_t *dst, int out_w,
+                     int from) {
+  const uint8_t *r0 = rows[0];
+  const uint8_t *r1 = rows[1];
+  for (int x = from; x < out_w; x++) {
+    int sum = r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1];
+    dst[x] = (uint8_t)((sum + 2) >> 2);
+  }
+}
+
+void box4_row_scalar(const uint8_t *const *rows, uint8_t *dst, int out_w,
+                     int from) {
+  for (int x = from; x < out_w; x++) {
+    int sum = 0;
+    for (int r = 0; r < 4; r++) {
+      const uint8_t *p = rows[r] + 4 * x;
+      sum += p[0] + p[1] + p[2] + p[3];
+    }
+    dst[x] = (uint8_t)((sum + 8) >> 4);
+  }
+}
+
+bool differs_scalar(const uint8_t *a, const uint8_t *b, int n, int from) {
+  for (int i = from; i < n; i++) {
+    if (a[i] != b[i])
+      return true;
+  }
+  return false;
+}
+
+// Strict >, so the first row holding the maximum wins and NaN never does.
+void argmax_row_scalar(const float *row, int32_t c, float *best, int32_t *cls,
+                       int n, int from) {
+  for (int i = from; i < n; i++) {
+    if (row[i] > best[i]) {
+      best[i] = row[i];
+      cls[i] = c;
+    }
+  }
+}
+
+void blend_row_scalar(const uint16_t *a, const uint16_t *b, int wy,
+                      float scale, float *dst32, uint16_t *dst16, int n,
+                      int from) {
+  const int wa = kBlendOne - wy;
+  for (int i = from; i < n; i++) {
+    float f = (float)(a[i] * wa + b[i] * wy) * scale;
+    if (dst32)
+      dst32[i] = f;
+    else
+      dst16[i] = vision_half_from_float(f);
+  }
+}
+
+const RowKernels kScalar = {gray_row_scalar,   box2_row_scalar,
+                            box4_row_scalar,   differs_scalar,
+                            argmax_row_scalar, blend_row_scalar};
+
+// ── NEON ──────────────────────────────────────────────────────────────
+
+#if defined(VISION_SIMD_NEON)
+
+inline uint8x8_t gray8_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  uint16x8_t r16 = vmovl_u8(r);
+  uint16x8_t g16 = vmovl_u8(g);
+  uint16x8_t b16 = vmovl_u8(b);
+  uint32x4_t lo = vmull_n_u16(vget_low_u16(r16), kGrayR);
+  lo = vmlal_n_u16(lo, vget_low_u16(g16), kGrayG);
+  lo = vmlal_n_u16(lo, vget_low_u16(b16), kGrayB);
+  uint32x4_t hi = vmull_n_u16(vget_high_u16(r16), kGrayR);
+  hi = vmlal_n_u16(hi, vget_high_u16(g16), kGrayG);
+  hi = vmlal_n_u16(hi, vget_high_u16(b16), kGrayB);
+  // vrshrn rounds: (x + 2^14) >> 15, same as the scalar formula.
+  return vmovn_u16(vcombine_u16(vrshrn_n_u32(lo, kGrayShift),
+                                vrshrn_n_u32(hi, kGrayShift)));
+}
+
+void gray_row_neon(const uint8_t *src, uint8_t *dst, int n, int from) {
+  int i = from;
+  for (; i + 16 <= n; i += 16) {
+    uint8x16x4_t px = vld4q_u8(src + 4 * i);
+    uint8x8_t lo = gray8_neon(vget_low_u8(px.val[0]), vget_low_u8(px.val[1]),
+                              vget_low_u8(px.val[2]));
+    uint8x8_t hi =
+        gray8_neon(vget_high_u8(px.val[0]), vget_high_u8(px.val[1]),
+                   vget_high_u8(px.val[2]));
+    vst1q_u8(dst + i, vcombine_u8(lo, hi));
+  }
+  gray_row_scalar(src, dst, n, i);
+}
+
+void box2_row_neon(const uint8_t *const *rows, uint8_t *dst, int out_w,
+                   int from) {
+  const uint8_t *r0 = rows[0];
+  const uint8_t *r1 = rows[1];
+  int x = from;
+  for (; x + 16 <= out_w; x += 16) {
+    uint16x8_t lo = vpaddlq_u8(vld1q_u8(r0 + 2 * x));
+    lo = vpadalq_u8(lo, vld1q_u8(r1 + 2 * x));
+    uint16x8_t hi = vpaddlq_u8(vld1q_u8(r0 + 2 * x + 16));
+    hi = vpadalq_u8(hi, vld1q_u8(r1 + 2 * x + 16));
+    vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+  }
+  box2_row_scalar(rows, dst, out_w, x);
+}
+
+void box4_row_neon(const uint8_t *const *rows, uint8_t *dst, int out_w,
+                   int from) {
+  int x = from;
+  for (; x + 16 <= out_w; x += 16) {
+    uint16x4_t quarter[4];
+    for (int c = 0; c < 4; c++) {
+      const int offset = 4 * x + 16 * c;
+      uint16x8_t s = vpaddlq_u8(vld1q_u8(rows[0] + offset));
+      s = vpadalq_u8(s, vld1q_u8(rows[1] + offset));
+      s = vpadalq_u8(s, vld1q_u8(rows[2] + offset));
+      s = vpadalq_u8(s, vld1q_u8(rows[3] + offset));
+      quarter[c] = vrshrn_n_u32(vpaddlq_u16(s), 4);
+    }
+    uint8x8_t lo = vmovn_u16(vcombine_u16(quarter[0], quarter[1]));
+    uint8x8_t hi = vmovn_u16(vcombine_u16(quarter[2], quarter[3]));
+    vst1q_u8(dst + x, vcombine_u8(lo, hi));
+  }
+  box4_row_scalar(rows, dst, out_w, x);
+}
+
+// XOR-accumulates the whole span and tests once: tiles are short, so a
+// branch per vector would cost more than it saves.
+bool differs_neon(const uint8_t *a, const uint8_t *b, int n, int from) {
+  uint8x16_t acc = vdupq_n_u8(0);
+  int i = from;
+  for (; i + 16 <= n; i += 16)
+    acc = vorrq_u8(acc, veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+  uint64x2_t lanes = vreinterpretq_u64_u8(acc);
+  if ((vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) != 0)
+    return true;
+  return differs_scalar(a, b, n, i);
+}
+
+void argmax_row_neon(const float *row, int32_t c, float *best, int32_t *cls,
+                     int n, int from) {
+  const int32x4_t vc = vdupq_n_s32(c);
+  int i = from;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t s = vld1q_f32(row + i);
+    float32x4_t b = vld1q_f32(best + i);
+    uint32x4_t gt = vcgtq_f32(s, b);
+    vst1q_f32(best + i, vbslq_f32(gt, s, b));
+    vst1q_s32(cls + i, vbslq_s32(gt, vc, vld1q_s32(cls + i)));
+  }
+  argmax_row_scalar(row, c, best, cls, n, i);
+}
+
+// Widening multiply-accumulate keeps the sum in integers, so only the final
+// scale is floating point. Half stores need AArch64's FCVTN.
+void blend_row_neon(const uint16_t *a, const uint16_t *b, int wy, float scale,
+                    float *dst32, uint16_t *dst16, int n, int from) {
+#if defined(__aarch64__)
+  const bool vector_half = true;
+#else
+  const bool vector_half = false;
+#endif
+  if (!dst32 && !vector_half) {
+    blend_row_scalar(a, b, wy, scale, dst32, dst16, n, from);
+    return;
+  }
+  const uint16_t wa = (uint16_t)(kBlendOne - wy);
+  const float32x4_t vs = vdupq_n_f32(scale);
+  int i = from;
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t va = vld1q_u16(a + i);
+    uint16x8_t vb = vld1q_u16(b + i);
+    uint32x4_t lo = vmull_n_u16(vget_low_u16(va), wa);
+    lo = vmlal_n_u16(lo, vget_low_u16(vb), (uint16_t)wy);
+    uint32x4_t hi = vmull_n_u16(vget_high_u16(va), wa);
+    hi = vmlal_n_u16(hi, vget_high_u16(vb), (uint16_t)wy);
+    float32x4_t flo = vmulq_f32(vcvtq_f32_u32(lo), vs);
+    float32x4_t fhi = vmulq_f32(vcvtq_f32_u32(hi), vs);
+    if (dst32) {
+      vst1q_f32(dst32 + i, flo);
+      vst1q_f32(dst32 + i + 4, fhi);
+    } else {
+#if defined(__aarch64__)
+      vst1_u16(dst16 + i, vreinterpret_u16_f16(vcvt_f16_f32(flo)));
+      vst1_u16(dst16 + i + 4, vreinterpret_u16_f16(vcvt_f16_f32(fhi)));
+#endif
+    }
+  }
+  blend_row_scalar(a, b, wy, scale, dst32, dst16, n, i);
+}
+
+const RowKernels kNeon = {gray_row_neon,   box2_row_neon, box4_row_neon,
+                          differs_neon,    argmax_row_neon,
+                          blend_row_neon};
+
+#endif // VISION_SIMD_NEON
+
+// ── SSE2 / AVX2 ───────────────────────────────────────────────────────
+
+#if defined(VISION_SIMD_X86)
+
+// Four RGBA pixels (one per 32-bit lane) -> four gray values in 32-bit
+// lanes. R and B sit in the two 16-bit halves of `px & 0x00FF00FF`, so one
+// madd yields R*kGrayR + B*kGrayB; G gets its own madd.
+inline __m128i gray4_sse2(__m128i px) {
+  const __m128i mask_rb = _mm_set1_epi32(0x00FF00FF);
+  const __m128i mask_g = _mm_set1_epi32(0x000000FF);
+  const __m128i coef_rb = _mm_set1_epi32((kGrayB << 16) | kGrayR);
+  const __m128i coef_g = _mm_set1_epi32(kGrayG);
+  const __m128i half = _mm_set1_epi32(1 << (kGrayShift - 1));
+  __m128i rb = _mm_and_si128(px, mask_rb);
+  __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), mask_g);
+  __m128i sum = _mm_add_epi32(_mm_madd_epi16(rb, coef_rb),
+                              _mm_madd_epi16(g, coef_g));
+  return _mm_srli_epi32(_mm_add_epi32(sum, half), kGrayShift);
+}
+
+void gray_row_sse2(const uint8_t *src, uint8_t *dst, int n, int from) {
+  int i = from;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i *p = reinterpret_cast<const __m128i *>(src + 4 * i);
+    __m128i a = gray4_sse2(_mm_loadu_si128(p));
+    __m128i b = gray4_sse2(_mm_loadu_si128(p + 1));
+    __m128i c = gray4_sse2(_mm_loadu_si128(p + 2));
+    __m128i d = gray4_sse2(_mm_loadu_si128(p + 3));
+    __m128i out =
+        _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+  }
+  gray_row_scalar(src, dst, n, i);
+}
+
+// Sums of horizontally adjacent byte pairs, as eight 16-bit lanes.
+inline __m128i pair_sums_sse2(__m128i v) {
+  const __m128i low = _mm_set1_epi16(0x00FF);
+  return _mm_add_epi16(_mm_and_si128(v, low), _mm_srli_epi16(v, 8));
+}
+
+void box2_row_sse2(const uint8_t *const *rows, uint8_t *dst, int out_w,
+                   int from) {
+  const __m128i two = _mm_set1_epi16(2);
+  int x = from;
+  for (; x + 16 <= out_w; x += 16) {
+    __m128i half[2];
+    for (int h = 0; h < 2; h++) {
+      const int offset = 2 * x + 16 * h;
+      __m128i s = _mm_add_epi16(
+          pair_sums_sse2(_mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(rows[0] + offset))),
+          pair_sums_sse2(_mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(rows[1] + offset))));
+      half[h] = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x),
+                     _mm_packus_epi16(half[0], half[1]));
+  }
+  box2_row_scalar(rows, dst, out_w, x);
+}
+
+void box4_row_sse2(const uint8_t *const *rows, uint8_t *dst, int out_w,
+                   int from) {
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i eight = _mm_set1_epi32(8);
+  int x = from;
+  for (; x + 16 <= out_w; x += 16) {
+    __m128i quarter[4];
+    for (int c = 0; c < 4; c++) {
+      const int offset = 4 * x + 16 * c;
+      __m128i s = _mm_setzero_si128();
+      for (int r = 0; r < 4; r++)
+        s = _mm_add_epi16(s, pair_sums_sse2(_mm_loadu_si128(
+                                 reinterpret_cast<const __m128i *>(
+                                     rows[r] + offset))));
+      // Adjacent 16-bit pairs -> four 32-bit sums of 4x4 pixels.
+      __m128i q = _mm_madd_epi16(s, ones);
+      quarter[c] = _mm_srli_epi32(_mm_add_epi32(q, eight), 4);
+    }
+    __m128i out = _mm_packus_epi16(_mm_packs_epi32(quarter[0], quarter[1]),
+                                   _mm_packs_epi32(quarter[2], quarter[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), out);
+  }
+  box4_row_scalar(rows, dst, out_w, x);
+}
+
+bool differs_sse2(const uint8_t *a, const uint8_t *b, int n, int from) {
+  __m128i acc = _mm_setzero_si128();
+  int i = from;
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    acc = _mm_or_si128(acc, _mm_xor_si128(va, vb));
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+    return true;
+  return differs_scalar(a, b, n, i);
+}
+
+// SSE2 has no blend; select with and/andnot/or on the compare mask.
+void argmax_row_sse2(const float *row, int32_t c, float *best, int32_t *cls,
+                     int n, int from) {
+  const __m128i vc = _mm_set1_epi32(c);
+  int i = from;
+  for (; i + 4 <= n; i += 4) {
+    __m128 s = _mm_loadu_ps(row + i);
+    __m128 b = _mm_loadu_ps(best + i);
+    __m128 gt = _mm_cmpgt_ps(s, b);
+    _mm_storeu_ps(best + i, _mm_or_ps(_mm_and_ps(gt, s), _mm_andnot_ps(gt, b)));
+    __m128i *k = reinterpret_cast<__m128i *>(cls + i);
+    __m128i m = _mm_castps_si128(gt);
+    _mm_storeu_si128(k, _mm_or_si128(_mm_and_si128(m, vc),
+                                     _mm_andnot_si128(m, _mm_loadu_si128(k))));
+  }
+  argmax_row_scalar(row, c, best, cls, n, i);
+}
+
+// Interleaving the two rows lets one madd form a * (kBlendOne - wy) + b * wy
+// per 32-bit lane. SSE2 has no half conversion, so half output is scalar.
+void blend_row_sse2(const uint16_t *a, const uint16_t *b, int wy, float scale,
+                    float *dst32, uint16_t *dst16, int n, int from) {
+  if (!dst32) {
+    blend_row_scalar(a, b, wy, scale, dst32, dst16, n, from);
+    return;
+  }
+  const __m128i w = _mm_set1_epi32((wy << 16) | (kBlendOne - wy));
+  const __m128 vs = _mm_set1_ps(scale);
+  int i = from;
+  for (; i + 8 <= n; i += 8) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), w);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), w);
+    _mm_storeu_ps(dst32 + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vs));
+    _mm_storeu_ps(dst32 + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vs));
+  }
+  blend_row_scalar(a, b, wy, scale, dst32, dst16, n, i);
+}
+
+const RowKernels kSse2 = {gray_row_sse2,   box2_row_sse2, box4_row_sse2,
+                          differs_sse2,    argmax_row_sse2,
+                          blend_row_sse2};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VISION_SIMD_AVX2 1
+
+// Same arithmetic as the SSE2 kernels on 256-bit registers, compiled for
+// AVX2 regardless of the global flags and only called after the CPU check.
+// AVX2 packs work per 128-bit lane, hence the final permutes.
+
+__attribute__((target("avx2"))) inline __m256i gray8_avx2(__m256i px) {
+  const __m256i mask_rb = _mm256_set1_epi32(0x00FF00FF);
+  const __m256i mask_g = _mm256_set1_epi32(0x000000FF);
+  const __m256i coef_rb = _mm256_set1_epi32((kGrayB << 16) | kGrayR);
+  const __m256i coef_g = _mm256_set1_epi32(kGrayG);
+  const __m256i half = _mm256_set1_epi32(1 << (kGrayShift - 1));
+  __m256i rb = _mm256_and_si256(px, mask_rb);
+  __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask_g);
+  __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(rb, coef_rb),
+                                 _mm256_madd_epi16(g, coef_g));
+  return _mm256_srli_epi32(_mm256_add_epi32(sum, half), kGrayShift);
+}
+
+__attribute__((target("avx2"))) void
+gray_row_avx2(const uint8_t *src, uint8_t *dst, int n, int from) {
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int i = from;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i *p = reinterpret_cast<const __m256i *>(src + 4 * i);
+    __m256i a = gray8_avx2(_mm256_loadu_si256(p));
+    __m256i b = gray8_avx2(_mm256_loadu_si256(p + 1));
+    __m256i c = gray8_avx2(_mm256_loadu_si256(p + 2));
+    __m256i d = gray8_avx2(_mm256_loadu_si256(p + 3));
+    __m256i out = _mm256_packus_epi16(_mm256_packs_epi32(a, b),
+                                      _mm256_packs_epi32(c, d));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_permutevar8x32_epi32(out, order));
+  }
+  gray_row_sse2(src, dst, n, i);
+}
+
+__attribute__((target("avx2"))) inline __m256i pair_sums_avx2(__m256i v) {
+  const __m256i low = _mm256_set1_epi16(0x00FF);
+  return _mm256_add_epi16(_mm256_and_si256(v, low), _mm256_srli_epi16(v, 8));
+}
+
+__attribute__((target("avx2"))) void
+box2_row_avx2(const uint8_t *const *rows, uint8_t *dst, int out_w, int from) {
+  const __m256i two = _mm256_set1_epi16(2);
+  int x = from;
+  for (; x + 32 <= out_w; x += 32) {
+    __m256i half[2];
+    for (int h = 0; h < 2; h++) {
+      const int offset = 2 * x + 32 * h;
+      __m256i s = _mm256_add_epi16(
+          pair_sums_avx2(_mm256_loadu_si256(
+              reinterpret_cast<const __m256i *>(rows[0] + offset))),
+          pair_sums_avx2(_mm256_loadu_si256(
+              reinterpret_cast<const __m256i *>(rows[1] + offset))));
+      half[h] = _mm256_srli_epi16(_mm256_add_epi16(s, two), 2);
+    }
+    __m256i out = _mm256_packus_epi16(half[0], half[1]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x),
+                        _mm256_permute4x64_epi64(out, 0xD8));
+  }
+  box2_row_sse2(rows, dst, out_w, x);
+}
+
+__attribute__((target("avx2"))) void
+box4_row_avx2(const uint8_t *const *rows, uint8_t *dst, int out_w, int from) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  const __m256i eight = _mm256_set1_epi32(8);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int x = from;
+  for (; x + 32 <= out_w; x += 32) {
+    __m256i quarter[4];
+    for (int c = 0; c < 4; c++) {
+      const int offset = 4 * x + 32 * c;
+      __m256i s = _mm256_setzero_si256();
+      for (int r = 0; r < 4; r++)
+        s = _mm256_add_epi16(s, pair_sums_avx2(_mm256_loadu_si256(
+                                    reinterpret_cast<const __m256i *>(
+                                        rows[r] + offset))));
+      __m256i q = _mm256_madd_epi16(s, ones);
+      quarter[c] = _mm256_srli_epi32(_mm256_add_epi32(q, eight), 4);
+    }
+    __m256i out =
+        _mm256_packus_epi16(_mm256_packs_epi32(quarter[0], quarter[1]),
+                            _mm256_packs_epi32(quarter[2], quarter[3]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x),
+                        _mm256_permutevar8x32_epi32(out, order));
+  }
+  box4_row_sse2(rows, dst, out_w, x);
+}
+
+__attribute__((target("avx2"))) bool
+differs_avx2(const uint8_t *a, const uint8_t *b, int n, int from) {
+  __m256i acc = _mm256_setzero_si256();
+  int i = from;
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    acc = _mm256_or_si256(acc, _mm256_xor_si256(va, vb));
+  }
+  if (!_mm256_testz_si256(acc, acc))
+    return true;
+  return differs_sse2(a, b, n, i);
+}
+
+__attribute__((target("avx2"))) void
+argmax_row_avx2(const float *row, int32_t c, float *best, int32_t *cls, int n,
+                int from) {
+  const __m256i vc = _mm256_set1_epi32(c);
+  int i = from;
+  for (; i + 8 <= n; i += 8) {
+    __m256 s = _mm256_loadu_ps(row + i);
+    __m256 b = _mm256_loadu_ps(best + i);
+    __m256 gt = _mm256_cmp_ps(s, b, _CMP_GT_OQ);
+    _mm256_storeu_ps(best + i, _mm256_blendv_ps(b, s, gt));
+    __m256i *k = reinterpret_cast<__m256i *>(cls + i);
+    _mm256_storeu_si256(k, _mm256_blendv_epi8(_mm256_loadu_si256(k), vc,
+                                              _mm256_castps_si256(gt)));
+  }
+  argmax_row_sse2(row, c, best, cls, n, i);
+}
+
+// F16C ships with every AVX2 CPU; vision_simd_supported checks for both.
+__attribute__((target("avx2,f16c"))) void
+blend_row_avx2(const uint16_t *a, const uint16_t *b, int wy, float scale,
+               float *dst32, uint16_t *dst16, int n, int from) {
+  const __m256i w = _mm256_set1_epi32((wy << 16) | (kBlendOne - wy));
+  const __m256 vs = _mm256_set1_ps(scale);
+  int i = from;
+  for (; i + 16 <= n; i += 16) {
+    // Lane-wise unpack yields elements 0-3 and 8-11 in lo, 4-7 and 12-15
+    // in hi; the permutes restore source order.
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(va, vb), w);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(va, vb), w);
+    __m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+    __m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+    __m256 f0 = _mm256_mul_ps(_mm256_cvtepi32_ps(first), vs);
+    __m256 f1 = _mm256_mul_ps(_mm256_cvtepi32_ps(second), vs);
+    if (dst32) {
+      _mm256_storeu_ps(dst32 + i, f0);
+      _mm256_storeu_ps(dst32 + i + 8, f1);
+    } else {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst16 + i),
+                       _mm256_cvtps_ph(f0, _MM_FROUND_TO_NEAREST_INT));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst16 + i + 8),
+                       _mm256_cvtps_ph(f1, _MM_FROUND_TO_NEAREST_INT));
+    }
+  }
+  blend_row_scalar(a, b, wy, scale, dst32, dst16, n, i);
+}
+
+const RowKernels kAvx2 = {gray_row_avx2,   box2_row_avx2, box4_row_avx2,
+                          differs_avx2,    argmax_row_avx2,
+                          blend_row_avx2};
+
+#endif // __GNUC__ || __clang__
+#endif // VISION_SIMD_X86
+
+const RowKernels &kernels_for(SimdPath path) {
+  if (!vision_simd_supported(path))
+    return kScalar;
+  switch (path) {
+#if defined(VISION_SIMD_NEON)
+  case SimdPath::Neon:
+    return kNeon;
+#endif
+#if defined(VISION_SIMD_X86)
+  case SimdPath::Sse2:
+    return kSse2;
+#if defined(VISION_SIMD_AVX2)
+  case SimdPath::Avx2:
+    return kAvx2;
+#endif
+#endif
+  default:
+    return kScalar;
+  }
+}
+
+} // namespace
+
+const char *vision_simd_path_name(SimdPath path) {
+  switch (path) {
+  case SimdPath::Sse2:
+    return "sse2";
+  case SimdPath::Avx2:
+    return "avx2";
+  case SimdPath::Neon:
+    return "neon";
+  default:
+    return "scalar";
+  }
+}
+
+bool vision_simd_supported(SimdPath path) {
+  switch (path) {
+  case SimdPath::Scalar:
+    return true;
+#if defined(VISION_SIMD_NEON)
+  case SimdPath::Neon:
+    return true;
+#endif
+#if defined(VISION_SIMD_X86)
+  case SimdPath::Sse2:
+    return true;
+#if defined(VISION_SIMD_AVX2)
+  case SimdPath::Avx2: {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2") &&
+                                 __builtin_cpu_supports("f16c");
+    return has_avx2;
+  }
+#endif
+#endif
+  default:
+    return false;
+  }
+}
+
+SimdPath vision_simd_best_path() {
+  if (vision_simd_supported(SimdPath::Neon))
+    return SimdPath::Neon;
+  if (vision_simd_supported(SimdPath::Avx2))
+    return SimdPath::Avx2;
+  if (vision_simd_supported(SimdPath::Sse2))
+    return SimdPath::Sse2;
+  return SimdPath::Scalar;
+}
+
+void vision_rgba_to_gray(SimdPath path, const uint8_t *src, size_t src_step,
+                         int width, int height, uint8_t *gray,
+                         size_t gray_step, uint8_t *reduced,
+                         size_t reduced_step, int factor) {
+  if (!src || width <= 0 || height <= 0)
+    return;
+  const RowKernels &k = kernels_for(path);
+
+  if (factor != 2 && factor != 4)
+    reduced = nullptr;
+  if (!reduced) {
+    if (!gray)
+      return;
+    for (int y = 0; y < height; y++)
+      k.gray(src + y * src_step, gray + y * gray_step, width, 0);
+    return;
+  }
+
+  // Without a full-resolution destination, each row group is converted into
+  // a small scratch block instead.
+  const int out_w = width / factor;
+  const int out_h = height / factor;
+  std::vector<uint8_t> scratch;
+  if (!gray)
+    scratch.resize((size_t)width * (size_t)factor);
+
+  const uint8_t *rows[4];
+  for (int oy = 0; oy < out_h; oy++) {
+    for (int r = 0; r < factor; r++) {
+      int y = oy * factor + r;
+      uint8_t *row =
+          gray ? gray + y * gray_step : scratch.data() + (size_t)r * width;
+      k.gray(src + y * src_step, row, width, 0);
+      rows[r] = row;
+    }
+    uint8_t *out = reduced + oy * reduced_step;
+    if (factor == 2)
+      k.box2(rows, out, out_w, 0);
+    else
+      k.box4(rows, out, out_w, 0);
+  }
+
+  if (gray) {
+    for (int y = out_h * factor; y < height; y++)
+      k.gray(src + y * src_step, gray + y * gray_step, width, 0);
+  }
+}
+
+int vision_tile_diff(SimdPath path, const uint8_t *a, size_t a_step,
+                     const uint8_t *b, size_t b_step, int width, int height,
+                     int tile, uint8_t *changed) {
+  if (!a || !b || !changed || width <= 0 || height <= 0 || tile <= 0)
+    return 0;
+  const RowKernels &k = kernels_for(path);
+  const int tiles_x = (width + tile - 1) / tile;
+  const int tiles_y = (height + tile - 1) / tile;
+
+  int total = 0;
+  for (int ty = 0; ty < tiles_y; ty++) {
+    uint8_t *flags = changed + (size_t)ty * tiles_x;
+    std::fill(flags, flags + tiles_x, (uint8_t)0);
+    const int y_end = std::min((ty + 1) * tile, height);
+    int band_changed = 0;
+    // Row by row through the band, skipping tiles already known to differ;
+    // a band stops early once every tile in it has changed.
+    for (int y = ty * tile; y < y_end && band_changed < tiles_x; y++) {
+      const uint8_t *ra = a + y * a_step;
+      const uint8_t *rb = b + y * b_step;
+      for (int tx = 0; tx < tiles_x; tx++) {
+        if (flags[tx])
+          continue;
+        const int x0 = tx * tile;
+        const int n = std::min(tile, width - x0);
+        if (k.differs(ra + x0, rb + x0, n, 0)) {
+          flags[tx] = 1;
+          band_changed++;
+        }
+      }
+    }
+    total += band_changed;
+  }
+  return total;
+}
+
+void vision_argmax_rows(SimdPath path, const float *rows, size_t stride,
+                        int channels, int count, float *best, int32_t *cls) {
+  if (!rows || !best || !cls || count <= 0)
+    return;
+  const RowKernels &k = kernels_for(path);
+  // Column blocks keep the running best/cls in L1 while every row streams
+  // past once.
+  constexpr int kBlock = 1024;
+  for (int x0 = 0; x0 < count; x0 += kBlock) {
+    const int n = std::min(kBlock, count - x0);
+    std::fill(best + x0, best + x0 + n, 0.0f);
+    std::fill(cls + x0, cls + x0 + n, -1);
+    for (int c = 0; c < channels; c++)
+      k.argmax(rows + c * stride + x0, c, best + x0, cls + x0, n, 0);
+  }
+}
+
+uint16_t vision_half_from_float(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  const uint32_t sign = (x >> 16) & 0x8000;
+  const uint32_t mant = x & 0x7FFFFF;
+  const int exp = (int)((x >> 23) & 0xFF);
+  if (exp == 0xFF)
+    return (uint16_t)(sign | 0x7C00 | (mant ? 0x200 | (mant >> 13) : 0));
+  const int e = exp - 127 + 15;
+  if (e >= 0x1F)
+    return (uint16_t)(sign | 0x7C00);
+  if (e <= 0) {
+    // Subnormal half: the implicit bit joins the mantissa, shifted down.
+    if (e < -10)
+      return (uint16_t)sign;
+    const uint32_t full = mant | 0x800000;
+    const int shift = 14 - e;
+    uint32_t h = full >> shift;
+    const uint32_t rem = full & ((1u << shift) - 1);
+    const uint32_t mid = 1u << (shift - 1);
+    if (rem > mid || (rem == mid && (h & 1)))
+      h++;
+    return (uint16_t)(sign | h);
+  }
+  // A mantissa carry rolls into the exponent, up to infinity, as it should.
+  uint32_t h = sign | ((uint32_t)e << 10) | (mant >> 13);
+  const uint32_t rem = mant & 0x1FFF;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+    h++;
+  return (uint16_t)h;
+}
+
+void vision_blend_rows(SimdPath path, const uint16_t *a, const uint16_t *b,
+                       int wy, float scale, int n, float *dst32,
+                       uint16_t *dst16) {
+  if (!a || !b || n <= 0 || (!dst32 && !dst16))
+    return;
+  wy = std::min(std::max(wy, 0), kBlendOne);
+  kernels_for(path).blend(a, b, wy, scale, dst32, dst16, n, 0);
+}
@@ -0,0 +1,102 @@
+#ifndef VISION_SIMD_H
+#define VISION_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Fused RGBA_8888 -> grayscale conversion with optional 2x/4x box
+// downsampling, a tile diff between consecutive grayscale frames and a
+// column argmax and resize blend for detector models, all vectorised per
+// architecture. Each group of `factor` source rows is converted and
+// immediately reduced while it is still in L1, so the RGBA frame is read
+// exactly once and no intermediate image is allocated.
+//
+// Gray uses OpenCV's fixed-point RGB2GRAY weights, (9798 R + 19235 G +
+// 3735 B + 2^14) >> 15, so factor 1 is bit-exact with cv::cvtColor. The box
+// filters average factor x factor gray pixels rounding half up, i.e.
+// (sum + 2) >> 2 and (sum + 8) >> 4; for even-sized input the 2x result
+// equals cv::resize(INTER_AREA). Every SIMD path is bit-exact with the
+// scalar reference.
+
+enum class SimdPath { Scalar = 0, Sse2 = 1, Avx2 = 2, Neon = 3 };
+
+const char *vision_simd_path_name(SimdPath path);
+bool vision_simd_supported(SimdPath path);
+// Fastest supported path on this CPU (AVX2 is detected at run time).
+SimdPath vision_simd_best_path();
+
+// Converts `width` x `height` RGBA pixels at `src` (rows `src_step` bytes
+// apart) into caller-owned buffers:
+//   gray    full-resolution grayscale, or null to skip it;
+//   reduced (width / factor) x (height / factor) box-downsampled grayscale,
+//           or null. factor is 1, 2 or 4; with factor 1 `reduced` is unused.
+// Source rows and columns that do not fill a whole box are converted into
+// `gray` but left out of `reduced`. Unsupported paths fall back to scalar.
+void vision_rgba_to_gray(SimdPath path, const uint8_t *src, size_t src_step,
+                         int width, int height, uint8_t *gray,
+                         size_t gray_step, uint8_t *reduced,
+                         size_t reduced_step, int factor);
+
+inline void vision_rgba_to_gray(const uint8_t *src, size_t src_step, int width,
+                                int height, uint8_t *gray, size_t gray_step,
+                                uint8_t *reduced, size_t reduced_step,
+                                int factor) {
+  vision_rgba_to_gray(vision_simd_best_path(), src, src_step, width, height,
+                      gray, gray_step, reduced, reduced_step, factor);
+}
+
+// Marks which `tile` x `tile` blocks of two equally sized grayscale images
+// differ in at least one pixel. `changed` receives ceil(width / tile) x
+// ceil(height / tile) flags (1 = changed) in row-major order; edge tiles
+// may be partial. Returns the number of changed tiles. The comparison is
+// exact, so an unchanged tile is guaranteed to hold identical pixels.
+int vision_tile_diff(SimdPath path, const uint8_t *a, size_t a_step,
+                     const uint8_t *b, size_t b_step, int width, int height,
+                     int tile, uint8_t *changed);
+
+inline int vision_tile_diff(const uint8_t *a, size_t a_step, const uint8_t *b,
+                            size_t b_step, int width, int height, int tile,
+                            uint8_t *changed) {
+  return vision_tile_diff(vision_simd_best_path(), a, a_step, b, b_step, width,
+                          height, tile, changed);
+}
+
+// Per-column argmax over `channels` rows of `count` floats, `stride` floats
+// apart — the channel-major class scores of a detector head. best[i]
+// starts at 0, so only positive scores count; cls[i] receives the first row
+// holding the strict maximum, or -1 when none is positive. NaN never wins.
+void vision_argmax_rows(SimdPath path, const float *rows, size_t stride,
+                        int channels, int count, float *best, int32_t *cls);
+
+inline void vision_argmax_rows(const float *rows, size_t stride, int channels,
+                               int count, float *best, int32_t *cls) {
+  vision_argmax_rows(vision_simd_best_path(), rows, stride, channels, count,
+                     best, cls);
+}
+
+// Weights of the separable bilinear resize behind vision_letterbox are
+// fixed point with this many fractional bits.
+constexpr int kBlendBits = 7;
+
+// Vertical step of that resize. `a` and `b` hold `n` horizontally
+// interpolated samples of two source rows (pixel x 2^kBlendBits, so at most
+// 255 << kBlendBits); for wy in [0, 2^kBlendBits]
+//   dst[i] = (a[i] * (2^kBlendBits - wy) + b[i] * wy) * scale,
+// stored as float32 in `dst32` or, when that is null, as IEEE half in
+// `dst16`. The sum is exact in integers and converts exactly to float, so
+// every path is bit-exact with the scalar reference.
+void vision_blend_rows(SimdPath path, const uint16_t *a, const uint16_t *b,
+                       int wy, float scale, int n, float *dst32,
+                       uint16_t *dst16);
+
+inline void vision_blend_rows(const uint16_t *a, const uint16_t *b, int wy,
+                              float scale, int n, float *dst32,
+                              uint16_t *dst16) {
+  vision_blend_rows(vision_simd_best_path(), a, b, wy, scale, n, dst32, dst16);
+}
+
+// IEEE 754 binary16 bits of `f`, rounded to nearest even like F16C and
+// NEON's FCVTN.
+uint16_t vision_half_from_float(float f);
+
+#endif // VISION_SIMD_H
@@ -0,0 +1,182 @@
+#include "vision_stats.h"
+#include "vision_scratch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// Bucket of a value in microseconds: 0-3 exactly, then four per power of
+// two by the two bits after the leading one.
+int bucket_of(uint64_t us) {
+  if (us < 4)
+    return (int)us;
+  int e = 63 - __builtin_clzll(us);
+  int index = 4 * (e - 1) + (int)((us >> (e - 2)) & 3);
+  return std::min(index, LatencyHistogram::kBuckets - 1);
+}
+
+// Smallest value of bucket `index`, in microseconds.
+uint64_t bucket_floor(int index) {
+  if (index < 4)
+    return (uint64_t)index;
+  int e = index / 4 + 1;
+  return (uint64_t)(4 + index % 4) << (e - 2);
+}
+
+void append(std::string &out, const char *format, double value) {
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), format, value);
+  out += buf;
+}
+
+} // namespace
+
+const char *vision_stage_name(VisionStage stage) {
+  switch (stage) {
+  case VisionStage::Lock:
+    return "lock";
+  case VisionStage::Convert:
+    return "convert";
+  case VisionStage::Resize:
+    return "resize";
+  case VisionStage::Diff:
+    return "diff";
+  case VisionStage::Features:
+    return "features";
+  case VisionStage::Correlate:
+    return "correlate";
+  case VisionStage::Peak:
+    return "peak";
+  case VisionStage::Detect:
+    return "detect";
+  case VisionStage::Marshal:
+    return "marshal";
+  case VisionStage::Frame:
+    return "frame";
+  }
+  return "unknown";
+}
+
+// ── LatencyHistogram ──────────────────────────────────────────────────
+
+void LatencyHistogram::record(uint64_t ns) {
+  count_.fetch_add(1, std::memory_order_relaxed);
+  total_.fetch_add(ns, std::memory_order_relaxed);
+  buckets_[bucket_of(ns / 1000)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t seen = max_.load(std::memory_order_relaxed);
+  while (ns > seen &&
+         !max_.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::reset() {
+  count_.store(0, std::memory_order_relaxed);
+  total_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+  for (std::atomic<uint64_t> &b : buckets_)
+    b.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile_us(double p) const {
+  // Counted from the buckets, which a concurrent record may have reached
+  // before count_; a snapshot only needs to be close.
+  uint64_t counts[kBuckets];
+  uint64_t n = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    n += counts[i];
+  }
+  if (n == 0)
+    return 0.0;
+  uint64_t rank = (uint64_t)std::ceil(p / 100.0 * (double)n);
+  rank = std::min(std::max<uint64_t>(rank, 1), n);
+  const double max_us = (double)max_ns() / 1000.0;
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::min((double)bucket_floor(i + 1), max_us);
+  }
+  return max_us;
+}
+
+// ── VisionStats ───────────────────────────────────────────────────────
+
+void VisionStats::add_templates(const std::vector<TemplateSample> &samples) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const TemplateSample &s : samples) {
+    TemplateTotals &t = templates_[s.id];
+    if (s.reused) {
+      t.reused++;
+    } else {
+      t.evaluated++;
+      t.ns.merge(s.tally);
+      t.max_ns = std::max(t.max_ns, s.tally.total());
+    }
+    t.matched += s.matched ? 1 : 0;
+    t.last_score = s.score;
+  }
+}
+
+void VisionStats::reset() {
+  for (LatencyHistogram &h : histograms_)
+    h.reset();
+  std::lock_guard<std::mutex> lock(mutex_);
+  templates_.clear();
+}
+
+std::string VisionStats::json(const ScratchCounters &scratch) const {
+  std::string out = "{\"stages\":{";
+  bool first = true;
+  for (int s = 0; s < kVisionStages; s++) {
+    const LatencyHistogram &h = histograms_[s];
+    const uint64_t n = h.count();
+    if (n == 0)
+      continue;
+    if (!first)
+      out += ',';
+    first = false;
+    out += '"';
+    out += vision_stage_name((VisionStage)s);
+    out += "\":{\"samples\":" + std::to_string(n);
+    append(out, ",\"mean_us\":%.1f", (double)h.total_ns() / 1000.0 / n);
+    append(out, ",\"p50_us\":%.1f", h.percentile_us(50));
+    append(out, ",\"p90_us\":%.1f", h.percentile_us(90));
+    append(out, ",\"p99_us\":%.1f", h.percentile_us(99));
+    append(out, ",\"max_us\":%.1f", (double)h.max_ns() / 1000.0);
+    out += '}';
+  }
+  out += "},\"templates\":[";
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  first = true;
+  for (const auto &pair : templates_) {
+    const TemplateTotals &t = pair.second;
+    if (!first)
+      out += ',';
+    first = false;
+    out += "{\"id\":" + std::to_string(pair.first);
+    out += ",\"evaluated\":" + std::to_string(t.evaluated);
+    out += ",\"reused\":" + std::to_string(t.reused);
+    out += ",\"matched\":" + std::to_string(t.matched);
+    append(out, ",\"last_score\":%.3f", (double)t.last_score);
+    const double evaluated = (double)std::max<uint64_t>(t.evaluated, 1);
+    append(out, ",\"mean_us\":%.1f",
+           (double)t.ns.total() / 1000.0 / evaluated);
+    append(out, ",\"max_us\":%.1f", (double)t.max_ns / 1000.0);
+    for (int s = 0; s < kVisionStages; s++) {
+      if (t.ns.ns[s] == 0)
+        continue;
+      out += ",\"";
+      out += vision_stage_name((VisionStage)s);
+      append(out, "_us\":%.1f", (double)t.ns.ns[s] / 1000.0);
+    }
+    out += '}';
+  }
+  out += "],\"scratch\":{\"growths\":" +
+         std::to_string(scratch.growths.load()) +
+         ",\"bytes\":" + std::to_string(scratch.bytes.load()) + "}}";
+  return out;
+}
@@ -0,0 +1,126 @@
+#ifndef VISION_STATS_H
+#define VISION_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Always-on performance counters for one matcher: a latency histogram per
+// pipeline stage and running totals per template, cheap enough to leave on
+// in release builds. Each histogram sample is one frame's time in a stage;
+// stages that run on several pool threads add up their CPU time. Histograms
+// take samples from any thread with relaxed atomics; per-template totals
+// are gathered in the frame's jobs and folded in once per frame.
+
+enum class VisionStage {
+  Lock,      // bitmap lock and copy into a Mat (JNI)
+  Convert,   // RGBA to gray, with the 4x level when the kernel fuses it
+  Resize,    // frame pyramid levels built with cv::resize
+  Diff,      // dirty-tile comparison with the previous frame
+  Features,  // frame keypoints, index votes and feature verification
+  Correlate, // matchTemplate plus normalisation, integrals included
+  Peak,      // minMaxLoc and multi-instance peak collection
+  Detect,    // detector input on submit, forward pass and decode
+  Marshal,   // results into Java arrays or objects (JNI)
+  Frame,     // a whole match call, wall time
+};
+constexpr int kVisionStages = 10;
+
+const char *vision_stage_name(VisionStage stage);
+
+inline uint64_t vision_now_ns() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Time one template spent in each stage during one frame, or one stripe of
+// it. Owned by a single task, so plain integers.
+struct StageTally {
+  uint64_t ns[kVisionStages] = {};
+
+  void add(VisionStage stage, uint64_t t) { ns[(int)stage] += t; }
+  void merge(const StageTally &other) {
+    for (int s = 0; s < kVisionStages; s++)
+      ns[s] += other.ns[s];
+  }
+  uint64_t total() const {
+    uint64_t sum = 0;
+    for (int s = 0; s < kVisionStages; s++)
+      sum += ns[s];
+    return sum;
+  }
+};
+
+// Log-linear histogram of microseconds: four buckets per power of two, so
+// any percentile read back is within 25% of the true value. Lock-free.
+class LatencyHistogram {
+public:
+  static constexpr int kBuckets = 128;
+
+  void record(uint64_t ns);
+  void reset();
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t total_ns() const { return total_.load(std::memory_order_relaxed); }
+  uint64_t max_ns() const { return max_.load(std::memory_order_relaxed); }
+  // Upper bound of the bucket holding the p-th percentile (0-100), in
+  // microseconds, capped at the largest sample; 0 without samples.
+  double percentile_us(double p) const;
+
+private:
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> total_{0};
+  std::atomic<uint64_t> max_{0};
+  std::atomic<uint64_t> buckets_[kBuckets] = {};
+};
+
+// One template's part in one frame, as folded into its running totals.
+struct TemplateSample {
+  int id;
+  bool reused; // answered from the previous frame
+  bool matched;
+  float score;
+  StageTally tally;
+};
+
+struct ScratchCounters; // vision_scratch.h
+
+class VisionStats {
+public:
+  void record(VisionStage stage, uint64_t ns) {
+    histograms_[(int)stage].record(ns);
+  }
+  void add_templates(const std::vector<TemplateSample> &samples);
+  void reset();
+
+  // Everything as one JSON object:
+  //   {"stages": {"<stage>": {"samples", "mean_us", "p50_us", "p90_us",
+  //                           "p99_us", "max_us"}, ...},
+  //    "templates": [{"id", "evaluated", "reused", "matched", "last_score",
+  //                   "mean_us", "max_us", "<stage>_us": total, ...}, ...],
+  //    "scratch": {"growths", "bytes"}}
+  // Stages without samples and template stages never entered are left out.
+  // "scratch" is the owning matcher's arenas, from `scratch`.
+  std::string json(const ScratchCounters &scratch) const;
+
+private:
+  struct TemplateTotals {
+    uint64_t evaluated = 0;
+    uint64_t reused = 0;
+    uint64_t matched = 0;
+    float last_score = 0.0f;
+    uint64_t max_ns = 0; // slowest evaluation
+    StageTally ns;
+  };
+
+  LatencyHistogram histograms_[kVisionStages];
+  mutable std::mutex mutex_; // Protects templates_
+  std::map<int, TemplateTotals> templates_;
+};
+
+#endif // VISION_STATS_H
@@ -0,0 +1,348 @@
+#include "vision_track.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Cost of a pair that failed the gate. Larger than any sum of real costs
+// (each at most 1), so the solver first maximises the number of real
+// matches and only then minimises their cost.
+constexpr double kForbidden = 1e6;
+// Lower bound on the hash cell side, in pixels.
+constexpr float kMinCell = 8.0f;
+
+bool usable(const Detection &d) {
+  return std::isfinite(d.left) && std::isfinite(d.top) &&
+         std::isfinite(d.right) && std::isfinite(d.bottom) &&
+         d.right > d.left && d.bottom > d.top;
+}
+
+float iou(const Detection &a, const Detection &b) {
+  float x0 = std::max(a.left, b.left);
+  float y0 = std::max(a.top, b.top);
+  float x1 = std::min(a.right, b.right);
+  float y1 = std::min(a.bottom, b.bottom);
+  float inter = std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+  float area_a = (a.right - a.left) * (a.bottom - a.top);
+  float area_b = (b.right - b.left) * (b.bottom - b.top);
+  float uni = area_a + area_b - inter;
+  return uni > 0 ? inter / uni : 0.0f;
+}
+
+uint64_t cell_key(int cx, int cy) {
+  return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+}
+
+// Hash cells covered by `d`, inclusive.
+void cell_range(const Detection &d, float inv, int &x0, int &y0, int &x1,
+                int &y1) {
+  x0 = (int)std::floor(d.left * inv);
+  y0 = (int)std::floor(d.top * inv);
+  x1 = (int)std::floor(d.right * inv);
+  y1 = (int)std::floor(d.bottom * inv);
+}
+
+int find(std::vector<int> &parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+} // namespace
+
+VisionTracker::VisionTracker(const TrackerConfig &config) : config_(config) {}
+
+void VisionTracker::clear() {
+  states_.clear();
+  out_.clear();
+}
+
+// Files every usable detection in each hash cell its box covers, then
+// looks up the cells under each predicted track box. Two boxes that
+// overlap always share a cell, so no pair with IoU above zero is missed.
+void VisionTracker::gate(const Detection *detections, size_t count) {
+  edges_.clear();
+  cells_.clear();
+  if (states_.empty() || count == 0)
+    return;
+
+  // Cells about the size of a typical box keep each box in a few cells.
+  double sum = 0.0;
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    const Detection &d = detections[i];
+    if (!usable(d))
+      continue;
+    sum += std::max(d.right - d.left, d.bottom - d.top);
+    n++;
+  }
+  if (n == 0)
+    return;
+  const float cell = std::max(kMinCell, (float)(sum / (double)n));
+  const float inv = 1.0f / cell;
+
+  for (size_t i = 0; i < count; i++) {
+    const Detection &d = detections[i];
+    if (!usable(d))
+      continue;
+    int x0, y0, x1, y1;
+    cell_range(d, inv, x0, y0, x1, y1);
+    for (int cy = y0; cy <= y1; cy++)
+      for (int cx = x0; cx <= x1; cx++)
+        cells_.emplace_back(cell_key(cx, cy), (int)i);
+  }
+  std::sort(cells_.begin(), cells_.end());
+
+  stamp_.assign(count, -1);
+  for (size_t t = 0; t < states_.size(); t++) {
+    const Detection &p = predicted_[t];
+    if (!usable(p))
+      continue;
+    int x0, y0, x1, y1;
+    cell_range(p, inv, x0, y0, x1, y1);
+    for (int cy = y0; cy <= y1; cy++) {
+      for (int cx = x0; cx <= x1; cx++) {
+        const uint64_t key = cell_key(cx, cy);
+        auto it = std::lower_bound(
+            cells_.begin(), cells_.end(),
+            std::make_pair(key, std::numeric_limits<int>::min()));
+        for (; it != cells_.end() && it->first == key; ++it) {
+          const int d = it->second;
+          if (stamp_[d] == (int)t)
+            continue; // already seen through another cell
+          stamp_[d] = (int)t;
+          if (detections[d].cls != states_[t].cls)
+            continue;
+          float overlap = iou(p, detections[d]);
+          if (overlap > config_.iou_threshold)
+            edges_.push_back({(int)t, d, 1.0f - overlap, 0});
+        }
+      }
+    }
+  }
+}
+
+// Splits the candidate pairs into connected groups and solves each one on
+// its own: on a screen, groups are a handful of boxes, so the cubic solver
+// never sees the whole frame.
+void VisionTracker::assign(size_t tracks, size_t count) {
+  match_.assign(tracks, -1);
+  matched_by_.assign(count, -1);
+  if (edges_.empty())
+    return;
+
+  parent_.resize(tracks + count);
+  for (size_t i = 0; i < parent_.size(); i++)
+    parent_[i] = (int)i;
+  for (const Edge &e : edges_) {
+    int a = find(parent_, e.track), b = find(parent_, (int)tracks + e.det);
+    if (a != b)
+      parent_[a] = b;
+  }
+  for (Edge &e : edges_)
+    e.group = find(parent_, e.track);
+  std::stable_sort(
+      edges_.begin(), edges_.end(),
+      [](const Edge &a, const Edge &b) { return a.group < b.group; });
+
+  for (size_t begin = 0; begin < edges_.size();) {
+    size_t end = begin;
+    while (end < edges_.size() && edges_[end].group == edges_[begin].group)
+      end++;
+
+    if (end - begin == 1) {
+      const Edge &e = edges_[begin];
+      match_[e.track] = e.det;
+      matched_by_[e.det] = e.track;
+    } else {
+      rows_.clear();
+      cols_.clear();
+      for (size_t k = begin; k < end; k++) {
+        rows_.push_back(edges_[k].track);
+        cols_.push_back(edges_[k].det);
+      }
+      std::sort(rows_.begin(), rows_.end());
+      rows_.erase(std::unique(rows_.begin(), rows_.end()), rows_.end());
+      std::sort(cols_.begin(), cols_.end());
+      cols_.erase(std::unique(cols_.begin(), cols_.end()), cols_.end());
+      solve(begin, end);
+    }
+    begin = end;
+  }
+}
+
+// Hungarian method (shortest augmenting paths with potentials) on one
+// group's dense cost matrix, with the shorter side as rows.
+void VisionTracker::solve(size_t begin, size_t end) {
+  const std::vector<int> &rows = rows_, &cols = cols_;
+  const bool flip = rows.size() > cols.size();
+  const std::vector<int> &r = flip ? cols : rows;
+  const std::vector<int> &c = flip ? rows : cols;
+  const size_t n = r.size(), m = c.size();
+
+  cost_.assign((n + 1) * (m + 1), kForbidden);
+  for (size_t k = begin; k < end; k++) {
+    const Edge &e = edges_[k];
+    size_t i = std::lower_bound(rows.begin(), rows.end(), e.track) -
+               rows.begin();
+    size_t j = std::lower_bound(cols.begin(), cols.end(), e.det) -
+               cols.begin();
+    if (flip)
+      std::swap(i, j);
+    cost_[(i + 1) * (m + 1) + (j + 1)] = e.cost;
+  }
+
+  const double inf = std::numeric_limits<double>::infinity();
+  u_.assign(n + 1, 0.0);
+  v_.assign(m + 1, 0.0);
+  p_.assign(m + 1, 0);
+  way_.assign(m + 1, 0);
+  for (size_t i = 1; i <= n; i++) {
+    p_[0] = (int)i;
+    size_t j0 = 0;
+    min_.assign(m + 1, inf);
+    used_.assign(m + 1, 0);
+    do {
+      used_[j0] = 1;
+      const size_t i0 = (size_t)p_[j0];
+      double delta = inf;
+      size_t j1 = 0;
+      for (size_t j = 1; j <= m; j++) {
+        if (used_[j])
+          continue;
+        double cur = cost_[i0 * (m + 1) + j] - u_[i0] - v_[j];
+        if (cur < min_[j]) {
+          min_[j] = cur;
+          way_[j] = (int)j0;
+        }
+        if (min_[j] < delta) {
+          delta = min_[j];
+          j1 = j;
+        }
+      }
+      for (size_t j = 0; j <= m; j++) {
+        if (used_[j]) {
+          u_[(size_t)p_[j]] += delta;
+          v_[j] -= delta;
+        } else {
+          min_[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (p_[j0] != 0);
+    do {
+      const size_t j1 = (size_t)way_[j0];
+      p_[j0] = p_[j1];
+      j0 = j1;
+    } while (j0 != 0);
+  }
+
+  for (size_t j = 1; j <= m; j++) {
+    if (p_[j] == 0 || cost_[(size_t)p_[j] * (m + 1) + j] >= kForbidden)
+      continue;
+    int track = flip ? c[j - 1] : r[(size_t)p_[j] - 1];
+    int det = flip ? r[(size_t)p_[j] - 1] : c[j - 1];
+    match_[track] = det;
+    matched_by_[det] = track;
+  }
+}
+
+const std::vector<Track> &VisionTracker::update(const Detection *detections,
+                                                size_t count, int64_t now_ms) {
+  if (!detections)
+    count = 0;
+
+  // 1. Constant-velocity prediction for the update time. A track seen only
+  // once has no velocity of its own yet; on a screen, content moves as a
+  // whole when it scrolls, so it borrows the mean of the tracks that have.
+  float scene_vx = 0.0f, scene_vy = 0.0f;
+  int moving = 0;
+  for (const State &s : states_) {
+    if (s.moving) {
+      scene_vx += s.vx;
+      scene_vy += s.vy;
+      moving++;
+    }
+  }
+  if (moving > 0) {
+    scene_vx /= (float)moving;
+    scene_vy /= (float)moving;
+  }
+  predicted_.resize(states_.size());
+  for (size_t t = 0; t < states_.size(); t++) {
+    const State &s = states_[t];
+    const float dt = (float)std::max<int64_t>(now_ms - s.seen_ms, 0);
+    const float vx = s.moving ? s.vx : scene_vx;
+    const float vy = s.moving ? s.vy : scene_vy;
+    Detection p = s.seen;
+    p.left += vx * dt;
+    p.right += vx * dt;
+    p.top += vy * dt;
+    p.bottom += vy * dt;
+    predicted_[t] = p;
+  }
+
+  // 2-3. Gate and assign.
+  const size_t tracks = states_.size();
+  gate(detections, count);
+  assign(tracks, count);
+
+  // 4. Update matched tracks, coast or drop the rest, keeping order.
+  out_.clear();
+  size_t kept = 0;
+  for (size_t t = 0; t < tracks; t++) {
+    State s = states_[t];
+    const int d = match_[t];
+    Track out;
+    if (d >= 0) {
+      const Detection &det = detections[d];
+      const int64_t dt = now_ms - s.seen_ms;
+      if (dt > 0) {
+        // Centre displacement over the gap: the sum of edges is twice it.
+        const float half = 0.5f / (float)dt;
+        const float sx = ((det.left + det.right) -
+                          (s.seen.left + s.seen.right)) * half;
+        const float sy = ((det.top + det.bottom) -
+                          (s.seen.top + s.seen.bottom)) * half;
+        const float a = s.moving ? config_.velocity_smoothing : 1.0f;
+        s.vx = a * sx + (1.0f - a) * s.vx;
+        s.vy = a * sy + (1.0f - a) * s.vy;
+        s.moving = true;
+      }
+      s.seen = det;
+      s.seen_ms = now_ms;
+      s.score = det.score;
+      out = {s.id, s.cls, s.score, det.left, det.top, det.right, det.bottom, 0};
+    } else {
+      const int64_t missed = now_ms - s.seen_ms;
+      if (missed > config_.max_age_ms)
+        continue;
+      const Detection &p = predicted_[t];
+      out = {s.id, s.cls, s.score, p.left, p.top, p.right, p.bottom, missed};
+    }
+    states_[kept++] = s;
+    out_.push_back(out);
+  }
+  states_.resize(kept);
+
+  // New tracks for unmatched detections.
+  for (size_t i = 0; i < count; i++) {
+    const Detection &det = detections[i];
+    if (matched_by_[i] >= 0 || !usable(det))
+      continue;
+    State s;
+    s.id = next_id_++;
+    s.cls = det.cls;
+    s.score = det.score;
+    s.seen = det;
+    s.seen_ms = now_ms;
+    states_.push_back(s);
+    out_.push_back(
+        {s.id, s.cls, s.score, det.left, det.top, det.right, det.bottom, 0});
+  }
+  return out_;
+}
@@ -0,0 +1,90 @@
+#ifndef VISION_TRACK_H
+#define VISION_TRACK_H
+
+#include "vision_detect.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Multi-object tracker for detector output, shared by the app (through JNI)
+// and host tools. Each update:
+//   1. predicts every track's box with a constant-velocity model (tracks
+//      without a velocity yet move with the mean of those that have one),
+//   2. gates candidate pairs through a spatial hash of the detections (same
+//      class, IoU above the threshold),
+//   3. solves the assignment optimally (Hungarian) per connected group of
+//      candidates, maximising matches first and total IoU second,
+//   4. starts a track for every unmatched detection and drops tracks unseen
+//      for longer than max_age_ms.
+// Track IDs are never reused within a tracker.
+
+struct TrackerConfig {
+  float iou_threshold = 0.3f; // against the predicted box
+  int64_t max_age_ms = 500;   // unmatched tracks coast this long
+  float velocity_smoothing = 0.5f; // weight of the newest velocity sample
+};
+
+struct Track {
+  int id;
+  int cls;
+  float score;                    // of the last matched detection
+  float left, top, right, bottom; // predicted for the update time
+  int64_t missed_ms; // since the last match; 0 when matched this update
+};
+
+class VisionTracker {
+public:
+  explicit VisionTracker(const TrackerConfig &config = TrackerConfig());
+
+  // Advances to `now_ms` with this frame's detections and returns the live
+  // tracks: those that existed before, in their previous order, then the
+  // new ones. The reference is valid until the next update or clear.
+  const std::vector<Track> &update(const Detection *detections, size_t count,
+                                   int64_t now_ms);
+
+  const std::vector<Track> &tracks() const { return out_; }
+  void clear();
+
+private:
+  struct State {
+    int id;
+    int cls;
+    float score;
+    Detection seen; // box at the last match
+    int64_t seen_ms;
+    float vx = 0.0f, vy = 0.0f; // centre velocity, pixels per ms
+    bool moving = false;        // has a velocity sample
+  };
+
+  struct Edge {
+    int track, det;
+    float cost; // 1 - IoU
+    int group;  // connected component, set by assign
+  };
+
+  void gate(const Detection *detections, size_t count);
+  void assign(size_t tracks, size_t count);
+  void solve(size_t begin, size_t end);
+
+  TrackerConfig config_;
+  int next_id_ = 1;
+  std::vector<State> states_;
+  std::vector<Track> out_;
+
+  // Per-update scratch, kept to avoid reallocating every frame.
+  std::vector<Detection> predicted_;
+  std::vector<std::pair<uint64_t, int>> cells_; // (cell key, detection)
+  std::vector<int> stamp_;                      // per detection
+  std::vector<Edge> edges_;
+  std::vector<int> parent_;           // union-find over tracks + detections
+  std::vector<int> match_;            // detection per track, or -1
+  std::vector<int> matched_by_;       // track per detection, or -1
+  std::vector<int> rows_, cols_;      // tracks and detections of one group
+  std::vector<double> cost_, u_, v_, min_; // solver
+  std::vector<int> p_, way_;
+  std::vector<char> used_;
+};
+
+#endif // VISION_TRACK_H
@@ -0,0 +1,134 @@
+#include "vision_log.h"
+#include "vision_track.h"
+#include <algorithm>
+#include <cstdint>
+#include <jni.h>
+
+// JNI glue for ObjectTracker; tracking lives in vision_track.cpp. Shares
+// libvision_engine (and its JNI_OnLoad) with vision_jni.cpp.
+
+// Detections arrive in the DetectionBuffer.kt layout: kDetectionFloats
+// floats each (class, score, left, top, right, bottom). Tracks leave in the
+// TrackBuffer.kt layout: kTrackInts ints (id, class, missed ms) and
+// kTrackFloats floats (score, left, top, right, bottom) each.
+constexpr int kDetectionFloats = 6;
+constexpr int kTrackInts = 3;
+constexpr int kTrackFloats = 5;
+
+namespace {
+
+// A tracker plus the unpacked input it reuses across frames.
+struct TrackerHandle {
+  explicit TrackerHandle(const TrackerConfig &config) : tracker(config) {}
+  VisionTracker tracker;
+  std::vector<Detection> input;
+};
+
+TrackerHandle *from_handle(jlong handle) {
+  return reinterpret_cast<TrackerHandle *>(handle);
+}
+
+// Writes as many tracks as fit; the total tells the caller whether to grow
+// and fetch again through nativeTracks, which does not advance the tracker.
+jint pack_tracks(JNIEnv *env, const std::vector<Track> &tracks,
+                 jintArray ints, jfloatArray floats) {
+  size_t n = std::min({tracks.size(),
+                       (size_t)env->GetArrayLength(ints) / kTrackInts,
+                       (size_t)env->GetArrayLength(floats) / kTrackFloats});
+  if (n > 0) {
+    auto *ip = static_cast<jint *>(env->GetPrimitiveArrayCritical(ints, 0));
+    if (!ip)
+      return -1;
+    auto *fp = static_cast<jfloat *>(env->GetPrimitiveArrayCritical(floats, 0));
+    if (!fp) {
+      env->ReleasePrimitiveArrayCritical(ints, ip, JNI_ABORT);
+      return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      const Track &t = tracks[i];
+      jint *ri = ip + i * kTrackInts;
+      jfloat *rf = fp + i * kTrackFloats;
+      ri[0] = t.id;
+      ri[1] = t.cls;
+      ri[2] = (jint)std::min<int64_t>(t.missed_ms, INT32_MAX);
+      rf[0] = t.score;
+      rf[1] = t.left;
+      rf[2] = t.top;
+      rf[3] = t.right;
+      rf[4] = t.bottom;
+    }
+    env->ReleasePrimitiveArrayCritical(floats, fp, 0);
+    env->ReleasePrimitiveArrayCritical(ints, ip, 0);
+  }
+  return (jint)tracks.size();
+}
+
+} // namespace
+
+extern "C" {
+
+JNIEXPORT jlong JNICALL
+Java_com_autonion_automationcompanion_core_vision_ObjectTracker_nativeCreate(
+    JNIEnv *, jobject, jfloat iou_threshold, jlong max_age_ms) {
+  TrackerConfig config;
+  config.iou_threshold = iou_threshold;
+  config.max_age_ms = (int64_t)max_age_ms;
+  return reinterpret_cast<jlong>(new TrackerHandle(config));
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_ObjectTracker_nativeDestroy(
+    JNIEnv *, jobject, jlong handle) {
+  delete from_handle(handle);
+}
+
+JNIEXPORT void JNICALL
+Java_com_autonion_automationcompanion_core_vision_ObjectTracker_nativeClear(
+    JNIEnv *, jobject, jlong handle) {
+  from_handle(handle)->tracker.clear();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_ObjectTracker_nativeUpdate(
+    JNIEnv *env, jobject, jlong handle, jfloatArray detections, jint count,
+    jlong now_ms, jintArray ints, jfloatArray floats) {
+  TrackerHandle *h = from_handle(handle);
+  if (!detections || !ints || !floats || count < 0 ||
+      (jlong)count * kDetectionFloats > env->GetArrayLength(detections)) {
+    LOGE("ObjectTracker: bad arguments (count=%d)", (int)count);
+    return -1;
+  }
+
+  h->input.resize((size_t)count);
+  if (count > 0) {
+    auto *fp = static_cast<jfloat *>(
+        env->GetPrimitiveArrayCritical(detections, 0));
+    if (!fp)
+      return -1;
+    for (jint i = 0; i < count; ++i) {
+      const jfloat *rec = fp + (size_t)i * kDetectionFloats;
+      Detection &d = h->input[(size_t)i];
+      d.cls = (int)rec[0];
+      d.score = rec[1];
+      d.left = rec[2];
+      d.top = rec[3];
+      d.right = rec[4];
+      d.bottom = rec[5];
+    }
+    env->ReleasePrimitiveArrayCritical(detections, fp, JNI_ABORT);
+  }
+
+  const std::vector<Track> &tracks =
+      h->tracker.update(h->input.data(), h->input.size(), (int64_t)now_ms);
+
+  return pack_tracks(env, tracks, ints, floats);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_autonion_automationcompanion_core_vision_ObjectTracker_nativeTracks(
+    JNIEnv *env, jobject, jlong handle, jintArray ints, jfloatArray floats) {
+  if (!ints || !floats)
+    return -1;
+  return pack_tracks(env, from_handle(handle)->tracker.tracks(), ints, floats);
+}
+}
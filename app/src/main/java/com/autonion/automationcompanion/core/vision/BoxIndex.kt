@@ -0,0 +1,138 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.graphics.RectF
+
+/**
+ * Native spatial index over one frame's boxes (UI elements, OCR blocks, step
+ * anchors), for the overlap and proximity lookups that would otherwise compare
+ * every box with every other. [build] files the boxes in a uniform grid; the
+ * queries then only look at nearby boxes and answer with indices into what was
+ * built. IoU is computed as in the Kotlin helpers it replaces, and ties go to
+ * the lower index, as with `maxByOrNull` / `minByOrNull` over a list.
+ *
+ * Each box carries a class ID of the caller's choosing (a label's index, or 1
+ * for "has the label I want" and 0 otherwise); queries filter on one, or take
+ * [ANY_CLASS]. Not thread-safe; [close] must not overlap any other call. Using
+ * a closed index throws [IllegalStateException].
+ */
+class BoxIndex : AutoCloseable {
+
+    private var handle: Long = nativeCreate()
+
+    // Packed boxes and queries in the DetectionBuffer layout, reused across builds.
+    private var boxes = FloatArray(64 * DetectionBuffer.RECORD_FLOATS)
+    private var queries = FloatArray(64 * DetectionBuffer.RECORD_FLOATS)
+
+    /** Number of boxes in the last build. */
+    var size = 0
+        private set
+
+    private fun live(): Long {
+        check(handle != 0L) { "BoxIndex is closed" }
+        return handle
+    }
+
+    // Runs a native call on the live handle, keeping this index reachable until it
+    // returns (see NativeCleaner.keepAlive).
+    private inline fun <T> withHandle(call: (Long) -> T): T =
+        try {
+            call(live())
+        } finally {
+            NativeCleaner.keepAlive(this)
+        }
+
+    /** Indexes a frame's decoded detections, with their model class IDs. */
+    fun build(detections: DetectionBuffer): BoxIndex {
+        size = if (withHandle { nativeBuild(it, detections.data, detections.count) }) detections.count else 0
+        return this
+    }
+
+    /** Indexes [count] boxes: box `i` has class [classId] `(i)` and [bounds] `(i)`. */
+    fun build(count: Int, classId: (Int) -> Int, bounds: (Int) -> RectF): BoxIndex {
+        boxes = pack(boxes, count, classId, bounds)
+        size = if (withHandle { nativeBuild(it, boxes, count) }) count else 0
+        return this
+    }
+
+    /**
+     * Writes into [into] every (query, box) pair whose IoU is above [minIou], for
+     * the [count] query boxes given by [bounds], against boxes of [classId]:
+     * grouped by query in query order, each group strongest overlap first.
+     */
+    fun join(
+        count: Int,
+        bounds: (Int) -> RectF,
+        minIou: Float,
+        into: OverlapBuffer,
+        classId: Int = ANY_CLASS
+    ): OverlapBuffer = withHandle { h ->
+        queries = pack(queries, count, { ANY_CLASS }, bounds)
+        val packed = queries
+        into.fill(
+            { ints, floats -> nativeJoin(h, packed, count, classId, minIou, ints, floats) },
+            { ints, floats -> nativeHits(h, ints, floats) }
+        )
+    }
+
+    /** Index of the box of [classId] overlapping [bounds] most with IoU above [minIou], or -1. */
+    fun bestOverlap(bounds: RectF, minIou: Float, classId: Int = ANY_CLASS): Int =
+        withHandle { nativeBestOverlap(it, bounds.left, bounds.top, bounds.right, bounds.bottom, classId, minIou) }
+
+    /** Index of the box of [classId] whose centre is closest to ([x], [y]) within [maxDistance], or -1. */
+    fun nearest(
+        x: Float,
+        y: Float,
+        classId: Int = ANY_CLASS,
+        maxDistance: Float = Float.POSITIVE_INFINITY
+    ): Int = withHandle { nativeNearest(it, x, y, classId, maxDistance) }
+
+    override fun close() {
+        val h = handle
+        if (h == 0L) return
+        handle = 0L
+        nativeDestroy(h)
+    }
+
+    private fun pack(
+        into: FloatArray,
+        count: Int,
+        classId: (Int) -> Int,
+        bounds: (Int) -> RectF
+    ): FloatArray {
+        val stride = DetectionBuffer.RECORD_FLOATS
+        val out = if (into.size >= count * stride) into else FloatArray(count * stride)
+        for (i in 0 until count) {
+            val r = bounds(i)
+            val o = i * stride
+            out[o] = classId(i).toFloat()
+            out[o + 1] = 0f
+            out[o + 2] = r.left
+            out[o + 3] = r.top
+            out[o + 4] = r.right
+            out[o + 5] = r.bottom
+        }
+        return out
+    }
+
+    private external fun nativeCreate(): Long
+    private external fun nativeDestroy(handle: Long)
+    private external fun nativeBuild(handle: Long, boxes: FloatArray, count: Int): Boolean
+    private external fun nativeJoin(
+        handle: Long, queries: FloatArray, count: Int, classId: Int, minIou: Float,
+        ints: IntArray, floats: FloatArray
+    ): Int
+    private external fun nativeHits(handle: Long, ints: IntArray, floats: FloatArray): Int
+    private external fun nativeBestOverlap(
+        handle: Long, left: Float, top: Float, right: Float, bottom: Float, classId: Int, minIou: Float
+    ): Int
+    private external fun nativeNearest(handle: Long, x: Float, y: Float, classId: Int, maxDistance: Float): Int
+
+    companion object {
+        /** Class filter matching every box. */
+        const val ANY_CLASS = -1
+
+        init {
+            System.loadLibrary("vision_engine")
+        }
+    }
+}
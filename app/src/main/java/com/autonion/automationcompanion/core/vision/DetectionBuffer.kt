@@ -0,0 +1,55 @@
+package com.autonion.automationcompanion.core.vision
+
+/**
+ * Reusable destination for decoded detections, filled natively without
+ * allocating: detection `i` occupies [RECORD_FLOATS] floats of [data] (class,
+ * score, left, top, right, bottom) in image pixels. Grown by
+ * [DetectionNativeBridge] when a frame has more survivors than fit.
+ */
+class DetectionBuffer(capacity: Int = 64) {
+
+    var data = FloatArray(capacity * RECORD_FLOATS)
+        internal set
+
+    /** Number of valid detections from the last fill. */
+    var count = 0
+        internal set
+
+    val capacity: Int get() = data.size / RECORD_FLOATS
+
+    fun classId(i: Int) = data[i * RECORD_FLOATS].toInt()
+    fun score(i: Int) = data[i * RECORD_FLOATS + 1]
+    fun left(i: Int) = data[i * RECORD_FLOATS + 2]
+    fun top(i: Int) = data[i * RECORD_FLOATS + 3]
+    fun right(i: Int) = data[i * RECORD_FLOATS + 4]
+    fun bottom(i: Int) = data[i * RECORD_FLOATS + 5]
+
+    /** Runs a packed native decode into this buffer, growing it once if needed. */
+    internal inline fun fill(call: (FloatArray) -> Int): DetectionBuffer {
+        var n = call(data)
+        if (n > capacity) {
+            data = FloatArray(n * RECORD_FLOATS)
+            n = call(data)
+        }
+        count = n.coerceIn(0, capacity)
+        return this
+    }
+
+    /**
+     * Runs [detect] into this buffer; when it reports more detections than fit,
+     * grows and collects them with [refetch], which must not run the model again.
+     */
+    internal inline fun fill(detect: (FloatArray) -> Int, refetch: (FloatArray) -> Int): DetectionBuffer {
+        var n = detect(data)
+        if (n > capacity) {
+            data = FloatArray(n * RECORD_FLOATS)
+            n = refetch(data)
+        }
+        count = n.coerceIn(0, capacity)
+        return this
+    }
+
+    companion object {
+        const val RECORD_FLOATS = 6
+    }
+}
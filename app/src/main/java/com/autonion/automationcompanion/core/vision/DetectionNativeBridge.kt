@@ -0,0 +1,93 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.graphics.Bitmap
+import java.nio.ByteBuffer
+import java.nio.FloatBuffer
+
+/**
+ * Native pre- and post-processing for YOLO-style detectors: the letterboxed,
+ * normalised model input written straight into the interpreter's buffer, and
+ * argmax over the class channels, score threshold and per-class NMS in one
+ * pass over the output tensor, without copying either to the Java heap.
+ */
+object DetectionNativeBridge {
+
+    init {
+        System.loadLibrary("vision_engine")
+    }
+
+    external fun nativeLetterbox(
+        bitmap: Bitmap,
+        side: Int,
+        keepAspect: Boolean,
+        half: Boolean,
+        dst: ByteBuffer,
+        transform: FloatArray
+    ): Boolean
+
+    external fun nativeDecodeYolo(
+        output: FloatBuffer,
+        channels: Int,
+        anchors: Int,
+        imageWidth: Int,
+        imageHeight: Int,
+        inputSize: Int,
+        scoreThreshold: Float,
+        iouThreshold: Float,
+        classes: Int,
+        transform: FloatArray?,
+        out: FloatArray
+    ): Int
+
+    /**
+     * The calling thread's last detections from [NativeDetector.detect] or a
+     * matcher's `detectLatest`, packed again for a buffer grown after the first
+     * fill came up short. Returns their total.
+     */
+    external fun nativeLastDetections(out: FloatArray): Int
+
+    /**
+     * Resizes [bitmap] (ARGB_8888) into the direct buffer [dst] as a [side] x
+     * [side] RGB input in 0-1, float32 or, with [half], float16, in one pass and
+     * without copying the pixels. With [keepAspect] the frame is scaled to fit
+     * and centred on gray padding, the way YOLO models are trained; otherwise it
+     * is stretched. [transform] receives the mapping to pass to [decodeYolo].
+     * Returns false if the bitmap config or buffer size does not fit.
+     */
+    fun letterbox(
+        bitmap: Bitmap,
+        side: Int,
+        dst: ByteBuffer,
+        transform: LetterboxTransform,
+        keepAspect: Boolean = true,
+        half: Boolean = false
+    ): Boolean = nativeLetterbox(bitmap, side, keepAspect, half, dst, transform.data)
+
+    /**
+     * Decodes a `[channels][anchors]` head (cx, cy, w, h, then one score per
+     * class) held in the direct buffer [output] into [into], with boxes scaled to
+     * [imageWidth] x [imageHeight]. Coordinates may be normalised or in
+     * [inputSize] pixels; the format is detected from the first candidates.
+     * Winners of class [classes] or above are dropped (0 keeps all). Survivors are
+     * grouped by class, highest score first. When the input was prepared by
+     * [letterbox], pass its [transform] so boxes land back on the frame.
+     */
+    fun decodeYolo(
+        output: FloatBuffer,
+        channels: Int,
+        anchors: Int,
+        imageWidth: Int,
+        imageHeight: Int,
+        into: DetectionBuffer,
+        inputSize: Int = 640,
+        scoreThreshold: Float = 0.25f,
+        iouThreshold: Float = 0.45f,
+        classes: Int = 0,
+        transform: LetterboxTransform? = null
+    ): DetectionBuffer = into.fill { out ->
+        nativeDecodeYolo(
+            output, channels, anchors, imageWidth, imageHeight, inputSize,
+            scoreThreshold, iouThreshold, classes, transform?.data, out
+        )
+    }
+}
@@ -0,0 +1,16 @@
+package com.autonion.automationcompanion.core.vision
+
+/**
+ * What native dirty-tile tracking saved on the most recent frame: tiles that
+ * differ from the previous frame, and templates answered from the previous
+ * result because none of their search area changed.
+ */
+data class FrameDiffStats(
+    val tiles: Int = 0,
+    val tilesChanged: Int = 0,
+    val templates: Int = 0,
+    val templatesSkipped: Int = 0
+) {
+    val changedFraction: Float get() = if (tiles > 0) tilesChanged.toFloat() / tiles else 1f
+    val skippedFraction: Float get() = if (templates > 0) templatesSkipped.toFloat() / templates else 0f
+}
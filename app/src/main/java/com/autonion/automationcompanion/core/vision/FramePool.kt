@@ -0,0 +1,134 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.media.Image
+import java.nio.ByteBuffer
+
+/**
+ * A fixed set of native frame buffers shared by every consumer of one screen
+ * capture. [fill] copies an ImageReader plane in once, without its row padding,
+ * and converts it to grayscale in the same call. Consumers take [latest] as a
+ * [NativeFrame] and pass it to [VisionMatcher.match], [VisionMatcher.submitFrame],
+ * [NativeDetector.detect] or [NativeFrame.toBitmap], which read that one copy.
+ *
+ * A buffer goes back to the pool when the last [NativeFrame] on it is closed, so
+ * memory stays at [capacity] frames however long capture runs. While every buffer
+ * is held, [fill] drops the image instead of allocating ([dropped]). A matcher
+ * given a frame through [VisionMatcher.submitFrame] holds it until its next
+ * submit.
+ *
+ * [VisionMatcher.waitFor] blocks on a pool until templates appear in its frames.
+ * A consumer that waits on another thread than the capture takes its own handle
+ * with [retain]: closing the capture's pool then ends the wait instead of freeing
+ * the pool under it, and [cancelWaits] ends the waits on that handle alone.
+ *
+ * [fill] and [latest] may be called from different threads, but [close] must not
+ * overlap any other call on the same handle except [cancelWaits]. Frames still
+ * open stay valid after [close]. Using a closed pool throws
+ * [IllegalStateException]. A handle collected without [close] is released by
+ * [NativeCleaner], which logs it as a leak.
+ */
+class FramePool private constructor(
+    val capacity: Int,
+    private var handle: Long,
+    private val owner: Boolean
+) : AutoCloseable {
+
+    constructor(capacity: Int = DEFAULT_CAPACITY) : this(capacity, nativeCreate(capacity), true)
+
+    private val cleanable = handle.let { h ->
+        val owns = owner
+        NativeCleaner.register(this, if (owns) "FramePool" else "FramePool (retained)") {
+            if (owns) nativeClose(h)
+            nativeDestroy(h)
+        }
+    }
+
+    private fun live(): Long {
+        check(handle != 0L) { "FramePool is closed" }
+        return handle
+    }
+
+    internal fun nativeHandle(): Long = live()
+
+    /**
+     * Runs [call] on the live handle and keeps this pool reachable until it
+     * returns, so [NativeCleaner] cannot release the handle during the call.
+     */
+    internal inline fun <T> withHandle(call: (Long) -> T): T =
+        try {
+            call(nativeHandle())
+        } finally {
+            NativeCleaner.keepAlive(this)
+        }
+
+    /**
+     * Another handle on the same pool, closed independently and without ending
+     * the capture. Once the pool this was retained from is closed, waits on
+     * either handle return and no new frames arrive.
+     */
+    fun retain(): FramePool = FramePool(capacity, withHandle { nativeRetain(it) }, false)
+
+    // Orders cancelWaits against close, which may run on different threads.
+    private val cancelLock = Any()
+
+    /**
+     * Ends every [VisionMatcher.waitFor] blocked on this handle, and makes later
+     * ones return at once; other handles on the pool are unaffected. Safe from any
+     * thread, during a wait and after [close] (then it does nothing).
+     */
+    fun cancelWaits() = synchronized(cancelLock) {
+        if (handle != 0L) nativeCancelWaits(handle)
+    }
+
+    /**
+     * Takes in an RGBA_8888 plane as the [latest] frame. Returns the frame's
+     * sequence number, or 0 when it was dropped. Call while the Image is still
+     * open.
+     */
+    fun fill(plane: Image.Plane, width: Int, height: Int): Long =
+        withHandle { nativeFill(it, plane.buffer, width, height, plane.rowStride, plane.pixelStride) }
+
+    /** The most recent frame, held until the returned frame is closed; null before the first. */
+    fun latest(): NativeFrame? {
+        val frame = withHandle { nativeLatest(it) }
+        return if (frame == 0L) null else NativeFrame(frame)
+    }
+
+    /** Buffers currently held, the latest frame included. */
+    val inUse: Int get() = withHandle { nativeStats(it) }[1].toInt()
+
+    /** Images dropped because every buffer was held. */
+    val dropped: Long get() = withHandle { nativeStats(it) }[3]
+
+    override fun close() {
+        val h = synchronized(cancelLock) { handle.also { handle = 0L } }
+        if (h == 0L) return
+        cleanable.clean()
+    }
+
+    private external fun nativeRetain(handle: Long): Long
+    private external fun nativeCancelWaits(handle: Long)
+    private external fun nativeFill(
+        handle: Long, buffer: ByteBuffer, width: Int, height: Int, rowStride: Int, pixelStride: Int
+    ): Long
+    private external fun nativeLatest(handle: Long): Long
+    private external fun nativeStats(handle: Long): LongArray
+
+    companion object {
+        /** The latest frame, one being filled and two held by consumers. */
+        const val DEFAULT_CAPACITY = 4
+
+        init {
+            System.loadLibrary("vision_engine")
+        }
+
+        @JvmStatic
+        private external fun nativeCreate(capacity: Int): Long
+
+        @JvmStatic
+        private external fun nativeClose(handle: Long)
+
+        @JvmStatic
+        private external fun nativeDestroy(handle: Long)
+    }
+}
@@ -0,0 +1,16 @@
+package com.autonion.automationcompanion.core.vision
+
+/**
+ * Where a frame landed in a model input prepared by
+ * [DetectionNativeBridge.letterbox]: `input = image * scale + pad`. Reused
+ * across frames; the native side writes [data] in place.
+ */
+class LetterboxTransform {
+
+    internal val data = FloatArray(4)
+
+    val scaleX: Float get() = data[0]
+    val scaleY: Float get() = data[1]
+    val padX: Float get() = data[2]
+    val padY: Float get() = data[3]
+}
@@ -0,0 +1,77 @@
+package com.autonion.automationcompanion.core.vision
+
+/**
+ * Reusable destination for a frame's match results, filled natively without
+ * allocating: result `i` occupies [RECORD_INTS] ints of [ints] (id, flags, x, y,
+ * width, height) and `scores[i]`. Size it to the number of registered templates;
+ * [VisionNativeBridge] grows it when a frame returns more results than fit.
+ */
+class MatchResultBuffer(capacity: Int = 16) {
+
+    var ints = IntArray(capacity * RECORD_INTS)
+        internal set
+    var scores = FloatArray(capacity)
+        internal set
+
+    /** Number of valid results from the last fill. */
+    var count = 0
+        internal set
+
+    val capacity: Int get() = scores.size
+
+    fun id(i: Int) = ints[i * RECORD_INTS]
+    fun matched(i: Int) = ints[i * RECORD_INTS + 1] and FLAG_MATCHED != 0
+    fun fromPrior(i: Int) = ints[i * RECORD_INTS + 1] and FLAG_FROM_PRIOR != 0
+    fun x(i: Int) = ints[i * RECORD_INTS + 2]
+    fun y(i: Int) = ints[i * RECORD_INTS + 3]
+    fun width(i: Int) = ints[i * RECORD_INTS + 4]
+    fun height(i: Int) = ints[i * RECORD_INTS + 5]
+    fun score(i: Int) = scores[i]
+
+    /** Index of the result for template [id], or -1. */
+    fun indexOfId(id: Int): Int {
+        for (i in 0 until count) if (id(i) == id) return i
+        return -1
+    }
+
+    /** [MatchResultNative] view of result [i], for callers that want the object form. */
+    operator fun get(i: Int) = MatchResultNative(
+        id(i), matched(i), score(i), x(i), y(i), width(i), height(i), fromPrior(i)
+    )
+
+    fun toArray(): Array<MatchResultNative> = Array(count) { get(it) }
+
+    /**
+     * Runs a packed native match into this buffer. When the frame has more results
+     * than fit, the buffer grows and collects them from the native side's copy of
+     * the last results; the frame is not matched again.
+     */
+    internal inline fun fill(call: (IntArray, FloatArray) -> Int): MatchResultBuffer {
+        var n = call(ints, scores)
+        if (n > capacity) {
+            ints = IntArray(n * RECORD_INTS)
+            scores = FloatArray(n)
+            n = VisionNativeBridge.nativeLastResultsPacked(ints, scores)
+        }
+        count = n.coerceIn(0, capacity)
+        return this
+    }
+
+    /**
+     * [fill] with the buffer grown to [atLeast] results before the call, for a
+     * blocking wait whose result count is known up front.
+     */
+    internal inline fun fillOnce(atLeast: Int, call: (IntArray, FloatArray) -> Int): MatchResultBuffer {
+        if (atLeast > capacity) {
+            ints = IntArray(atLeast * RECORD_INTS)
+            scores = FloatArray(atLeast)
+        }
+        return fill(call)
+    }
+
+    companion object {
+        const val RECORD_INTS = 6
+        const val FLAG_MATCHED = 1
+        const val FLAG_FROM_PRIOR = 2
+    }
+}
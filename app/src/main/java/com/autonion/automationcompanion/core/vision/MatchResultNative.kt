@@ -7,5 +7,7 @@ data class MatchResultNative(
     val x: Int = 0,
     val y: Int = 0,
     val width: Int = 0,
-    val height: Int = 0
+    val height: Int = 0,
+    /** True when the hit came from the template's prior window, not the full-screen fallback. */
+    val fromPrior: Boolean = false
 )
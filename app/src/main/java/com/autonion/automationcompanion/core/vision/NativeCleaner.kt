@@ -0,0 +1,102 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.os.Build
+import android.util.Log
+import java.lang.ref.PhantomReference
+import java.lang.ref.Reference
+import java.lang.ref.ReferenceQueue
+import java.util.Collections
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.atomic.AtomicBoolean
+
+private const val TAG = "NativeCleaner"
+
+/**
+ * Fallback release for native handles whose Kotlin owner was garbage collected
+ * without being closed: a leaked [NativeFrame] would otherwise hold one of its
+ * [FramePool]'s few buffers for good, and capture stalls once every buffer is
+ * held. The same idea as `java.lang.ref.Cleaner`, which needs API 33, on a
+ * [PhantomReference] queue drained by one daemon thread.
+ *
+ * [register] takes the release action; it must not reference the owner (call
+ * only static natives with the handle value), or the owner is never collected.
+ * The owner's close() calls [Cleanable.clean]; whichever of close() and the
+ * collector comes first releases, once. A release by the collector is logged as
+ * a leak.
+ *
+ * An owner whose handle is passed by value to a native call is otherwise
+ * unreachable once the value is read, so the collector could release the handle
+ * while the call still uses it. Owners therefore make such calls through a
+ * `withHandle` helper that calls [keepAlive] after the call returns.
+ */
+internal object NativeCleaner {
+
+    private val queue = ReferenceQueue<Any>()
+
+    // Keeps every registered reference reachable until it is released.
+    private val pending: MutableSet<Cleanable> = Collections.newSetFromMap(ConcurrentHashMap())
+
+    class Cleanable internal constructor(
+        owner: Any,
+        private val what: String,
+        private val release: () -> Unit
+    ) : PhantomReference<Any>(owner, queue) {
+
+        private val released = AtomicBoolean(false)
+
+        /** Releases now, from the owner's close(). */
+        fun clean() {
+            if (!released.compareAndSet(false, true)) return
+            pending.remove(this)
+            clear()
+            release()
+        }
+
+        internal fun collected() {
+            if (!released.compareAndSet(false, true)) return
+            pending.remove(this)
+            Log.w(TAG, "$what was garbage collected without close(); released by the cleaner")
+            release()
+        }
+    }
+
+    // Written by keepAlive below API 28; never read.
+    @Volatile
+    private var keepAliveSink: Any? = null
+
+    /**
+     * Keeps [owner] reachable up to this call, so a native call made before it
+     * on the owner's handle cannot have the handle released under it. Call in a
+     * `finally` after the native call. `Reference.reachabilityFence` needs API
+     * 28; below it a volatile write of the owner, which cannot be elided, does
+     * the same.
+     */
+    fun keepAlive(owner: Any?) {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.P) {
+            Reference.reachabilityFence(owner)
+        } else {
+            keepAliveSink = owner
+            keepAliveSink = null
+        }
+    }
+
+    /** Registers [release] to run when [owner] is collected unless cleaned first. */
+    fun register(owner: Any, what: String, release: () -> Unit): Cleanable =
+        Cleanable(owner, what, release).also { pending.add(it) }
+
+    init {
+        Thread({
+            while (true) {
+                try {
+                    (queue.remove() as Cleanable).collected()
+                } catch (_: InterruptedException) {
+                } catch (t: Throwable) {
+                    Log.e(TAG, "Releasing a collected native handle failed", t)
+                }
+            }
+        }, "vision-native-cleaner").apply {
+            isDaemon = true
+            start()
+        }
+    }
+}
@@ -0,0 +1,100 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.graphics.Bitmap
+
+/**
+ * Native UI-element detector: the YOLO-style model in ONNX form, run on the CPU
+ * through OpenCV's DNN module inside `vision_engine`, with the same letterbox and
+ * decode as [DetectionNativeBridge]. A model quantised to int8 loads the same way
+ * and runs on int8 kernels ([quantized]), the faster choice on devices where the
+ * GPU delegate is unavailable.
+ *
+ * [detect] reads a bitmap's pixels in place. Attached to a matcher with
+ * [VisionMatcher.setDetector] or [VisionNativeBridge.setDetector], it instead
+ * runs on the frames given to `submitFrame`, prepared while they are converted
+ * for matching, so one submitted frame feeds both.
+ *
+ * Construction throws [IllegalArgumentException] when [model] does not load.
+ * Detections are serialised on the model; [close] must not overlap any other
+ * call, and a matcher it is attached to keeps the model alive. Using a closed
+ * detector throws [IllegalStateException].
+ */
+class NativeDetector(
+    model: ByteArray,
+    val inputSize: Int = 640,
+    keepAspect: Boolean = true,
+    scoreThreshold: Float = 0.25f,
+    iouThreshold: Float = 0.45f,
+    classes: Int = 0
+) : AutoCloseable {
+
+    private var handle: Long =
+        nativeCreate(model, inputSize, keepAspect, scoreThreshold, iouThreshold, classes)
+
+    init {
+        require(handle != 0L) { "NativeDetector: model did not load" }
+    }
+
+    private fun live(): Long {
+        check(handle != 0L) { "NativeDetector is closed" }
+        return handle
+    }
+
+    internal fun nativeHandle(): Long = live()
+
+    /**
+     * Runs [call] on the live handle and keeps this detector reachable until it
+     * returns, so [NativeCleaner] cannot release the handle during the call.
+     */
+    internal inline fun <T> withHandle(call: (Long) -> T): T =
+        try {
+            call(nativeHandle())
+        } finally {
+            NativeCleaner.keepAlive(this)
+        }
+
+    /** True when the model carries int8 layers. */
+    val quantized: Boolean get() = withHandle { nativeQuantized(it) }
+
+    /**
+     * Detects UI elements in [bitmap] (ARGB_8888) into [into], boxes in bitmap
+     * pixels, grouped by class and highest score first. Empty on failure.
+     */
+    fun detect(bitmap: Bitmap, into: DetectionBuffer): DetectionBuffer = withHandle { h ->
+        into.fill(
+            { out -> nativeDetect(h, bitmap, out) },
+            { out -> DetectionNativeBridge.nativeLastDetections(out) }
+        )
+    }
+
+    /** [detect] on a pooled [frame] (see [FramePool]), read in place. */
+    fun detect(frame: NativeFrame, into: DetectionBuffer): DetectionBuffer = withHandle { h ->
+        frame.withHandle { f ->
+            into.fill(
+                { out -> nativeDetectFrame(h, f, out) },
+                { out -> DetectionNativeBridge.nativeLastDetections(out) }
+            )
+        }
+    }
+
+    override fun close() {
+        val h = handle
+        if (h == 0L) return
+        handle = 0L
+        nativeDestroy(h)
+    }
+
+    private external fun nativeCreate(
+        model: ByteArray, inputSize: Int, keepAspect: Boolean, scoreThreshold: Float, iouThreshold: Float, classes: Int
+    ): Long
+    private external fun nativeDestroy(handle: Long)
+    private external fun nativeQuantized(handle: Long): Boolean
+    private external fun nativeDetect(handle: Long, bitmap: Bitmap, out: FloatArray): Int
+    private external fun nativeDetectFrame(handle: Long, frame: Long, out: FloatArray): Int
+
+    private companion object {
+        init {
+            System.loadLibrary("vision_engine")
+        }
+    }
+}
@@ -0,0 +1,90 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.graphics.Bitmap
+
+/**
+ * One reference to a frame in a [FramePool]: its RGBA pixels and grayscale, held
+ * natively and never rewritten while any reference is open. Close it as soon as
+ * the frame has been used — the buffer only returns to the pool once every
+ * reference is closed. [retain] takes another reference for a consumer that
+ * outlives this one.
+ *
+ * [close] must not overlap any other call on the same reference. Using a closed
+ * frame throws [IllegalStateException]. A reference collected without [close]
+ * is released by [NativeCleaner], which logs it as a leak, so a forgotten frame
+ * does not hold its pool buffer for good.
+ */
+class NativeFrame internal constructor(private var handle: Long) : AutoCloseable {
+
+    val width: Int
+    val height: Int
+
+    /** Position of the frame among the images its pool has taken in, from 1. */
+    val sequence: Long
+
+    /** Capture time on the clock of [android.os.SystemClock.uptimeMillis], in milliseconds. */
+    val timestampMs: Long
+
+    private val cleanable: NativeCleaner.Cleanable
+
+    init {
+        val info = nativeInfo(handle)
+        width = info[0].toInt()
+        height = info[1].toInt()
+        sequence = info[2]
+        timestampMs = info[3]
+        val h = handle
+        cleanable = NativeCleaner.register(this, "NativeFrame #$sequence") { nativeRelease(h) }
+    }
+
+    private fun live(): Long {
+        check(handle != 0L) { "NativeFrame is closed" }
+        return handle
+    }
+
+    internal fun nativeHandle(): Long = live()
+
+    /**
+     * Runs [call] on the live handle and keeps this frame reachable until it
+     * returns, so [NativeCleaner] cannot release the handle during the call.
+     */
+    internal inline fun <T> withHandle(call: (Long) -> T): T =
+        try {
+            call(nativeHandle())
+        } finally {
+            NativeCleaner.keepAlive(this)
+        }
+
+    /** Another reference to the same frame, closed independently. */
+    fun retain(): NativeFrame = NativeFrame(withHandle { nativeRetain(it) })
+
+    /** Copies the pixels into [bitmap], which must be ARGB_8888 and [width] x [height]. */
+    fun copyTo(bitmap: Bitmap): Boolean = withHandle { nativeCopyToBitmap(it, bitmap) }
+
+    /** A new ARGB_8888 bitmap holding the frame, e.g. for a snapshot. */
+    fun toBitmap(): Bitmap {
+        val bitmap = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888)
+        copyTo(bitmap)
+        return bitmap
+    }
+
+    override fun close() {
+        val h = handle
+        if (h == 0L) return
+        handle = 0L
+        cleanable.clean()
+    }
+
+    private external fun nativeInfo(frame: Long): LongArray
+    private external fun nativeRetain(frame: Long): Long
+    private external fun nativeCopyToBitmap(frame: Long, bitmap: Bitmap): Boolean
+
+    private companion object {
+        init {
+            System.loadLibrary("vision_engine")
+        }
+
+        @JvmStatic
+        private external fun nativeRelease(frame: Long)
+    }
+}
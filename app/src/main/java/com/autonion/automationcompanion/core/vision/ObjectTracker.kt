@@ -0,0 +1,70 @@
+package com.autonion.automationcompanion.core.vision
+
+/**
+ * Native multi-object tracker for detector output. Each [update] predicts every
+ * track with a constant-velocity model, gates same-class candidates through a
+ * spatial hash, assigns detections optimally (Hungarian) and keeps unmatched
+ * tracks coasting for [maxAgeMs], so elements keep their ID while a list
+ * scrolls or a detection drops out for a frame.
+ *
+ * Works on packed buffers end to end: a [DetectionBuffer] from
+ * [DetectionNativeBridge.decodeYolo] goes in, a [TrackBuffer] comes out, and no
+ * per-element objects are created. Not thread-safe; [close] must not overlap
+ * any other call. Using a closed tracker throws [IllegalStateException].
+ */
+class ObjectTracker(
+    iouThreshold: Float = 0.3f,
+    val maxAgeMs: Long = 500L
+) : AutoCloseable {
+
+    private var handle: Long = nativeCreate(iouThreshold, maxAgeMs)
+
+    private fun live(): Long {
+        check(handle != 0L) { "ObjectTracker is closed" }
+        return handle
+    }
+
+    // Runs a native call on the live handle, keeping this tracker reachable until it
+    // returns (see NativeCleaner.keepAlive).
+    private inline fun <T> withHandle(call: (Long) -> T): T =
+        try {
+            call(live())
+        } finally {
+            NativeCleaner.keepAlive(this)
+        }
+
+    /**
+     * Advances the tracker to [nowMs] with [detections] and writes the live tracks
+     * into [into]: existing tracks in their previous order, then new ones.
+     */
+    fun update(detections: DetectionBuffer, nowMs: Long, into: TrackBuffer): TrackBuffer = withHandle { h ->
+        into.fill(
+            { ints, floats -> nativeUpdate(h, detections.data, detections.count, nowMs, ints, floats) },
+            { ints, floats -> nativeTracks(h, ints, floats) }
+        )
+    }
+
+    /** Forgets every track; IDs keep increasing. */
+    fun clear() = withHandle { nativeClear(it) }
+
+    override fun close() {
+        val h = handle
+        if (h == 0L) return
+        handle = 0L
+        nativeDestroy(h)
+    }
+
+    private external fun nativeCreate(iouThreshold: Float, maxAgeMs: Long): Long
+    private external fun nativeDestroy(handle: Long)
+    private external fun nativeClear(handle: Long)
+    private external fun nativeUpdate(
+        handle: Long, detections: FloatArray, count: Int, nowMs: Long, ints: IntArray, floats: FloatArray
+    ): Int
+    private external fun nativeTracks(handle: Long, ints: IntArray, floats: FloatArray): Int
+
+    private companion object {
+        init {
+            System.loadLibrary("vision_engine")
+        }
+    }
+}
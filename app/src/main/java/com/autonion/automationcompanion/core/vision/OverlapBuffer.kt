@@ -0,0 +1,48 @@
+package com.autonion.automationcompanion.core.vision
+
+/**
+ * Reusable destination for [BoxIndex.join] output, filled natively without
+ * allocating: pair `i` occupies [RECORD_INTS] ints of [ints] (query index, box
+ * index) and [RECORD_FLOATS] float of [floats] (their IoU). Grown when a join
+ * finds more pairs than fit.
+ */
+class OverlapBuffer(capacity: Int = 64) {
+
+    var ints = IntArray(capacity * RECORD_INTS)
+        internal set
+    var floats = FloatArray(capacity * RECORD_FLOATS)
+        internal set
+
+    /** Number of valid pairs from the last fill. */
+    var count = 0
+        internal set
+
+    val capacity: Int get() = ints.size / RECORD_INTS
+
+    fun query(i: Int) = ints[i * RECORD_INTS]
+    fun box(i: Int) = ints[i * RECORD_INTS + 1]
+    fun iou(i: Int) = floats[i * RECORD_FLOATS]
+
+    /**
+     * Runs [join] into this buffer; when it reports more pairs than fit, grows
+     * and collects them with [refetch], which must not run the join again.
+     */
+    internal inline fun fill(
+        join: (IntArray, FloatArray) -> Int,
+        refetch: (IntArray, FloatArray) -> Int
+    ): OverlapBuffer {
+        var n = join(ints, floats)
+        if (n > capacity) {
+            ints = IntArray(n * RECORD_INTS)
+            floats = FloatArray(n * RECORD_FLOATS)
+            n = refetch(ints, floats)
+        }
+        count = n.coerceIn(0, capacity)
+        return this
+    }
+
+    companion object {
+        const val RECORD_INTS = 2
+        const val RECORD_FLOATS = 1
+    }
+}
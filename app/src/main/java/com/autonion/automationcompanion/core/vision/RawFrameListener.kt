@@ -0,0 +1,12 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.media.Image
+
+/**
+ * Receives each captured frame as the ImageReader's RGBA_8888 plane, before any
+ * Bitmap is made. The plane (and its direct buffer) is only valid for the
+ * duration of the call; hand it to [VisionNativeBridge.submitFrame] or copy it.
+ */
+fun interface RawFrameListener {
+    fun onFrame(plane: Image.Plane, width: Int, height: Int)
+}
@@ -0,0 +1,54 @@
+package com.autonion.automationcompanion.core.vision
+
+/**
+ * Reusable destination for [ObjectTracker] output, filled natively without
+ * allocating: track `i` occupies [RECORD_INTS] ints of [ints] (id, class, ms
+ * since last matched) and [RECORD_FLOATS] floats of [floats] (score, left, top,
+ * right, bottom) in image pixels. Grown when a frame has more tracks than fit.
+ */
+class TrackBuffer(capacity: Int = 64) {
+
+    var ints = IntArray(capacity * RECORD_INTS)
+        internal set
+    var floats = FloatArray(capacity * RECORD_FLOATS)
+        internal set
+
+    /** Number of valid tracks from the last fill. */
+    var count = 0
+        internal set
+
+    val capacity: Int get() = ints.size / RECORD_INTS
+
+    fun id(i: Int) = ints[i * RECORD_INTS]
+    fun classId(i: Int) = ints[i * RECORD_INTS + 1]
+    /** 0 when the track was matched in the last update; otherwise it is coasting. */
+    fun missedMs(i: Int) = ints[i * RECORD_INTS + 2]
+    fun score(i: Int) = floats[i * RECORD_FLOATS]
+    fun left(i: Int) = floats[i * RECORD_FLOATS + 1]
+    fun top(i: Int) = floats[i * RECORD_FLOATS + 2]
+    fun right(i: Int) = floats[i * RECORD_FLOATS + 3]
+    fun bottom(i: Int) = floats[i * RECORD_FLOATS + 4]
+
+    /**
+     * Runs [update] into this buffer; when it reports more tracks than fit, grows
+     * and collects them with [refetch], which must not advance the tracker again.
+     */
+    internal inline fun fill(
+        update: (IntArray, FloatArray) -> Int,
+        refetch: (IntArray, FloatArray) -> Int
+    ): TrackBuffer {
+        var n = update(ints, floats)
+        if (n > capacity) {
+            ints = IntArray(n * RECORD_INTS)
+            floats = FloatArray(n * RECORD_FLOATS)
+            n = refetch(ints, floats)
+        }
+        count = n.coerceIn(0, capacity)
+        return this
+    }
+
+    companion object {
+        const val RECORD_INTS = 3
+        const val RECORD_FLOATS = 5
+    }
+}
@@ -0,0 +1,247 @@
+package com.autonion.automationcompanion.core.vision
+
+import android.graphics.Bitmap
+import android.graphics.Rect
+import android.media.Image
+import java.nio.ByteBuffer
+
+/**
+ * An independent native template matcher. Unlike the process-wide set behind
+ * [VisionNativeBridge], each instance owns its templates, search config, worker
+ * threads and frame history, so a caller can register templates once and match
+ * many frames while other instances match in parallel.
+ *
+ * Calls are thread-safe, but [close] must not overlap any other call on the
+ * same instance. Using a closed matcher throws [IllegalStateException]. A
+ * matcher collected without [close] is released by [NativeCleaner], which logs
+ * it as a leak.
+ */
+class VisionMatcher : AutoCloseable {
+
+    private var handle: Long = nativeCreate()
+    private val cleanable = handle.let { h ->
+        NativeCleaner.register(this, "VisionMatcher") { nativeDestroy(h) }
+    }
+
+    private fun live(): Long {
+        check(handle != 0L) { "VisionMatcher is closed" }
+        return handle
+    }
+
+    // Runs a native call on the live handle, keeping this matcher reachable until
+    // it returns so the cleaner cannot destroy the handle under it.
+    private inline fun <T> withHandle(call: (Long) -> T): T =
+        try {
+            call(live())
+        } finally {
+            NativeCleaner.keepAlive(this)
+        }
+
+    fun addTemplate(id: Int, bitmap: Bitmap) = withHandle { nativeAddTemplate(it, id, bitmap) }
+
+    /** See [VisionNativeBridge.addTemplate] with a prior. */
+    fun addTemplate(
+        id: Int,
+        bitmap: Bitmap,
+        prior: Rect,
+        marginPx: Int = VisionNativeBridge.DEFAULT_PRIOR_MARGIN_PX
+    ) = withHandle {
+        nativeAddTemplateWithPrior(it, id, bitmap, prior.left, prior.top, prior.width(), prior.height(), marginPx)
+    }
+
+    /** See [VisionNativeBridge.addFeatureTemplate]. */
+    fun addFeatureTemplate(id: Int, bitmap: Bitmap): Boolean =
+        withHandle { nativeAddFeatureTemplate(it, id, bitmap) }
+
+    /**
+     * See [VisionNativeBridge.addPack]; with [ids] only those templates of the
+     * pack are registered.
+     */
+    fun addPack(path: String, checksum: Long, ids: IntArray? = null): Int =
+        withHandle { nativeAddPack(it, path, checksum, ids) }
+
+    fun removeTemplate(id: Int): Boolean = withHandle { nativeRemoveTemplate(it, id) }
+    fun clearTemplates() = withHandle { nativeClearTemplates(it) }
+    val templateCount: Int get() = withHandle { nativeTemplateCount(it) }
+
+    fun setSearchMode(mode: Int, pyramidFactor: Int = 4, refineCandidates: Int = 3) =
+        withHandle { nativeSetSearchMode(it, mode, pyramidFactor, refineCandidates) }
+
+    fun setDiffTile(tilePx: Int) = withHandle { nativeSetDiffTile(it, tilePx) }
+    fun setThreads(threads: Int, cpus: IntArray? = null) = withHandle { nativeSetThreads(it, threads, cpus) }
+
+    fun match(bitmap: Bitmap): Array<MatchResultNative> = withHandle { nativeMatch(it, bitmap) }
+
+    fun match(bitmap: Bitmap, into: MatchResultBuffer): MatchResultBuffer = withHandle { h ->
+        into.fill { ints, scores -> nativeMatchPacked(h, bitmap, ints, scores) }
+    }
+
+    /** See [VisionNativeBridge.match] with ids. */
+    fun match(
+        bitmap: Bitmap,
+        into: MatchResultBuffer,
+        ids: IntArray,
+        stop: Int = VisionNativeBridge.MATCH_ALL,
+        n: Int = 1,
+        instances: Int = 1
+    ): MatchResultBuffer = withHandle { h ->
+        into.fill { ints, scores -> nativeMatchTargetedPacked(h, bitmap, ids, stop, n, instances, ints, scores) }
+    }
+
+    /**
+     * Matches a pooled [frame] (see [FramePool]) in place, without converting it
+     * again. The frame is only read during the call.
+     */
+    fun match(frame: NativeFrame, into: MatchResultBuffer): MatchResultBuffer = withHandle { h ->
+        frame.withHandle { f -> into.fill { ints, scores -> nativeMatchFramePacked(h, f, ints, scores) } }
+    }
+
+    /**
+     * Blocks until [ids] appear in the frames [pool] takes in, as [stop] and [n]
+     * define it for [match]: every template with [VisionNativeBridge.MATCH_ALL],
+     * any with [VisionNativeBridge.MATCH_FIRST], [n] with
+     * [VisionNativeBridge.MATCH_ANY_N], counting hits scoring at least [minScore].
+     * The target must hold still for [stableFrames] frames in a row; a screen that
+     * stops changing with the target on it counts as holding still. Matching starts
+     * on the latest frame already in the pool and follows each new one, so this
+     * returns as soon as the target settles rather than on a polling interval.
+     *
+     * The latest frame at the call may predate whatever action led to the wait, so
+     * a quiet screen only counts as holding still once a frame captured after the
+     * call has matched.
+     *
+     * Returns true when found; false after [timeoutMs], once [pool] is closed, or
+     * once [FramePool.cancelWaits] is called on [pool]. [into] holds the results of
+     * the last frame matched either way. Call off the main thread.
+     */
+    fun waitFor(
+        pool: FramePool,
+        into: MatchResultBuffer,
+        ids: IntArray,
+        timeoutMs: Long,
+        stableFrames: Int = 1,
+        minScore: Float = VisionNativeBridge.MATCH_THRESHOLD,
+        stop: Int = VisionNativeBridge.MATCH_ALL,
+        n: Int = 1
+    ): Boolean {
+        val status = IntArray(2)
+        val atLeast = if (ids.isEmpty()) templateCount else ids.size
+        withHandle { h ->
+            pool.withHandle { p ->
+                into.fillOnce(atLeast) { ints, scores ->
+                    nativeWaitFor(
+                        h, p, ids, stop, n, minScore, timeoutMs.coerceIn(0L, Int.MAX_VALUE.toLong()).toInt(),
+                        stableFrames, ints, scores, status
+                    )
+                }
+            }
+        }
+        return status[0] != 0
+    }
+
+    fun submitFrame(plane: Image.Plane, width: Int, height: Int): Boolean =
+        withHandle { nativeSubmitFrame(it, plane.buffer, width, height, plane.rowStride, plane.pixelStride) }
+
+    /** See [VisionNativeBridge.submitFrame] with a [NativeFrame]. */
+    fun submitFrame(frame: NativeFrame): Boolean =
+        withHandle { h -> frame.withHandle { f -> nativeSubmitPooled(h, f) } }
+
+    fun matchLatest(into: MatchResultBuffer): MatchResultBuffer = withHandle { h ->
+        into.fill { ints, scores -> nativeMatchLatestPacked(h, ints, scores) }
+    }
+
+    /** See [VisionNativeBridge.matchLatest] with ids. */
+    fun matchLatest(
+        into: MatchResultBuffer,
+        ids: IntArray,
+        stop: Int = VisionNativeBridge.MATCH_ALL,
+        n: Int = 1,
+        instances: Int = 1
+    ): MatchResultBuffer = withHandle { h ->
+        into.fill { ints, scores -> nativeMatchLatestTargetedPacked(h, ids, stop, n, instances, ints, scores) }
+    }
+
+    /** See [VisionNativeBridge.setDetector]. */
+    fun setDetector(detector: NativeDetector?) = withHandle { h ->
+        if (detector == null) nativeSetDetector(h, 0L)
+        else detector.withHandle { d -> nativeSetDetector(h, d) }
+    }
+
+    /** See [VisionNativeBridge.detectLatest]. */
+    fun detectLatest(into: DetectionBuffer): DetectionBuffer = withHandle { h ->
+        into.fill(
+            { out -> nativeDetectLatest(h, out) },
+            { out -> DetectionNativeBridge.nativeLastDetections(out) }
+        )
+    }
+
+    fun lastFrameDiff(): FrameDiffStats {
+        val v = withHandle { nativeLastFrameDiff(it) }
+        return FrameDiffStats(v[0], v[1], v[2], v[3])
+    }
+
+    /** See [VisionNativeBridge.startRecording]. */
+    fun startRecording(path: String): Boolean = withHandle { nativeStartRecording(it, path) }
+
+    fun stopRecording(): Int = withHandle { nativeStopRecording(it) }
+
+    /** This matcher's counters; see [VisionNativeBridge.stats]. */
+    fun stats(): String = withHandle { nativeGetStats(it) }
+
+    fun resetStats() = withHandle { nativeResetStats(it) }
+
+    override fun close() {
+        val h = handle
+        if (h == 0L) return
+        handle = 0L
+        cleanable.clean()
+    }
+
+    private external fun nativeCreate(): Long
+    private external fun nativeAddTemplate(handle: Long, id: Int, bitmap: Bitmap)
+    private external fun nativeAddTemplateWithPrior(
+        handle: Long, id: Int, bitmap: Bitmap, x: Int, y: Int, width: Int, height: Int, margin: Int
+    )
+    private external fun nativeAddFeatureTemplate(handle: Long, id: Int, bitmap: Bitmap): Boolean
+    private external fun nativeAddPack(handle: Long, path: String, checksum: Long, ids: IntArray?): Int
+    private external fun nativeRemoveTemplate(handle: Long, id: Int): Boolean
+    private external fun nativeClearTemplates(handle: Long)
+    private external fun nativeTemplateCount(handle: Long): Int
+    private external fun nativeSetSearchMode(handle: Long, mode: Int, pyramidFactor: Int, refineCandidates: Int)
+    private external fun nativeSetDiffTile(handle: Long, tile: Int)
+    private external fun nativeSetThreads(handle: Long, threads: Int, cpus: IntArray?)
+    private external fun nativeMatch(handle: Long, bitmap: Bitmap): Array<MatchResultNative>
+    private external fun nativeMatchPacked(handle: Long, bitmap: Bitmap, ints: IntArray, scores: FloatArray): Int
+    private external fun nativeMatchTargetedPacked(
+        handle: Long, bitmap: Bitmap, ids: IntArray, stop: Int, n: Int, instances: Int, ints: IntArray, scores: FloatArray
+    ): Int
+    private external fun nativeMatchFramePacked(handle: Long, frame: Long, ints: IntArray, scores: FloatArray): Int
+    private external fun nativeSubmitFrame(
+        handle: Long, buffer: ByteBuffer, width: Int, height: Int, rowStride: Int, pixelStride: Int
+    ): Boolean
+    private external fun nativeSubmitPooled(handle: Long, frame: Long): Boolean
+    private external fun nativeMatchLatestPacked(handle: Long, ints: IntArray, scores: FloatArray): Int
+    private external fun nativeMatchLatestTargetedPacked(
+        handle: Long, ids: IntArray, stop: Int, n: Int, instances: Int, ints: IntArray, scores: FloatArray
+    ): Int
+    private external fun nativeWaitFor(
+        handle: Long, pool: Long, ids: IntArray, stop: Int, n: Int, minScore: Float, timeoutMs: Int,
+        stableFrames: Int, ints: IntArray, scores: FloatArray, status: IntArray
+    ): Int
+    private external fun nativeSetDetector(handle: Long, detector: Long)
+    private external fun nativeDetectLatest(handle: Long, out: FloatArray): Int
+    private external fun nativeLastFrameDiff(handle: Long): IntArray
+    private external fun nativeStartRecording(handle: Long, path: String): Boolean
+    private external fun nativeStopRecording(handle: Long): Int
+    private external fun nativeGetStats(handle: Long): String
+    private external fun nativeResetStats(handle: Long)
+
+    private companion object {
+        init {
+            System.loadLibrary("vision_engine")
+        }
+
+        @JvmStatic
+        private external fun nativeDestroy(handle: Long)
+    }
+}
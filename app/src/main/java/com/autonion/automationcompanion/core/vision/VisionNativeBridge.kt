@@ -1,21 +1,303 @@
 package com.autonion.automationcompanion.core.vision
 
 import android.graphics.Bitmap
+import android.graphics.Rect
+import android.media.Image
+import java.nio.ByteBuffer
 
 object VisionNativeBridge {
 
+    /** Every scale at full resolution over the whole screen. */
+    const val SEARCH_EXHAUSTIVE = 0
+
+    /**
+     * Every scale at 1/pyramidFactor resolution, then only the best candidates
+     * re-scored at full resolution. Much cheaper on large screens. Opt-in;
+     * [SEARCH_EXHAUSTIVE] is the default.
+     */
+    const val SEARCH_PYRAMID = 1
+
+    /** Targeted match: every requested template is evaluated. */
+    const val MATCH_ALL = 0
+
+    /** Targeted match: evaluation stops at the first requested template that matches. */
+    const val MATCH_FIRST = 1
+
+    /** Targeted match: evaluation stops once `n` requested templates matched. */
+    const val MATCH_ANY_N = 2
+
+    /** Score from which a template counts as matched (kMatchThreshold natively). */
+    const val MATCH_THRESHOLD = 0.75f
+
+    /** Pixels added on every side of a template's prior rectangle before searching it. */
+    const val DEFAULT_PRIOR_MARGIN_PX = 160
+
     init {
         System.loadLibrary("vision_engine")
     }
 
     external fun nativeInit(): String
     external fun nativeAddTemplate(id: Int, bitmap: Bitmap)
+    external fun nativeAddTemplateWithPrior(
+        id: Int, bitmap: Bitmap, x: Int, y: Int, width: Int, height: Int, margin: Int
+    )
+    external fun nativeAddFeatureTemplate(id: Int, bitmap: Bitmap): Boolean
     external fun nativeClearTemplates()
+    external fun nativeSetSearchMode(mode: Int, pyramidFactor: Int, refineCandidates: Int)
+    external fun nativeSetDiffTile(tile: Int)
+    external fun nativeSetThreads(threads: Int, cpus: IntArray?)
+    external fun nativePerformanceCores(): IntArray
     external fun nativeMatch(bitmap: Bitmap): Array<MatchResultNative>
+    external fun nativeMatchPacked(bitmap: Bitmap, ints: IntArray, scores: FloatArray): Int
+    external fun nativeMatchTargetedPacked(
+        bitmap: Bitmap, ids: IntArray, stop: Int, n: Int, instances: Int, ints: IntArray, scores: FloatArray
+    ): Int
+    external fun nativeSubmitFrame(
+        buffer: ByteBuffer, width: Int, height: Int, rowStride: Int, pixelStride: Int
+    ): Boolean
+    external fun nativeSubmitPooled(frame: Long): Boolean
+    external fun nativeMatchLatest(): Array<MatchResultNative>
+    external fun nativeMatchLatestPacked(ints: IntArray, scores: FloatArray): Int
+    external fun nativeMatchLatestTargetedPacked(
+        ids: IntArray, stop: Int, n: Int, instances: Int, ints: IntArray, scores: FloatArray
+    ): Int
+    external fun nativeMatchLatestSincePacked(
+        sequence: LongArray, ids: IntArray?, stop: Int, n: Int, instances: Int, ints: IntArray, scores: FloatArray
+    ): Int
+    external fun nativeClearLatest()
+
+    /**
+     * The calling thread's last packed match results, from any matcher, packed
+     * again for a buffer grown after the first fill came up short. Returns their
+     * total.
+     */
+    external fun nativeLastResultsPacked(ints: IntArray, scores: FloatArray): Int
+    external fun nativeSetDetector(detector: Long)
+    external fun nativeDetectLatest(out: FloatArray): Int
+    external fun nativeLastFrameDiff(): IntArray
+    external fun nativeStartRecording(path: String): Boolean
+    external fun nativeStopRecording(): Int
+    external fun nativeGetStats(): String
+    external fun nativeResetStats()
+    external fun nativeSetTemplateLogging(enabled: Boolean)
+    external fun nativeCompilePack(
+        path: String, ids: IntArray, bitmaps: Array<Bitmap>, priors: IntArray, margin: Int, checksum: Long
+    ): Boolean
+    external fun nativePackCurrent(path: String, checksum: Long): Boolean
+    external fun nativeAddPack(path: String, checksum: Long): Int
 
     fun init() = nativeInit()
     fun addTemplate(id: Int, bitmap: Bitmap) = nativeAddTemplate(id, bitmap)
+
+    /**
+     * Registers a template with the screen rectangle it was recorded at. Matching
+     * searches [prior] grown by [marginPx] first and only scans the whole screen
+     * when that window misses.
+     */
+    fun addTemplate(id: Int, bitmap: Bitmap, prior: Rect, marginPx: Int = DEFAULT_PRIOR_MARGIN_PX) =
+        nativeAddTemplateWithPrior(id, bitmap, prior.left, prior.top, prior.width(), prior.height(), marginPx)
+
+    /**
+     * Registers a template for keypoint matching instead of pixel correlation. It
+     * is found rotated or at scales far outside the usual +/-15%, e.g. on a screen
+     * of another density, and scores like a pixel match. Returns false when the
+     * template is too plain for keypoints (flat buttons, short text); it is then
+     * registered for pixel matching.
+     */
+    fun addFeatureTemplate(id: Int, bitmap: Bitmap): Boolean = nativeAddFeatureTemplate(id, bitmap)
     fun clearTemplates() = nativeClearTemplates()
+    fun setSearchMode(mode: Int, pyramidFactor: Int = 4, refineCandidates: Int = 3) =
+        nativeSetSearchMode(mode, pyramidFactor, refineCandidates)
+
+    /**
+     * Side in pixels of the tiles each frame is diffed in. Templates whose search
+     * area has no changed tile keep their previous result; 0 re-matches everything.
+     */
+    fun setDiffTile(tilePx: Int) = nativeSetDiffTile(tilePx)
+
+    /**
+     * Matches on [threads] native threads (the caller included); results keep
+     * their ID order. Workers are pinned to [cpus] when given, e.g.
+     * [performanceCores]. 1 matches serially on the calling thread.
+     */
+    fun setThreads(threads: Int, cpus: IntArray? = null) = nativeSetThreads(threads, cpus)
+
+    /** CPU indices of the big/prime cores, or every CPU on a homogeneous SoC. */
+    fun performanceCores(): IntArray = nativePerformanceCores()
+
     fun match(bitmap: Bitmap): Array<MatchResultNative> = nativeMatch(bitmap)
+
+    /** [match] into a reusable [MatchResultBuffer]; no per-result objects. */
+    fun match(bitmap: Bitmap, into: MatchResultBuffer): MatchResultBuffer =
+        into.fill { ints, scores -> nativeMatchPacked(bitmap, ints, scores) }
+
+    /**
+     * Matches only the templates in [ids], in that order, and returns their results
+     * in the same order; other registered templates are not touched, and an empty
+     * [ids] matches them all. With [MATCH_FIRST] or [MATCH_ANY_N] ([n] matched
+     * templates) the results end at the match that satisfied it and later
+     * templates are never matched.
+     *
+     * [instances] above 1 finds repeated elements (every "Install" button of a
+     * list) in one scan: a matched template's best result is followed by up to
+     * `instances - 1` more results with the same ID, strongest first, none
+     * overlapping another. Those searches always cover the whole screen.
+     */
+    fun match(
+        bitmap: Bitmap,
+        into: MatchResultBuffer,
+        ids: IntArray,
+        stop: Int = MATCH_ALL,
+        n: Int = 1,
+        instances: Int = 1
+    ): MatchResultBuffer =
+        into.fill { ints, scores -> nativeMatchTargetedPacked(bitmap, ids, stop, n, instances, ints, scores) }
+
+    /**
+     * Converts an RGBA_8888 ImageReader plane to grayscale straight from its direct
+     * buffer into the native latest-frame slot — no Bitmap, no RGBA copy. Row
+     * padding is handled natively. Call while the Image is still open.
+     */
+    fun submitFrame(plane: Image.Plane, width: Int, height: Int): Boolean =
+        nativeSubmitFrame(plane.buffer, width, height, plane.rowStride, plane.pixelStride)
+
+    /**
+     * Makes a pooled [frame] (see [FramePool]) the latest without copying or
+     * converting it. The matcher holds it, and its pool buffer, until the next
+     * submit.
+     */
+    fun submitFrame(frame: NativeFrame): Boolean = frame.withHandle { nativeSubmitPooled(it) }
+
+    /** Matches against the latest [submitFrame]; empty until a frame has arrived. */
+    fun matchLatest(): Array<MatchResultNative> = nativeMatchLatest()
+
+    /** [matchLatest] into a reusable [MatchResultBuffer]; no per-result objects. */
+    fun matchLatest(into: MatchResultBuffer): MatchResultBuffer =
+        into.fill { ints, scores -> nativeMatchLatestPacked(ints, scores) }
+
+    /** Targeted [matchLatest]; see [match] with [ids]. */
+    fun matchLatest(
+        into: MatchResultBuffer,
+        ids: IntArray,
+        stop: Int = MATCH_ALL,
+        n: Int = 1,
+        instances: Int = 1
+    ): MatchResultBuffer =
+        into.fill { ints, scores -> nativeMatchLatestTargetedPacked(ids, stop, n, instances, ints, scores) }
+
+    /**
+     * [matchLatest] for a loop polling on a timer: matches only when a frame was
+     * submitted after the one numbered `sequence[0]` (0 before any), and advances
+     * it to that frame's number. Returns false, with [into] emptied, when there is
+     * no newer frame, so an unchanged screen is not acted on again. Null [ids]
+     * matches every template; otherwise see [match] with `ids`.
+     */
+    fun matchLatestSince(
+        sequence: LongArray,
+        into: MatchResultBuffer,
+        ids: IntArray? = null,
+        stop: Int = MATCH_ALL,
+        n: Int = 1,
+        instances: Int = 1
+    ): Boolean {
+        val before = sequence[0]
+        into.fill { ints, scores -> nativeMatchLatestSincePacked(sequence, ids, stop, n, instances, ints, scores) }
+        return sequence[0] != before
+    }
+
+    /**
+     * Forgets the latest [submitFrame] (and the detector input made from it):
+     * [matchLatest] is empty again until the next submit, so a frame from before
+     * a pause is never acted on after it.
+     */
+    fun clearLatest() = nativeClearLatest()
+
+    /**
+     * Attaches [detector] (null detaches it): every [submitFrame] then also
+     * letterboxes the frame as its input, from the same plane and in the same
+     * call, so [detectLatest] needs no Bitmap.
+     */
+    fun setDetector(detector: NativeDetector?) =
+        if (detector == null) nativeSetDetector(0L) else detector.withHandle { nativeSetDetector(it) }
+
+    /**
+     * Detects UI elements on the latest [submitFrame] with the attached detector,
+     * into [into], boxes in frame pixels. Empty without a detector or a frame
+     * submitted since it was attached.
+     */
+    fun detectLatest(into: DetectionBuffer): DetectionBuffer =
+        into.fill(
+            { out -> nativeDetectLatest(out) },
+            { out -> DetectionNativeBridge.nativeLastDetections(out) }
+        )
+
+    /** Tiles changed and templates skipped on the most recent match. */
+    fun lastFrameDiff(): FrameDiffStats {
+        val v = nativeLastFrameDiff()
+        return FrameDiffStats(v[0], v[1], v[2], v[3])
+    }
+
+    /**
+     * Records every frame passed to [submitFrame] from now on, losslessly and
+     * delta-compressed, together with the templates registered now, to [path].
+     * Register the preset first. Replay it on a desktop with `vision_replay`.
+     */
+    fun startRecording(path: String): Boolean = nativeStartRecording(path)
+
+    /** Ends the recording; returns how many frames it holds. */
+    fun stopRecording(): Int = nativeStopRecording()
+
+    /**
+     * Engine counters since start-up or [resetStats], as JSON: per stage (lock,
+     * convert, resize, diff, features, correlate, peak, detect, marshal, frame) the
+     * sample count, mean, p50/p90/p99 and max in microseconds, one sample per
+     * frame; per template how often it was evaluated, reused and matched, its
+     * last score and its time per stage; and how often the matcher's scratch
+     * arenas grew and the bytes they hold. Always collected; reading is cheap.
+     */
+    fun stats(): String = nativeGetStats()
+
+    fun resetStats() = nativeResetStats()
+
+    /**
+     * Per-template debug lines (scores, windows, instances) in logcat. Off by
+     * default: at several templates per frame they cost more than the counters.
+     * Applies to every matcher.
+     */
+    fun setTemplateLogging(enabled: Boolean) = nativeSetTemplateLogging(enabled)
+
+    /**
+     * Writes a template pack to [path]: every bitmap preprocessed exactly as
+     * [addTemplate] would, tagged with [checksum] of the sources. [priors] holds
+     * one rectangle per template; an empty Rect means none.
+     */
+    fun compilePack(
+        path: String,
+        ids: IntArray,
+        bitmaps: Array<Bitmap>,
+        priors: Array<Rect>,
+        checksum: Long,
+        marginPx: Int = DEFAULT_PRIOR_MARGIN_PX
+    ): Boolean {
+        val rects = IntArray(priors.size * 4)
+        priors.forEachIndexed { i, r ->
+            rects[i * 4] = r.left
+            rects[i * 4 + 1] = r.top
+            rects[i * 4 + 2] = r.width()
+            rects[i * 4 + 3] = r.height()
+        }
+        return nativeCompilePack(path, ids, bitmaps, rects, marginPx, checksum)
+    }
+
+    /** True when [path] is a pack built from [checksum] by this engine version. */
+    fun isPackCurrent(path: String, checksum: Long): Boolean = nativePackCurrent(path, checksum)
+
+    /**
+     * Registers every template of the pack at [path] by memory-mapping it; no
+     * decoding or pixel copies. Returns the number added, or -1 when the pack is
+     * missing, corrupt or stale (its checksum is not [checksum]).
+     */
+    fun addPack(path: String, checksum: Long): Int = nativeAddPack(path, checksum)
+
     fun release() = nativeClearTemplates()
 }
@@ -6,6 +6,7 @@ import com.autonion.automationcompanion.features.automation_debugger.DebugLogger
 import com.autonion.automationcompanion.features.automation_debugger.data.LogCategory
 import com.autonion.automationcompanion.features.flow_automation.engine.executors.*
 import com.autonion.automationcompanion.features.flow_automation.model.*
+import com.autonion.automationcompanion.features.visual_trigger.data.VisionPackStore
 import kotlinx.coroutines.*
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
@@ -48,7 +49,7 @@ class FlowExecutionEngine(
     private val executors = mapOf<FlowNodeType, NodeExecutor>(
         FlowNodeType.START to StartNodeExecutor(appContext),
         FlowNodeType.GESTURE to GestureNodeExecutor(),
-        FlowNodeType.VISUAL_TRIGGER to VisualTriggerNodeExecutor(screenCaptureProvider),
+        FlowNodeType.VISUAL_TRIGGER to VisualTriggerNodeExecutor(screenCaptureProvider, VisionPackStore(appContext)),
         FlowNodeType.SCREEN_ML to ScreenMLNodeExecutor(appContext, screenCaptureProvider),
         FlowNodeType.DELAY to DelayNodeExecutor(),
         FlowNodeType.LAUNCH_APP to LaunchAppNodeExecutor(appContext)
@@ -78,6 +79,9 @@ class FlowExecutionEngine(
                 Log.e(TAG, "Flow execution error: ${e.message}", e)
                 DebugLogger.error(appContext, DBG_CATEGORY, "Flow Error", "Execution error: ${e.message}", TAG)
                 _state.value = FlowExecutionState.Error(null, e.message ?: "Unknown error")
+            } finally {
+                // Executors may cache native state (e.g. template matchers) per run
+                executors.values.filterIsInstance<AutoCloseable>().forEach { it.close() }
             }
         }
     }
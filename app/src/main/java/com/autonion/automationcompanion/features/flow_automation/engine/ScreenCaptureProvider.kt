@@ -5,7 +5,15 @@ import android.content.Intent
 import android.graphics.Bitmap
 import android.media.projection.MediaProjectionManager
 import android.util.Log
+import com.autonion.automationcompanion.core.vision.MatchResultBuffer
+import com.autonion.automationcompanion.core.vision.NativeFrame
+import com.autonion.automationcompanion.core.vision.VisionMatcher
+import com.autonion.automationcompanion.core.vision.VisionNativeBridge
 import com.autonion.automationcompanion.features.visual_trigger.core.VisionMediaProjection
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.coroutineScope
 import kotlinx.coroutines.flow.first
 import kotlinx.coroutines.withTimeoutOrNull
 
@@ -16,12 +24,14 @@ private const val TAG = "ScreenCaptureProvider"
  *
  * Used by VisualTriggerNodeExecutor and ScreenMLNodeExecutor to get
  * live screen frames without each executor managing its own MediaProjection.
+ * Frames come from the projection's frame pool: [captureNativeFrame] hands
+ * one out without copying it, [captureFrame] copies it into a Bitmap for
+ * APIs that need one, and [waitFor] matches each new frame natively until
+ * templates appear.
  */
 class ScreenCaptureProvider(private val context: Context) {
 
     private var projection: VisionMediaProjection? = null
-    @Volatile
-    private var latestBitmap: Bitmap? = null
     private var isStarted = false
 
     /**
@@ -49,32 +59,77 @@ class ScreenCaptureProvider(private val context: Context) {
     }
 
     /**
-     * Capture the latest screen frame. Waits up to [timeoutMs] for a frame.
-     * Returns null if no frame arrives in time.
+     * The latest screen frame, held until the caller closes it. Waits up to
+     * [timeoutMs] for a frame. Returns null if no frame arrives in time.
      */
-    suspend fun captureFrame(timeoutMs: Long = 3000L): Bitmap? {
+    suspend fun captureNativeFrame(timeoutMs: Long = 3000L): NativeFrame? {
         val vmp = projection ?: run {
             Log.e(TAG, "captureFrame called but projection is not started")
             return null
         }
         return try {
             withTimeoutOrNull(timeoutMs) {
-                vmp.screenCaptureFlow.first()
-            }
+                vmp.frameSequence.first { it != 0L }
+            } ?: return null
+            vmp.latestFrame()
         } catch (e: Exception) {
             Log.e(TAG, "Error capturing frame", e)
             null
         }
     }
 
+    /**
+     * [captureNativeFrame] copied into a new Bitmap, for APIs that take one.
+     * Returns null if no frame arrives in time.
+     */
+    suspend fun captureFrame(timeoutMs: Long = 3000L): Bitmap? =
+        captureNativeFrame(timeoutMs)?.use { it.toBitmap() }
+
+    /**
+     * Waits on an IO thread until [ids] appear on screen and hold still for
+     * [stableFrames] frames; see [VisionMatcher.waitFor]. Every captured frame is
+     * matched as it arrives, so this returns as soon as the target settles.
+     * [into] holds the last frame's results. Returns null when capture is not
+     * running.
+     *
+     * Cancelling the caller cancels the native wait through
+     * [FramePool.cancelWaits], releasing the IO thread and the pool at once.
+     */
+    suspend fun waitFor(
+        matcher: VisionMatcher,
+        into: MatchResultBuffer,
+        ids: IntArray,
+        timeoutMs: Long,
+        stableFrames: Int = 1,
+        minScore: Float = VisionNativeBridge.MATCH_THRESHOLD,
+        stop: Int = VisionNativeBridge.MATCH_ALL
+    ): Boolean? {
+        val pool = projection?.retainFramePool() ?: run {
+            Log.e(TAG, "waitFor called but projection is not started")
+            return null
+        }
+        return pool.use {
+            coroutineScope {
+                val wait = async(Dispatchers.IO) {
+                    matcher.waitFor(pool, into, ids, timeoutMs, stableFrames, minScore, stop)
+                }
+                try {
+                    wait.await()
+                } catch (e: CancellationException) {
+                    // The scope still waits for the blocked call, which this ends.
+                    pool.cancelWaits()
+                    throw e
+                }
+            }
+        }
+    }
+
     /**
      * Stop the screen capture and release resources.
      */
     fun stop() {
         projection?.stopProjection()
         projection = null
-        latestBitmap?.recycle()
-        latestBitmap = null
         isStarted = false
         Log.d(TAG, "Screen capture stopped")
     }
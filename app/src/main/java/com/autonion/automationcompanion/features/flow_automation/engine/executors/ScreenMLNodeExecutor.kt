@@ -2,6 +2,7 @@ package com.autonion.automationcompanion.features.flow_automation.engine.executo
 
 import android.content.Context
 import android.util.Log
+import com.autonion.automationcompanion.core.vision.BoxIndex
 import com.autonion.automationcompanion.features.automation_debugger.DebugLogger
 import com.autonion.automationcompanion.features.automation_debugger.data.LogCategory
 import com.autonion.automationcompanion.features.flow_automation.engine.NodeExecutor
@@ -122,13 +123,13 @@ class ScreenMLNodeExecutor(
             ?: return NodeResult.Failure("App context not available for PerceptionLayer")
 
         // 1. Capture the screen
-        val bitmap = provider.captureFrame()
+        val frame = provider.captureNativeFrame()
             ?: return NodeResult.Failure("Failed to capture screen frame for Object Detection")
 
-        // 2. Run TFLite detection
+        // 2. Run detection on the pooled frame
         val perceptionLayer = PerceptionLayer(ctx)
         try {
-            val detections = perceptionLayer.detect(bitmap)
+            val detections = frame.use { perceptionLayer.detect(it) }
             Log.d(TAG, "Object Detection: detected ${detections.size} elements")
             DebugLogger.info(ctx, LogCategory.FLOW_BUILDER, "Detection Complete", "Detected ${detections.size} UI elements", TAG)
 
@@ -184,6 +185,7 @@ class ScreenMLNodeExecutor(
             DebugLogger.info(ctx, LogCategory.FLOW_BUILDER, "ML Steps Started", "Playing back ${steps.size} automation steps", TAG)
             
             val perceptionLayer = PerceptionLayer(ctx)
+            val index = BoxIndex()
             try {
                 for (step in steps.sortedBy { it.orderIndex }) {
                     Log.d(TAG, "Executing step ${step.orderIndex}: ${step.label}")
@@ -191,22 +193,21 @@ class ScreenMLNodeExecutor(
                     // Allow UI to settle
                     kotlinx.coroutines.delay(500)
                     
-                    val bitmap = provider.captureFrame()
-                    if (bitmap == null) {
+                    val frame = provider.captureNativeFrame()
+                    if (frame == null) {
                         if (step.isOptional) continue else return NodeResult.Failure("Failed to capture screen for step ${step.label}")
                     }
                     
-                    val detections = perceptionLayer.detect(bitmap)
-                    val matches = detections.filter { it.label.equals(step.anchor.label, ignoreCase = true) }
+                    val detections = frame.use { perceptionLayer.detect(it) }
                     
                     val originalCx = (step.anchor.bounds.left + step.anchor.bounds.right) / 2f
                     val originalCy = (step.anchor.bounds.top + step.anchor.bounds.bottom) / 2f
                     
-                    val bestMatch = matches.minByOrNull { detection ->
-                        val cx = (detection.bounds.left + detection.bounds.right) / 2f
-                        val cy = (detection.bounds.top + detection.bounds.bottom) / 2f
-                        Math.hypot((cx - originalCx).toDouble(), (cy - originalCy).toDouble())
-                    }
+                    // Nearest same-label element to the saved anchor (class 1 in the index)
+                    index.build(detections.size, {
+                        if (detections[it].label.equals(step.anchor.label, ignoreCase = true)) 1 else 0
+                    }) { detections[it].bounds }
+                    val bestMatch = detections.getOrNull(index.nearest(originalCx, originalCy, classId = 1))
                     
                     if (bestMatch != null) {
                         val cx = (bestMatch.bounds.left + bestMatch.bounds.right) / 2f
@@ -232,6 +233,7 @@ class ScreenMLNodeExecutor(
                 }
             } finally {
                 perceptionLayer.close()
+                index.close()
             }
             return NodeResult.Success
         } catch (e: Exception) {
@@ -1,30 +1,110 @@
 package com.autonion.automationcompanion.features.flow_automation.engine.executors
 
 import android.graphics.BitmapFactory
+import android.graphics.Rect
 import android.util.Log
-import com.autonion.automationcompanion.core.vision.VisionNativeBridge
+import com.autonion.automationcompanion.core.vision.MatchResultBuffer
+import com.autonion.automationcompanion.core.vision.VisionMatcher
 import com.autonion.automationcompanion.features.flow_automation.engine.NodeExecutor
 import com.autonion.automationcompanion.features.flow_automation.engine.NodeResult
 import com.autonion.automationcompanion.features.flow_automation.engine.ScreenCaptureProvider
 import com.autonion.automationcompanion.features.flow_automation.model.FlowContext
 import com.autonion.automationcompanion.features.flow_automation.model.FlowNode
 import com.autonion.automationcompanion.features.flow_automation.model.VisualTriggerNode
+import com.autonion.automationcompanion.features.visual_trigger.data.VisionPackStore
 import com.autonion.automationcompanion.features.visual_trigger.models.VisionPreset
+import com.autonion.automationcompanion.features.visual_trigger.models.VisionRegion
 import com.autonion.automationcompanion.features.visual_trigger.models.ExecutionMode
 import com.autonion.automationcompanion.features.visual_trigger.service.VisionActionExecutor
 
 private const val TAG = "VisualTriggerExecutor"
 
+// How long a template may take to appear before the node (or a mandatory
+// region) fails, and the shorter wait an optional region gets before it is
+// skipped. Both stay well inside the node's own timeout.
+private const val APPEAR_TIMEOUT_MS = 3_000L
+private const val OPTIONAL_APPEAR_TIMEOUT_MS = 1_000L
+
+// Frames a match must hold still for before it is reported or tapped, so a
+// target still animating in is not hit mid-slide.
+private const val STABLE_FRAMES = 2
+
 /**
  * Executor for [VisualTriggerNode].
  *
- * Captures the current screen via [ScreenCaptureProvider], loads the template
- * image, and runs native OpenCV template matching through [VisionNativeBridge].
+ * Loads the template image and waits, through [ScreenCaptureProvider.waitFor],
+ * for native OpenCV template matching in a [VisionMatcher] to find it on the
+ * captured screen: every frame is matched as it arrives, so the node completes
+ * as soon as the target appears and settles instead of after fixed delays.
  * Writes match coordinates to [FlowContext] on success.
+ *
+ * Each template gets its own matcher, decoded and registered the first time it
+ * is used and kept until [close], so loops re-running a node only match. The
+ * matchers are private to this executor and never touch the template set of
+ * a running VisionExecutionService. Preset regions come from the preset's
+ * compiled pack in [packStore] when there is one, which maps the preprocessed
+ * templates instead of decoding every PNG.
  */
 class VisualTriggerNodeExecutor(
-    private val screenCaptureProvider: ScreenCaptureProvider? = null
-) : NodeExecutor {
+    private val screenCaptureProvider: ScreenCaptureProvider? = null,
+    private val packStore: VisionPackStore? = null
+) : NodeExecutor, AutoCloseable {
+
+    // Keyed by template (or pack) path and the ID the template is registered
+    // under, so nodes sharing an image each get a matcher knowing their ID;
+    // flows run one node at a time.
+    private val matchers = HashMap<String, VisionMatcher>()
+
+    // Compiled pack per preset ID, null when it could not be built.
+    private val packs = HashMap<String, VisionPackStore.Pack?>()
+
+    // Results of the latest match, reused across nodes.
+    private val matchBuffer = MatchResultBuffer()
+
+    /**
+     * Matcher holding the template at [path] as [id], registering it on first
+     * use. Null when the image cannot be decoded. Internal for tests.
+     */
+    internal fun matcherFor(path: String, id: Int, prior: Rect? = null): VisionMatcher? {
+        val key = "$path#$id"
+        matchers[key]?.let { return it }
+        val bitmap = BitmapFactory.decodeFile(path) ?: return null
+        val matcher = VisionMatcher()
+        try {
+            if (prior != null) matcher.addTemplate(id, bitmap, prior) else matcher.addTemplate(id, bitmap)
+        } finally {
+            bitmap.recycle()
+        }
+        matchers[key] = matcher
+        return matcher
+    }
+
+    /**
+     * Matcher holding [region] of [preset], registered from the preset's pack,
+     * or from its PNG when no pack is available.
+     */
+    private fun regionMatcher(preset: VisionPreset, region: VisionRegion): VisionMatcher? {
+        if (!packs.containsKey(preset.id)) packs[preset.id] = packStore?.ensure(preset)
+        val pack = packs[preset.id]
+        if (pack != null) {
+            val key = "${pack.path}#${region.id}"
+            matchers[key]?.let { return it }
+            val matcher = VisionMatcher()
+            if (matcher.addPack(pack.path, pack.checksum, intArrayOf(region.id)) > 0) {
+                matchers[key] = matcher
+                return matcher
+            }
+            matcher.close()
+        }
+        return matcherFor(region.templatePath, region.id, region.toRect())
+    }
+
+    /** Releases every cached matcher; called when a flow run ends. */
+    override fun close() {
+        matchers.values.forEach { it.close() }
+        matchers.clear()
+        packs.clear()
+    }
 
     override suspend fun execute(node: FlowNode, context: FlowContext): NodeResult {
         val vtNode = node as? VisualTriggerNode
@@ -43,53 +123,41 @@ class VisualTriggerNodeExecutor(
 
         Log.d(TAG, "Visual trigger: template=${vtNode.templateImagePath}, threshold=${vtNode.threshold}")
 
-        // 1. Decode the template image from disk
-        val templateBitmap = BitmapFactory.decodeFile(vtNode.templateImagePath)
+        // 1. Matcher with the template registered (decoded once per flow run)
+        // Use hashCode as integer ID for the native matcher
+        val templateId = vtNode.id.hashCode()
+        val matcher = matcherFor(vtNode.templateImagePath, templateId)
             ?: return NodeResult.Failure("Failed to decode template image: ${vtNode.templateImagePath}")
 
-        // 2. Capture the current screen
-        val screenBitmap = provider.captureFrame()
-            ?: return NodeResult.Failure("Failed to capture screen frame")
-
-        try {
-            // 3. Load template into the native bridge with a unique ID
-            // Use hashCode as integer ID for the native bridge
-            val templateId = vtNode.id.hashCode()
-            VisionNativeBridge.nativeClearTemplates()
-            VisionNativeBridge.addTemplate(templateId, templateBitmap)
-
-            // 4. Run native template matching
-            val results = VisionNativeBridge.match(screenBitmap)
-
-            // 5. Find our template result
-            val match = results.firstOrNull { it.id == templateId }
-
-            if (match != null && match.matched && match.score >= vtNode.threshold) {
-                Log.d(TAG, "  ✓ Match found: score=${match.score}, at=(${match.x},${match.y}), size=${match.width}x${match.height}")
-
-                // Write match coordinates to FlowContext
-                val cx = match.x + match.width / 2
-                val cy = match.y + match.height / 2
-                context.put("${vtNode.outputContextKey}_found", true)
-                context.put("${vtNode.outputContextKey}_x", cx)
-                context.put("${vtNode.outputContextKey}_y", cy)
-                context.put("${vtNode.outputContextKey}_width", match.width)
-                context.put("${vtNode.outputContextKey}_height", match.height)
-                context.put("${vtNode.outputContextKey}_score", match.score)
-                context.put(vtNode.outputContextKey, "${cx},${cy}")
-
-                return NodeResult.Success
-            } else {
-                val score = match?.score ?: 0f
-                Log.d(TAG, "  ✗ No match above threshold (score=$score, need≥${vtNode.threshold})")
-                context.put("${vtNode.outputContextKey}_found", false)
-                context.put(vtNode.outputContextKey, "not_found")
-                return NodeResult.Failure("Template not found on screen (best score: $score)")
-            }
-        } finally {
-            templateBitmap.recycle()
-            // Don't recycle screenBitmap — it's managed by the VisionMediaProjection flow
-            VisionNativeBridge.nativeClearTemplates()
+        // 2. Match captured frames as they arrive until the template settles
+        val found = provider.waitFor(
+            matcher, matchBuffer, intArrayOf(templateId), APPEAR_TIMEOUT_MS, STABLE_FRAMES, vtNode.threshold
+        ) ?: return NodeResult.Failure("Failed to capture screen frame")
+
+        // 3. Find our template result
+        val match = matchBuffer.indexOfId(templateId).takeIf { it >= 0 }?.let { matchBuffer[it] }
+
+        if (found && match != null && match.matched && match.score >= vtNode.threshold) {
+            Log.d(TAG, "  ✓ Match found: score=${match.score}, at=(${match.x},${match.y}), size=${match.width}x${match.height}")
+
+            // Write match coordinates to FlowContext
+            val cx = match.x + match.width / 2
+            val cy = match.y + match.height / 2
+            context.put("${vtNode.outputContextKey}_found", true)
+            context.put("${vtNode.outputContextKey}_x", cx)
+            context.put("${vtNode.outputContextKey}_y", cy)
+            context.put("${vtNode.outputContextKey}_width", match.width)
+            context.put("${vtNode.outputContextKey}_height", match.height)
+            context.put("${vtNode.outputContextKey}_score", match.score)
+            context.put(vtNode.outputContextKey, "${cx},${cy}")
+
+            return NodeResult.Success
+        } else {
+            val score = match?.score ?: 0f
+            Log.d(TAG, "  ✗ No match above threshold (score=$score, need≥${vtNode.threshold})")
+            context.put("${vtNode.outputContextKey}_found", false)
+            context.put(vtNode.outputContextKey, "not_found")
+            return NodeResult.Failure("Template not found on screen (best score: $score)")
         }
     }
 
@@ -101,8 +169,8 @@ class VisualTriggerNodeExecutor(
             var anyRegionMatched = false
             
             for (region in preset.regions) {
-                val templateBitmap = BitmapFactory.decodeFile(region.templatePath)
-                if (templateBitmap == null) {
+                val matcher = regionMatcher(preset, region)
+                if (matcher == null) {
                     Log.e(TAG, "Failed to decode region template: ${region.templatePath}")
                     if (preset.executionMode == ExecutionMode.MANDATORY_SEQUENTIAL) {
                         return NodeResult.Failure("Failed to decode region template")
@@ -110,58 +178,48 @@ class VisualTriggerNodeExecutor(
                     continue
                 }
                 
-                // Allow UI to update
-                kotlinx.coroutines.delay(200)
-                
-                val screenBitmap = provider.captureFrame()
-                if (screenBitmap == null) {
-                    templateBitmap.recycle()
-                    return NodeResult.Failure("Failed to capture screen frame")
+                // Wait for the region to appear and settle; the previous region's
+                // action has usually started a transition
+                val timeoutMs = if (preset.executionMode == ExecutionMode.MANDATORY_SEQUENTIAL) {
+                    APPEAR_TIMEOUT_MS
+                } else {
+                    OPTIONAL_APPEAR_TIMEOUT_MS
                 }
+                val found = provider.waitFor(
+                    matcher, matchBuffer, intArrayOf(region.id), timeoutMs, STABLE_FRAMES, node.threshold
+                ) ?: return NodeResult.Failure("Failed to capture screen frame")
+                val match = matchBuffer.indexOfId(region.id).takeIf { it >= 0 }?.let { matchBuffer[it] }
                 
-                try {
-                    VisionNativeBridge.nativeClearTemplates()
-                    VisionNativeBridge.addTemplate(region.id, templateBitmap)
-                    val results = VisionNativeBridge.match(screenBitmap)
-                    val match = results.firstOrNull { it.id == region.id }
+                if (found && match != null && match.matched && match.score >= node.threshold) {
+                    val cx = match.x + match.width / 2f
+                    val cy = match.y + match.height / 2f
+                    Log.d(TAG, "Region ${region.id} matched at ($cx, $cy) score: ${match.score}")
+                    
+                    anyRegionMatched = true
+                    context.put("${node.outputContextKey}_found", true)
+                    context.put("${node.outputContextKey}_x", cx)
+                    context.put("${node.outputContextKey}_y", cy)
+                    context.put("${node.outputContextKey}_width", match.width)
+                    context.put("${node.outputContextKey}_height", match.height)
+                    context.put("${node.outputContextKey}_score", match.score)
+                    context.put(node.outputContextKey, "${cx},${cy}")
                     
-                    if (match != null && match.matched && match.score >= node.threshold) {
-                        val cx = match.x + match.width / 2f
-                        val cy = match.y + match.height / 2f
-                        Log.d(TAG, "Region ${region.id} matched at ($cx, $cy) score: ${match.score}")
-                        
-                        anyRegionMatched = true
-                        context.put("${node.outputContextKey}_found", true)
-                        context.put("${node.outputContextKey}_x", cx)
-                        context.put("${node.outputContextKey}_y", cy)
-                        context.put("${node.outputContextKey}_width", match.width)
-                        context.put("${node.outputContextKey}_height", match.height)
-                        context.put("${node.outputContextKey}_score", match.score)
-                        context.put(node.outputContextKey, "${cx},${cy}")
-                        
-                        if (preset.executionMode != ExecutionMode.DETECT_ONLY) {
-                            val success = VisionActionExecutor.execute(region.action, android.graphics.PointF(cx, cy))
-                            if (!success) {
-                                Log.w(TAG, "Failed to execute action for region ${region.id}")
-                            }
-                        } else {
-                            Log.d(TAG, "DETECT_ONLY mode: Skipping action execution for region ${region.id}")
+                    if (preset.executionMode != ExecutionMode.DETECT_ONLY) {
+                        val success = VisionActionExecutor.execute(region.action, android.graphics.PointF(cx, cy))
+                        if (!success) {
+                            Log.w(TAG, "Failed to execute action for region ${region.id}")
                         }
-                        
-                        // Add delay to let UI settle before next region
-                        kotlinx.coroutines.delay(500)
                     } else {
-                        Log.d(TAG, "Region ${region.id} not found above threshold")
-                        context.put("${node.outputContextKey}_found", false)
-                        
-                        if (preset.executionMode == ExecutionMode.MANDATORY_SEQUENTIAL) {
-                            return NodeResult.Failure("Mandatory region ${region.id} not found")
-                        }
-                        // OPTIONAL_SEQUENTIAL and DETECT_ONLY: continue to next region
+                        Log.d(TAG, "DETECT_ONLY mode: Skipping action execution for region ${region.id}")
+                    }
+                } else {
+                    Log.d(TAG, "Region ${region.id} not found above threshold")
+                    context.put("${node.outputContextKey}_found", false)
+                    
+                    if (preset.executionMode == ExecutionMode.MANDATORY_SEQUENTIAL) {
+                        return NodeResult.Failure("Mandatory region ${region.id} not found")
                     }
-                } finally {
-                    templateBitmap.recycle()
-                    VisionNativeBridge.nativeClearTemplates()
+                    // OPTIONAL_SEQUENTIAL and DETECT_ONLY: continue to next region
                 }
             }
             
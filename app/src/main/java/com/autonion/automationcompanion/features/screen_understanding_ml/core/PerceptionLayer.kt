@@ -4,15 +4,21 @@ import android.content.Context
 import android.graphics.Bitmap
 import android.graphics.RectF
 import android.util.Log
+import com.autonion.automationcompanion.core.vision.BoxIndex
+import com.autonion.automationcompanion.core.vision.DetectionBuffer
+import com.autonion.automationcompanion.core.vision.DetectionNativeBridge
+import com.autonion.automationcompanion.core.vision.LetterboxTransform
+import com.autonion.automationcompanion.core.vision.NativeDetector
+import com.autonion.automationcompanion.core.vision.NativeFrame
+import com.autonion.automationcompanion.core.vision.OverlapBuffer
 import com.autonion.automationcompanion.features.automation_debugger.DebugLogger
 import com.autonion.automationcompanion.features.automation_debugger.data.LogCategory
 import com.autonion.automationcompanion.features.screen_understanding_ml.model.UIElement
 import org.tensorflow.lite.Interpreter
 import org.tensorflow.lite.gpu.GpuDelegate
-import org.tensorflow.lite.support.common.ops.NormalizeOp
-import org.tensorflow.lite.support.image.ImageProcessor
-import org.tensorflow.lite.support.image.TensorImage
-import org.tensorflow.lite.support.image.ops.ResizeOp
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.FloatBuffer
 import java.util.UUID
 
 class PerceptionLayer(private val context: Context) {
@@ -23,11 +29,26 @@ class PerceptionLayer(private val context: Context) {
 
     private var interpreter: Interpreter? = null
     private val modelFilename = "best_float16.tflite"
+    // The same model for the native OpenCV DNN backend used on CPU-only devices,
+    // int8-quantised first; either may be absent from the assets.
+    private val onnxModelFilenames = listOf("best_int8.onnx", "best.onnx")
+    private var nativeDetector: NativeDetector? = null
     private val labels = listOf("Button", "Input", "Image", "Toggle", "Text")
     
     // Model specific constants
     private val inputSize = 640 
     private val confThreshold = 0.25f
+    private val iouThreshold = 0.45f
+    // Letterboxing keeps tall phone screens undistorted, as the model was trained
+    private val keepAspect = true
+
+    // Reused across frames; guarded by [lock] like the interpreter.
+    private var inputBuffer: ByteBuffer? = null
+    private var outputBuffer: ByteBuffer? = null
+    private val transform = LetterboxTransform()
+    private val detectionBuffer = DetectionBuffer()
+    // Pooled frames are copied here for the TFLite path, one bitmap reused
+    private var frameBitmap: Bitmap? = null
 
     private var gpuDelegate: GpuDelegate? = null
 
@@ -63,6 +84,8 @@ class PerceptionLayer(private val context: Context) {
             Log.w("PerceptionLayer", "GPU delegate failed, falling back to CPU", e)
             gpuDelegate?.close()
             gpuDelegate = null
+            nativeDetector = loadNativeDetector()
+            if (nativeDetector != null) return
             try {
                 val cpuOptions = Interpreter.Options().apply {
                     setNumThreads(4)
@@ -76,6 +99,28 @@ class PerceptionLayer(private val context: Context) {
         }
     }
 
+    /**
+     * Without a GPU delegate, the ONNX model run natively (int8 when shipped) beats
+     * the TFLite CPU interpreter and reads the frame's pixels in place.
+     */
+    private fun loadNativeDetector(): NativeDetector? {
+        for (name in onnxModelFilenames) {
+            val bytes = try {
+                context.assets.open(name).use { it.readBytes() }
+            } catch (e: java.io.IOException) {
+                continue
+            }
+            try {
+                val detector = NativeDetector(bytes, inputSize, keepAspect, confThreshold, iouThreshold, labels.size)
+                Log.i(TAG, "Model $name loaded with the native CPU backend (int8=${detector.quantized})")
+                return detector
+            } catch (e: IllegalArgumentException) {
+                Log.w(TAG, "Native backend could not load $name", e)
+            }
+        }
+        return null
+    }
+
     @Throws(java.io.IOException::class)
     private fun loadModelFile(context: Context, modelFilename: String): java.nio.MappedByteBuffer {
         val fileDescriptor = context.assets.openFd(modelFilename)
@@ -89,187 +134,145 @@ class PerceptionLayer(private val context: Context) {
     private val lock = Any()
     private var isClosed = false
 
-    fun detect(bitmap: Bitmap): List<UIElement> {
+    /**
+     * Detects UI elements in [bitmap]. With a [tracker], the packed detections go
+     * straight into it and the tracked elements (stable IDs, coasting tracks) are
+     * returned instead of the raw ones.
+     */
+    fun detect(bitmap: Bitmap, tracker: TemporalTracker? = null): List<UIElement> {
         synchronized(lock) {
-            if (isClosed || interpreter == null) return emptyList()
+            if (isClosed) return emptyList()
+            nativeDetector?.let { return detectNative(it, bitmap, tracker) }
+            if (interpreter == null) return emptyList()
             
-            // 1. Preprocess
-            val imageProcessor = ImageProcessor.Builder()
-                .add(ResizeOp(inputSize, inputSize, ResizeOp.ResizeMethod.BILINEAR))
-                .add(NormalizeOp(0f, 255f))
-                .build()
-    
-            var tensorImage = TensorImage(org.tensorflow.lite.DataType.FLOAT32)
-            tensorImage.load(bitmap)
-            tensorImage = imageProcessor.process(tensorImage)
+            // 1. Preprocess: letterbox and normalise natively into the reused
+            // input buffer, in the tensor's own float16/float32 layout
+            val input = prepareInput(bitmap) ?: return emptyList()
     
             // 2. Inference
             val outputTensor = interpreter!!.getOutputTensor(0)
             val outputShape = outputTensor.shape() 
             
-            // Create output array — handle different output ranks safely
-            val outputArray = if (outputShape.size == 3) {
-                 Array(outputShape[0]) { Array(outputShape[1]) { FloatArray(outputShape[2]) } }
-            } else {
+            // Output stays in a reused direct buffer so the native decoder reads
+            // the tensor in place — handle different output ranks safely
+            if (outputShape.size != 3) {
                  android.util.Log.e("PerceptionLayer", "Unexpected output rank: ${outputShape.size}")
                  return emptyList()
             }
+            val numChannels = outputShape[1]
+            val numAnchors = outputShape[2]
+            val floats = outputShape[0] * numChannels * numAnchors
+            val output = outputBuffer?.takeIf { it.capacity() == floats * 4 }
+                ?: ByteBuffer.allocateDirect(floats * 4).order(ByteOrder.nativeOrder()).also { outputBuffer = it }
+            output.rewind()
     
             try {
-                interpreter!!.run(tensorImage.buffer, outputArray)
+                interpreter!!.run(input, output)
             } catch (e: Exception) {
                 android.util.Log.e("PerceptionLayer", "Error running inference", e)
                 return emptyList()
             }
     
             // 3. Postprocess
-            return processOutput(outputArray, bitmap.width, bitmap.height)
+            output.rewind()
+            return processOutput(output.asFloatBuffer(), numChannels, numAnchors, bitmap.width, bitmap.height, tracker)
         }
     }
 
-    private fun processOutput(output: Array<Array<FloatArray>>, imgWidth: Int, imgHeight: Int): List<UIElement> {
-        val elements = mutableListOf<UIElement>()
-        val outputData = output[0] // Shape: [numChannels, numAnchors]
-        
-        val numChannels = outputData.size
-        val numAnchors = outputData[0].size
-
-        android.util.Log.d("PerceptionLayer", "Output: Channels=$numChannels, Anchors=$numAnchors, Image=${imgWidth}x${imgHeight}")
-
-        // Auto-detect coordinate format by sampling high-confidence detections
-        // Normalized: all values typically < 2.0;  Pixel-space (640): values > 10
-        var maxCx = 0f
-        var maxCy = 0f
-        var sampledCount = 0
-        for (i in 0 until numAnchors) {
-            var score = 0f
-            for (c in 4 until numChannels) { score = maxOf(score, outputData[c][i]) }
-            if (score > confThreshold) {
-                maxCx = maxOf(maxCx, outputData[0][i])
-                maxCy = maxOf(maxCy, outputData[1][i])
-                sampledCount++
-                if (sampledCount >= 20) break
-            }
+    /**
+     * [detect] on a pooled capture [frame]. The native detector reads it in place;
+     * the TFLite path copies it into one reused bitmap.
+     */
+    fun detect(frame: NativeFrame, tracker: TemporalTracker? = null): List<UIElement> {
+        synchronized(lock) {
+            if (isClosed) return emptyList()
+            nativeDetector?.let { return toElements(it.detect(frame, detectionBuffer), tracker) }
+            val bitmap = frameBitmap?.takeIf { frame.copyTo(it) }
+                ?: frame.toBitmap().also { frameBitmap = it }
+            return detect(bitmap, tracker)
         }
-        // If max coordinate is < 3.0, it's definitely normalized 
-        // (pixel space at 640 input would have values in 10-640 range)
-        val isNormalized = maxCx < 3.0f && maxCy < 3.0f
-        android.util.Log.d("PerceptionLayer", "Coord format: maxCx=$maxCx, maxCy=$maxCy, sampled=$sampledCount → ${if (isNormalized) "NORMALIZED" else "PIXEL_SPACE"}")
-
-        for (i in 0 until numAnchors) {
-            // Channel layout: 0:cx, 1:cy, 2:w, 3:h, 4..N:class_scores
-            var maxScore = 0f
-            var classId = -1
-            
-            for (c in 4 until numChannels) {
-                val score = outputData[c][i]
-                if (score > maxScore) {
-                    maxScore = score
-                    classId = c - 4
-                }
-            }
-
-            if (maxScore > confThreshold) {
-                val cx = outputData[0][i]
-                val cy = outputData[1][i]
-                val w = outputData[2][i]
-                val h = outputData[3][i]
+    }
 
-                val left: Float
-                val top: Float
-                val right: Float
-                val bottom: Float
+    private fun detectNative(detector: NativeDetector, bitmap: Bitmap, tracker: TemporalTracker?): List<UIElement> {
+        // The native side reads ARGB_8888 pixels in place; other configs are converted once
+        val source = if (bitmap.config == Bitmap.Config.ARGB_8888) bitmap
+            else bitmap.copy(Bitmap.Config.ARGB_8888, false) ?: return emptyList()
+        try {
+            return toElements(detector.detect(source, detectionBuffer), tracker)
+        } finally {
+            if (source !== bitmap) source.recycle()
+        }
+    }
 
-                if (isNormalized) {
-                    // Normalized (0-1) → multiply by image dimensions directly
-                    left = (cx - w / 2) * imgWidth
-                    top = (cy - h / 2) * imgHeight
-                    right = (cx + w / 2) * imgWidth
-                    bottom = (cy + h / 2) * imgHeight
-                } else {
-                    // Pixel space (0-inputSize) → scale from inputSize to image dimensions
-                    val scaleX = imgWidth.toFloat() / inputSize.toFloat()
-                    val scaleY = imgHeight.toFloat() / inputSize.toFloat()
-                    left = (cx - w / 2) * scaleX
-                    top = (cy - h / 2) * scaleY
-                    right = (cx + w / 2) * scaleX
-                    bottom = (cy + h / 2) * scaleY
-                }
+    private fun prepareInput(bitmap: Bitmap): ByteBuffer? {
+        val inputTensor = interpreter!!.getInputTensor(0)
+        val floatBytes = inputSize * inputSize * 3 * 4
+        val half = inputTensor.numBytes() == floatBytes / 2
+        val bytes = if (half) floatBytes / 2 else floatBytes
+        val input = inputBuffer?.takeIf { it.capacity() == bytes }
+            ?: ByteBuffer.allocateDirect(bytes).order(ByteOrder.nativeOrder()).also { inputBuffer = it }
 
-                if (classId in labels.indices) {
-                    elements.add(
-                        UIElement(
-                            id = UUID.randomUUID().toString(),
-                            label = labels[classId],
-                            confidence = maxScore,
-                            bounds = RectF(left, top, right, bottom)
-                        )
-                    )
-                }
+        // The native side reads ARGB_8888 pixels in place; other configs are converted once
+        val source = if (bitmap.config == Bitmap.Config.ARGB_8888) bitmap
+            else bitmap.copy(Bitmap.Config.ARGB_8888, false) ?: return null
+        try {
+            if (!DetectionNativeBridge.letterbox(source, inputSize, input, transform, keepAspect, half)) {
+                Log.e(TAG, "Letterbox failed for ${bitmap.width}x${bitmap.height} ${bitmap.config}")
+                return null
             }
+        } finally {
+            if (source !== bitmap) source.recycle()
         }
-        
-        android.util.Log.d("PerceptionLayer", "Found ${elements.size} candidates before NMS")
-        
-        // B7 fix: Per-class NMS to avoid suppressing across different classes
-        val nmsElements = perClassNMS(elements)
-        android.util.Log.d("PerceptionLayer", "After NMS: ${nmsElements.size} elements")
-        if (nmsElements.isNotEmpty()) {
-            val first = nmsElements[0]
-            android.util.Log.d("PerceptionLayer", "Sample element: label=${first.label}, conf=${first.confidence}, bounds=${first.bounds}")
-        }
-        return nmsElements
+        input.rewind()
+        return input
     }
 
     /**
-     * Performs NMS per-class to avoid a high-confidence "Button" suppressing
-     * a lower-confidence "Input" that happens to overlap.
+     * Decodes the `[numChannels][numAnchors]` head natively (class argmax,
+     * threshold and per-class NMS, so a high-confidence "Button" never
+     * suppresses an overlapping "Input") and wraps only the survivors, or the
+     * tracks they update.
      */
-    private fun perClassNMS(candidates: List<UIElement>, iouThreshold: Float = 0.45f): List<UIElement> {
-        if (candidates.isEmpty()) return emptyList()
-        
-        val result = mutableListOf<UIElement>()
-        // Group by class label, then NMS each group independently
-        val grouped = candidates.groupBy { it.label }
-        for ((_, classCandidates) in grouped) {
-            result.addAll(simpleNMS(classCandidates, iouThreshold))
-        }
-        return result
-    }
+    private fun processOutput(
+        output: FloatBuffer, numChannels: Int, numAnchors: Int, imgWidth: Int, imgHeight: Int,
+        tracker: TemporalTracker?
+    ): List<UIElement> {
+        android.util.Log.d("PerceptionLayer", "Output: Channels=$numChannels, Anchors=$numAnchors, Image=${imgWidth}x${imgHeight}")
 
-    private fun simpleNMS(candidates: List<UIElement>, iouThreshold: Float = 0.45f): List<UIElement> {
-        if (candidates.isEmpty()) return emptyList()
-        
-        val sorted = candidates.sortedByDescending { it.confidence }
-        val selected = mutableListOf<UIElement>()
-        
-        for (candidate in sorted) {
-            var shouldSelect = true
-            for (existing in selected) {
-                if (calculateIoU(candidate.bounds, existing.bounds) > iouThreshold) {
-                    shouldSelect = false
-                    break
-                }
-            }
-            if (shouldSelect) {
-                selected.add(candidate)
-            }
-        }
-        return selected
+        val detections = DetectionNativeBridge.decodeYolo(
+            output, numChannels, numAnchors, imgWidth, imgHeight, detectionBuffer,
+            inputSize = inputSize,
+            scoreThreshold = confThreshold,
+            iouThreshold = iouThreshold,
+            classes = labels.size,
+            transform = transform
+        )
+        return toElements(detections, tracker)
     }
-    
-    private fun calculateIoU(boxA: RectF, boxB: RectF): Float {
-        val xA = maxOf(boxA.left, boxB.left)
-        val yA = maxOf(boxA.top, boxB.top)
-        val xB = minOf(boxA.right, boxB.right)
-        val yB = minOf(boxA.bottom, boxB.bottom) 
 
-        val interArea = maxOf(0f, xB - xA) * maxOf(0f, yB - yA)
-        val boxAArea = (boxA.right - boxA.left) * (boxA.bottom - boxA.top)
-        val boxBArea = (boxB.right - boxB.left) * (boxB.bottom - boxB.top)
+    /** Wraps decoded detections as elements, or as the tracks they update. */
+    private fun toElements(detections: DetectionBuffer, tracker: TemporalTracker?): List<UIElement> {
+        if (tracker != null) {
+            return tracker.update(detections, labels)
+        }
+        val elements = ArrayList<UIElement>(detections.count)
+        for (i in 0 until detections.count) {
+            elements.add(
+                UIElement(
+                    id = UUID.randomUUID().toString(),
+                    label = labels[detections.classId(i)],
+                    confidence = detections.score(i),
+                    bounds = RectF(detections.left(i), detections.top(i), detections.right(i), detections.bottom(i))
+                )
+            )
+        }
 
-        val unionArea = boxAArea + boxBArea - interArea
-        return if (unionArea > 0) interArea / unionArea else 0f
+        android.util.Log.d("PerceptionLayer", "After NMS: ${elements.size} elements")
+        if (elements.isNotEmpty()) {
+            val first = elements[0]
+            android.util.Log.d("PerceptionLayer", "Sample element: label=${first.label}, conf=${first.confidence}, bounds=${first.bounds}")
+        }
+        return elements
     }
 
     /**
@@ -294,23 +297,22 @@ class PerceptionLayer(private val context: Context) {
 
             Log.d(TAG, "OCR found ${ocrResult.blocks.size} text blocks to match against ${elements.size} elements")
 
-            // 3. For each element, find overlapping OCR text
-            return elements.map { element ->
-                val matchingTexts = ocrResult.blocks
-                    .filter { block ->
-                        block.bounds != null && calculateIoU(element.bounds, block.bounds) > 0.05f
-                    }
-                    .sortedByDescending { block ->
-                        calculateIoU(element.bounds, block.bounds!!)
-                    }
-
-                if (matchingTexts.isNotEmpty()) {
-                    val text = matchingTexts.joinToString(" ") { it.text }
-                    element.copy(text = text)
-                } else {
-                    element
+            // 3. For each element, join the texts of the OCR blocks overlapping it,
+            // strongest overlap first, through a spatial index of the blocks
+            val blocks = ocrResult.blocks.filter { it.bounds != null }
+            val texts = arrayOfNulls<String>(elements.size)
+            BoxIndex().use { index ->
+                index.build(blocks.size, { 0 }) { blocks[it].bounds!! }
+                val pairs = index.join(elements.size, { elements[it].bounds }, 0.05f, OverlapBuffer())
+                for (k in 0 until pairs.count) {
+                    val e = pairs.query(k)
+                    val text = blocks[pairs.box(k)].text
+                    texts[e] = texts[e]?.let { "$it $text" } ?: text
                 }
             }
+            return elements.mapIndexed { i, element ->
+                texts[i]?.let { element.copy(text = it) } ?: element
+            }
         } catch (e: Exception) {
             Log.w(TAG, "OCR enrichment failed, returning elements without text", e)
             return elements
@@ -324,8 +326,12 @@ class PerceptionLayer(private val context: Context) {
             isClosed = true
             interpreter?.close()
             interpreter = null
+            nativeDetector?.close()
+            nativeDetector = null
             gpuDelegate?.close()
             gpuDelegate = null
+            frameBitmap?.recycle()
+            frameBitmap = null
         }
     }
 }
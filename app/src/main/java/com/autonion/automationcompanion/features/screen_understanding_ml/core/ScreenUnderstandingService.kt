@@ -11,7 +11,6 @@ import android.content.Intent
 import android.content.pm.ServiceInfo
 import android.graphics.Bitmap
 import android.graphics.PointF
-import android.graphics.RectF
 import android.media.projection.MediaProjectionManager
 import android.os.Build
 import android.os.IBinder
@@ -19,6 +18,7 @@ import android.util.Log
 import android.widget.Toast
 import androidx.core.app.NotificationCompat
 import com.autonion.automationcompanion.R
+import com.autonion.automationcompanion.core.vision.BoxIndex
 import com.autonion.automationcompanion.features.screen_understanding_ml.logic.ActionExecutor
 import com.autonion.automationcompanion.features.screen_understanding_ml.logic.PresetRepository
 import com.autonion.automationcompanion.features.screen_understanding_ml.model.AutomationPreset
@@ -36,9 +36,13 @@ import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.SupervisorJob
 import kotlinx.coroutines.cancel
 import kotlinx.coroutines.delay
+import kotlinx.coroutines.channels.BufferOverflow
+import kotlinx.coroutines.flow.MutableSharedFlow
 import kotlinx.coroutines.flow.collect
+import kotlinx.coroutines.flow.first
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
+import kotlinx.coroutines.withTimeoutOrNull
 import java.io.File
 import java.io.FileOutputStream
 import java.util.UUID
@@ -71,10 +75,11 @@ class ScreenUnderstandingService : Service() {
     // Accumulated steps from multiple snaps
     private val accumulatedSteps: MutableList<AutomationStep> = mutableListOf()
 
-    @Volatile
-    private var latestElements: List<UIElement> = emptyList()
-    @Volatile
-    private var latestBitmap: Bitmap? = null
+    // Every tracked frame, latest replayed. Not a StateFlow: UIElement equality is
+    // by ID, so a frame where elements only moved would be conflated away.
+    private val latestElements = MutableSharedFlow<List<UIElement>>(
+        replay = 1, onBufferOverflow = BufferOverflow.DROP_OLDEST
+    )
     @Volatile
     private var isPlaying = false
 
@@ -102,6 +107,7 @@ class ScreenUnderstandingService : Service() {
         overlay?.dismiss()
         mediaProjectionCore?.stopProjection()
         perceptionLayer?.close()
+        temporalTracker?.close()
         super.onDestroy()
     }
 
@@ -207,6 +213,7 @@ class ScreenUnderstandingService : Service() {
         overlay?.dismiss()
         mediaProjectionCore?.stopProjection()
         perceptionLayer?.close()
+        temporalTracker?.close()
 
         val metrics = resources.displayMetrics
 
@@ -256,18 +263,19 @@ class ScreenUnderstandingService : Service() {
         mediaProjectionCore?.startProjection(resultCode, data, metrics.widthPixels, metrics.heightPixels, metrics.densityDpi)
 
         scope.launch {
-            mediaProjectionCore?.screenCaptureFlow?.collect { bitmap ->
-                Log.d(TAG, "Frame received: ${bitmap.width}x${bitmap.height}")
-
-                // Store a copy of the latest bitmap for snap capture
-                latestBitmap = bitmap.copy(bitmap.config ?: Bitmap.Config.ARGB_8888, false)
-
-                // Use lightweight TFLite detection for live frames
+            mediaProjectionCore?.frameSequence?.collect { sequence ->
+                if (sequence == 0L) return@collect
+                // The pooled frame is only held while it is detected on; snaps
+                // read the latest one from the pool instead of a per-frame copy
+                val frame = mediaProjectionCore?.latestFrame() ?: return@collect
+                Log.d(TAG, "Frame received: ${frame.width}x${frame.height}")
+
+                // Use lightweight detection for live frames
                 // OCR is too expensive for every frame — use detectWithOcr() on-demand instead
-                val detections = perceptionLayer?.detect(bitmap) ?: emptyList()
-                val tracked = temporalTracker?.update(detections) ?: emptyList()
+                // Detections go to the tracker packed, without per-element objects
+                val tracked = frame.use { perceptionLayer?.detect(it, temporalTracker) } ?: emptyList()
 
-                latestElements = tracked
+                latestElements.tryEmit(tracked)
 
                 withContext(Dispatchers.Main) {
                     overlay?.updateElements(tracked)
@@ -277,8 +285,9 @@ class ScreenUnderstandingService : Service() {
     }
 
     private fun captureSnapshot() {
-        Log.d(TAG, "Snap clicked, latestBitmap=${latestBitmap != null}")
-        val bitmap = latestBitmap
+        // Copied out of the pool only now, when a snap is taken
+        val bitmap = mediaProjectionCore?.latestFrame()?.use { it.toBitmap() }
+        Log.d(TAG, "Snap clicked, frame=${bitmap != null}")
         if (bitmap != null) {
             Toast.makeText(this, "Capturing Snapshot...", Toast.LENGTH_SHORT).show()
             scope.launch { saveBitmapAndOpenEditor(bitmap) }
@@ -428,41 +437,29 @@ class ScreenUnderstandingService : Service() {
      */
     private suspend fun waitForElement(step: AutomationStep): UIElement? {
         val timeout = 5000L
-        val startTime = System.currentTimeMillis()
         val anchorBounds = step.anchor.bounds
 
-        while (System.currentTimeMillis() - startTime < timeout && isPlaying) {
-            val currentElements = latestElements
-
-            // Find best match: same label AND highest IoU with saved anchor bounds
-            val match = currentElements
-                .filter { it.label == step.anchor.label }  // Use anchor's actual label
-                .maxByOrNull { calculateIoU(it.bounds, anchorBounds) }
-
-            // Accept if IoU > 0.1 (lenient since screen may have scrolled slightly)
-            if (match != null && calculateIoU(match.bounds, anchorBounds) > 0.1f) {
-                return match
+        // Find best match: same label AND highest IoU with saved anchor bounds.
+        // Accept if IoU > 0.1 (lenient since screen may have scrolled slightly)
+        // Elements with the anchor's label are class 1 in the index.
+        fun bestMatch(index: BoxIndex, elements: List<UIElement>): UIElement? {
+            index.build(elements.size, { if (elements[it].label == step.anchor.label) 1 else 0 }) {
+                elements[it].bounds
             }
-
-            delay(200)
+            return elements.getOrNull(index.bestOverlap(anchorBounds, 0.1f, classId = 1))
         }
-        return null
-    }
-
-    private fun calculateIoU(a: RectF, b: RectF): Float {
-        val interLeft = maxOf(a.left, b.left)
-        val interTop = maxOf(a.top, b.top)
-        val interRight = minOf(a.right, b.right)
-        val interBottom = minOf(a.bottom, b.bottom)
-
-        if (interRight < interLeft || interBottom < interTop) return 0f
-
-        val interArea = (interRight - interLeft) * (interBottom - interTop)
-        val aArea = a.width() * a.height()
-        val bArea = b.width() * b.height()
-        val unionArea = aArea + bArea - interArea
 
-        return if (unionArea > 0) interArea / unionArea else 0f
+        // Re-checked on every tracked frame instead of polling
+        var match: UIElement? = null
+        BoxIndex().use { index ->
+            withTimeoutOrNull(timeout) {
+                latestElements.first { elements ->
+                    match = bestMatch(index, elements)
+                    match != null || !isPlaying
+                }
+            }
+        }
+        return match?.takeIf { isPlaying }
     }
 
     private fun savePreset(name: String, elementsData: List<Pair<UIElement, Boolean>>) {
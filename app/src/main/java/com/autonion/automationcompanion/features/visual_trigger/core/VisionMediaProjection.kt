@@ -2,34 +2,81 @@ package com.autonion.automationcompanion.features.visual_trigger.core
 
 import android.content.Context
 import android.content.Intent
-import android.graphics.Bitmap
 import android.graphics.PixelFormat
 import android.hardware.display.DisplayManager
 import android.hardware.display.VirtualDisplay
+import android.media.Image
 import android.media.ImageReader
 import android.media.projection.MediaProjection
 import android.media.projection.MediaProjectionManager
 import android.os.Handler
+import android.os.HandlerThread
 import android.os.Looper
+import android.os.SystemClock
 import android.util.Log
-import kotlinx.coroutines.channels.BufferOverflow
-import kotlinx.coroutines.flow.MutableSharedFlow
-import kotlinx.coroutines.flow.SharedFlow
-import kotlinx.coroutines.flow.asSharedFlow
+import com.autonion.automationcompanion.core.vision.FramePool
+import com.autonion.automationcompanion.core.vision.NativeFrame
+import com.autonion.automationcompanion.core.vision.RawFrameListener
+import com.autonion.automationcompanion.core.vision.VisionMatcher
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.asStateFlow
 
+/**
+ * Each captured image is copied once into a [FramePool]; consumers take it with
+ * [latestFrame] when [frameSequence] moves. No Bitmap is made per frame, so memory
+ * stays at the pool's capacity however long capture runs.
+ *
+ * @param emitFrames when false nothing is pooled and [frameSequence] stays at 0;
+ *   frames only reach the [RawFrameListener].
+ */
 class VisionMediaProjection(
     private val context: Context,
-    private val projectionManager: MediaProjectionManager
+    private val projectionManager: MediaProjectionManager,
+    private val emitFrames: Boolean = true
 ) {
     private var mediaProjection: MediaProjection? = null
     private var virtualDisplay: VirtualDisplay? = null
     private var imageReader: ImageReader? = null
-    
-    private val _screenCaptureFlow = MutableSharedFlow<Bitmap>(
-        replay = 1, 
-        onBufferOverflow = BufferOverflow.DROP_OLDEST
-    )
-    val screenCaptureFlow: SharedFlow<Bitmap> = _screenCaptureFlow.asSharedFlow()
+    private var captureThread: HandlerThread? = null
+
+    @Volatile private var rawFrameListener: RawFrameListener? = null
+    @Volatile private var rawFrameIntervalMs = 0L
+    private var lastRawFrameAt = 0L
+
+    // The newest image that came sooner than the interval allows, held open on
+    // the capture thread until it is handed over or a newer one replaces it.
+    private var deferredImage: Image? = null
+
+    // Created with the reader and closed on the capture thread after it.
+    private var framePool: FramePool? = null
+    private val poolLock = Any()
+
+    private val _frameSequence = MutableStateFlow(0L)
+
+    /** Sequence number of the latest pooled frame; 0 until one arrives. */
+    val frameSequence: StateFlow<Long> = _frameSequence.asStateFlow()
+
+    /** The latest captured frame, held until closed; null before the first and after stop. */
+    fun latestFrame(): NativeFrame? = synchronized(poolLock) { framePool?.latest() }
+
+    /**
+     * A handle on the capture's frame pool for [VisionMatcher.waitFor], closed by
+     * the caller; null while not capturing. Stopping the projection ends a wait on
+     * it.
+     */
+    fun retainFramePool(): FramePool? = synchronized(poolLock) { framePool?.retain() }
+
+    /**
+     * Hands every frame's plane to [listener] on the capture thread, at most once
+     * per [minIntervalMs]. A frame arriving sooner is held, replacing any held
+     * before it, and handed over once the interval has passed, so the last frame
+     * of a screen change always arrives, at most one interval late.
+     */
+    fun setRawFrameListener(minIntervalMs: Long = 0L, listener: RawFrameListener?) {
+        rawFrameIntervalMs = minIntervalMs
+        rawFrameListener = listener
+    }
 
     fun startProjection(resultCode: Int, data: Intent, width: Int, height: Int, density: Int) {
         mediaProjection = projectionManager.getMediaProjection(resultCode, data)
@@ -45,6 +92,10 @@ class VisionMediaProjection(
 
     private fun setupVirtualDisplay(width: Int, height: Int, density: Int) {
         imageReader = ImageReader.newInstance(width, height, PixelFormat.RGBA_8888, 2)
+        val thread = HandlerThread("VisionCapture").also { it.start() }
+        captureThread = thread
+        val pool = if (emitFrames) FramePool() else null
+        synchronized(poolLock) { framePool = pool }
         
         virtualDisplay = mediaProjection?.createVirtualDisplay(
             "VisionTriggerDisplay",
@@ -57,47 +108,93 @@ class VisionMediaProjection(
             null
         )
 
+        val handler = Handler(thread.looper)
+        val flushDeferred = Runnable { flushDeferred(width, height) }
         imageReader?.setOnImageAvailableListener({ reader ->
             val image = reader.acquireLatestImage()
             if (image != null) {
+                var deferred = false
                 try {
                     val planes = image.planes
-                    val buffer = planes[0].buffer
-                    val pixelStride = planes[0].pixelStride
-                    val rowStride = planes[0].rowStride
-                    val rowPadding = rowStride - pixelStride * width
-    
-                    val bitmap = Bitmap.createBitmap(
-                        width + rowPadding / pixelStride,
-                        height,
-                        Bitmap.Config.ARGB_8888
-                    )
-                    bitmap.copyPixelsFromBuffer(buffer)
-                    
-                    val finalBitmap = if (rowPadding == 0) {
-                        bitmap
-                    } else {
-                        val cropped = Bitmap.createBitmap(bitmap, 0, 0, width, height)
-                        // bitmap.recycle() // Don't recycle if createBitmap returns same instance, but here it returns new
-                        cropped
-                    }
-
-                    _screenCaptureFlow.tryEmit(finalBitmap)
+
+                    deferred = offerRawFrame(image, width, height, handler, flushDeferred)
+                    if (pool == null) return@setOnImageAvailableListener
+
+                    // One copy per image, into a reused buffer; dropped while
+                    // consumers hold every buffer
+                    val sequence = pool.fill(planes[0], width, height)
+                    if (sequence != 0L) _frameSequence.value = sequence
                 } catch (e: Exception) {
-                    Log.e("VisionProjection", "Error converting image", e)
+                    Log.e("VisionProjection", "Error pooling image", e)
                 } finally {
-                    image.close()
+                    if (!deferred) image.close()
                 }
             }
-        }, Handler(Looper.getMainLooper()))
+        }, handler)
+    }
+
+    // Hands [image] to the raw listener now, or holds it for [flush] when it came
+    // sooner than the interval allows. True when it was held and must stay open.
+    // Capture thread only.
+    private fun offerRawFrame(image: Image, width: Int, height: Int, handler: Handler, flush: Runnable): Boolean {
+        val listener = rawFrameListener ?: return false
+        val now = SystemClock.uptimeMillis()
+        val wait = lastRawFrameAt + rawFrameIntervalMs - now
+        val held = deferredImage
+        if (wait <= 0) {
+            handler.removeCallbacks(flush)
+            deferredImage = null
+            held?.close()
+            lastRawFrameAt = now
+            listener.onFrame(image.planes[0], width, height)
+            return false
+        }
+        if (held == null) handler.postDelayed(flush, wait) else held.close()
+        deferredImage = image
+        return true
+    }
+
+    private fun flushDeferred(width: Int, height: Int) {
+        val image = deferredImage ?: return
+        deferredImage = null
+        try {
+            val listener = rawFrameListener ?: return
+            lastRawFrameAt = SystemClock.uptimeMillis()
+            listener.onFrame(image.planes[0], width, height)
+        } catch (e: Exception) {
+            Log.e("VisionProjection", "Error handing over a held image", e)
+        } finally {
+            image.close()
+        }
     }
 
     fun stopProjection() {
         mediaProjection?.stop()
         virtualDisplay?.release()
-        imageReader?.close()
+        val pool = synchronized(poolLock) { framePool.also { framePool = null } }
+        closeReader(imageReader, pool, captureThread)
+        _frameSequence.value = 0L
         mediaProjection = null
         virtualDisplay = null
         imageReader = null
+        captureThread = null
+    }
+
+    // The reader (and after it the pool) is closed on the capture thread so a
+    // listener that is still reading a plane (possibly from native code)
+    // finishes first. Frames consumers still hold stay valid.
+    private fun closeReader(reader: ImageReader?, pool: FramePool?, thread: HandlerThread?) {
+        val close = Runnable {
+            deferredImage?.close()
+            deferredImage = null
+            reader?.close()
+            synchronized(poolLock) { pool?.close() }
+        }
+        if (thread == null) {
+            close.run()
+            return
+        }
+        Handler(thread.looper).post(close)
+        thread.quitSafely()
     }
 }
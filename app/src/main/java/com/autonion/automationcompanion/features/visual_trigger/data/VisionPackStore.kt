@@ -0,0 +1,118 @@
+package com.autonion.automationcompanion.features.visual_trigger.data
+
+import android.content.Context
+import android.graphics.Bitmap
+import android.graphics.BitmapFactory
+import android.util.Log
+import com.autonion.automationcompanion.core.vision.VisionNativeBridge
+import com.autonion.automationcompanion.features.visual_trigger.models.VisionPreset
+import java.io.File
+import java.util.zip.CRC32
+
+/**
+ * Compiled template packs for [VisionPreset]s.
+ *
+ * A pack holds every region template of a preset already converted to
+ * grayscale, scaled and measured, in one file the native engine memory-maps.
+ * Starting a preset from a pack therefore skips the per-region PNG decode,
+ * JNI copy and grayscale conversion. Each pack is tagged with a checksum of
+ * its region PNGs and rectangles and of the parameters it is compiled with
+ * (the prior margin), and is rebuilt on first use after any of them change.
+ */
+class VisionPackStore(context: Context) {
+
+    /** A compiled pack, valid for registration with [checksum]. */
+    data class Pack(val file: File, val checksum: Long) {
+        val path: String get() = file.absolutePath
+    }
+
+    private val packsDir = File(context.filesDir, "vision_packs")
+
+    init {
+        if (!packsDir.exists()) {
+            packsDir.mkdirs()
+        }
+    }
+
+    private fun packFile(presetId: String) = File(packsDir, "$presetId.vpk")
+
+    /**
+     * The up-to-date pack for [preset], compiling it first when it is missing or
+     * stale. Null when a region PNG cannot be read or the pack cannot be written;
+     * callers then fall back to registering the PNGs one by one.
+     */
+    fun ensure(preset: VisionPreset): Pack? {
+        if (preset.regions.isEmpty()) return null
+        val checksum = checksum(preset) ?: return null
+        val file = packFile(preset.id)
+        if (VisionNativeBridge.isPackCurrent(file.absolutePath, checksum)) {
+            return Pack(file, checksum)
+        }
+        return if (compile(preset, file, checksum)) Pack(file, checksum) else null
+    }
+
+    fun delete(presetId: String) {
+        packFile(presetId).delete()
+    }
+
+    private fun compile(preset: VisionPreset, file: File, checksum: Long): Boolean {
+        val start = System.currentTimeMillis()
+        val bitmaps = ArrayList<Bitmap>(preset.regions.size)
+        try {
+            for (region in preset.regions) {
+                val bitmap = BitmapFactory.decodeFile(region.templatePath)
+                if (bitmap == null) {
+                    Log.e(TAG, "Cannot compile '${preset.name}': failed to decode ${region.templatePath}")
+                    return false
+                }
+                bitmaps.add(bitmap)
+            }
+            val ok = VisionNativeBridge.compilePack(
+                file.absolutePath,
+                preset.regions.map { it.id }.toIntArray(),
+                bitmaps.toTypedArray(),
+                preset.regions.map { it.toRect() }.toTypedArray(),
+                checksum,
+                PRIOR_MARGIN_PX
+            )
+            Log.d(TAG, "Compiled '${preset.name}' (${preset.regions.size} templates) in ${System.currentTimeMillis() - start}ms: ok=$ok")
+            return ok
+        } finally {
+            bitmaps.forEach { it.recycle() }
+        }
+    }
+
+    /**
+     * CRC-32 of the compile parameters and every region's ID, rectangle and PNG
+     * bytes; null if a PNG is unreadable.
+     */
+    private fun checksum(preset: VisionPreset): Long? {
+        val crc = CRC32()
+        val buffer = ByteArray(16 * 1024)
+        crc.update("margin=$PRIOR_MARGIN_PX;".toByteArray())
+        for (region in preset.regions) {
+            crc.update("${region.id}:${region.x},${region.y},${region.width}x${region.height}:".toByteArray())
+            try {
+                File(region.templatePath).inputStream().use { input ->
+                    while (true) {
+                        val n = input.read(buffer)
+                        if (n < 0) break
+                        crc.update(buffer, 0, n)
+                    }
+                }
+            } catch (e: Exception) {
+                Log.e(TAG, "Cannot read template ${region.templatePath}", e)
+                return null
+            }
+        }
+        return crc.value
+    }
+
+    private companion object {
+        const val TAG = "VisionPackStore"
+
+        // Baked into every compiled prior; part of the checksum so a change
+        // rebuilds existing packs.
+        const val PRIOR_MARGIN_PX = VisionNativeBridge.DEFAULT_PRIOR_MARGIN_PX
+    }
+}
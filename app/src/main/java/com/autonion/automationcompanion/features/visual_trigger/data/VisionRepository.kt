@@ -46,6 +46,7 @@ class VisionRepository(private val context: Context) {
         if (file.exists()) {
             file.delete()
         }
+        VisionPackStore(context).delete(presetId)
     }
 
     suspend fun getPreset(id: String): VisionPreset? = withContext(Dispatchers.IO) {
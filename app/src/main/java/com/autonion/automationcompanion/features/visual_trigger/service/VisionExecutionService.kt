@@ -6,14 +6,11 @@ import android.app.NotificationManager
 import android.app.Service
 import android.content.Intent
 import android.content.pm.ServiceInfo
-import android.graphics.Bitmap
 import android.graphics.PixelFormat
 import android.graphics.drawable.GradientDrawable
 import android.media.projection.MediaProjectionManager
 import android.os.Build
-import android.os.Handler
 import android.os.IBinder
-import android.os.Looper
 import android.util.Log
 import android.view.Gravity
 import android.view.MotionEvent
@@ -23,10 +20,12 @@ import android.widget.ImageView
 import android.widget.LinearLayout
 import androidx.core.app.NotificationCompat
 import com.autonion.automationcompanion.R
+import com.autonion.automationcompanion.core.vision.MatchResultBuffer
 import com.autonion.automationcompanion.core.vision.VisionNativeBridge
 import com.autonion.automationcompanion.features.automation_debugger.DebugLogger
 import com.autonion.automationcompanion.features.automation_debugger.data.LogCategory
 import com.autonion.automationcompanion.features.visual_trigger.core.VisionMediaProjection
+import com.autonion.automationcompanion.features.visual_trigger.data.VisionPackStore
 import com.autonion.automationcompanion.features.visual_trigger.data.VisionRepository
 import com.autonion.automationcompanion.features.visual_trigger.models.ExecutionMode
 import com.autonion.automationcompanion.features.visual_trigger.models.VisionPreset
@@ -40,6 +39,8 @@ class VisionExecutionService : Service() {
         private const val TAG = "VisionExecution"
         private const val CHANNEL_ID = "vision_execution_channel"
         private const val NOTIFICATION_ID = 1002
+        private const val MAX_MATCH_THREADS = 4
+        private const val FRAME_INTERVAL_MS = 500L
     }
 
     private val job = SupervisorJob()
@@ -48,10 +49,21 @@ class VisionExecutionService : Service() {
     private var visionProjection: VisionMediaProjection? = null
     private var repository: VisionRepository? = null
     private var activePreset: VisionPreset? = null
+    // Reused every frame so results cross JNI without allocating objects.
+    private val resultBuffer = MatchResultBuffer()
+    // The current step's template ID in sequential mode.
+    private val stepIds = IntArray(1)
+    // Number of the last frame matched: each frame is matched, and acted on,
+    // once, however often the loop polls.
+    private val matchedSequence = LongArray(1)
+    // The step the last sequential match looked for; a new step looks at the
+    // current frame again.
+    private var matchedStepId: Int? = null
 
     // Overlay
     private var windowManager: WindowManager? = null
     private var overlayView: View? = null
+    @Volatile
     private var isPaused = true  // Start paused — user taps play to begin
     private var playPauseIcon: ImageView? = null
 
@@ -65,6 +77,9 @@ class VisionExecutionService : Service() {
         repository = VisionRepository(applicationContext)
         windowManager = getSystemService(WINDOW_SERVICE) as WindowManager
         VisionNativeBridge.init()
+        // Spread templates over the big cores; little cores would be the stragglers
+        val bigCores = VisionNativeBridge.performanceCores()
+        VisionNativeBridge.setThreads(bigCores.size.coerceIn(1, MAX_MATCH_THREADS), bigCores)
         Log.d(TAG, "Service created")
         DebugLogger.info(applicationContext, LogCategory.VISUAL_TRIGGER, "Service Created", "VisionExecutionService initialized", TAG)
     }
@@ -227,6 +242,9 @@ class VisionExecutionService : Service() {
 
     private fun togglePause() {
         isPaused = !isPaused
+        // Frames keep arriving while paused; drop the one from before the pause
+        // so only what is on screen now is acted on after it.
+        if (isPaused) VisionNativeBridge.clearLatest()
         playPauseIcon?.setImageResource(
             if (isPaused) android.R.drawable.ic_media_play else android.R.drawable.ic_media_pause
         )
@@ -250,15 +268,25 @@ class VisionExecutionService : Service() {
             DebugLogger.info(applicationContext, LogCategory.VISUAL_TRIGGER, "Execution Started", "Preset: '${activePreset?.name}', ${activePreset?.regions?.size} regions, mode=${activePreset?.executionMode}", TAG)
 
             VisionNativeBridge.nativeClearTemplates()
-
-            activePreset?.regions?.forEach { region ->
-                val bitmap = android.graphics.BitmapFactory.decodeFile(region.templatePath)
-                if (bitmap != null) {
-                    Log.d(TAG, "  ✓ Template ID=${region.id}: ${bitmap.width}x${bitmap.height}")
-                    VisionNativeBridge.addTemplate(region.id, bitmap)
-                } else {
-                    Log.e(TAG, "  ✗ Failed to decode template: ${region.templatePath}")
-                    DebugLogger.warning(applicationContext, LogCategory.VISUAL_TRIGGER, "Template Decode Failed", "Path: ${region.templatePath}", TAG)
+            VisionNativeBridge.resetStats()
+
+            // One mmap of the compiled pack registers every template; the PNGs
+            // are only decoded when the pack is (re)built.
+            val pack = activePreset?.let { VisionPackStore(applicationContext).ensure(it) }
+            val packed = pack?.let { VisionNativeBridge.addPack(it.path, it.checksum) } ?: -1
+            if (packed >= 0) {
+                Log.d(TAG, "  ✓ $packed templates from pack ${pack?.file?.name}")
+            } else {
+                activePreset?.regions?.forEach { region ->
+                    val bitmap = android.graphics.BitmapFactory.decodeFile(region.templatePath)
+                    if (bitmap != null) {
+                        Log.d(TAG, "  ✓ Template ID=${region.id}: ${bitmap.width}x${bitmap.height}")
+                        // The recorded rectangle is where the element usually is; search there first.
+                        VisionNativeBridge.addTemplate(region.id, bitmap, region.toRect())
+                    } else {
+                        Log.e(TAG, "  ✗ Failed to decode template: ${region.templatePath}")
+                        DebugLogger.warning(applicationContext, LogCategory.VISUAL_TRIGGER, "Template Decode Failed", "Path: ${region.templatePath}", TAG)
+                    }
                 }
             }
 
@@ -266,7 +294,15 @@ class VisionExecutionService : Service() {
             Log.d(TAG, "Screen: ${metrics.widthPixels}x${metrics.heightPixels}")
 
             val mpManager = getSystemService(MEDIA_PROJECTION_SERVICE) as MediaProjectionManager
-            visionProjection = VisionMediaProjection(this@VisionExecutionService, mpManager)
+            // Frames go straight from the ImageReader plane into the native
+            // engine as grayscale; no Bitmap is created per frame. They are
+            // submitted while paused too, so the latest frame is the current
+            // screen when execution resumes.
+            visionProjection = VisionMediaProjection(this@VisionExecutionService, mpManager, emitFrames = false).apply {
+                setRawFrameListener(FRAME_INTERVAL_MS) { plane, width, height ->
+                    if (isRunning) VisionNativeBridge.submitFrame(plane, width, height)
+                }
+            }
             visionProjection?.startProjection(resultCode, resultData, metrics.widthPixels, metrics.heightPixels, metrics.densityDpi)
 
             Log.d(TAG, "Projection started, collecting frames...")
@@ -278,46 +314,62 @@ class VisionExecutionService : Service() {
 
             var frameCount = 0
 
-            visionProjection?.screenCaptureFlow?.collect { bitmap ->
+            while (isRunning) {
                 frameCount++
-                if (!isPaused && isRunning) {
+                if (!isPaused) {
                     if (frameCount <= 5 || frameCount % 20 == 0) {
-                        Log.d(TAG, "Frame #$frameCount: ${bitmap.width}x${bitmap.height}")
+                        Log.d(TAG, "Frame #$frameCount")
                     }
-                    processFrame(bitmap)
-                } else if (isPaused && frameCount % 50 == 0) {
+                    processFrame()
+                } else if (frameCount % 50 == 0) {
                     Log.d(TAG, "Skipping frame #$frameCount (paused)")
                 }
-                delay(500)
+                delay(FRAME_INTERVAL_MS)
             }
         }
     }
 
-    private suspend fun processFrame(bitmap: Bitmap) {
+    private suspend fun processFrame() {
         if (!isRunning) return
         val preset = activePreset ?: return
 
         try {
-            val results = VisionNativeBridge.match(bitmap)
-            if (!isRunning) return
+            // A sequential preset only acts on its current step, so only that
+            // template is matched.
+            val sequential = preset.executionMode == ExecutionMode.MANDATORY_SEQUENTIAL
+            val step = if (sequential) sequentialStep(preset) ?: return else null
+            // Nothing is matched, or acted on, again until a new frame arrives.
+            val fresh = if (step != null) {
+                if (step.id != matchedStepId) matchedSequence[0] = 0L
+                matchedStepId = step.id
+                stepIds[0] = step.id
+                VisionNativeBridge.matchLatestSince(matchedSequence, resultBuffer, stepIds)
+            } else {
+                VisionNativeBridge.matchLatestSince(matchedSequence, resultBuffer)
+            }
+            if (!fresh || !isRunning) return
+            val results = resultBuffer
+
+            val diff = VisionNativeBridge.lastFrameDiff()
+            Log.d(TAG, "  Diff: ${"%.0f".format(diff.changedFraction * 100)}% tiles changed, ${diff.templatesSkipped}/${diff.templates} templates reused")
 
             // Log match results
-            results.forEach { match ->
-                Log.d(TAG, "  Match ID=${match.id}: matched=${match.matched}, score=${match.score}, at=(${match.x},${match.y}), size=${match.width}x${match.height}")
+            for (i in 0 until results.count) {
+                Log.d(TAG, "  Match ID=${results.id(i)}: matched=${results.matched(i)}, score=${results.score(i)}, at=(${results.x(i)},${results.y(i)}), size=${results.width(i)}x${results.height(i)}, prior=${results.fromPrior(i)}")
             }
 
-            if (preset.executionMode == ExecutionMode.MANDATORY_SEQUENTIAL) {
-                handleSequentialExecution(preset, results)
+            if (step != null) {
+                handleSequentialExecution(step, results)
             } else {
-                val matches = results.filter { it.matched }
-                if (matches.isEmpty()) {
+                if ((0 until results.count).none { results.matched(it) }) {
                     Log.d(TAG, "  No matches above threshold (need score≥0.75)")
                 }
-                matches.forEach { match ->
-                    val region = preset.regions.find { it.id == match.id }
+                for (i in 0 until results.count) {
+                    if (!results.matched(i)) continue
+                    val region = preset.regions.find { it.id == results.id(i) }
                     if (region != null) {
-                        val cx = match.x + match.width / 2
-                        val cy = match.y + match.height / 2
+                        val cx = results.x(i) + results.width(i) / 2
+                        val cy = results.y(i) + results.height(i) / 2
                         Log.d(TAG, "  ▶ Executing ${region.action} at ($cx, $cy)")
                         DebugLogger.info(applicationContext, LogCategory.VISUAL_TRIGGER, "Action Executing", "${region.action} at ($cx, $cy)", TAG)
                         val success = executeAction(region, cx, cy)
@@ -339,23 +391,26 @@ class VisionExecutionService : Service() {
     private var currentStepIndex = 0
     private var lastActionTime = 0L
 
-    private suspend fun handleSequentialExecution(
-        preset: VisionPreset,
-        results: Array<com.autonion.automationcompanion.core.vision.MatchResultNative>
-    ) {
-        if (System.currentTimeMillis() - lastActionTime < 2000) return
+    /** The region the sequence waits for, or null while cooling down or wrapping round. */
+    private fun sequentialStep(preset: VisionPreset): VisionRegion? {
+        if (System.currentTimeMillis() - lastActionTime < 2000) return null
 
         if (currentStepIndex >= preset.regions.size) {
             currentStepIndex = 0
-            return
+            return null
         }
+        return preset.regions[currentStepIndex]
+    }
 
-        val targetRegion = preset.regions[currentStepIndex]
-        val match = results.find { it.id == targetRegion.id }
+    private suspend fun handleSequentialExecution(
+        targetRegion: VisionRegion,
+        results: MatchResultBuffer
+    ) {
+        val i = results.indexOfId(targetRegion.id)
 
-        if (match != null && match.matched) {
+        if (i >= 0 && results.matched(i)) {
             Log.d(TAG, "Sequential step $currentStepIndex matched: ID ${targetRegion.id}")
-            val success = executeAction(targetRegion, match.x + match.width / 2, match.y + match.height / 2)
+            val success = executeAction(targetRegion, results.x(i) + results.width(i) / 2, results.y(i) + results.height(i) / 2)
             if (success) {
                 currentStepIndex++
                 lastActionTime = System.currentTimeMillis()
@@ -386,18 +441,21 @@ class VisionExecutionService : Service() {
         // 3. Cancel coroutines and wait for them to finish
         job.cancel()
 
+        // Where this run's frame time went, per stage and per template.
+        try {
+            val stats = VisionNativeBridge.stats()
+            DebugLogger.info(applicationContext, LogCategory.VISUAL_TRIGGER, "Engine Stats", "Native stage latencies for '${activePreset?.name}'", TAG, metadata = stats)
+        } catch (_: Exception) {}
+
         // 4. Remove overlay
         if (overlayView != null) {
             try { windowManager?.removeView(overlayView) } catch (_: Exception) {}
             overlayView = null
         }
 
-        // 5. Release native resources after delay (let any in-flight JNI call finish)
-        //    The C++ side now uses a mutex, so this is safe as long as
-        //    the match call finishes before clear is called.
-        Handler(Looper.getMainLooper()).postDelayed({
-            try { VisionNativeBridge.release() } catch (_: Exception) {}
-            Log.d(TAG, "Native resources released")
-        }, 1000)
+        // 5. Release native resources. A match still in flight keeps the
+        //    template set it started with alive until it returns.
+        try { VisionNativeBridge.release() } catch (_: Exception) {}
+        Log.d(TAG, "Native resources released")
     }
 }